@@ -0,0 +1,440 @@
+#define _POSIX_C_SOURCE 200809L
+#include "batch.h"
+#include "timer.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+// ================== FILE LIST ==================
+
+void batch_init(BatchReport* report) {
+    memset(report, 0, sizeof(*report));
+}
+
+void batch_free(BatchReport* report) {
+    for (int i = 0; i < report->file_count; i++) {
+        free(report->files[i].path);
+        free(report->files[i].diagnostics);
+    }
+    free(report->files);
+    memset(report, 0, sizeof(*report));
+}
+
+static bool add_file(BatchReport* report, const char* path) {
+    if (report->file_count == report->file_capacity) {
+        int capacity = report->file_capacity ? report->file_capacity * 2 : 64;
+        BatchFile* files = realloc(report->files, sizeof(BatchFile) * (size_t)capacity);
+        if (!files) return false;
+        report->files = files;
+        report->file_capacity = capacity;
+    }
+    BatchFile* file = &report->files[report->file_count];
+    memset(file, 0, sizeof(*file));
+    file->path = strdup(path);
+    if (!file->path) return false;
+    // A file that cannot be stat'ed is still compiled, and fails there
+    struct stat info;
+    if (stat(path, &info) == 0) file->size = (size_t)info.st_size;
+    const char* slash = strrchr(path, '/');
+    char directory[4096];
+    if (slash) {
+        snprintf(directory, sizeof(directory), "%.*s", slash == path ? 1 : (int)(slash - path), path);
+    } else {
+        snprintf(directory, sizeof(directory), ".");
+    }
+    if (stat(directory, &info) == 0) {
+        file->located = true;
+        file->directory_device = (uint64_t)info.st_dev;
+        file->directory_inode = (uint64_t)info.st_ino;
+    }
+    report->file_count++;
+    return true;
+}
+
+bool batch_add(BatchReport* report, const char* arg) {
+    if (arg[0] != '@') {
+        if (add_file(report, arg)) return true;
+        snprintf(report->error_message, sizeof(report->error_message), "Out of memory");
+        return false;
+    }
+
+    FILE* list = fopen(arg + 1, "r");
+    if (!list) {
+        snprintf(report->error_message, sizeof(report->error_message), "Cannot open file list: %s", arg + 1);
+        return false;
+    }
+    char line[4096];
+    bool added = true;
+    while (added && fgets(line, sizeof(line), list)) {
+        size_t length = strcspn(line, "\r\n");
+        line[length] = '\0';
+        if (length > 0) added = add_file(report, line);
+    }
+    fclose(list);
+    if (!added) snprintf(report->error_message, sizeof(report->error_message), "Out of memory");
+    return added;
+}
+
+void batch_output_path(const char* input, char* buffer, size_t size) {
+    size_t length = strlen(input);
+    if (length > 5 && strcmp(input + length - 5, ".shay") == 0) length -= 5;
+    snprintf(buffer, size, "%.*s.c", (int)length, input);
+}
+
+// ================== SCHEDULING ==================
+
+// Indices into report->files, largest first. The owner takes from the
+// front, thieves from the back.
+typedef struct {
+    int* items;
+    int head;
+    int tail;
+    pthread_mutex_t lock;
+} BatchDeque;
+
+typedef struct {
+    BatchReport* report;
+    const ShayOptions* options;
+    BatchDeque* deques;
+    int thread_count;
+    int index;
+    int steals;
+    pthread_t thread;
+    bool started;
+} BatchWorker;
+
+static int deque_take(BatchDeque* deque, bool front) {
+    int item = -1;
+    pthread_mutex_lock(&deque->lock);
+    if (deque->head < deque->tail) {
+        item = front ? deque->items[deque->head++] : deque->items[--deque->tail];
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return item;
+}
+
+// Own work first, then the other threads' in turn
+static int next_file(BatchWorker* worker) {
+    int index = deque_take(&worker->deques[worker->index], true);
+    for (int k = 1; index < 0 && k < worker->thread_count; k++) {
+        index = deque_take(&worker->deques[(worker->index + k) % worker->thread_count], false);
+        if (index >= 0) worker->steals++;
+    }
+    return index;
+}
+
+typedef struct {
+    size_t size;
+    int index;
+} BatchOrder;
+
+static int compare_largest_first(const void* a, const void* b) {
+    const BatchOrder* x = a;
+    const BatchOrder* y = b;
+    if (x->size != y->size) return x->size < y->size ? 1 : -1;
+    return x->index - y->index;
+}
+
+static const char* base_name(const char* path) {
+    const char* slash = strrchr(path, '/');
+    return slash ? slash + 1 : path;
+}
+
+static int compare_u64(uint64_t x, uint64_t y) {
+    return (x > y) - (x < y);
+}
+
+// Files whose directories could be stat'ed order by directory and name,
+// so a.shay, ./a.shay and /abs/dir/a.shay sit together; the rest by path
+static int compare_location(const BatchFile* x, const BatchFile* y) {
+    if (x->located != y->located) return x->located ? -1 : 1;
+    if (!x->located) return strcmp(x->path, y->path);
+    int order = compare_u64(x->directory_device, y->directory_device);
+    if (order == 0) order = compare_u64(x->directory_inode, y->directory_inode);
+    return order ? order : strcmp(base_name(x->path), base_name(y->path));
+}
+
+// Ties keep the order the files were added in
+static int compare_files(const void* a, const void* b) {
+    const BatchFile* x = *(const BatchFile* const*)a;
+    const BatchFile* y = *(const BatchFile* const*)b;
+    int order = compare_location(x, y);
+    return order ? order : (x < y ? -1 : x > y);
+}
+
+// One file named twice (say as a.shay on the command line and ./a.shay
+// in a list) would be compiled by two threads into the same output; keep
+// the first. Same directory and name is what makes the outputs collide.
+static bool remove_duplicates(BatchReport* report) {
+    if (report->file_count < 2) return true;
+    BatchFile** sorted = malloc(sizeof(BatchFile*) * (size_t)report->file_count);
+    if (!sorted) return false;
+    for (int i = 0; i < report->file_count; i++) sorted[i] = &report->files[i];
+    qsort(sorted, (size_t)report->file_count, sizeof(BatchFile*), compare_files);
+    const BatchFile* kept_file = sorted[0];
+    for (int i = 1; i < report->file_count; i++) {
+        if (compare_location(kept_file, sorted[i]) != 0) {
+            kept_file = sorted[i];
+        } else {
+            free(sorted[i]->path);
+            free(sorted[i]->diagnostics);
+            sorted[i]->path = NULL;
+        }
+    }
+    free(sorted);
+
+    int kept = 0;
+    for (int i = 0; i < report->file_count; i++) {
+        if (report->files[i].path) report->files[kept++] = report->files[i];
+    }
+    report->file_count = kept;
+    return true;
+}
+
+// ================== COMPILING ==================
+
+static bool read_all(const char* path, char** buffer, size_t* capacity, size_t* length) {
+    FILE* file = fopen(path, "rb");
+    if (!file) return false;
+    *length = 0;
+    bool ok = true;
+    while (ok) {
+        if (*length == *capacity) {
+            size_t grown = *capacity ? *capacity * 2 : 1 << 16;
+            char* data = realloc(*buffer, grown);
+            if (!data) {
+                ok = false;
+                break;
+            }
+            *buffer = data;
+            *capacity = grown;
+        }
+        size_t got = fread(*buffer + *length, 1, *capacity - *length, file);
+        *length += got;
+        if (got == 0) {
+            ok = !ferror(file);
+            break;
+        }
+    }
+    fclose(file);
+    return ok;
+}
+
+static bool write_all(const char* path, const OutputBuffer* out) {
+    FILE* file = fopen(path, "wb");
+    if (!file) return false;
+    bool ok = fwrite(out->data, 1, out->length, file) == out->length;
+    return fclose(file) == 0 && ok;
+}
+
+static void compile_file(BatchWorker* worker, ShayContext* ctx, BatchFile* file, OutputBuffer* out,
+                         char** source, size_t* capacity) {
+    double start = timer_now();
+    file->thread = worker->index;
+    file->io_error = NULL;
+
+    size_t length;
+    if (!read_all(file->path, source, capacity, &length)) {
+        file->io_error = "Cannot read file";
+    } else {
+        ShayOptions options = *worker->options;
+        options.filename = file->path;
+        outbuf_clear(out);
+        file->compiled = shaynefro_compile(ctx, *source, length, &options, out);
+        file->stats = ctx->stats;
+        file->diagnostic_count = shaynefro_diagnostic_count(ctx);
+        if (file->diagnostic_count > 0) {
+            file->diagnostics = malloc(sizeof(ShayDiagnostic) * (size_t)file->diagnostic_count);
+            if (file->diagnostics) {
+                memcpy(file->diagnostics, ctx->diagnostics, sizeof(ShayDiagnostic) * (size_t)file->diagnostic_count);
+            } else {
+                file->diagnostic_count = 0;
+            }
+        }
+        if (file->compiled && out->had_error) {
+            file->compiled = false;
+            file->io_error = "Out of memory";
+        }
+        if (file->compiled) {
+            char output_path[4096];
+            batch_output_path(file->path, output_path, sizeof(output_path));
+            if (!write_all(output_path, out)) {
+                file->compiled = false;
+                file->io_error = "Cannot write output";
+            }
+        }
+    }
+    file->seconds = timer_now() - start;
+}
+
+static void* batch_worker_main(void* arg) {
+    BatchWorker* worker = arg;
+    // Without a context this thread compiles nothing; its files are stolen
+    ShayContext* ctx = shaynefro_context_create();
+    OutputBuffer out;
+    if (!ctx || !outbuf_init(&out, -1)) {
+        shaynefro_context_destroy(ctx);
+        return NULL;
+    }
+    char* source = NULL;
+    size_t capacity = 0;
+
+    int index;
+    while ((index = next_file(worker)) >= 0) {
+        compile_file(worker, ctx, &worker->report->files[index], &out, &source, &capacity);
+    }
+
+    free(source);
+    outbuf_free(&out);
+    shaynefro_context_destroy(ctx);
+    return NULL;
+}
+
+static void sum_results(BatchReport* report, const BatchWorker* workers, int thread_count) {
+    report->compiled = report->failed = 0;
+    report->input_bytes = report->output_bytes = report->tokens = 0;
+    report->ast_nodes = report->output_lines = 0;
+    report->steals = 0;
+    memset(report->thread_files, 0, sizeof(report->thread_files));
+    memset(report->thread_busy, 0, sizeof(report->thread_busy));
+    for (int w = 0; w < thread_count; w++) {
+        report->steals += workers[w].steals;
+    }
+    for (int i = 0; i < report->file_count; i++) {
+        const BatchFile* file = &report->files[i];
+        if (file->compiled) {
+            report->compiled++;
+        } else {
+            report->failed++;
+        }
+        report->input_bytes += file->size;
+        report->output_bytes += file->stats.output_bytes;
+        report->tokens += file->stats.tokens;
+        report->ast_nodes += file->stats.ast_nodes;
+        report->output_lines += file->stats.output_lines;
+        if (file->thread >= 0) {
+            report->thread_files[file->thread]++;
+            report->thread_busy[file->thread] += file->seconds;
+        }
+    }
+}
+
+bool batch_run(BatchReport* report, int threads, const ShayOptions* options) {
+    if (!remove_duplicates(report)) {
+        snprintf(report->error_message, sizeof(report->error_message), "Out of memory");
+        return false;
+    }
+    int thread_count = threads < 1 ? 1 : threads > BATCH_MAX_THREADS ? BATCH_MAX_THREADS : threads;
+    if (thread_count > report->file_count && report->file_count > 0) thread_count = report->file_count;
+    report->threads = thread_count;
+    for (int i = 0; i < report->file_count; i++) {
+        BatchFile* file = &report->files[i];
+        free(file->diagnostics);
+        file->diagnostics = NULL;
+        file->diagnostic_count = 0;
+        file->compiled = false;
+        file->io_error = "Not compiled: out of memory";
+        memset(&file->stats, 0, sizeof(file->stats));
+        file->seconds = 0;
+        file->thread = -1;
+    }
+
+    BatchOrder* order = malloc(sizeof(BatchOrder) * (size_t)(report->file_count + 1));
+    BatchDeque* deques = calloc((size_t)thread_count, sizeof(BatchDeque));
+    BatchWorker* workers = calloc((size_t)thread_count, sizeof(BatchWorker));
+    if (!order || !deques || !workers) {
+        free(order);
+        free(deques);
+        free(workers);
+        snprintf(report->error_message, sizeof(report->error_message), "Out of memory");
+        return false;
+    }
+
+    // Deal largest first, round robin, so every deque is sorted too
+    for (int i = 0; i < report->file_count; i++) {
+        order[i].size = report->files[i].size;
+        order[i].index = i;
+    }
+    qsort(order, (size_t)report->file_count, sizeof(BatchOrder), compare_largest_first);
+    int per_thread = report->file_count / thread_count + 1;
+    bool ready = true;
+    for (int t = 0; t < thread_count; t++) {
+        deques[t].items = malloc(sizeof(int) * (size_t)per_thread);
+        ready &= deques[t].items != NULL;
+        pthread_mutex_init(&deques[t].lock, NULL);
+    }
+    for (int i = 0; ready && i < report->file_count; i++) {
+        BatchDeque* deque = &deques[i % thread_count];
+        deque->items[deque->tail++] = order[i].index;
+    }
+
+    double start = timer_now();
+    if (ready) {
+        for (int t = 0; t < thread_count; t++) {
+            workers[t].report = report;
+            workers[t].options = options;
+            workers[t].deques = deques;
+            workers[t].thread_count = thread_count;
+            workers[t].index = t;
+        }
+        for (int t = 1; t < thread_count; t++) {
+            workers[t].started = pthread_create(&workers[t].thread, NULL, batch_worker_main, &workers[t]) == 0;
+        }
+        batch_worker_main(&workers[0]);
+        for (int t = 1; t < thread_count; t++) {
+            if (workers[t].started) pthread_join(workers[t].thread, NULL);
+        }
+    }
+    report->wall_time = timer_now() - start;
+    sum_results(report, workers, thread_count);
+
+    for (int t = 0; t < thread_count; t++) {
+        free(deques[t].items);
+        pthread_mutex_destroy(&deques[t].lock);
+    }
+    free(order);
+    free(deques);
+    free(workers);
+    return report->failed == 0;
+}
+
+// ================== REPORTING ==================
+
+void batch_print_diagnostics(const BatchReport* report, FILE* stream) {
+    for (int i = 0; i < report->file_count; i++) {
+        const BatchFile* file = &report->files[i];
+        if (file->io_error) {
+            fprintf(stream, "[ERROR] %s: %s\n", file->path, file->io_error);
+        }
+        for (int d = 0; d < file->diagnostic_count; d++) {
+            const ShayDiagnostic* diag = &file->diagnostics[d];
+            fprintf(stream, "[ERROR] %s:%d:%d: %s (%s)\n", file->path, diag->line, diag->column,
+                    diag->message, shaynefro_phase_name(diag->phase));
+        }
+    }
+}
+
+void batch_print(const BatchReport* report, FILE* stream) {
+    double seconds = report->wall_time;
+    fprintf(stream, ">> BATCH COMPILE (%d files, %d thread%s):\n", report->file_count, report->threads,
+            report->threads == 1 ? "" : "s");
+    fprintf(stream, "   Compiled: %d, failed: %d\n", report->compiled, report->failed);
+    fprintf(stream, "   Input: %.1f MB, output: %.1f MB, %zu tokens, %lld AST nodes, %lld lines\n",
+            report->input_bytes / 1048576.0, report->output_bytes / 1048576.0, report->tokens,
+            report->ast_nodes, report->output_lines);
+    fprintf(stream, "   Wall time: %.4f seconds (%.0f files/s, %.1f MB/s)\n", seconds,
+            seconds > 0 ? report->file_count / seconds : 0.0,
+            seconds > 0 ? report->input_bytes / seconds / 1048576.0 : 0.0);
+
+    int fewest = report->file_count, most = 0;
+    double busy = 0;
+    for (int t = 0; t < report->threads; t++) {
+        if (report->thread_files[t] < fewest) fewest = report->thread_files[t];
+        if (report->thread_files[t] > most) most = report->thread_files[t];
+        busy += report->thread_busy[t];
+    }
+    fprintf(stream, "   Threads: %d to %d files each, %.1f%% busy, %d stolen\n", fewest, most,
+            seconds > 0 && report->threads > 0 ? 100.0 * busy / (seconds * report->threads) : 0.0,
+            report->steals);
+}
@@ -0,0 +1,75 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "shaynefro.h"
+#include <stdio.h>
+#include <stdint.h>
+
+// ================== BATCH COMPILATION ==================
+//
+// `shaynefro -j N a.shay b.shay @list` compiles many files in one process,
+// each to a .c next to its input. Every thread owns a ShayContext, so its
+// lexer and parser arenas are reused from file to file and never shared.
+// Files are dealt largest first into one deque per thread. A thread works
+// from the front of its own deque (its largest file left) and, once that
+// is empty, steals from the back of the others', so huge files start
+// early and small ones fill the gaps at the end. Diagnostics and
+// statistics are kept per file and reported in input order.
+
+#define BATCH_MAX_THREADS 64
+
+typedef struct {
+    char* path;
+    size_t size;                // Bytes when added, used for scheduling
+    bool located;               // Directory found by stat; it and the name identify the file
+    uint64_t directory_device;
+    uint64_t directory_inode;
+    bool compiled;
+    const char* io_error;       // Reading or writing failed, NULL otherwise
+    ShayDiagnostic* diagnostics; // Copied from the context
+    int diagnostic_count;
+    ShayStats stats;
+    double seconds;             // Read, compile and write
+    int thread;                 // Worker that compiled it
+} BatchFile;
+
+typedef struct {
+    BatchFile* files;           // In the order they were added
+    int file_count;
+    int file_capacity;
+
+    // Totals from the last batch_run
+    int threads;
+    double wall_time;
+    int compiled;
+    int failed;
+    size_t input_bytes;
+    size_t output_bytes;
+    size_t tokens;
+    long long ast_nodes;
+    long long output_lines;
+    int steals;                 // Files a thread took from another's deque
+    int thread_files[BATCH_MAX_THREADS];
+    double thread_busy[BATCH_MAX_THREADS]; // Seconds spent on files
+    char error_message[256];
+} BatchReport;
+
+void batch_init(BatchReport* report);
+void batch_free(BatchReport* report);
+
+// A path, or "@list" for every non-empty line of list; false with
+// error_message set if the list cannot be read
+bool batch_add(BatchReport* report, const char* arg);
+
+// Compiles every file on `threads` threads (the calling thread is one of
+// them); false if any file failed
+bool batch_run(BatchReport* report, int threads, const ShayOptions* options);
+
+// a.shay -> a.c; any other name gets .c appended
+void batch_output_path(const char* input, char* buffer, size_t size);
+
+// Errors of failed files in input order, then the totals
+void batch_print_diagnostics(const BatchReport* report, FILE* stream);
+void batch_print(const BatchReport* report, FILE* stream);
+
+#endif
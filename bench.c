@@ -0,0 +1,1999 @@
+#define _POSIX_C_SOURCE 200809L
+#include "bench.h"
+#include "shaynefro.h"
+#include "timer.h"
+#include "stats.h"
+#include "driver.h"
+#include "profile.h"
+#include "batch.h"
+#include "server.h"
+#include "watch.h"
+#include "pipeline.h"
+#include "streaming.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <pthread.h>
+
+static const char* const mix_names[BENCH_MIX_KINDS] = {
+    "arith", "calls", "control", "strings", "floats", "comments"
+};
+
+static const char* const phase_names[BENCH_PHASE_COUNT] = {
+    "lex", "parse", "codegen", "e2e"
+};
+
+// ================== CONFIGURATION ==================
+
+void bench_default_config(BenchConfig* config) {
+    memset(config, 0, sizeof(*config));
+    static const size_t sizes[] = { 1 << 10, 64 << 10, 1 << 20, 16 << 20 };
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        config->sizes[config->size_count++] = sizes[i];
+    }
+    config->warmup = 2;
+    config->runs = 15;
+    config->phases = (1u << BENCH_PHASE_COUNT) - 1;
+    static const int weights[BENCH_MIX_KINDS] = { 30, 15, 25, 10, 10, 10 };
+    memcpy(config->mix.weights, weights, sizeof(weights));
+    config->seed = 1;
+}
+
+const char* bench_phase_name(BenchPhase phase) {
+    return phase < BENCH_PHASE_COUNT ? phase_names[phase] : "unknown";
+}
+
+// Calls handle(item, length, data) for each comma-separated item
+static bool for_each_item(const char* spec, bool (*handle)(const char*, size_t, void*), void* data) {
+    if (*spec == '\0') return false;
+    while (*spec) {
+        const char* end = strchr(spec, ',');
+        size_t length = end ? (size_t)(end - spec) : strlen(spec);
+        if (length == 0 || !handle(spec, length, data)) return false;
+        spec += length + (end ? 1 : 0);
+    }
+    return true;
+}
+
+static bool parse_mix_item(const char* item, size_t length, void* data) {
+    BenchMix* mix = data;
+    const char* equals = memchr(item, '=', length);
+    if (!equals) return false;
+    size_t name_length = (size_t)(equals - item);
+    for (int kind = 0; kind < BENCH_MIX_KINDS; kind++) {
+        if (strlen(mix_names[kind]) == name_length && strncmp(item, mix_names[kind], name_length) == 0) {
+            char* end;
+            long weight = strtol(equals + 1, &end, 10);
+            if (end != item + length || weight < 0 || weight > 1000) return false;
+            mix->weights[kind] = (int)weight;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool bench_mix_parse(BenchMix* mix, const char* spec) {
+    BenchMix parsed = *mix;
+    if (!for_each_item(spec, parse_mix_item, &parsed)) return false;
+    int total = 0;
+    for (int kind = 0; kind < BENCH_MIX_KINDS; kind++) total += parsed.weights[kind];
+    if (total == 0) return false;
+    *mix = parsed;
+    return true;
+}
+
+static bool parse_size_item(const char* item, size_t length, void* data) {
+    BenchConfig* config = data;
+    if (config->size_count >= BENCH_MAX_SIZES) return false;
+    char* end;
+    unsigned long long value = strtoull(item, &end, 10);
+    size_t rest = length - (size_t)(end - item);
+    if (end == item || rest > 1) return false;
+    if (rest == 1) {
+        switch (*end) {
+            case 'K': case 'k': value <<= 10; break;
+            case 'M': case 'm': value <<= 20; break;
+            case 'G': case 'g': value <<= 30; break;
+            default: return false;
+        }
+    }
+    if (value == 0 || value > (4ULL << 30)) return false;
+    config->sizes[config->size_count++] = (size_t)value;
+    return true;
+}
+
+bool bench_sizes_parse(BenchConfig* config, const char* spec) {
+    config->size_count = 0;
+    return for_each_item(spec, parse_size_item, config);
+}
+
+static bool parse_phase_item(const char* item, size_t length, void* data) {
+    unsigned* phases = data;
+    for (int phase = 0; phase < BENCH_PHASE_COUNT; phase++) {
+        if (strlen(phase_names[phase]) == length && strncmp(item, phase_names[phase], length) == 0) {
+            *phases |= 1u << phase;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool bench_phases_parse(BenchConfig* config, const char* spec) {
+    unsigned phases = 0;
+    if (!for_each_item(spec, parse_phase_item, &phases)) return false;
+    config->phases = phases;
+    return true;
+}
+
+void bench_format_size(size_t bytes, char* buffer, size_t size) {
+    static const char units[] = "GMK";
+    for (int i = 0; i < 3; i++) {
+        size_t unit = (size_t)1 << (10 * (3 - i));
+        if (bytes >= unit && bytes % unit == 0) {
+            snprintf(buffer, size, "%zu%c", bytes / unit, units[i]);
+            return;
+        }
+    }
+    snprintf(buffer, size, "%zu", bytes);
+}
+
+// ================== CORPUS GENERATOR ==================
+
+typedef struct {
+    uint64_t state;
+} BenchRandom;
+
+// xorshift64*: fast, and the same sequence on every platform
+static uint64_t bench_random(BenchRandom* random) {
+    random->state ^= random->state >> 12;
+    random->state ^= random->state << 25;
+    random->state ^= random->state >> 27;
+    return random->state * 0x2545F4914F6CDD1DULL;
+}
+
+static int random_below(BenchRandom* random, int limit) {
+    return (int)(bench_random(random) % (uint64_t)limit);
+}
+
+static void append_words(OutputBuffer* out, BenchRandom* random, int count) {
+    static const char* const words[] = {
+        "alpha", "buffer", "compute", "delta", "result", "token", "parser", "value",
+        "index", "frame", "quick", "sorted", "vector", "update", "retry", "offset",
+    };
+    for (int i = 0; i < count; i++) {
+        if (i > 0) outbuf_putc(out, ' ');
+        outbuf_append_str(out, words[random_below(random, (int)(sizeof(words) / sizeof(words[0])))]);
+    }
+}
+
+static void append_statement(OutputBuffer* out, BenchRandom* random, BenchMixKind kind,
+                             int function, int statement) {
+    char line[256];
+    int n = 0;
+    int r = random_below(random, 1 << 16);
+    switch (kind) {
+        case BENCH_MIX_ARITH:
+            n = snprintf(line, sizeof(line),
+                         "    int v%d = (a * %d + b) / %d - acc %% %d;\n"
+                         "    acc = acc + v%d;\n",
+                         statement, r % 89 + 2, r % 13 + 1, r % 97 + 3, statement);
+            break;
+        case BENCH_MIX_CALLS:
+            // Only earlier functions, so the call graph stays acyclic
+            n = snprintf(line, sizeof(line), "    acc += f%d(b, acc %% %d) + f%d(a, %d);\n",
+                         random_below(random, function), r % 31 + 2, random_below(random, function), r % 50);
+            break;
+        case BENCH_MIX_CONTROL:
+            switch (r % 3) {
+                case 0:
+                    n = snprintf(line, sizeof(line),
+                                 "    if (acc > %d) { acc = acc %% %d; } else { acc += a - %d; }\n",
+                                 r % 5000 + 100, r % 97 + 3, r % 17);
+                    break;
+                case 1:
+                    n = snprintf(line, sizeof(line),
+                                 "    for (int i%d = 0; i%d < b; i%d++) { acc += i%d * %d; }\n",
+                                 statement, statement, statement, statement, r % 7 + 1);
+                    break;
+                default:
+                    n = snprintf(line, sizeof(line), "    while (acc > %d) { acc = acc / %d; }\n",
+                                 r % 100000 + 1000, r % 5 + 2);
+                    break;
+            }
+            break;
+        case BENCH_MIX_STRINGS:
+            n = snprintf(line, sizeof(line), "    string s%d = \"", statement);
+            outbuf_append(out, line, (size_t)n);
+            append_words(out, random, r % 6 + 1);
+            outbuf_append_lit(out, "\";\n");
+            return;
+        case BENCH_MIX_FLOATS:
+            n = snprintf(line, sizeof(line), "    float x%d = %d.%03d * a + %de-%d;\n",
+                         statement, r % 1000, r % 997, r % 9 + 1, r % 5 + 1);
+            break;
+        case BENCH_MIX_COMMENTS:
+            outbuf_append_lit(out, r % 2 ? "    // " : "    /* ");
+            append_words(out, random, r % 10 + 2);
+            if (r % 2) {
+                outbuf_putc(out, '\n');
+            } else {
+                outbuf_append_lit(out, " */\n");
+            }
+            return;
+        default:
+            return;
+    }
+    outbuf_append(out, line, (size_t)n);
+}
+
+void bench_generate_corpus(OutputBuffer* out, size_t target_bytes, const BenchMix* mix, uint64_t seed) {
+    BenchRandom random = { seed * 0x9E3779B97F4A7C15ULL + 0x632BE59BD9B4E019ULL };
+    int total_weight = 0;
+    for (int kind = 0; kind < BENCH_MIX_KINDS; kind++) total_weight += mix->weights[kind];
+
+    static const char tail[] = "return f0(3, 4) % 256;\n";
+    size_t start = outbuf_total_size(out);
+    char line[128];
+    for (int function = 0;
+         function == 0 || outbuf_total_size(out) - start + sizeof(tail) - 1 < target_bytes;
+         function++) {
+        int n = snprintf(line, sizeof(line), "function f%d(int a, int b) {\n    int acc = a;\n", function);
+        outbuf_append(out, line, (size_t)n);
+
+        int statements = random_below(&random, 17) + 8;
+        for (int statement = 0; statement < statements; statement++) {
+            int pick = random_below(&random, total_weight);
+            BenchMixKind kind = BENCH_MIX_ARITH;
+            for (int k = 0; k < BENCH_MIX_KINDS; k++) {
+                if (pick < mix->weights[k]) {
+                    kind = (BenchMixKind)k;
+                    break;
+                }
+                pick -= mix->weights[k];
+            }
+            if (kind == BENCH_MIX_CALLS && function == 0) kind = BENCH_MIX_ARITH;
+            append_statement(out, &random, kind, function, statement);
+        }
+        outbuf_append_lit(out, "    return acc;\n}\n\n");
+    }
+    outbuf_append_lit(out, tail);
+}
+
+// ================== RUNNING ==================
+
+// One context's lexer, parser and codegen serve every phase, so the
+// arenas are shared and a corpus is held in memory only once
+typedef struct {
+    ShayContext* ctx;
+    const char* source;
+    size_t length;
+    ASTNode* ast;           // Kept for the codegen phase
+    OutputBuffer output;
+    PerfCounters counters;
+} BenchSubject;
+
+static bool run_pass(BenchSubject* subject, BenchPhase phase) {
+    ShayContext* ctx = subject->ctx;
+    switch (phase) {
+        case BENCH_PHASE_LEX: {
+            lexer_reset(ctx->lexer, subject->source, subject->length, "bench.shay");
+            Token token;
+            do {
+                token = lexer_next_token(ctx->lexer);
+            } while (token.type != TOKEN_EOF && token.type != TOKEN_ERROR);
+            return token.type == TOKEN_EOF;
+        }
+        case BENCH_PHASE_PARSE:
+            lexer_reset(ctx->lexer, subject->source, subject->length, "bench.shay");
+            parser_reset(ctx->parser, ctx->lexer);
+            subject->ast = parser_parse(ctx->parser);
+            return subject->ast && !parser_has_error(ctx->parser);
+        case BENCH_PHASE_CODEGEN:
+            outbuf_clear(&subject->output);
+            codegen_reset(ctx->codegen, &subject->output, OUTPUT_C);
+            return codegen_generate(ctx->codegen, subject->ast);
+        case BENCH_PHASE_END_TO_END: {
+            // Invalidates the AST, so it runs last
+            subject->ast = NULL;
+            outbuf_clear(&subject->output);
+            ShayOptions options = shaynefro_default_options();
+            options.filename = "bench.shay";
+            return shaynefro_compile(ctx, subject->source, subject->length, &options, &subject->output);
+        }
+        default:
+            return false;
+    }
+}
+
+static int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static void compute_statistics(BenchResult* result) {
+    int n = result->sample_count;
+    double* sorted = malloc((size_t)n * sizeof(double));
+    if (!sorted) return;
+    memcpy(sorted, result->samples, (size_t)n * sizeof(double));
+    qsort(sorted, (size_t)n, sizeof(double), compare_doubles);
+
+    double sum = 0;
+    for (int i = 0; i < n; i++) sum += sorted[i];
+    result->min = sorted[0];
+    result->median = n % 2 ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+    result->p95 = sorted[(95 * n + 99) / 100 - 1];    // Nearest rank
+    result->mean = sum / n;
+    free(sorted);
+}
+
+static BenchResult* add_result(BenchReport* report) {
+    if (report->count == report->capacity) {
+        int capacity = report->capacity ? report->capacity * 2 : 16;
+        BenchResult* grown = realloc(report->results, (size_t)capacity * sizeof(BenchResult));
+        if (!grown) return NULL;
+        report->results = grown;
+        report->capacity = capacity;
+    }
+    BenchResult* result = &report->results[report->count++];
+    memset(result, 0, sizeof(*result));
+    return result;
+}
+
+static bool run_benchmark(BenchSubject* subject, const BenchConfig* config, BenchPhase phase,
+                          BenchResult* result) {
+    // Warmup passes also calibrate how many passes make one sample
+    double pass_time = 0;
+    for (int i = 0; i < (config->warmup > 0 ? config->warmup : 1); i++) {
+        double start = timer_now();
+        if (!run_pass(subject, phase)) return false;
+        pass_time = timer_now() - start;
+    }
+    result->iterations = 1;
+    if (pass_time < BENCH_MIN_SAMPLE_SECONDS) {
+        result->iterations = pass_time > 0 ? (int)(BENCH_MIN_SAMPLE_SECONDS / pass_time) + 1 : 1000;
+    }
+
+    result->samples = malloc((size_t)config->runs * sizeof(double));
+    if (!result->samples) return false;
+    CounterSample counters_start, counters_end;
+    counters_read(&subject->counters, &counters_start);
+    for (int run = 0; run < config->runs; run++) {
+        double start = timer_now();
+        for (int i = 0; i < result->iterations; i++) {
+            if (!run_pass(subject, phase)) return false;
+        }
+        result->samples[result->sample_count++] = (timer_now() - start) / result->iterations;
+    }
+    counters_read(&subject->counters, &counters_end);
+    counters_diff(&counters_end, &counters_start, &result->counters);
+    counters_scale(&result->counters, (double)config->runs * result->iterations);
+    compute_statistics(result);
+    return true;
+}
+
+bool bench_run(const BenchConfig* config, BenchReport* report) {
+    memset(report, 0, sizeof(*report));
+    report->config = *config;
+
+    BenchSubject subject;
+    memset(&subject, 0, sizeof(subject));
+    subject.ctx = shaynefro_context_create();
+    counters_open(&subject.counters);
+    CounterSample probe;
+    counters_read(&subject.counters, &probe);
+    if (!counters_have_hardware(&probe)) {
+        snprintf(report->counters_status, sizeof(report->counters_status), "%s",
+                 subject.counters.error_message);
+    }
+    OutputBuffer corpus;
+    if (!subject.ctx || !outbuf_init(&corpus, -1) || !outbuf_init(&subject.output, -1)) {
+        snprintf(report->error_message, sizeof(report->error_message), "Out of memory");
+        shaynefro_context_destroy(subject.ctx);
+        counters_close(&subject.counters);
+        return false;
+    }
+
+    bool ok = true;
+    for (int s = 0; s < config->size_count && ok; s++) {
+        outbuf_clear(&corpus);
+        double start = timer_now();
+        bench_generate_corpus(&corpus, config->sizes[s], &config->mix, config->seed);
+        if (corpus.had_error) {
+            snprintf(report->error_message, sizeof(report->error_message),
+                     "Out of memory generating a %zu byte corpus", config->sizes[s]);
+            ok = false;
+            break;
+        }
+        char size_name[24];
+        bench_format_size(config->sizes[s], size_name, sizeof(size_name));
+        printf("   Corpus %s: %zu bytes, generated in %.3f seconds\n", size_name, corpus.length,
+               timer_now() - start);
+        fflush(stdout);
+
+        subject.source = corpus.data;
+        subject.length = corpus.length;
+        subject.ast = NULL;
+        size_t tokens = 0;
+        int ast_nodes = 0;
+
+        for (int p = 0; p < BENCH_PHASE_COUNT && ok; p++) {
+            BenchPhase phase = (BenchPhase)p;
+            if (!(config->phases & (1u << phase))) continue;
+            // Codegen needs an AST even when parsing is not being measured
+            if (phase == BENCH_PHASE_CODEGEN && !subject.ast && !run_pass(&subject, BENCH_PHASE_PARSE)) {
+                ok = false;
+            }
+
+            BenchResult* result = ok ? add_result(report) : NULL;
+            if (!result) {
+                ok = false;
+                break;
+            }
+            snprintf(result->name, sizeof(result->name), "%s/%s", phase_names[phase], size_name);
+            result->phase = phase;
+            result->source_bytes = corpus.length;
+            ok = run_benchmark(&subject, config, phase, result);
+
+            if (phase == BENCH_PHASE_LEX || phase == BENCH_PHASE_PARSE) {
+                tokens = subject.ctx->lexer->tokens_processed;
+            }
+            if (phase == BENCH_PHASE_PARSE || phase == BENCH_PHASE_CODEGEN) {
+                ast_nodes = parser_get_nodes_created(subject.ctx->parser);
+            }
+            if (phase == BENCH_PHASE_END_TO_END) {
+                tokens = subject.ctx->stats.tokens;
+                ast_nodes = subject.ctx->stats.ast_nodes;
+            }
+            result->tokens = tokens;
+            result->ast_nodes = ast_nodes;
+            result->output_bytes = phase >= BENCH_PHASE_CODEGEN ? subject.output.length : 0;
+            if (!ok) {
+                snprintf(report->error_message, sizeof(report->error_message),
+                         "%s failed on the generated corpus", result->name);
+                report->count--;
+                free(result->samples);
+            } else {
+                printf("   %-14s median %.6f s, %d x %d passes\n", result->name, result->median,
+                       result->sample_count, result->iterations);
+                fflush(stdout);
+            }
+        }
+    }
+
+    outbuf_free(&subject.output);
+    outbuf_free(&corpus);
+    shaynefro_context_destroy(subject.ctx);
+    counters_close(&subject.counters);
+    return ok;
+}
+
+// ================== REPORTING ==================
+
+// Counter value per token (per AST node for codegen), "-" if not measured
+static void print_per_unit(const BenchResult* result, CounterKind kind, int width, int precision) {
+    double units = result->phase == BENCH_PHASE_CODEGEN ? result->ast_nodes : (double)result->tokens;
+    if (!result->counters.valid[kind] || units <= 0) {
+        printf(" %*s", width, "-");
+    } else {
+        printf(" %*.*f", width, precision, result->counters.values[kind] / units);
+    }
+}
+
+void bench_print(const BenchReport* report) {
+    printf("\n%-14s %12s %12s %12s %10s %12s\n", "Benchmark", "median (s)", "p95 (s)", "min (s)",
+           "MB/s", "tokens/s");
+    for (int i = 0; i < report->count; i++) {
+        const BenchResult* result = &report->results[i];
+        printf("%-14s %12.6f %12.6f %12.6f %10.1f %12.0f\n", result->name, result->median,
+               result->p95, result->min, result->source_bytes / result->median / 1e6,
+               result->tokens / result->median);
+    }
+
+    if (report->counters_status[0]) {
+        printf("\nHardware counters unavailable: %s\n", report->counters_status);
+        return;
+    }
+    printf("\nPer token (per AST node for codegen):\n");
+    printf("%-14s %6s %10s %10s %10s %10s\n", "Benchmark", "IPC", "instr", "L1D miss",
+           "LLC miss", "br miss");
+    for (int i = 0; i < report->count; i++) {
+        const BenchResult* result = &report->results[i];
+        printf("%-14s %6.2f", result->name, counters_ipc(&result->counters));
+        print_per_unit(result, COUNTER_INSTRUCTIONS, 10, 1);
+        print_per_unit(result, COUNTER_L1D_MISSES, 10, 3);
+        print_per_unit(result, COUNTER_LLC_MISSES, 10, 4);
+        print_per_unit(result, COUNTER_BRANCH_MISSES, 10, 3);
+        printf("\n");
+    }
+}
+
+bool bench_write_json(const BenchReport* report, const char* path) {
+    FILE* file = strcmp(path, "-") == 0 ? stdout : fopen(path, "w");
+    if (!file) return false;
+
+    const BenchConfig* config = &report->config;
+    fprintf(file, "{\n  \"version\": \"%s\",\n  \"config\": {\n", SHAYNEFRO_VERSION);
+    fprintf(file, "    \"warmup\": %d,\n    \"runs\": %d,\n    \"seed\": %llu,\n    \"mix\": {",
+            config->warmup, config->runs, (unsigned long long)config->seed);
+    for (int kind = 0; kind < BENCH_MIX_KINDS; kind++) {
+        fprintf(file, "%s\"%s\": %d", kind ? ", " : "", mix_names[kind], config->mix.weights[kind]);
+    }
+    fprintf(file, "},\n    \"sizes\": [");
+    for (int s = 0; s < config->size_count; s++) {
+        fprintf(file, "%s%zu", s ? ", " : "", config->sizes[s]);
+    }
+    fprintf(file, "],\n    \"phases\": [");
+    bool first = true;
+    for (int phase = 0; phase < BENCH_PHASE_COUNT; phase++) {
+        if (!(config->phases & (1u << phase))) continue;
+        fprintf(file, "%s\"%s\"", first ? "" : ", ", phase_names[phase]);
+        first = false;
+    }
+    fprintf(file, "]\n  },\n  \"benchmarks\": [\n");
+
+    for (int i = 0; i < report->count; i++) {
+        const BenchResult* result = &report->results[i];
+        fprintf(file, "    {\n      \"name\": \"%s\",\n      \"phase\": \"%s\",\n", result->name,
+                phase_names[result->phase]);
+        fprintf(file, "      \"source_bytes\": %zu,\n      \"tokens\": %zu,\n      \"ast_nodes\": %d,\n"
+                      "      \"output_bytes\": %zu,\n      \"iterations\": %d,\n",
+                result->source_bytes, result->tokens, result->ast_nodes, result->output_bytes,
+                result->iterations);
+        fprintf(file, "      \"min\": %.9g,\n      \"median\": %.9g,\n      \"p95\": %.9g,\n"
+                      "      \"mean\": %.9g,\n      \"mb_per_second\": %.3f,\n      \"samples\": [",
+                result->min, result->median, result->p95, result->mean,
+                result->source_bytes / result->median / 1e6);
+        for (int s = 0; s < result->sample_count; s++) {
+            fprintf(file, "%s%.9g", s ? ", " : "", result->samples[s]);
+        }
+        fprintf(file, "],\n      \"counters\": {");
+        bool first_counter = true;
+        for (int kind = 0; kind < COUNTER_KINDS; kind++) {
+            if (!result->counters.valid[kind]) continue;
+            fprintf(file, "%s\"%s\": %llu", first_counter ? "" : ", ", counter_name((CounterKind)kind),
+                    (unsigned long long)result->counters.values[kind]);
+            first_counter = false;
+        }
+        fprintf(file, "}\n    }%s\n", i + 1 < report->count ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+
+    bool ok = !ferror(file);
+    if (file != stdout) ok = fclose(file) == 0 && ok;
+    return ok;
+}
+
+// ================== READING RESULTS ==================
+//
+// Enough JSON to read back what bench_write_json writes; unknown members
+// are skipped so older or newer result files still load.
+
+typedef struct {
+    const char* p;
+} JsonReader;
+
+static void json_skip_space(JsonReader* reader) {
+    while (*reader->p == ' ' || *reader->p == '\n' || *reader->p == '\r' || *reader->p == '\t') {
+        reader->p++;
+    }
+}
+
+static bool json_consume(JsonReader* reader, char c) {
+    json_skip_space(reader);
+    if (*reader->p != c) return false;
+    reader->p++;
+    return true;
+}
+
+// Escapes are kept as the escaped character; names and phases never need more
+static bool json_string(JsonReader* reader, char* buffer, size_t size) {
+    if (!json_consume(reader, '"')) return false;
+    size_t length = 0;
+    while (*reader->p && *reader->p != '"') {
+        if (*reader->p == '\\' && reader->p[1]) reader->p++;
+        if (length + 1 < size) buffer[length++] = *reader->p;
+        reader->p++;
+    }
+    buffer[length] = '\0';
+    return json_consume(reader, '"');
+}
+
+static bool json_number(JsonReader* reader, double* value) {
+    json_skip_space(reader);
+    char* end;
+    *value = strtod(reader->p, &end);
+    if (end == reader->p) return false;
+    reader->p = end;
+    return true;
+}
+
+// Seeds need all 64 bits, more than a double holds
+static bool json_unsigned(JsonReader* reader, unsigned long long* value) {
+    json_skip_space(reader);
+    char* end;
+    *value = strtoull(reader->p, &end, 10);
+    if (end == reader->p) return false;
+    reader->p = end;
+    return true;
+}
+
+typedef bool (*JsonMember)(JsonReader* reader, const char* key, void* data);
+typedef bool (*JsonElement)(JsonReader* reader, void* data);
+
+static bool json_skip_value(JsonReader* reader);
+
+static bool skip_member(JsonReader* reader, const char* key, void* data) {
+    (void)key;
+    (void)data;
+    return json_skip_value(reader);
+}
+
+static bool skip_element(JsonReader* reader, void* data) {
+    (void)data;
+    return json_skip_value(reader);
+}
+
+static bool json_object(JsonReader* reader, JsonMember member, void* data) {
+    if (!json_consume(reader, '{')) return false;
+    if (json_consume(reader, '}')) return true;
+    do {
+        char key[64];
+        if (!json_string(reader, key, sizeof(key)) || !json_consume(reader, ':') ||
+            !member(reader, key, data)) {
+            return false;
+        }
+    } while (json_consume(reader, ','));
+    return json_consume(reader, '}');
+}
+
+static bool json_array(JsonReader* reader, JsonElement element, void* data) {
+    if (!json_consume(reader, '[')) return false;
+    if (json_consume(reader, ']')) return true;
+    do {
+        if (!element(reader, data)) return false;
+    } while (json_consume(reader, ','));
+    return json_consume(reader, ']');
+}
+
+static bool json_skip_value(JsonReader* reader) {
+    char text[8];
+    double number;
+    json_skip_space(reader);
+    switch (*reader->p) {
+        case '{': return json_object(reader, skip_member, NULL);
+        case '[': return json_array(reader, skip_element, NULL);
+        case '"': return json_string(reader, text, sizeof(text));
+        case 't': case 'f': case 'n':
+            while (*reader->p >= 'a' && *reader->p <= 'z') reader->p++;
+            return true;
+        default: return json_number(reader, &number);
+    }
+}
+
+static bool read_int(JsonReader* reader, int* value) {
+    double number;
+    if (!json_number(reader, &number)) return false;
+    *value = (int)number;
+    return true;
+}
+
+static bool read_size(JsonReader* reader, size_t* value) {
+    unsigned long long number;
+    if (!json_unsigned(reader, &number)) return false;
+    *value = (size_t)number;
+    return true;
+}
+
+static bool mix_member(JsonReader* reader, const char* key, void* data) {
+    BenchMix* mix = data;
+    for (int kind = 0; kind < BENCH_MIX_KINDS; kind++) {
+        if (strcmp(key, mix_names[kind]) == 0) return read_int(reader, &mix->weights[kind]);
+    }
+    return json_skip_value(reader);
+}
+
+static bool size_element(JsonReader* reader, void* data) {
+    BenchConfig* config = data;
+    if (config->size_count >= BENCH_MAX_SIZES) return false;
+    return read_size(reader, &config->sizes[config->size_count++]);
+}
+
+static bool phase_from_name(const char* name, BenchPhase* phase) {
+    for (int p = 0; p < BENCH_PHASE_COUNT; p++) {
+        if (strcmp(name, phase_names[p]) == 0) {
+            *phase = (BenchPhase)p;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool phase_element(JsonReader* reader, void* data) {
+    BenchConfig* config = data;
+    char name[16];
+    BenchPhase phase;
+    if (!json_string(reader, name, sizeof(name)) || !phase_from_name(name, &phase)) return false;
+    config->phases |= 1u << phase;
+    return true;
+}
+
+static bool config_member(JsonReader* reader, const char* key, void* data) {
+    BenchConfig* config = data;
+    if (strcmp(key, "warmup") == 0) return read_int(reader, &config->warmup);
+    if (strcmp(key, "runs") == 0) return read_int(reader, &config->runs);
+    if (strcmp(key, "mix") == 0) return json_object(reader, mix_member, &config->mix);
+    if (strcmp(key, "seed") == 0) {
+        unsigned long long seed;
+        if (!json_unsigned(reader, &seed)) return false;
+        config->seed = seed;
+        return true;
+    }
+    if (strcmp(key, "sizes") == 0) {
+        config->size_count = 0;
+        return json_array(reader, size_element, config);
+    }
+    if (strcmp(key, "phases") == 0) {
+        config->phases = 0;
+        return json_array(reader, phase_element, config);
+    }
+    return json_skip_value(reader);
+}
+
+static bool sample_element(JsonReader* reader, void* data) {
+    BenchResult* result = data;
+    int count = result->sample_count;
+    // Grow at powers of two
+    if (count >= 16 && (count & (count - 1)) == 0) {
+        double* grown = realloc(result->samples, (size_t)count * 2 * sizeof(double));
+        if (!grown) return false;
+        result->samples = grown;
+    } else if (count == 0) {
+        result->samples = malloc(16 * sizeof(double));
+        if (!result->samples) return false;
+    }
+    if (!json_number(reader, &result->samples[count])) return false;
+    result->sample_count++;
+    return true;
+}
+
+static bool result_member(JsonReader* reader, const char* key, void* data) {
+    BenchResult* result = data;
+    if (strcmp(key, "name") == 0) return json_string(reader, result->name, sizeof(result->name));
+    if (strcmp(key, "phase") == 0) {
+        char name[16];
+        return json_string(reader, name, sizeof(name)) && phase_from_name(name, &result->phase);
+    }
+    if (strcmp(key, "source_bytes") == 0) return read_size(reader, &result->source_bytes);
+    if (strcmp(key, "tokens") == 0) return read_size(reader, &result->tokens);
+    if (strcmp(key, "ast_nodes") == 0) return read_int(reader, &result->ast_nodes);
+    if (strcmp(key, "output_bytes") == 0) return read_size(reader, &result->output_bytes);
+    if (strcmp(key, "iterations") == 0) return read_int(reader, &result->iterations);
+    if (strcmp(key, "samples") == 0) return json_array(reader, sample_element, result);
+    // Statistics are recomputed from the samples
+    return json_skip_value(reader);
+}
+
+static bool benchmark_element(JsonReader* reader, void* data) {
+    BenchReport* report = data;
+    BenchResult* result = add_result(report);
+    if (!result || !json_object(reader, result_member, result)) return false;
+    if (result->sample_count == 0 || result->name[0] == '\0') return false;
+    compute_statistics(result);
+    return true;
+}
+
+static bool report_member(JsonReader* reader, const char* key, void* data) {
+    BenchReport* report = data;
+    if (strcmp(key, "config") == 0) return json_object(reader, config_member, &report->config);
+    if (strcmp(key, "benchmarks") == 0) return json_array(reader, benchmark_element, report);
+    return json_skip_value(reader);
+}
+
+bool bench_read_json(const char* path, BenchReport* report) {
+    memset(report, 0, sizeof(*report));
+    bench_default_config(&report->config);
+
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        snprintf(report->error_message, sizeof(report->error_message), "Cannot open %.200s", path);
+        return false;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char* text = size >= 0 ? malloc((size_t)size + 1) : NULL;
+    bool ok = text && fread(text, 1, (size_t)size, file) == (size_t)size;
+    fclose(file);
+
+    if (ok) {
+        text[size] = '\0';
+        JsonReader reader = { text };
+        ok = json_object(&reader, report_member, report);
+        json_skip_space(&reader);
+        ok = ok && *reader.p == '\0';
+    }
+    free(text);
+    if (!ok) {
+        snprintf(report->error_message, sizeof(report->error_message),
+                 "%.200s is not a benchmark result file", path);
+        bench_report_free(report);
+    }
+    return ok;
+}
+
+// ================== COMPARISON ==================
+
+typedef struct {
+    double value;
+    int group;
+} RankedSample;
+
+static int compare_ranked(const void* a, const void* b) {
+    double x = ((const RankedSample*)a)->value, y = ((const RankedSample*)b)->value;
+    return (x > y) - (x < y);
+}
+
+double bench_mann_whitney(const double* a, int n, const double* b, int m) {
+    int total = n + m;
+    if (n == 0 || m == 0) return 1.0;
+    RankedSample* all = malloc((size_t)total * sizeof(RankedSample));
+    if (!all) return 1.0;
+    for (int i = 0; i < n; i++) all[i] = (RankedSample){ a[i], 0 };
+    for (int i = 0; i < m; i++) all[n + i] = (RankedSample){ b[i], 1 };
+    qsort(all, (size_t)total, sizeof(RankedSample), compare_ranked);
+
+    // Rank sum of a, with ties sharing their average rank
+    double rank_sum = 0, tie_term = 0;
+    for (int i = 0; i < total;) {
+        int j = i;
+        while (j < total && all[j].value == all[i].value) j++;
+        double rank = (i + 1 + j) / 2.0;
+        for (int k = i; k < j; k++) {
+            if (all[k].group == 0) rank_sum += rank;
+        }
+        double ties = j - i;
+        tie_term += ties * ties * ties - ties;
+        i = j;
+    }
+    free(all);
+
+    // Normal approximation with tie and continuity corrections
+    double u = rank_sum - n * (n + 1) / 2.0;
+    double mean = n * (double)m / 2.0;
+    double variance = n * (double)m / 12.0 * ((total + 1) - tie_term / (total * (double)(total - 1)));
+    if (variance <= 0) return 1.0;
+    double z = (fabs(u - mean) - 0.5) / sqrt(variance);
+    if (z < 0) z = 0;
+    return erfc(z / sqrt(2.0));
+}
+
+static const BenchResult* find_result(const BenchReport* report, const char* name) {
+    for (int i = 0; i < report->count; i++) {
+        if (strcmp(report->results[i].name, name) == 0) return &report->results[i];
+    }
+    return NULL;
+}
+
+int bench_compare(const BenchReport* baseline, const BenchReport* current,
+                  double threshold_percent, double alpha) {
+    printf("\n%-14s %13s %13s %9s %9s   %s\n", "Benchmark", "baseline (s)", "current (s)", "delta",
+           "p", "verdict");
+    int regressions = 0;
+    for (int i = 0; i < baseline->count; i++) {
+        const BenchResult* before = &baseline->results[i];
+        const BenchResult* after = find_result(current, before->name);
+        if (!after) {
+            printf("%-14s %13.6f %13s %9s %9s   missing\n", before->name, before->median, "-", "-", "-");
+            continue;
+        }
+        // Timings of different inputs say nothing about the compiler
+        if (after->source_bytes != before->source_bytes) {
+            printf("%-14s %13.6f %13.6f %9s %9s   input changed (%zu -> %zu bytes)\n", before->name,
+                   before->median, after->median, "-", "-", before->source_bytes, after->source_bytes);
+            continue;
+        }
+
+        double delta = (after->median / before->median - 1.0) * 100.0;
+        double p = bench_mann_whitney(before->samples, before->sample_count,
+                                      after->samples, after->sample_count);
+        const char* verdict = "same";
+        if (p < alpha && delta > threshold_percent) {
+            verdict = "SLOWER";
+            regressions++;
+        } else if (p < alpha && delta < -threshold_percent) {
+            verdict = "faster";
+        } else if (p < alpha) {
+            verdict = "same (within threshold)";
+        }
+        printf("%-14s %13.6f %13.6f %+8.1f%% %9.4f   %s\n", before->name, before->median,
+               after->median, delta, p, verdict);
+    }
+    for (int i = 0; i < current->count; i++) {
+        if (!find_result(baseline, current->results[i].name)) {
+            printf("%-14s %13s %13.6f %9s %9s   new\n", current->results[i].name, "-",
+                   current->results[i].median, "-", "-");
+        }
+    }
+    printf("\nThreshold %.1f%%, significance %.3g: %d regression%s\n", threshold_percent, alpha,
+           regressions, regressions == 1 ? "" : "s");
+    return regressions;
+}
+
+void bench_report_free(BenchReport* report) {
+    for (int i = 0; i < report->count; i++) {
+        free(report->results[i].samples);
+    }
+    free(report->results);
+    report->results = NULL;
+    report->count = report->capacity = 0;
+}
+
+// ================== PATHOLOGICAL INPUTS ==================
+
+static const char* const pathology_names[BENCH_PATHOLOGY_COUNT] = {
+    "identifier", "nesting", "chain", "string", "comments", "keywords"
+};
+
+const char* bench_pathology_name(BenchPathology kind) {
+    return pathology_names[kind];
+}
+
+static void append_repeated(OutputBuffer* out, const char* text, size_t count) {
+    size_t length = strlen(text);
+    for (size_t i = 0; i < count; i++) {
+        outbuf_append(out, text, length);
+    }
+}
+
+void bench_generate_pathological(OutputBuffer* out, BenchPathology kind, size_t n) {
+    switch (kind) {
+        case BENCH_PATHOLOGY_IDENTIFIER:
+            // Declared and used, so the name also goes through codegen twice
+            outbuf_append_str(out, "int ");
+            append_repeated(out, "a", n);
+            outbuf_append_str(out, " = 1;\nint y = ");
+            append_repeated(out, "a", n);
+            outbuf_append_str(out, " + 1;\n");
+            break;
+        case BENCH_PATHOLOGY_NESTING:
+            outbuf_append_str(out, "int x = ");
+            append_repeated(out, "(", n);
+            outbuf_putc(out, '1');
+            append_repeated(out, ")", n);
+            outbuf_append_str(out, ";\n");
+            break;
+        case BENCH_PATHOLOGY_CHAIN:
+            outbuf_append_str(out, "int x = 1");
+            append_repeated(out, " + 1", n > 0 ? n - 1 : 0);
+            outbuf_append_str(out, ";\n");
+            break;
+        case BENCH_PATHOLOGY_STRING:
+            outbuf_append_str(out, "string s = \"");
+            append_repeated(out, "x", n);
+            outbuf_append_str(out, "\";\n");
+            break;
+        case BENCH_PATHOLOGY_COMMENTS: {
+            // Half in short line comments, half in one block comment
+            static const char line[] = "// nothing to see here, the lexer only skips this line\n";
+            append_repeated(out, line, n / 2 / (sizeof(line) - 1));
+            outbuf_append_str(out, "/*");
+            append_repeated(out, " *", n / 4);
+            outbuf_append_str(out, "/\nint x = 1;\n");
+            break;
+        }
+        case BENCH_PATHOLOGY_KEYWORDS: {
+            static const char* const keywords[] = {
+                "if", "else", "while", "for", "return", "int", "float", "string",
+                "function", "class", "true", "false", "null", "undefined",
+            };
+            for (size_t i = 0; i < n; i++) {
+                outbuf_append_str(out, keywords[i % (sizeof(keywords) / sizeof(keywords[0]))]);
+                outbuf_putc(out, i % 16 == 15 ? '\n' : ' ');
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+typedef struct {
+    double seconds;         // Best of the runs
+    size_t peak_memory;     // memory_stats_peak_total
+    bool compiled;
+    char error_message[256];
+} PathologyRun;
+
+// Lexes, parses and generates the input in a fresh context, so arena
+// peaks belong to this size alone
+static bool run_pathology(BenchPathology kind, const OutputBuffer* source, int runs, PathologyRun* run) {
+    memset(run, 0, sizeof(*run));
+    ShayContext* ctx = shaynefro_context_create();
+    OutputBuffer output;
+    if (!ctx || !outbuf_init(&output, -1)) {
+        shaynefro_context_destroy(ctx);
+        return false;
+    }
+    
+    run->seconds = -1;
+    for (int r = 0; r < runs; r++) {
+        double start = timer_now();
+        lexer_reset(ctx->lexer, source->data, source->length, "pathological.shay");
+        if (kind == BENCH_PATHOLOGY_KEYWORDS) {
+            Token token;
+            do {
+                token = lexer_next_token(ctx->lexer);
+            } while (token.type != TOKEN_EOF && token.type != TOKEN_ERROR);
+            run->compiled = token.type == TOKEN_EOF;
+            if (!run->compiled) {
+                snprintf(run->error_message, sizeof(run->error_message), "%s", lexer_get_error(ctx->lexer));
+            }
+        } else {
+            parser_reset(ctx->parser, ctx->lexer);
+            outbuf_clear(&output);
+            codegen_reset(ctx->codegen, &output, OUTPUT_C);
+            ASTNode* ast = parser_parse(ctx->parser);
+            run->compiled = ast && !parser_has_error(ctx->parser) && codegen_generate(ctx->codegen, ast);
+            if (!run->compiled) {
+                snprintf(run->error_message, sizeof(run->error_message), "%s",
+                         parser_has_error(ctx->parser) ? parser_get_error(ctx->parser)
+                                                       : codegen_get_error(ctx->codegen));
+            }
+        }
+        double seconds = timer_now() - start;
+        if (run->seconds < 0 || seconds < run->seconds) run->seconds = seconds;
+    }
+    
+    MemoryStats memory;
+    bool lex_only = kind == BENCH_PATHOLOGY_KEYWORDS;
+    memory_stats_collect(&memory, ctx->lexer, lex_only ? NULL : ctx->parser,
+                         lex_only ? NULL : ctx->codegen);
+    run->peak_memory = memory_stats_peak_total(&memory);
+    
+    outbuf_free(&output);
+    shaynefro_context_destroy(ctx);
+    return true;
+}
+
+// Whether the compile ended the way this case must at size n
+static bool pathology_outcome_ok(BenchPathology kind, size_t n, const PathologyRun* run) {
+    if (kind == BENCH_PATHOLOGY_NESTING && n > PARSER_MAX_DEPTH) {
+        return !run->compiled && strstr(run->error_message, "Nesting too deep") != NULL;
+    }
+    return run->compiled;
+}
+
+int bench_run_pathological(size_t size, int runs) {
+    char small_name[24], large_name[24];
+    bench_format_size(size / 4, small_name, sizeof(small_name));
+    bench_format_size(size, large_name, sizeof(large_name));
+    printf(">> PATHOLOGICAL INPUTS (%s and %s, best of %d):\n", small_name, large_name, runs);
+    
+    OutputBuffer source;
+    if (!outbuf_init(&source, -1)) {
+        printf("[ERROR] Out of memory\n");
+        return BENCH_PATHOLOGY_COUNT;
+    }
+    
+    int failures = 0;
+    for (int k = 0; k < BENCH_PATHOLOGY_COUNT; k++) {
+        BenchPathology kind = (BenchPathology)k;
+        size_t sizes[2] = { size / 4, size };
+        PathologyRun result[2];
+        bool ok = true;
+        for (int s = 0; s < 2 && ok; s++) {
+            outbuf_clear(&source);
+            bench_generate_pathological(&source, kind, sizes[s]);
+            ok = !source.had_error && run_pathology(kind, &source, runs, &result[s]);
+            if (!ok) {
+                printf("   %-10s out of memory at %zu\n", pathology_names[k], sizes[s]);
+            } else if (!pathology_outcome_ok(kind, sizes[s], &result[s])) {
+                printf("   %-10s unexpected %s at %zu: %s\n", pathology_names[k],
+                       result[s].compiled ? "success" : "failure", sizes[s], result[s].error_message);
+                ok = false;
+            }
+        }
+        if (!ok) {
+            failures++;
+            continue;
+        }
+        
+        // Runs well under a millisecond are mostly timer and cache noise,
+        // so a tenth of one is added to both sides
+        double time_ratio = (result[1].seconds + 1e-4) / (result[0].seconds + 1e-4);
+        double memory_ratio = result[0].peak_memory ? (double)result[1].peak_memory / result[0].peak_memory : 0;
+        bool scales = time_ratio < BENCH_PATHOLOGICAL_MAX_RATIO && memory_ratio < BENCH_PATHOLOGICAL_MAX_RATIO;
+        printf("   %-10s %9.3f ms %8.1f MB -> %9.3f ms %8.1f MB   time x%.1f, memory x%.1f%s%s\n",
+               pathology_names[k], result[0].seconds * 1e3, result[0].peak_memory / 1048576.0,
+               result[1].seconds * 1e3, result[1].peak_memory / 1048576.0, time_ratio, memory_ratio,
+               result[1].compiled ? "" : " (rejected)", scales ? "" : "  SUPER-LINEAR");
+        fflush(stdout);
+        if (!scales) failures++;
+    }
+    
+    outbuf_free(&source);
+    return failures;
+}
+
+// ================== NATIVE BUILDS ==================
+
+typedef struct {
+    const char* name;
+    const char* source;
+} PgoProgram;
+
+// Each has a function that never runs, which a complete profile marks cold
+static const PgoProgram pgo_programs[] = {
+    { "fibonacci",
+      "int fib(int n) {\n"
+      "    if (n < 2) { return n; }\n"
+      "    return fib(n - 1) + fib(n - 2);\n"
+      "}\n"
+      "int fib_iterative(int n) {\n"
+      "    int a = 0;\n"
+      "    int b = 1;\n"
+      "    for (int i = 0; i < n; i++) { int t = a + b; a = b; b = t; }\n"
+      "    return a;\n"
+      "}\n"
+      "int r = fib(34);\n"
+      "return r % 256;\n" },
+    { "primes",
+      "int divides(int n, int d) { return n % d == 0; }\n"
+      "int is_prime(int n) {\n"
+      "    if (n < 2) { return 0; }\n"
+      "    int d = 2;\n"
+      "    while (d * d <= n) {\n"
+      "        if (divides(n, d)) { return 0; } else { d++; }\n"
+      "    }\n"
+      "    return 1;\n"
+      "}\n"
+      "int is_prime_slow(int n) {\n"
+      "    for (int d = 2; d < n; d++) { if (divides(n, d)) { return 0; } }\n"
+      "    return n > 1;\n"
+      "}\n"
+      "int count = 0;\n"
+      "for (int i = 0; i < 1000000; i++) { if (is_prime(i)) { count++; } }\n"
+      "return count % 256;\n" },
+};
+
+// How one executable is generated
+typedef struct {
+    bool profile;               // --profile
+    const ProfileData* data;    // --profile-use
+    int sample_hz;              // --sample
+} NativeVariant;
+
+// Compiles source straight into the C compiler, as -o does
+static bool native_program_build(const char* source, const char* path, const NativeVariant* variant,
+                                 ProfileDecisions* decisions, char* error, size_t error_size) {
+    error[0] = '\0';
+    Lexer* lexer = lexer_create(source, "pgo.shay");
+    Parser* parser = lexer ? parser_create(lexer) : NULL;
+    ASTNode* ast = parser ? parser_parse(parser) : NULL;
+    if (!ast || parser_has_error(parser)) {
+        snprintf(error, error_size, "%s", parser ? parser_get_error(parser) : "Out of memory");
+        parser_destroy(parser);
+        lexer_destroy(lexer);
+        return false;
+    }
+    
+    NativeBuild build;
+    OutputBuffer out;
+    if (!native_build_start(&build, CC_PROFILE_RELEASE, path) || !outbuf_init(&out, build.input_fd)) {
+        snprintf(error, error_size, "%s", build.error_message[0] ? build.error_message : "Out of memory");
+        if (build.pid > 0) native_build_abort(&build);
+        parser_destroy(parser);
+        lexer_destroy(lexer);
+        return false;
+    }
+    CodeGenerator* codegen = codegen_create_in_memory(&out, OUTPUT_C);
+    bool built = codegen != NULL;
+    if (built) {
+        codegen_set_profile(codegen, variant->profile);
+        codegen_set_profile_data(codegen, variant->data);
+        codegen_set_sampling(codegen, variant->sample_hz);
+        built = codegen_generate(codegen, ast) && !codegen_has_error(codegen);
+        if (!built) snprintf(error, error_size, "%s", codegen_get_error(codegen));
+        codegen_get_profile_decisions(codegen, decisions);
+    }
+    if (built) {
+        built = native_build_finish(&build);
+        if (!built) snprintf(error, error_size, "%s", build.error_message);
+    } else {
+        native_build_abort(&build);
+    }
+    outbuf_free(&out);
+    codegen_destroy(codegen);
+    parser_destroy(parser);
+    lexer_destroy(lexer);
+    return built;
+}
+
+// Exit status of the command, -1 if it did not exit normally
+static int native_program_run(const char* command) {
+    int status = system(command);
+    return status != -1 && WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+// Best of `runs` wall-clock seconds per command, and its exit status in
+// the last run. The commands take turns, so drift in machine load or
+// clock speed hits them alike.
+static void native_programs_time(const char* const* commands, int count, int runs,
+                                 double* best, int* exit_codes) {
+    for (int c = 0; c < count; c++) best[c] = -1;
+    for (int r = 0; r < runs; r++) {
+        for (int c = 0; c < count; c++) {
+            double start = timer_now();
+            exit_codes[c] = native_program_run(commands[c]);
+            double seconds = timer_now() - start;
+            if (best[c] < 0 || seconds < best[c]) best[c] = seconds;
+        }
+    }
+}
+
+// Builds, profiles and times one program in dir
+static bool pgo_measure(const PgoProgram* program, const char* dir, int runs) {
+    char plain[512], profiled[512], guided[512], profile_path[512], command[2048], error[256];
+    snprintf(plain, sizeof(plain), "%s/%s", dir, program->name);
+    snprintf(profiled, sizeof(profiled), "%s/%s-profile", dir, program->name);
+    snprintf(guided, sizeof(guided), "%s/%s-pgo", dir, program->name);
+    snprintf(profile_path, sizeof(profile_path), "%s/%s.prof", dir, program->name);
+    
+    ProfileDecisions decisions;
+    ProfileData data;
+    memset(&data, 0, sizeof(data));
+    NativeVariant variant = { false, NULL, 0 };
+    bool ok = native_program_build(program->source, plain, &variant, &decisions, error, sizeof(error));
+    variant.profile = true;
+    ok = ok && native_program_build(program->source, profiled, &variant, &decisions, error, sizeof(error));
+    if (ok) {
+        // The flat profile on stderr is not part of the benchmark
+        snprintf(command, sizeof(command), "SHAYNEFRO_PROFILE=%s %s 2>/dev/null", profile_path, profiled);
+        ok = native_program_run(command) >= 0 && profile_load(&data, profile_path);
+        if (!ok) snprintf(error, sizeof(error), "%s", data.error_message[0] ? data.error_message
+                                                                            : "Profiled run failed");
+    }
+    variant.profile = false;
+    variant.data = &data;
+    ok = ok && native_program_build(program->source, guided, &variant, &decisions, error, sizeof(error));
+    
+    if (ok) {
+        const char* commands[2] = { plain, guided };
+        double seconds[2];
+        int exit_codes[2];
+        native_programs_time(commands, 2, runs, seconds, exit_codes);
+        double plain_time = seconds[0], guided_time = seconds[1];
+        ok = exit_codes[0] >= 0 && exit_codes[0] == exit_codes[1];
+        printf("   %-10s %9.3f ms -> %9.3f ms   x%.2f   hot %d, cold %d, inlined %d, hinted %d, swapped %d%s\n",
+               program->name, plain_time * 1e3, guided_time * 1e3,
+               guided_time > 0 ? plain_time / guided_time : 0.0, decisions.hot, decisions.cold,
+               decisions.inlined, decisions.branch_hints, decisions.swapped,
+               ok ? "" : "   [RESULT DIFFERS]");
+    } else {
+        printf("   %-10s failed: %s\n", program->name, error);
+    }
+    
+    profile_free(&data);
+    unlink(plain);
+    unlink(profiled);
+    unlink(guided);
+    unlink(profile_path);
+    return ok;
+}
+
+int bench_run_pgo(int runs) {
+    const int count = (int)(sizeof(pgo_programs) / sizeof(pgo_programs[0]));
+    printf(">> PROFILE-GUIDED BUILDS (%s, plain -> profile-guided, best of %d):\n",
+           cc_profile_flags(CC_PROFILE_RELEASE), runs);
+    
+    char dir[] = BENCH_NATIVE_DIR_TEMPLATE;
+    if (!mkdtemp(dir)) {
+        printf("[ERROR] Cannot create %s\n", BENCH_NATIVE_DIR_TEMPLATE);
+        return count;
+    }
+    int failures = 0;
+    for (int i = 0; i < count; i++) {
+        failures += !pgo_measure(&pgo_programs[i], dir, runs);
+    }
+    rmdir(dir);
+    return failures;
+}
+
+// The share of CPU time the sampled program reported for its handler, -1
+// if it reported none
+static double sampling_handler_share(const char* log_path) {
+    FILE* file = fopen(log_path, "r");
+    if (!file) return -1;
+    double percent = -1;
+    char line[512];
+    while (fgets(line, sizeof(line), file)) {
+        if (sscanf(line, "Sampling handler: %lf%%", &percent) == 1) break;
+    }
+    fclose(file);
+    return percent < 0 ? -1 : percent / 100;
+}
+
+// Samples in a folded-stack file: the last field of every line
+static unsigned long long folded_samples(const char* path) {
+    FILE* file = fopen(path, "r");
+    if (!file) return 0;
+    unsigned long long total = 0;
+    char line[4096];
+    while (fgets(line, sizeof(line), file)) {
+        const char* count = strrchr(line, ' ');
+        if (count) total += strtoull(count + 1, NULL, 10);
+    }
+    fclose(file);
+    return total;
+}
+
+// The sampled build is timed with the timer off ($SHAYNEFRO_SAMPLE_HZ=0)
+// and on: the difference is what sampling costs, the rest is the shadow
+// stack the wrappers keep. A few percent is below the noise of wall-clock
+// timing, so the limit applies to the handler time the program reports.
+static bool sample_measure(const PgoProgram* program, const char* dir, int runs) {
+    char plain[512], sampled[512], folded[512], log_path[512], command[2048], error[256];
+    snprintf(plain, sizeof(plain), "%s/%s", dir, program->name);
+    snprintf(sampled, sizeof(sampled), "%s/%s-sample", dir, program->name);
+    snprintf(folded, sizeof(folded), "%s/%s.folded", dir, program->name);
+    snprintf(log_path, sizeof(log_path), "%s/%s.log", dir, program->name);
+    
+    ProfileDecisions decisions;
+    NativeVariant variant = { false, NULL, 0 };
+    bool ok = native_program_build(program->source, plain, &variant, &decisions, error, sizeof(error));
+    variant.sample_hz = CODEGEN_SAMPLE_DEFAULT_HZ;
+    ok = ok && native_program_build(program->source, sampled, &variant, &decisions, error, sizeof(error));
+    
+    if (ok) {
+        char stack_only[1024];
+        snprintf(stack_only, sizeof(stack_only), "SHAYNEFRO_SAMPLE_HZ=0 %s", sampled);
+        snprintf(command, sizeof(command), "SHAYNEFRO_SAMPLES=%s %s 2>%s", folded, sampled, log_path);
+        const char* commands[3] = { plain, stack_only, command };
+        double seconds[3];
+        int exit_codes[3];
+        native_programs_time(commands, 3, runs, seconds, exit_codes);
+        double plain_time = seconds[0], stack_time = seconds[1], sampled_time = seconds[2];
+        unsigned long long samples = folded_samples(folded);
+        
+        double stack_cost = plain_time > 0 ? stack_time / plain_time - 1 : 0;
+        double sample_cost = stack_time > 0 ? sampled_time / stack_time - 1 : 0;
+        double handler_share = sampling_handler_share(log_path);
+        ok = exit_codes[0] >= 0 && exit_codes[0] == exit_codes[1] && exit_codes[0] == exit_codes[2] &&
+             samples > 0 && handler_share >= 0 && handler_share <= BENCH_SAMPLE_MAX_OVERHEAD;
+        printf("   %-10s %9.3f ms   stack %+7.1f%%   sampling %+6.2f%%   handler %.3f%%   %llu samples%s\n",
+               program->name, plain_time * 1e3, stack_cost * 100, sample_cost * 100, handler_share * 100,
+               samples, ok ? "" : "   [FAILED]");
+    } else {
+        printf("   %-10s failed: %s\n", program->name, error);
+    }
+    
+    unlink(plain);
+    unlink(sampled);
+    unlink(folded);
+    unlink(log_path);
+    return ok;
+}
+
+int bench_run_sampling(int runs) {
+    const int count = (int)(sizeof(pgo_programs) / sizeof(pgo_programs[0]));
+    printf(">> SAMPLING OVERHEAD (%s, %d Hz, best of %d):\n",
+           cc_profile_flags(CC_PROFILE_RELEASE), CODEGEN_SAMPLE_DEFAULT_HZ, runs);
+    
+    char dir[] = BENCH_NATIVE_DIR_TEMPLATE;
+    if (!mkdtemp(dir)) {
+        printf("[ERROR] Cannot create %s\n", BENCH_NATIVE_DIR_TEMPLATE);
+        return count;
+    }
+    int failures = 0;
+    for (int i = 0; i < count; i++) {
+        failures += !sample_measure(&pgo_programs[i], dir, runs);
+    }
+    rmdir(dir);
+    return failures;
+}
+
+// ================== BATCH THROUGHPUT ==================
+
+typedef struct {
+    char** paths;
+    int count;
+} BatchCorpus;
+
+// Writes count files of about size bytes each into dir as <prefix>N.shay
+static bool batch_corpus_write(BatchCorpus* corpus, const char* dir, const char* prefix,
+                               int count, size_t size, uint64_t seed) {
+    BenchConfig config;
+    bench_default_config(&config);
+    OutputBuffer source;
+    if (!outbuf_init(&source, -1)) return false;
+    
+    char** paths = realloc(corpus->paths, sizeof(char*) * (size_t)(corpus->count + count));
+    if (!paths) {
+        outbuf_free(&source);
+        return false;
+    }
+    corpus->paths = paths;
+    
+    bool ok = true;
+    for (int i = 0; i < count && ok; i++) {
+        char path[512];
+        snprintf(path, sizeof(path), "%s/%s%d.shay", dir, prefix, i);
+        outbuf_clear(&source);
+        bench_generate_corpus(&source, size, &config.mix, seed + (uint64_t)i);
+        FILE* file = fopen(path, "wb");
+        ok = !source.had_error && file &&
+             fwrite(source.data, 1, source.length, file) == source.length;
+        if (file) ok = fclose(file) == 0 && ok;
+        char* copy = malloc(strlen(path) + 1);
+        if (copy) {
+            strcpy(copy, path);
+            corpus->paths[corpus->count++] = copy;
+        }
+        ok = ok && copy;
+    }
+    outbuf_free(&source);
+    return ok;
+}
+
+static void batch_corpus_remove(BatchCorpus* corpus) {
+    for (int i = 0; i < corpus->count; i++) {
+        char output[512];
+        batch_output_path(corpus->paths[i], output, sizeof(output));
+        unlink(output);
+        unlink(corpus->paths[i]);
+        free(corpus->paths[i]);
+    }
+    free(corpus->paths);
+    corpus->paths = NULL;
+    corpus->count = 0;
+}
+
+// Compiles the corpus on `threads` threads; files per second, or -1 if a
+// file failed
+static double batch_measure(const BatchCorpus* corpus, const char* name, int threads, double baseline) {
+    BatchReport report;
+    batch_init(&report);
+    bool ok = true;
+    for (int i = 0; i < corpus->count && ok; i++) {
+        ok = batch_add(&report, corpus->paths[i]);
+    }
+    ShayOptions options = shaynefro_default_options();
+    ok = ok && batch_run(&report, threads, &options);
+    
+    double rate = report.wall_time > 0 ? report.file_count / report.wall_time : 0;
+    double input_rate = report.wall_time > 0 ? report.input_bytes / report.wall_time / (1 << 20) : 0;
+    printf("   %-6s %5d files %7.1f MB   %2d thread%s %10.0f files/s %8.1f MB/s",
+           name, report.file_count, report.input_bytes / (double)(1 << 20),
+           threads, threads == 1 ? " " : "s", rate, input_rate);
+    if (baseline > 0) printf("   %5.2fx   %d stolen", rate / baseline, report.steals);
+    printf("%s\n", ok ? "" : "   [FAILED]");
+    if (!ok) batch_print_diagnostics(&report, stdout);
+    batch_free(&report);
+    return ok ? rate : -1;
+}
+
+// One thread first, so the speedup has a baseline
+static int batch_workload(const BatchCorpus* corpus, const char* name, int threads) {
+    double baseline = batch_measure(corpus, name, 1, 0);
+    if (threads == 1) return baseline < 0;
+    return (baseline < 0) + (batch_measure(corpus, name, threads, baseline) < 0);
+}
+
+int bench_run_batch(int threads) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    printf(">> BATCH THROUGHPUT (%d threads, %ld core%s online):\n", threads, cores, cores == 1 ? "" : "s");
+    
+    char dir[] = BENCH_BATCH_DIR_TEMPLATE;
+    if (!mkdtemp(dir)) {
+        printf("[ERROR] Cannot create %s\n", BENCH_BATCH_DIR_TEMPLATE);
+        return 1;
+    }
+    
+    int failures = 0;
+    BatchCorpus corpus = { NULL, 0 };
+    if (batch_corpus_write(&corpus, dir, "small", BENCH_BATCH_SMALL_FILES, BENCH_BATCH_SMALL_SIZE, 1)) {
+        failures += batch_workload(&corpus, "small", threads);
+    } else {
+        printf("[ERROR] Cannot write the small files to %s\n", dir);
+        failures++;
+    }
+    batch_corpus_remove(&corpus);
+    
+    if (batch_corpus_write(&corpus, dir, "mix", BENCH_BATCH_MIX_SMALL, BENCH_BATCH_SMALL_SIZE, 1) &&
+        batch_corpus_write(&corpus, dir, "huge", BENCH_BATCH_MIX_HUGE, BENCH_BATCH_HUGE_SIZE, 1)) {
+        failures += batch_workload(&corpus, "mixed", threads);
+    } else {
+        printf("[ERROR] Cannot write the mixed files to %s\n", dir);
+        failures++;
+    }
+    batch_corpus_remove(&corpus);
+    
+    rmdir(dir);
+    return failures;
+}
+
+// ================== COMPILE SERVER LATENCY ==================
+
+typedef struct {
+    const char* socket_path;
+    OutputBuffer* programs;
+    int requests;
+    int index;
+    double* latencies;          // This client's slice, one per request
+    int failures;
+    pthread_t thread;
+    bool started;
+} BenchClient;
+
+static void* bench_client_main(void* arg) {
+    BenchClient* bench_client = arg;
+    ShayOptions options = shaynefro_default_options();
+    options.filename = "bench.shay";
+    OutputBuffer output;
+    if (!outbuf_init(&output, -1)) {
+        bench_client->failures = bench_client->requests;
+        return NULL;
+    }
+    for (int i = 0; i < bench_client->requests; i++) {
+        const OutputBuffer* program =
+            &bench_client->programs[(bench_client->index + i) % BENCH_SERVER_PROGRAMS];
+        ServerClient client;
+        bool compiled = false;
+        outbuf_clear(&output);
+        double start = timer_now();
+        bool answered = server_client_connect(&client, bench_client->socket_path) &&
+                        server_client_compile(&client, program->data, program->length, &options,
+                                              &output, &compiled);
+        server_client_close(&client);
+        bench_client->latencies[i] = timer_now() - start;
+        bench_client->failures += !(answered && compiled);
+    }
+    outbuf_free(&output);
+    return NULL;
+}
+
+// Median of runs of command, run through the shell
+static double process_median(const char* command, int runs, int* failures) {
+    double* seconds = malloc(sizeof(double) * (size_t)runs);
+    if (!seconds) return 0;
+    for (int i = 0; i < runs; i++) {
+        double start = timer_now();
+        int status = system(command);
+        seconds[i] = timer_now() - start;
+        *failures += !(status != -1 && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    }
+    qsort(seconds, (size_t)runs, sizeof(double), compare_doubles);
+    double median = seconds[runs / 2];
+    free(seconds);
+    return median;
+}
+
+// -f and --client, each as a fresh process; the shell is included in both
+static int server_process_compare(const char* dir, const char* socket_path, const OutputBuffer* program) {
+    char executable[512], source[600], command[2048];
+    ssize_t length = readlink("/proc/self/exe", executable, sizeof(executable) - 1);
+    if (length <= 0) {
+        printf("   Per process: skipped, cannot find this executable\n");
+        return 0;
+    }
+    executable[length] = '\0';
+    snprintf(source, sizeof(source), "%s/program.shay", dir);
+    FILE* file = fopen(source, "wb");
+    bool written = file && fwrite(program->data, 1, program->length, file) == program->length;
+    if (file) written = fclose(file) == 0 && written;
+    if (!written) {
+        printf("   Per process: cannot write %s\n", source);
+        return 1;
+    }
+    
+    int failures = 0;
+    snprintf(command, sizeof(command), "cd '%s' && '%s' -f program.shay >/dev/null", dir, executable);
+    double cold = process_median(command, BENCH_SERVER_PROCESS_RUNS, &failures);
+    snprintf(command, sizeof(command), "cd '%s' && '%s' --client program.shay --socket='%s' >/dev/null",
+             dir, executable, socket_path);
+    double warm = process_median(command, BENCH_SERVER_PROCESS_RUNS, &failures);
+    printf("   Per process (median of %d, shell included): -f %.3f ms, --client %.3f ms (%.2fx)\n",
+           BENCH_SERVER_PROCESS_RUNS, cold * 1e3, warm * 1e3, warm > 0 ? cold / warm : 0);
+    
+    char path[700];
+    snprintf(path, sizeof(path), "%s/output.c", dir);
+    unlink(path);
+    unlink(source);
+    return failures;
+}
+
+int bench_run_server(int clients, int requests, int threads) {
+    printf(">> COMPILE SERVER (%d clients x %d requests, %d server threads, %d-byte programs):\n",
+           clients, requests, threads, BENCH_SERVER_PROGRAM_SIZE);
+    int total = clients * requests;
+    
+    char dir[] = BENCH_SERVER_DIR_TEMPLATE;
+    if (!mkdtemp(dir)) {
+        printf("[ERROR] Cannot create %s\n", BENCH_SERVER_DIR_TEMPLATE);
+        return total;
+    }
+    char socket_path[108];
+    snprintf(socket_path, sizeof(socket_path), "%s/server.sock", dir);
+    
+    BenchConfig config;
+    bench_default_config(&config);
+    OutputBuffer programs[BENCH_SERVER_PROGRAMS];
+    bool ready = true;
+    for (int i = 0; i < BENCH_SERVER_PROGRAMS; i++) {
+        ready = outbuf_init(&programs[i], -1) && ready;
+        bench_generate_corpus(&programs[i], BENCH_SERVER_PROGRAM_SIZE, &config.mix, (uint64_t)i + 1);
+        ready = ready && !programs[i].had_error;
+    }
+    double* latencies = malloc(sizeof(double) * (size_t)total);
+    BenchClient* bench_clients = calloc((size_t)clients, sizeof(BenchClient));
+    
+    CompileServer server;
+    int failures = total;
+    if (!ready || !latencies || !bench_clients) {
+        printf("[ERROR] Out of memory\n");
+    } else if (!server_start(&server, socket_path, threads, NULL)) {
+        printf("[ERROR] %s\n", server.error_message);
+    } else {
+        double start = timer_now();
+        for (int c = 0; c < clients; c++) {
+            BenchClient* bench_client = &bench_clients[c];
+            bench_client->socket_path = socket_path;
+            bench_client->programs = programs;
+            bench_client->requests = requests;
+            bench_client->index = c;
+            bench_client->latencies = latencies + (size_t)c * (size_t)requests;
+            bench_client->started = pthread_create(&bench_client->thread, NULL, bench_client_main, bench_client) == 0;
+        }
+        failures = 0;
+        for (int c = 0; c < clients; c++) {
+            if (bench_clients[c].started) {
+                pthread_join(bench_clients[c].thread, NULL);
+                failures += bench_clients[c].failures;
+            } else {
+                failures += requests;
+            }
+        }
+        double wall = timer_now() - start;
+        
+        qsort(latencies, (size_t)total, sizeof(double), compare_doubles);
+        printf("   Client latency: p50 %.3f ms, p99 %.3f ms, max %.3f ms; %.0f requests/s\n",
+               latencies[(50 * total + 99) / 100 - 1] * 1e3, latencies[(99 * total + 99) / 100 - 1] * 1e3,
+               latencies[total - 1] * 1e3, total / wall);
+        failures += server_process_compare(dir, socket_path, &programs[0]);
+        
+        server_stop(&server);
+        server_print(&server, stdout);
+        server_free(&server);
+    }
+    
+    for (int i = 0; i < BENCH_SERVER_PROGRAMS; i++) outbuf_free(&programs[i]);
+    free(latencies);
+    free(bench_clients);
+    rmdir(dir);
+    return failures;
+}
+
+// ================== WATCH REBUILDS ==================
+
+// The program with its last function returning a + edit, saved in place
+// or through a temporary file renamed over it
+static bool watch_save(const OutputBuffer* program, const char* path, int edit, bool rename_over) {
+    char temp_path[600];
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+    const char* target = rename_over ? temp_path : path;
+    FILE* file = fopen(target, "wb");
+    if (!file) return false;
+    bool ok = fwrite(program->data, 1, program->length, file) == program->length &&
+              fprintf(file, "function watch_edit(int a) {\n    return a + %d;\n}\n", edit) > 0;
+    ok = fclose(file) == 0 && ok;
+    return ok && (!rename_over || rename(temp_path, path) == 0);
+}
+
+int bench_run_watch(int edits) {
+    printf(">> WATCH REBUILDS (%d KB program, %d edits, debounce %d ms):\n",
+           BENCH_WATCH_PROGRAM_SIZE >> 10, edits, WATCH_DEFAULT_DEBOUNCE_MS);
+    char dir[] = BENCH_WATCH_DIR_TEMPLATE;
+    if (!mkdtemp(dir)) {
+        printf("[ERROR] Cannot create %s\n", BENCH_WATCH_DIR_TEMPLATE);
+        return edits;
+    }
+    char path[512], output[512], manifest[600];
+    snprintf(path, sizeof(path), "%s/program.shay", dir);
+    batch_output_path(path, output, sizeof(output));
+    snprintf(manifest, sizeof(manifest), "%s.manifest", output);
+    
+    BenchConfig config;
+    bench_default_config(&config);
+    OutputBuffer program;
+    double* rebuild_times = malloc(sizeof(double) * (size_t)edits);
+    double* save_times = malloc(sizeof(double) * (size_t)edits);
+    FILE* quiet = fopen("/dev/null", "w");
+    Watcher watcher;
+    bool ready = outbuf_init(&program, -1);
+    if (ready) bench_generate_corpus(&program, BENCH_WATCH_PROGRAM_SIZE, &config.mix, config.seed);
+    ready = ready && !program.had_error && rebuild_times && save_times && quiet &&
+            watch_save(&program, path, 0, false) &&
+            watch_init(&watcher, 0, WATCH_DEFAULT_DEBOUNCE_MS);
+    if (ready && (!watch_add(&watcher, path) || !watch_build_all(&watcher, quiet))) {
+        printf("[ERROR] %s\n", watcher.error_message[0] ? watcher.error_message : "First build failed");
+        watch_free(&watcher);
+        ready = false;
+    }
+    
+    int failures = edits;
+    if (ready) {
+        failures = 0;
+        int regenerated = 0, units = 0;
+        for (int e = 0; e < edits; e++) {
+            int rebuilds = watcher.rebuilds;
+            double start = timer_now();
+            bool saved = watch_save(&program, path, e + 1, e % 2 == 1);
+            int rebuilt = saved ? watch_poll(&watcher, 1000, quiet) : 0;
+            save_times[e] = timer_now() - start;
+            bool ok = rebuilt == 1 && watcher.rebuilds == rebuilds + 1 && watcher.failures == 0;
+            rebuild_times[e] = ok ? watcher.latencies[rebuilds % WATCH_LATENCY_WINDOW] : 0;
+            regenerated += watcher.last.regenerated;
+            units = watcher.last.units;
+            failures += !ok;
+        }
+        
+        qsort(rebuild_times, (size_t)edits, sizeof(double), compare_doubles);
+        qsort(save_times, (size_t)edits, sizeof(double), compare_doubles);
+        double median = rebuild_times[edits / 2];
+        bool fast = median < BENCH_WATCH_TARGET;
+        printf("   Rebuild: p50 %.2f ms, p99 %.2f ms, max %.2f ms%s\n", median * 1e3,
+               rebuild_times[(99 * edits + 99) / 100 - 1] * 1e3, rebuild_times[edits - 1] * 1e3,
+               fast ? "" : "   [OVER TARGET]");
+        printf("   Save to rebuilt (write, events, debounce, rebuild): p50 %.2f ms, max %.2f ms\n",
+               save_times[edits / 2] * 1e3, save_times[edits - 1] * 1e3);
+        printf("   Units regenerated per edit: %.1f of %d\n", (double)regenerated / edits, units);
+        failures += !fast;
+        watch_free(&watcher);
+    }
+    
+    if (quiet) fclose(quiet);
+    outbuf_free(&program);
+    free(rebuild_times);
+    free(save_times);
+    unlink(path);
+    unlink(output);
+    unlink(manifest);
+    rmdir(dir);
+    return failures;
+}
+
+// ================== PIPELINED COMPILE ==================
+
+// One in-memory compile into out; false if it failed
+static bool pipeline_measure(const OutputBuffer* source, bool pipelined, OutputBuffer* out,
+                             double* seconds, PipelineStats* stats) {
+    outbuf_clear(out);
+    double start = timer_now();
+    Lexer* lexer = lexer_create_with_length(source->data, source->length, "bench-pipeline");
+    Parser* parser = lexer ? parser_create(lexer) : NULL;
+    CodeGenerator* codegen = codegen_create_in_memory(out, OUTPUT_C);
+    bool compiled = parser && codegen;
+    if (compiled && pipelined) {
+        CodegenStream stream;
+        compiled = codegen_stream_begin(codegen, &stream);
+        if (compiled) {
+            ASTNode* ast = pipeline_parse(parser, codegen, &stream, stats);
+            compiled = ast && !parser_has_error(parser) && codegen_stream_finish(codegen, &stream, ast);
+            codegen_stream_free(&stream);
+        }
+    } else if (compiled) {
+        ASTNode* ast = parser_parse(parser);
+        compiled = ast && !parser_has_error(parser) && codegen_generate(codegen, ast);
+    }
+    *seconds = timer_now() - start;
+    codegen_destroy(codegen);
+    parser_destroy(parser);
+    lexer_destroy(lexer);
+    return compiled && !out->had_error;
+}
+
+int bench_run_pipeline(size_t size, int runs) {
+    char size_name[32];
+    bench_format_size(size, size_name, sizeof(size_name));
+    printf(">> PIPELINED COMPILE (%s generated program, best of %d):\n", size_name, runs);
+    
+    BenchConfig config;
+    bench_default_config(&config);
+    OutputBuffer source, sequential, pipelined;
+    bool ready = outbuf_init(&source, -1) && outbuf_init(&sequential, -1) && outbuf_init(&pipelined, -1);
+    if (ready) bench_generate_corpus(&source, size, &config.mix, config.seed);
+    if (!ready || source.had_error) {
+        printf("[ERROR] Out of memory\n");
+        outbuf_free(&source);
+        outbuf_free(&sequential);
+        outbuf_free(&pipelined);
+        return 1;
+    }
+    
+    // Alternating, so drift in the machine's speed hits both alike
+    double best_sequential = 0, best_pipelined = 0;
+    PipelineStats stats;
+    int failures = 0;
+    for (int r = 0; r < runs && failures == 0; r++) {
+        double seconds;
+        if (!pipeline_measure(&source, false, &sequential, &seconds, NULL)) failures++;
+        if (r == 0 || seconds < best_sequential) best_sequential = seconds;
+        if (!pipeline_measure(&source, true, &pipelined, &seconds, &stats)) failures++;
+        if (r == 0 || seconds < best_pipelined) best_pipelined = seconds;
+    }
+    if (failures > 0) {
+        printf("[ERROR] Generated program failed to compile\n");
+    } else if (sequential.length != pipelined.length ||
+               memcmp(sequential.data, pipelined.data, sequential.length) != 0) {
+        printf("[ERROR] Pipelined output differs from sequential output\n");
+        failures++;
+    } else {
+        printf("   Sequential: %.4f seconds (%.1f MB/s)\n", best_sequential, source.length / best_sequential / 1e6);
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        printf("   Pipelined:  %.4f seconds (%.1f MB/s), %.2fx on %ld CPU%s\n", best_pipelined,
+               source.length / best_pipelined / 1e6, best_sequential / best_pipelined, cpus, cpus == 1 ? "" : "s");
+        printf("   Output: %zu bytes, identical\n", pipelined.length);
+        printf("   Stalls in the last run: lexer %llu, parser %llu, codegen %llu\n",
+               (unsigned long long)stats.lexer_waits, (unsigned long long)stats.parser_waits,
+               (unsigned long long)stats.codegen_waits);
+    }
+    
+    outbuf_free(&source);
+    outbuf_free(&sequential);
+    outbuf_free(&pipelined);
+    return failures;
+}
+
+// ================== STREAMING MEMORY ==================
+
+typedef struct {
+    bool compiled;
+    double seconds;
+    size_t peak_rss;
+} StreamRun;
+
+// The normal path as -f takes it: the file read whole, a full syntax tree
+static bool stream_full_compile(const char* source_path, const char* output_path) {
+    FILE* file = fopen(source_path, "rb");
+    if (!file) return false;
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char* source = size >= 0 ? malloc((size_t)size + 1) : NULL;
+    bool compiled = source && fread(source, 1, (size_t)size, file) == (size_t)size;
+    fclose(file);
+    if (!compiled) {
+        free(source);
+        return false;
+    }
+    
+    Lexer* lexer = lexer_create_with_length(source, (size_t)size, source_path);
+    Parser* parser = lexer ? parser_create(lexer) : NULL;
+    CodeGenerator* codegen = parser ? codegen_create(output_path, OUTPUT_C) : NULL;
+    compiled = codegen != NULL;
+    if (compiled) {
+        ASTNode* ast = parser_parse(parser);
+        compiled = ast && !parser_has_error(parser) && codegen_generate(codegen, ast);
+    }
+    codegen_destroy(codegen);
+    parser_destroy(parser);
+    lexer_destroy(lexer);
+    free(source);
+    return compiled;
+}
+
+// In a child process, so each peak RSS is the compile's own
+static StreamRun stream_measure(const char* source_path, const char* output_path, bool streaming) {
+    StreamRun run = { false, 0, 0 };
+    int fds[2];
+    if (pipe(fds) != 0) return run;
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(fds[0]);
+        double start = timer_now();
+        if (streaming) {
+            CodeGenerator* codegen = codegen_create_in_memory(NULL, OUTPUT_C);
+            StreamingResult result;
+            run.compiled = codegen && streaming_compile(source_path, output_path, codegen, &result);
+            codegen_destroy(codegen);
+        } else {
+            run.compiled = stream_full_compile(source_path, output_path);
+        }
+        run.seconds = timer_now() - start;
+        run.peak_rss = memory_peak_rss();
+        ssize_t written = write(fds[1], &run, sizeof(run));
+        _exit(written == (ssize_t)sizeof(run) ? 0 : 1);
+    }
+    close(fds[1]);
+    if (pid > 0) {
+        if (read(fds[0], &run, sizeof(run)) != (ssize_t)sizeof(run)) run.compiled = false;
+        int status;
+        waitpid(pid, &status, 0);
+    }
+    close(fds[0]);
+    return run;
+}
+
+static bool stream_same_files(const char* a, const char* b) {
+    FILE* x = fopen(a, "rb");
+    FILE* y = fopen(b, "rb");
+    bool same = x && y;
+    static char left[65536], right[65536];
+    while (same) {
+        size_t got = fread(left, 1, sizeof(left), x);
+        same = fread(right, 1, sizeof(right), y) == got && memcmp(left, right, got) == 0;
+        if (got == 0) break;
+    }
+    if (x) fclose(x);
+    if (y) fclose(y);
+    return same;
+}
+
+int bench_run_stream(const size_t* sizes, int size_count) {
+    printf(">> STREAMING MEMORY (peak RSS per compile, each in its own process):\n");
+    char dir[] = BENCH_STREAM_DIR_TEMPLATE;
+    if (!mkdtemp(dir)) {
+        printf("[ERROR] Cannot create %s\n", BENCH_STREAM_DIR_TEMPLATE);
+        return 1;
+    }
+    char source_path[512], full_path[512], stream_path[512];
+    snprintf(source_path, sizeof(source_path), "%s/program.shay", dir);
+    snprintf(full_path, sizeof(full_path), "%s/full.c", dir);
+    snprintf(stream_path, sizeof(stream_path), "%s/stream.c", dir);
+    
+    BenchConfig config;
+    bench_default_config(&config);
+    int failures = 0;
+    for (int i = 0; i < size_count; i++) {
+        char size_name[32];
+        bench_format_size(sizes[i], size_name, sizeof(size_name));
+        
+        // Written through a file-backed buffer, so this process stays small too
+        OutputBuffer program;
+        FILE* file = fopen(source_path, "wb");
+        bool written = file && outbuf_init(&program, fileno(file));
+        if (written) {
+            bench_generate_corpus(&program, sizes[i], &config.mix, config.seed);
+            written = outbuf_flush(&program);
+            outbuf_free(&program);
+        }
+        if (file) written = fclose(file) == 0 && written;
+        if (!written) {
+            printf("[ERROR] Cannot write %s\n", source_path);
+            failures++;
+            continue;
+        }
+        
+        StreamRun stream = stream_measure(source_path, stream_path, true);
+        if (!stream.compiled) {
+            printf("   %-6s streaming compile failed\n", size_name);
+            failures++;
+            continue;
+        }
+        bool bounded = stream.peak_rss <= BENCH_STREAM_MAX_RSS;
+        printf("   %-6s --stream: %.2f s, peak RSS %.1f MB%s\n", size_name, stream.seconds,
+               stream.peak_rss / 1e6, bounded ? "" : "   [OVER LIMIT]");
+        failures += !bounded;
+        
+        if (sizes[i] > BENCH_STREAM_FULL_MAX) {
+            printf("          full tree: skipped, needs far more memory than this size allows\n");
+            continue;
+        }
+        StreamRun full = stream_measure(source_path, full_path, false);
+        bool same = full.compiled && stream_same_files(full_path, stream_path);
+        printf("          full tree: %.2f s, peak RSS %.1f MB (%.1fx), output %s\n", full.seconds,
+               full.peak_rss / 1e6, stream.peak_rss ? (double)full.peak_rss / stream.peak_rss : 0,
+               !full.compiled ? "missing" : same ? "identical" : "DIFFERENT");
+        failures += !same;
+    }
+    
+    unlink(source_path);
+    unlink(full_path);
+    unlink(stream_path);
+    rmdir(dir);
+    return failures;
+}
@@ -0,0 +1,263 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include "outbuf.h"
+#include "counters.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// ================== BENCHMARK SUITE ==================
+//
+// Times each compiler phase on synthetic programs of several sizes. The
+// corpus generator is deterministic for a given size, mix and seed, so
+// two builds of the compiler see byte-identical input. Every benchmark
+// runs warmup iterations first, then a number of timed samples; a sample
+// repeats the phase enough times to last BENCH_MIN_SAMPLE_SECONDS so
+// small inputs are not lost in timer resolution. Times are per pass of
+// the phase over the whole corpus.
+
+#define BENCH_MAX_SIZES 16
+#define BENCH_MIN_SAMPLE_SECONDS 0.005
+
+// What the generated function bodies are made of
+typedef enum {
+    BENCH_MIX_ARITH,        // Integer declarations with arithmetic
+    BENCH_MIX_CALLS,        // Calls to earlier functions
+    BENCH_MIX_CONTROL,      // if/else, for and while
+    BENCH_MIX_STRINGS,      // String literals
+    BENCH_MIX_FLOATS,       // Float literals and arithmetic
+    BENCH_MIX_COMMENTS,     // Line and block comments
+    BENCH_MIX_KINDS
+} BenchMixKind;
+
+typedef struct {
+    int weights[BENCH_MIX_KINDS];   // Relative, need not sum to 100
+} BenchMix;
+
+typedef enum {
+    BENCH_PHASE_LEX,        // Lexer alone, token by token
+    BENCH_PHASE_PARSE,      // Parser, including the lexing it drives
+    BENCH_PHASE_CODEGEN,    // C generation from an existing AST
+    BENCH_PHASE_END_TO_END, // shaynefro_compile into memory
+    BENCH_PHASE_COUNT
+} BenchPhase;
+
+typedef struct {
+    size_t sizes[BENCH_MAX_SIZES];  // Target corpus sizes in bytes
+    int size_count;
+    int warmup;             // Untimed passes before sampling
+    int runs;               // Timed samples per benchmark
+    unsigned phases;        // Bit (1 << BenchPhase) per phase to run
+    BenchMix mix;
+    uint64_t seed;
+} BenchConfig;
+
+typedef struct {
+    char name[48];          // "<phase>/<size>", e.g. "parse/1M"
+    BenchPhase phase;
+    size_t source_bytes;    // Actual corpus size
+    size_t tokens;
+    int ast_nodes;
+    size_t output_bytes;
+    int iterations;         // Passes per sample
+    double* samples;        // Seconds per pass, in run order
+    int sample_count;
+    double min, median, p95, mean;
+    CounterSample counters; // Per pass, averaged over every timed pass
+} BenchResult;
+
+typedef struct {
+    BenchConfig config;
+    BenchResult* results;
+    int count;
+    int capacity;
+    char counters_status[256];  // Why hardware counters are missing, empty if present
+    char error_message[256];
+} BenchReport;
+
+// Defaults: 1K, 64K, 1M and 16M, 2 warmup passes, 15 runs, every phase
+void bench_default_config(BenchConfig* config);
+
+// "arith=30,calls=15,..." - kinds not named keep their current weight
+bool bench_mix_parse(BenchMix* mix, const char* spec);
+
+// "1K,64K,1M,1G" (powers of 1024) or plain byte counts
+bool bench_sizes_parse(BenchConfig* config, const char* spec);
+
+// "lex,parse,codegen,e2e"
+bool bench_phases_parse(BenchConfig* config, const char* spec);
+
+// Appends a program of about target_bytes (never less than one function)
+void bench_generate_corpus(OutputBuffer* out, size_t target_bytes, const BenchMix* mix, uint64_t seed);
+
+// "1K", "16M" or the plain number
+void bench_format_size(size_t bytes, char* buffer, size_t size);
+const char* bench_phase_name(BenchPhase phase);
+
+// Runs the suite, printing progress; false (with error_message) if a
+// corpus fails to compile or memory runs out
+bool bench_run(const BenchConfig* config, BenchReport* report);
+void bench_print(const BenchReport* report);
+
+// path "-" writes to stdout
+bool bench_write_json(const BenchReport* report, const char* path);
+
+// Loads a file written by bench_write_json; statistics are recomputed
+// from the samples
+bool bench_read_json(const char* path, BenchReport* report);
+
+// ================== REGRESSION CHECK ==================
+//
+// A benchmark regresses when its median grew by more than the threshold
+// and a two-sided Mann-Whitney U test on the raw samples puts the change
+// below the significance level. The test is rank-based, so an outlier
+// sample from a busy machine cannot produce or hide a regression by
+// itself, and it makes no normality assumption about timings.
+
+#define BENCH_DEFAULT_THRESHOLD_PERCENT 5.0
+#define BENCH_DEFAULT_ALPHA 0.01
+
+// Two-sided p-value that a and b come from the same distribution
+double bench_mann_whitney(const double* a, int n, const double* b, int m);
+
+// Prints a delta per benchmark and returns the number of regressions
+int bench_compare(const BenchReport* baseline, const BenchReport* current,
+                  double threshold_percent, double alpha);
+
+void bench_report_free(BenchReport* report);
+
+// ================== PATHOLOGICAL INPUTS ==================
+//
+// One worst case per stage: a single enormous identifier, deeply nested
+// parentheses, a very long + chain, a huge string literal, a file of
+// nothing but comments and a stream of keywords. Each case is compiled at
+// a quarter of its size and at full size, and both time and peak memory
+// must grow by less than BENCH_PATHOLOGICAL_MAX_RATIO: linear work grows
+// 4x, quadratic 16x. Nesting past PARSER_MAX_DEPTH must be rejected with
+// an error, not crash.
+//
+// The chain is the one case whose memory is large by design: each term
+// is four source bytes and two 80-byte AST nodes, and the parser arena
+// holds them in doubling blocks, so it peaks at about 190 bytes per term
+// (17 MB at 64K, 192 MB at the default 1M).
+
+#define BENCH_PATHOLOGICAL_MAX_RATIO 8.0
+#define BENCH_PATHOLOGICAL_DEFAULT_SIZE (1 << 20)
+
+typedef enum {
+    BENCH_PATHOLOGY_IDENTIFIER, // One identifier of n characters
+    BENCH_PATHOLOGY_NESTING,    // n nested parentheses
+    BENCH_PATHOLOGY_CHAIN,      // 1 + 1 + ... with n terms
+    BENCH_PATHOLOGY_STRING,     // One string literal of n bytes
+    BENCH_PATHOLOGY_COMMENTS,   // n bytes of line and block comments
+    BENCH_PATHOLOGY_KEYWORDS,   // n keywords, lexed only
+    BENCH_PATHOLOGY_COUNT
+} BenchPathology;
+
+const char* bench_pathology_name(BenchPathology kind);
+
+// Appends the case's program at size n
+void bench_generate_pathological(OutputBuffer* out, BenchPathology kind, size_t n);
+
+// Runs every case at size / 4 and size, best of `runs`, printing a line
+// per case; returns the number of cases that failed or scaled badly
+int bench_run_pathological(size_t size, int runs);
+
+// ================== NATIVE BUILDS ==================
+//
+// Each built-in program (recursive fibonacci, trial-division primes) is
+// built with the C compiler three times: plain, with --profile, and with
+// --profile-use on what the profiled executable wrote when run. Plain and
+// profile-guided executables are timed, best of `runs`, and must exit
+// with the same status. Needs a C compiler (see driver.h).
+
+#define BENCH_NATIVE_DIR_TEMPLATE "/tmp/shaynefro-native-XXXXXX"
+
+// Prints a line per program; returns the number that failed to build, run
+// or agree
+int bench_run_pgo(int runs);
+
+// The same programs built plain and with --sample, timed best of `runs`
+// with the sampling timer off and at the default rate. Sampled runs must
+// write samples, and their signal handler may take at most
+// BENCH_SAMPLE_MAX_OVERHEAD of the CPU time. Returns the number of
+// programs that failed.
+#define BENCH_SAMPLE_MAX_OVERHEAD 0.02
+int bench_run_sampling(int runs);
+
+// ================== BATCH THROUGHPUT ==================
+//
+// Files per second of -j batch compilation on two workloads written to a
+// temporary directory: BENCH_BATCH_SMALL_FILES small files, and
+// BENCH_BATCH_MIX_SMALL small files with BENCH_BATCH_MIX_HUGE huge ones
+// among them, where the schedule decides how long the last thread runs.
+// Each is compiled on one thread and on `threads`.
+
+#define BENCH_BATCH_DIR_TEMPLATE "/tmp/shaynefro-batch-XXXXXX"
+#define BENCH_BATCH_SMALL_FILES 10000
+#define BENCH_BATCH_SMALL_SIZE (2 << 10)
+#define BENCH_BATCH_MIX_SMALL 200
+#define BENCH_BATCH_MIX_HUGE 4
+#define BENCH_BATCH_HUGE_SIZE (8 << 20)
+
+// Prints a line per workload and thread count; returns the number of
+// batches with a file that failed to compile
+int bench_run_batch(int threads);
+
+// ================== COMPILE SERVER LATENCY ==================
+//
+// Starts a compile server on a temporary socket and has `clients` threads
+// send `requests` small programs each, one connection per request as the
+// command-line client makes. Prints p50/p99 latency as clients see it and
+// as the server measures it, then the same compile run as separate
+// processes: `-f` against `--client` on the running server.
+
+#define BENCH_SERVER_DIR_TEMPLATE "/tmp/shaynefro-server-XXXXXX"
+#define BENCH_SERVER_PROGRAMS 64
+#define BENCH_SERVER_PROGRAM_SIZE (1 << 10)
+#define BENCH_SERVER_PROCESS_RUNS 50
+
+// Returns the number of requests that failed
+int bench_run_server(int clients, int requests, int threads);
+
+// ================== WATCH REBUILDS ==================
+//
+// A generated program of BENCH_WATCH_PROGRAM_SIZE bytes is watched while
+// one of its functions is edited `edits` times, saved alternately in
+// place and by renaming a new file over it. Every save must be rebuilt,
+// and the median rebuild must take under BENCH_WATCH_TARGET seconds.
+
+#define BENCH_WATCH_DIR_TEMPLATE "/tmp/shaynefro-watch-XXXXXX"
+#define BENCH_WATCH_PROGRAM_SIZE (64 << 10)
+#define BENCH_WATCH_TARGET 0.010
+
+// Returns the number of failed checks: edits not rebuilt, plus one for a
+// median over the target
+int bench_run_watch(int edits);
+
+// ================== PIPELINED COMPILE ==================
+//
+// A generated program of `size` bytes compiled in memory sequentially and
+// with --pipeline's three threads, alternately, best of `runs`. The two
+// outputs must be byte-identical.
+#define BENCH_PIPELINE_DEFAULT_SIZE (16 << 20)
+
+// Returns the number of failed checks
+int bench_run_pipeline(size_t size, int runs);
+
+// ================== STREAMING MEMORY ==================
+//
+// Generated programs of each size are written to a temporary file and
+// compiled with --stream, each in a child process so that its peak RSS is
+// its own; the peak must stay under BENCH_STREAM_MAX_RSS at any size. Up
+// to BENCH_STREAM_FULL_MAX bytes the file is also compiled the normal
+// way, for comparison, and the two outputs must be identical.
+#define BENCH_STREAM_DIR_TEMPLATE "/tmp/shaynefro-stream-XXXXXX"
+#define BENCH_STREAM_MAX_RSS (64u << 20)
+#define BENCH_STREAM_FULL_MAX (64u << 20)
+
+// Returns the number of failed checks
+int bench_run_stream(const size_t* sizes, int size_count);
+
+#endif
@@ -0,0 +1,478 @@
+#define _POSIX_C_SOURCE 200809L
+#include "cache.h"
+#include "hash.h"
+#include "shaynefro.h"
+#include "timer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#define CACHE_MAGIC "SHAYCCH1"
+
+// Fixed-size header in front of every payload
+typedef struct {
+    char magic[8];
+    uint64_t key;
+    uint64_t payload_size;
+    uint64_t payload_hash;  // Catches truncated or corrupted entries
+} CacheEntryHeader;
+
+// ================== DIRECTORY AND FILE HELPERS ==================
+
+static void cache_error(CompileCache* cache, const char* what, const char* path) {
+    // Keep the tail of long paths, it names the entry
+    size_t length = strlen(path);
+    const char* shown = length > 160 ? path + length - 160 : path;
+    snprintf(cache->error_message, sizeof(cache->error_message), "%s %.160s: %.64s", what, shown, strerror(errno));
+}
+
+// mkdir -p
+static bool make_dirs(const char* path) {
+    char partial[512];
+    size_t length = strlen(path);
+    if (length == 0 || length >= sizeof(partial)) return false;
+    
+    memcpy(partial, path, length + 1);
+    for (size_t i = 1; i <= length; i++) {
+        if (partial[i] != '/' && partial[i] != '\0') continue;
+        char saved = partial[i];
+        partial[i] = '\0';
+        if (mkdir(partial, 0755) < 0 && errno != EEXIST) return false;
+        partial[i] = saved;
+    }
+    return true;
+}
+
+static void entry_path(const CompileCache* cache, uint64_t key, char* path, size_t size) {
+    snprintf(path, size, "%s/%016llx.entry", cache->dir, (unsigned long long)key);
+}
+
+static bool write_all(int fd, const void* data, size_t length) {
+    const char* p = data;
+    while (length > 0) {
+        ssize_t written = write(fd, p, length);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        p += written;
+        length -= (size_t)written;
+    }
+    return true;
+}
+
+static bool read_all(int fd, void* data, size_t length) {
+    char* p = data;
+    while (length > 0) {
+        ssize_t got = read(fd, p, length);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) return false;
+        p += got;
+        length -= (size_t)got;
+    }
+    return true;
+}
+
+// ================== LIFECYCLE ==================
+
+void cache_default_dir(char* buffer, size_t size) {
+    const char* dir = getenv("SHAYNEFRO_CACHE_DIR");
+    if (dir && *dir) {
+        snprintf(buffer, size, "%s", dir);
+        return;
+    }
+    dir = getenv("XDG_CACHE_HOME");
+    if (dir && *dir) {
+        snprintf(buffer, size, "%s/shaynefro", dir);
+        return;
+    }
+    dir = getenv("HOME");
+    snprintf(buffer, size, "%s/.cache/shaynefro", dir && *dir ? dir : "/tmp");
+}
+
+CompileCache* cache_open(const char* dir, uint64_t max_bytes) {
+    CompileCache* cache = calloc(1, sizeof(CompileCache));
+    if (!cache) return NULL;
+    
+    if (dir) {
+        snprintf(cache->dir, sizeof(cache->dir), "%s", dir);
+    } else {
+        cache_default_dir(cache->dir, sizeof(cache->dir));
+    }
+    if (max_bytes == 0) {
+        const char* limit = getenv("SHAYNEFRO_CACHE_MAX_MB");
+        max_bytes = limit && atoll(limit) > 0 ? (uint64_t)atoll(limit) << 20 : CACHE_DEFAULT_MAX_BYTES;
+    }
+    cache->max_bytes = max_bytes;
+    
+    if (!make_dirs(cache->dir)) {
+        free(cache);
+        return NULL;
+    }
+    return cache;
+}
+
+void cache_close(CompileCache* cache) {
+    free(cache);
+}
+
+// The compiler build is part of every key, so a new compiler never
+// reuses output from an old one. The build is identified by a hash of the
+// running executable, which every object file contributes to; where that
+// cannot be read, by the version alone.
+static uint64_t build_identity;
+static pthread_once_t build_identity_once = PTHREAD_ONCE_INIT;
+
+static void hash_executable(void) {
+    static const char version[] = "shaynefro " SHAYNEFRO_VERSION;
+    build_identity = hash_bytes(version, sizeof(version) - 1, 0);
+    int fd = open("/proc/self/exe", O_RDONLY);
+    if (fd < 0) return;
+    char chunk[65536];
+    ssize_t got;
+    while ((got = read(fd, chunk, sizeof(chunk))) > 0 || (got < 0 && errno == EINTR)) {
+        if (got > 0) build_identity = hash_bytes(chunk, (size_t)got, build_identity);
+    }
+    close(fd);
+}
+
+uint64_t cache_key(uint64_t source_checksum, const char* options) {
+    pthread_once(&build_identity_once, hash_executable);
+    uint64_t key = hash_bytes(&build_identity, sizeof(build_identity), source_checksum);
+    return hash_bytes(options, strlen(options), key);
+}
+
+// ================== TOTALS AND EVICTION ==================
+
+typedef struct {
+    char name[32];
+    time_t last_used;
+    uint64_t size;
+} CacheFile;
+
+static int compare_last_used(const void* a, const void* b) {
+    time_t ta = ((const CacheFile*)a)->last_used;
+    time_t tb = ((const CacheFile*)b)->last_used;
+    return (ta > tb) - (ta < tb);
+}
+
+// Deletes stale temp files, then least recently used entries until the
+// cache is under its eviction target; returns the exact size left
+static uint64_t cache_evict(CompileCache* cache, uint64_t* evicted) {
+    DIR* dir = opendir(cache->dir);
+    if (!dir) return 0;
+    
+    CacheFile* files = NULL;
+    size_t count = 0;
+    size_t capacity = 0;
+    uint64_t total = 0;
+    struct dirent* entry;
+    char path[sizeof(cache->dir) + 1 + sizeof(entry->d_name)];
+    
+    time_t stale = time(NULL) - CACHE_STALE_TEMP_SECONDS;
+    while ((entry = readdir(dir)) != NULL) {
+        size_t length = strlen(entry->d_name);
+        bool temp = strncmp(entry->d_name, "tmp.", 4) == 0;
+        if (!temp && (length < 6 || length >= sizeof(files[0].name) ||
+                      strcmp(entry->d_name + length - 6, ".entry") != 0)) {
+            continue;
+        }
+        
+        struct stat st;
+        snprintf(path, sizeof(path), "%s/%s", cache->dir, entry->d_name);
+        if (stat(path, &st) < 0) continue;
+        
+        // Left by a store that crashed; a recent one may still be written
+        if (temp) {
+            if (st.st_mtime < stale && unlink(path) == 0) {
+                (*evicted)++;
+            } else {
+                total += (uint64_t)st.st_size;
+            }
+            continue;
+        }
+        
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 256;
+            CacheFile* grown = realloc(files, capacity * sizeof(CacheFile));
+            if (!grown) break;
+            files = grown;
+        }
+        memcpy(files[count].name, entry->d_name, length + 1);
+        files[count].last_used = st.st_mtime;
+        files[count].size = (uint64_t)st.st_size;
+        total += files[count].size;
+        count++;
+    }
+    closedir(dir);
+    
+    uint64_t target = cache->max_bytes / 100 * CACHE_EVICT_TARGET_PERCENT;
+    if (total > target) {
+        qsort(files, count, sizeof(CacheFile), compare_last_used);
+        for (size_t i = 0; i < count && total > target; i++) {
+            snprintf(path, sizeof(path), "%s/%s", cache->dir, files[i].name);
+            if (unlink(path) == 0) {
+                total -= files[i].size;
+                (*evicted)++;
+            }
+        }
+    }
+    
+    free(files);
+    return total;
+}
+
+static void parse_totals(const char* text, CacheTotals* totals) {
+    const char* names[] = { "hits", "misses", "stores", "evictions", "bytes" };
+    uint64_t* fields[] = { &totals->hits, &totals->misses, &totals->stores, &totals->evictions, &totals->bytes };
+    
+    memset(totals, 0, sizeof(*totals));
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        const char* found = strstr(text, names[i]);
+        if (found) *fields[i] = strtoull(found + strlen(names[i]), NULL, 10);
+    }
+}
+
+// fcntl locks belong to the process, so caches opened by several threads
+// (one per compile server worker) also take this lock
+static pthread_mutex_t totals_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Adds delta to the shared totals under an fcntl lock, evicting when the
+// size limit is exceeded
+static void cache_update_totals(CompileCache* cache, const CacheTotals* delta, int64_t bytes_delta) {
+    char path[600];
+    snprintf(path, sizeof(path), "%s/stats", cache->dir);
+    pthread_mutex_lock(&totals_lock);
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        pthread_mutex_unlock(&totals_lock);
+        return;
+    }
+    
+    struct flock lock;
+    memset(&lock, 0, sizeof(lock));
+    lock.l_type = F_WRLCK;
+    lock.l_whence = SEEK_SET;
+    while (fcntl(fd, F_SETLKW, &lock) < 0 && errno == EINTR) {}
+    
+    char text[512];
+    ssize_t length = pread(fd, text, sizeof(text) - 1, 0);
+    text[length > 0 ? length : 0] = '\0';
+    
+    CacheTotals totals;
+    parse_totals(text, &totals);
+    totals.hits += delta->hits;
+    totals.misses += delta->misses;
+    totals.stores += delta->stores;
+    if (bytes_delta < 0 && (uint64_t)-bytes_delta > totals.bytes) {
+        totals.bytes = 0;
+    } else {
+        totals.bytes += (uint64_t)bytes_delta;
+    }
+    
+    if (totals.bytes > cache->max_bytes) {
+        uint64_t evicted = 0;
+        totals.bytes = cache_evict(cache, &evicted);
+        totals.evictions += evicted;
+        cache->session.evictions += evicted;
+    }
+    
+    int written = snprintf(text, sizeof(text),
+                           "hits %llu\nmisses %llu\nstores %llu\nevictions %llu\nbytes %llu\n",
+                           (unsigned long long)totals.hits, (unsigned long long)totals.misses,
+                           (unsigned long long)totals.stores, (unsigned long long)totals.evictions,
+                           (unsigned long long)totals.bytes);
+    if (pwrite(fd, text, (size_t)written, 0) == written) {
+        if (ftruncate(fd, written) < 0) {
+            // Stale trailing bytes only affect the stats display
+        }
+    }
+    
+    lock.l_type = F_UNLCK;
+    fcntl(fd, F_SETLK, &lock);
+    close(fd);
+    pthread_mutex_unlock(&totals_lock);
+}
+
+bool cache_read_totals(CompileCache* cache, CacheTotals* totals) {
+    char path[600];
+    snprintf(path, sizeof(path), "%s/stats", cache->dir);
+    memset(totals, 0, sizeof(*totals));
+    
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return errno == ENOENT;
+    
+    char text[512];
+    ssize_t length = read(fd, text, sizeof(text) - 1);
+    close(fd);
+    text[length > 0 ? length : 0] = '\0';
+    parse_totals(text, totals);
+    return true;
+}
+
+// ================== LOOKUP AND STORE ==================
+
+static void record_miss(CompileCache* cache, double start) {
+    CacheTotals delta = { 0, 1, 0, 0, 0 };
+    cache->session.misses++;
+    cache_update_totals(cache, &delta, 0);
+    cache->time_spent += timer_now() - start;
+}
+
+bool cache_lookup(CompileCache* cache, uint64_t key, OutputBuffer* out) {
+    double start = timer_now();
+    char path[600];
+    entry_path(cache, key, path, sizeof(path));
+    
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        record_miss(cache, start);
+        return false;
+    }
+    
+    CacheEntryHeader header;
+    struct stat st;
+    char* payload = NULL;
+    bool valid = fstat(fd, &st) == 0 && read_all(fd, &header, sizeof(header)) &&
+                 memcmp(header.magic, CACHE_MAGIC, sizeof(header.magic)) == 0 &&
+                 header.key == key &&
+                 (uint64_t)st.st_size == sizeof(header) + header.payload_size;
+    if (valid) {
+        payload = malloc(header.payload_size ? header.payload_size : 1);
+        valid = payload && read_all(fd, payload, header.payload_size) &&
+                hash_bytes(payload, header.payload_size, key) == header.payload_hash;
+    }
+    
+    if (!valid) {
+        // Corrupt or foreign file: drop it and compile normally
+        close(fd);
+        free(payload);
+        unlink(path);
+        record_miss(cache, start);
+        return false;
+    }
+    
+    // Refresh the mtime so LRU eviction sees the use
+    futimens(fd, NULL);
+    close(fd);
+    
+    outbuf_append(out, payload, header.payload_size);
+    free(payload);
+    
+    CacheTotals delta = { 1, 0, 0, 0, 0 };
+    cache->session.hits++;
+    cache_update_totals(cache, &delta, 0);
+    cache->time_spent += timer_now() - start;
+    return !out->had_error;
+}
+
+bool cache_store(CompileCache* cache, uint64_t key, const char* data, size_t length) {
+    double start = timer_now();
+    char path[600];
+    char temp_path[640];
+    entry_path(cache, key, path, sizeof(path));
+    snprintf(temp_path, sizeof(temp_path), "%s/tmp.%ld.%p.%u", cache->dir, (long)getpid(), (void*)cache, cache->temp_counter++);
+    
+    int fd = open(temp_path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+    if (fd < 0) {
+        cache_error(cache, "Cannot create", temp_path);
+        return false;
+    }
+    
+    CacheEntryHeader header;
+    memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+    header.key = key;
+    header.payload_size = length;
+    header.payload_hash = hash_bytes(data, length, key);
+    
+    bool written = write_all(fd, &header, sizeof(header)) && write_all(fd, data, length);
+    if (close(fd) < 0) written = false;
+    if (!written) {
+        cache_error(cache, "Cannot write", temp_path);
+        unlink(temp_path);
+        return false;
+    }
+    
+    // An existing entry for the key is replaced, not added to the total
+    struct stat st;
+    int64_t replaced = stat(path, &st) == 0 ? (int64_t)st.st_size : 0;
+    
+    // rename() is atomic: readers see the old entry or the new one
+    if (rename(temp_path, path) < 0) {
+        cache_error(cache, "Cannot install", path);
+        unlink(temp_path);
+        return false;
+    }
+    
+    CacheTotals delta = { 0, 0, 1, 0, 0 };
+    cache->session.stores++;
+    cache_update_totals(cache, &delta, (int64_t)(sizeof(header) + length) - replaced);
+    cache->time_spent += timer_now() - start;
+    return true;
+}
+
+// ================== FILE OUTPUTS ==================
+
+bool cache_lookup_file(CompileCache* cache, uint64_t key, const char* path, int mode) {
+    OutputBuffer payload;
+    if (!outbuf_init(&payload, -1)) return false;
+    if (!cache_lookup(cache, key, &payload)) {
+        outbuf_free(&payload);
+        return false;
+    }
+    
+    // Written next to path and renamed over it, so a failed restore never
+    // leaves a truncated output behind
+    const char* slash = strrchr(path, '/');
+    int dir_length = slash ? (int)(slash - path + 1) : 0;
+    char temp_path[640];
+    int needed = snprintf(temp_path, sizeof(temp_path), "%.*s.%s.tmp.%ld.%u", dir_length, path,
+                          path + dir_length, (long)getpid(), cache->temp_counter++);
+    
+    errno = ENAMETOOLONG;
+    int fd = needed < (int)sizeof(temp_path) ? open(temp_path, O_WRONLY | O_CREAT | O_EXCL, (mode_t)mode) : -1;
+    bool written = fd >= 0 && fchmod(fd, (mode_t)mode) == 0 &&
+                   write_all(fd, payload.data, payload.length);
+    if (fd >= 0 && close(fd) < 0) written = false;
+    if (!written) {
+        cache_error(cache, "Cannot write", temp_path);
+    } else if (rename(temp_path, path) < 0) {
+        cache_error(cache, "Cannot install", path);
+        written = false;
+    }
+    if (!written && fd >= 0) unlink(temp_path);
+    
+    outbuf_free(&payload);
+    return written;
+}
+
+bool cache_store_file(CompileCache* cache, uint64_t key, const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        cache_error(cache, "Cannot open", path);
+        return false;
+    }
+    
+    struct stat st;
+    char* data = NULL;
+    bool loaded = fstat(fd, &st) == 0 && (data = malloc((size_t)st.st_size + 1)) != NULL &&
+                  read_all(fd, data, (size_t)st.st_size);
+    close(fd);
+    if (!loaded) {
+        cache_error(cache, "Cannot read", path);
+        free(data);
+        return false;
+    }
+    
+    bool stored = cache_store(cache, key, data, (size_t)st.st_size);
+    free(data);
+    return stored;
+}
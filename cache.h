@@ -0,0 +1,64 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "outbuf.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// ================== CONTENT-ADDRESSED COMPILATION CACHE ==================
+//
+// Compiler output keyed by a hash of the source bytes (Lexer.checksum),
+// the compiler build, and every option that affects the output. Entries
+// are written to a temp file and renamed into place, so concurrent
+// compilers never see a partial entry. A hit refreshes the entry's mtime;
+// when the cache grows past its size limit the least recently used
+// entries are deleted.
+
+#define CACHE_DEFAULT_MAX_BYTES (1024ULL << 20)
+#define CACHE_EVICT_TARGET_PERCENT 80   // Evict down to this share of the limit
+#define CACHE_STALE_TEMP_SECONDS 3600   // Older temp files are from a crashed store
+
+// Counters; the cache directory keeps running totals in its stats file
+typedef struct {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t stores;
+    uint64_t evictions;
+    uint64_t bytes;         // Size of all entries (totals only)
+} CacheTotals;
+
+typedef struct {
+    char dir[512];
+    uint64_t max_bytes;
+    unsigned temp_counter;  // Makes temp file names unique within the process
+    
+    CacheTotals session;    // This process only
+    double time_spent;      // Seconds in lookups and stores
+    
+    char error_message[256];
+} CompileCache;
+
+// Lifecycle; dir NULL uses cache_default_dir, max_bytes 0 uses
+// $SHAYNEFRO_CACHE_MAX_MB, else CACHE_DEFAULT_MAX_BYTES
+CompileCache* cache_open(const char* dir, uint64_t max_bytes);
+void cache_close(CompileCache* cache);
+
+// $SHAYNEFRO_CACHE_DIR, else $XDG_CACHE_HOME/shaynefro, else ~/.cache/shaynefro
+void cache_default_dir(char* buffer, size_t size);
+
+// Key for a source checksum plus a description of every output-affecting option
+uint64_t cache_key(uint64_t source_checksum, const char* options);
+
+// On a hit the cached payload is appended to out
+bool cache_lookup(CompileCache* cache, uint64_t key, OutputBuffer* out);
+bool cache_store(CompileCache* cache, uint64_t key, const char* data, size_t length);
+
+// Whole files, for outputs the compiler writes to disk; mode applies on a hit
+bool cache_lookup_file(CompileCache* cache, uint64_t key, const char* path, int mode);
+bool cache_store_file(CompileCache* cache, uint64_t key, const char* path);
+
+// Totals across every process that used this directory
+bool cache_read_totals(CompileCache* cache, CacheTotals* totals);
+
+#endif
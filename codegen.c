@@ -1,7 +1,19 @@
+#define _POSIX_C_SOURCE 200809L
 #include "codegen.h"
+#include "timer.h"
+#include "trace.h"
+#include "dtoa.h"
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+
+static void symbol_clear(SymbolTable* table);
 
 // ================== CODE GENERATOR CREATION ==================
 
@@ -9,12 +21,57 @@ CodeGenerator* codegen_create(const char* output_filename, OutputFormat format)
     CodeGenerator* codegen = malloc(sizeof(CodeGenerator));
     if (!codegen) return NULL;
     
-    codegen->output_file = fopen(output_filename, "w");
-    if (!codegen->output_file) {
+    int fd = open(output_filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        free(codegen);
+        return NULL;
+    }
+    
+    if (!outbuf_init(&codegen->file_out, fd)) {
+        close(fd);
         free(codegen);
         return NULL;
     }
     
+    memset(&codegen->flatten, 0, sizeof(codegen->flatten));
+    memset(&codegen->variables, 0, sizeof(codegen->variables));
+    memset(&codegen->functions, 0, sizeof(codegen->functions));
+    codegen->spine = NULL;
+    codegen->spine_count = 0;
+    codegen->spine_capacity = 0;
+    codegen->threads = 1;
+    codegen->profile = false;
+    codegen->profile_data = NULL;
+    codegen->sample_hz = 0;
+    codegen_reset(codegen, &codegen->file_out, format);
+    return codegen;
+}
+
+// Generate into a caller-owned buffer instead of a file
+CodeGenerator* codegen_create_in_memory(OutputBuffer* target, OutputFormat format) {
+    CodeGenerator* codegen = malloc(sizeof(CodeGenerator));
+    if (!codegen) return NULL;
+    
+    codegen->file_out.data = NULL;
+    codegen->file_out.capacity = 0;
+    codegen->file_out.fd = -1;
+    memset(&codegen->flatten, 0, sizeof(codegen->flatten));
+    memset(&codegen->variables, 0, sizeof(codegen->variables));
+    memset(&codegen->functions, 0, sizeof(codegen->functions));
+    codegen->spine = NULL;
+    codegen->spine_count = 0;
+    codegen->spine_capacity = 0;
+    codegen->threads = 1;
+    codegen->profile = false;
+    codegen->profile_data = NULL;
+    codegen->sample_hz = 0;
+    codegen_reset(codegen, target, format);
+    return codegen;
+}
+
+// Retarget a generator and clear its state so it can be reused
+void codegen_reset(CodeGenerator* codegen, OutputBuffer* target, OutputFormat format) {
+    codegen->out = target;
     codegen->format = format;
     codegen->indent_level = 0;
     codegen->had_error = false;
@@ -22,16 +79,66 @@ CodeGenerator* codegen_create(const char* output_filename, OutputFormat format)
     codegen->lines_generated = 0;
     codegen->variables_declared = 0;
     codegen->functions_generated = 0;
-    codegen->gen_start_time = (double)clock() / CLOCKS_PER_SEC;
+    codegen->binary_expressions = 0;
+    codegen->binary_parens = 0;
+    codegen->unit_bytes = 0;
+    codegen->generation_time = 0;
+    codegen->scratch_peak = 0;
+    codegen->spine_count = 0;
+    codegen->profile_runtime = false;
+    codegen->profile_hints = false;
+    codegen->sample_runtime = false;
+    codegen->function = NULL;
+    codegen->function_profile = NULL;
+    codegen->branch_site = 0;
+    memset(&codegen->pgo, 0, sizeof(codegen->pgo));
     
-    return codegen;
+    codegen->flatten.active = false;
+    codegen->flatten.next_temp = 0;
+    codegen->flatten.temps_generated = 0;
+    codegen->flatten.expressions_flattened = 0;
+    symbol_clear(&codegen->variables);
+    symbol_clear(&codegen->functions);
+}
+
+// Expressions with more than threshold nodes are split into temporaries
+void codegen_set_flatten_threshold(CodeGenerator* codegen, int threshold) {
+    codegen->flatten.threshold = threshold > 0 ? threshold : 0;
+}
+
+// Output is identical for any thread count
+void codegen_set_threads(CodeGenerator* codegen, int threads) {
+    codegen->threads = threads > 1 ? threads : 1;
+}
+
+// Functions marked with 📊 are instrumented either way
+void codegen_set_profile(CodeGenerator* codegen, bool profile) {
+    codegen->profile = profile;
+}
+
+// Counts from a --profile run; the caller keeps them alive while generating.
+// Only single-file C output uses them.
+void codegen_set_profile_data(CodeGenerator* codegen, const ProfileData* data) {
+    codegen->profile_data = data;
+}
+
+// 0 turns sampling off; single-file C output only
+void codegen_set_sampling(CodeGenerator* codegen, int hz) {
+    codegen->sample_hz = hz > 0 ? hz : 0;
 }
 
 void codegen_destroy(CodeGenerator* codegen) {
     if (codegen) {
-        if (codegen->output_file) {
-            fclose(codegen->output_file);
+        if (codegen->file_out.fd >= 0) {
+            outbuf_flush(&codegen->file_out);
+            close(codegen->file_out.fd);
         }
+        outbuf_free(&codegen->file_out);
+        free(codegen->flatten.entries);
+        free(codegen->flatten.stack);
+        free(codegen->spine);
+        free(codegen->variables.entries);
+        free(codegen->functions.entries);
         free(codegen);
     }
 }
@@ -40,22 +147,106 @@ void codegen_destroy(CodeGenerator* codegen) {
 
 // Forward declarations
 static void generate_c_expression(CodeGenerator* codegen, const ASTNode* node);
+static bool is_profiled(const CodeGenerator* codegen, const ASTNode* function);
+static const char* function_attribute(CodeGenerator* codegen, const ASTNode* function);
+
+#define emit_lit(codegen, lit) outbuf_append_lit((codegen)->out, lit)
+
+static void emit_str(CodeGenerator* codegen, const char* str) {
+    outbuf_append_str(codegen->out, str);
+}
 
 static void emit_indent(CodeGenerator* codegen) {
-    for (int i = 0; i < codegen->indent_level; i++) {
-        fprintf(codegen->output_file, "    ");
-    }
+    outbuf_append_indent(codegen->out, codegen->indent_level);
 }
 
 static void emit_line(CodeGenerator* codegen, const char* line) {
     emit_indent(codegen);
-    fprintf(codegen->output_file, "%s\n", line);
+    emit_str(codegen, line);
+    outbuf_putc(codegen->out, '\n');
     codegen->lines_generated++;
 }
 
 static void codegen_error(CodeGenerator* codegen, const char* message) {
     codegen->had_error = true;
     strncpy(codegen->error_message, message, sizeof(codegen->error_message) - 1);
+    codegen->error_message[sizeof(codegen->error_message) - 1] = '\0';
+}
+
+
+// ================== FLATTEN MAP ==================
+
+static size_t hash_pointer(const void* ptr) {
+    uint64_t x = (uint64_t)(uintptr_t)ptr;
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    return (size_t)x;
+}
+
+// Find (or with insert, create) the entry for node in the current generation
+static FlattenEntry* flatten_entry(CodeGenerator* codegen, const ASTNode* node, bool insert) {
+    FlattenState* state = &codegen->flatten;
+    
+    if (insert && (state->count + 1) * 2 > state->capacity) {
+        size_t new_capacity = state->capacity ? state->capacity * 2 : 1024;
+        FlattenEntry* entries = calloc(new_capacity, sizeof(FlattenEntry));
+        if (!entries) {
+            codegen_error(codegen, "Out of memory while flattening expression");
+            return NULL;
+        }
+        for (size_t i = 0; i < state->capacity; i++) {
+            FlattenEntry* old = &state->entries[i];
+            if (old->generation != state->generation || !old->node) continue;
+            size_t slot = hash_pointer(old->node) & (new_capacity - 1);
+            while (entries[slot].node) slot = (slot + 1) & (new_capacity - 1);
+            entries[slot] = *old;
+        }
+        free(state->entries);
+        state->entries = entries;
+        state->capacity = new_capacity;
+    }
+    if (state->capacity == 0) return NULL;
+    
+    size_t mask = state->capacity - 1;
+    size_t slot = hash_pointer(node) & mask;
+    while (true) {
+        FlattenEntry* entry = &state->entries[slot];
+        if (entry->generation != state->generation || !entry->node) {
+            if (!insert) return NULL;
+            entry->node = node;
+            entry->size = 0;
+            entry->weight = 0;
+            entry->temp = -1;
+            entry->ctype = 0;
+            entry->generation = state->generation;
+            state->count++;
+            return entry;
+        }
+        if (entry->node == node) return entry;
+        slot = (slot + 1) & mask;
+    }
+}
+
+static int flatten_temp_of(const CodeGenerator* codegen, const ASTNode* node) {
+    FlattenEntry* entry = flatten_entry((CodeGenerator*)codegen, node, false);
+    return entry ? entry->temp : -1;
+}
+
+static void emit_temp_name(CodeGenerator* codegen, int temp) {
+    emit_lit(codegen, "shayc_t");
+    outbuf_append_int(codegen->out, temp);
+}
+
+// Every Shaynefro identifier is emitted as shay_<name>, so a function or
+// variable called main, free, printf or int cannot clash with C's main,
+// the included headers or a keyword. Names the compiler makes up start
+// with shayc_ and so never meet a user's.
+#define C_USER_PREFIX "shay_"
+
+static void emit_user_name(CodeGenerator* codegen, const char* name) {
+    emit_lit(codegen, C_USER_PREFIX);
+    emit_str(codegen, name);
 }
 
 // ================== C CODE GENERATION ==================
@@ -63,22 +254,35 @@ static void codegen_error(CodeGenerator* codegen, const char* message) {
 static void generate_c_literal(CodeGenerator* codegen, const ASTNode* node) {
     switch (node->data.literal.token_type) {
         case TOKEN_INTEGER:
-            fprintf(codegen->output_file, "%lld", node->data.literal.value.int_value);
+            outbuf_append_int(codegen->out, node->data.literal.value.int_value);
             break;
-        case TOKEN_FLOAT:
-            fprintf(codegen->output_file, "%g", node->data.literal.value.float_value);
+        case TOKEN_FLOAT: {
+            char number[DTOA_BUFFER_SIZE];
+            size_t length = dtoa_shortest(node->data.literal.value.float_value, number);
+            // Literals too large for a double read as infinity; C has no spelling for it
+            if (number[length - 1] == 'f') {
+                if (number[0] == '-') outbuf_putc(codegen->out, '-');
+                emit_lit(codegen, "(1.0 / 0.0)");
+            } else if (number[0] == 'n') {
+                emit_lit(codegen, "(0.0 / 0.0)");
+            } else {
+                outbuf_append(codegen->out, number, length);
+            }
             break;
+        }
         case TOKEN_STRING:
-            fprintf(codegen->output_file, "\"%s\"", node->data.literal.value.string_value);
+            outbuf_putc(codegen->out, '"');
+            emit_str(codegen, node->data.literal.value.string_value);
+            outbuf_putc(codegen->out, '"');
             break;
         case TOKEN_TRUE:
-            fprintf(codegen->output_file, "true");
+            emit_lit(codegen, "true");
             break;
         case TOKEN_FALSE:
-            fprintf(codegen->output_file, "false");
+            emit_lit(codegen, "false");
             break;
         case TOKEN_NULL:
-            fprintf(codegen->output_file, "NULL");
+            emit_lit(codegen, "NULL");
             break;
         default:
             codegen_error(codegen, "Unknown literal type");
@@ -87,40 +291,254 @@ static void generate_c_literal(CodeGenerator* codegen, const ASTNode* node) {
 }
 
 static void generate_c_identifier(CodeGenerator* codegen, const ASTNode* node) {
-    fprintf(codegen->output_file, "%s", node->data.identifier.name);
+    emit_user_name(codegen, node->data.identifier.name);
 }
 
-static void generate_c_binary(CodeGenerator* codegen, const ASTNode* node) {
-    fprintf(codegen->output_file, "(");
-    generate_c_expression(codegen, node->data.binary.left);
-    
-    switch (node->data.binary.operator) {
-        case TOKEN_PLUS: fprintf(codegen->output_file, " + "); break;
-        case TOKEN_MINUS: fprintf(codegen->output_file, " - "); break;
-        case TOKEN_MULTIPLY: fprintf(codegen->output_file, " * "); break;
-        case TOKEN_DIVIDE: fprintf(codegen->output_file, " / "); break;
-        case TOKEN_MODULO: fprintf(codegen->output_file, " %% "); break;
-        case TOKEN_EQUAL: fprintf(codegen->output_file, " == "); break;
-        case TOKEN_NOT_EQUAL: fprintf(codegen->output_file, " != "); break;
-        case TOKEN_LESS: fprintf(codegen->output_file, " < "); break;
-        case TOKEN_LESS_EQUAL: fprintf(codegen->output_file, " <= "); break;
-        case TOKEN_GREATER: fprintf(codegen->output_file, " > "); break;
-        case TOKEN_GREATER_EQUAL: fprintf(codegen->output_file, " >= "); break;
-        case TOKEN_AND: fprintf(codegen->output_file, " && "); break;
-        case TOKEN_OR: fprintf(codegen->output_file, " || "); break;
-        case TOKEN_ASSIGN: fprintf(codegen->output_file, " = "); break;
+// ================== C OPERATOR TABLE ==================
+
+// Spelling, precedence (higher binds tighter) and associativity of the C
+// operator each Shaynefro operator token lowers to. Parentheses are only
+// emitted where this table says C would otherwise regroup the tree. Only
+// operators the parser builds have entries; the lexer's bitwise and shift
+// tokens never reach an expression.
+typedef struct {
+    const char* spelling;
+    size_t length;
+    int precedence;
+    bool right_assoc;
+} COperator;
+
+enum {
+    PREC_NONE = 0,
+    PREC_ASSIGNMENT,
+    PREC_LOGICAL_OR,
+    PREC_LOGICAL_AND,
+    PREC_EQUALITY,
+    PREC_RELATIONAL,
+    PREC_ADDITIVE,
+    PREC_MULTIPLICATIVE,
+    PREC_UNARY,
+    PREC_POSTFIX,
+    PREC_PRIMARY
+};
+
+#define C_BINARY(text, prec) { " " text " ", sizeof(text) + 1, prec, false }
+#define C_ASSIGN(text) { " " text " ", sizeof(text) + 1, PREC_ASSIGNMENT, true }
+
+static const COperator c_binary_operators[TOKEN_UNKNOWN + 1] = {
+    [TOKEN_MULTIPLY] = C_BINARY("*", PREC_MULTIPLICATIVE),
+    [TOKEN_DIVIDE] = C_BINARY("/", PREC_MULTIPLICATIVE),
+    [TOKEN_MODULO] = C_BINARY("%", PREC_MULTIPLICATIVE),
+    [TOKEN_PLUS] = C_BINARY("+", PREC_ADDITIVE),
+    [TOKEN_MINUS] = C_BINARY("-", PREC_ADDITIVE),
+    [TOKEN_LESS] = C_BINARY("<", PREC_RELATIONAL),
+    [TOKEN_LESS_EQUAL] = C_BINARY("<=", PREC_RELATIONAL),
+    [TOKEN_GREATER] = C_BINARY(">", PREC_RELATIONAL),
+    [TOKEN_GREATER_EQUAL] = C_BINARY(">=", PREC_RELATIONAL),
+    [TOKEN_EQUAL] = C_BINARY("==", PREC_EQUALITY),
+    [TOKEN_NOT_EQUAL] = C_BINARY("!=", PREC_EQUALITY),
+    [TOKEN_AND] = C_BINARY("&&", PREC_LOGICAL_AND),
+    [TOKEN_OR] = C_BINARY("||", PREC_LOGICAL_OR),
+    [TOKEN_ASSIGN] = C_ASSIGN("="),
+    [TOKEN_PLUS_ASSIGN] = C_ASSIGN("+="),
+    [TOKEN_MINUS_ASSIGN] = C_ASSIGN("-="),
+    [TOKEN_MULTIPLY_ASSIGN] = C_ASSIGN("*="),
+    [TOKEN_DIVIDE_ASSIGN] = C_ASSIGN("/="),
+    [TOKEN_MODULO_ASSIGN] = C_ASSIGN("%="),
+    // TOKEN_POWER has no C operator and is rejected as unknown
+};
+
+static const COperator c_unary_operators[TOKEN_UNKNOWN + 1] = {
+    [TOKEN_MINUS] = { "-", 1, PREC_UNARY, true },
+    [TOKEN_NOT] = { "!", 1, PREC_UNARY, true },
+    [TOKEN_INCREMENT] = { "++", 2, PREC_UNARY, true },
+    [TOKEN_DECREMENT] = { "--", 2, PREC_UNARY, true },
+};
+
+static int expression_precedence(const CodeGenerator* codegen, const ASTNode* node) {
+    if (codegen->flatten.active && flatten_temp_of(codegen, node) >= 0) {
+        return PREC_PRIMARY;
+    }
+    
+    switch (node->type) {
+        case AST_BINARY:
+        case AST_ASSIGNMENT:
+            return c_binary_operators[node->data.binary.operator].precedence;
+        case AST_UNARY:
+            return node->data.unary.postfix ? PREC_POSTFIX : PREC_UNARY;
+        case AST_CALL:
+            return PREC_POSTFIX;
         default:
-            codegen_error(codegen, "Unknown binary operator");
-            break;
+            return PREC_PRIMARY;
+    }
+}
+
+// Groupings C parses as intended but GCC's -Wparentheses still flags;
+// they keep their parentheses so generated code builds warning-free
+static bool warns_without_parens(int parent_prec, int child_prec) {
+    switch (parent_prec) {
+        case PREC_LOGICAL_OR:
+            return child_prec == PREC_LOGICAL_AND;
+        case PREC_EQUALITY:
+        case PREC_RELATIONAL:
+            return child_prec == PREC_EQUALITY || child_prec == PREC_RELATIONAL;
+        default:
+            return false;
+    }
+}
+
+static void generate_c_operand(CodeGenerator* codegen, const ASTNode* node, bool wrap) {
+    if (wrap) outbuf_putc(codegen->out, '(');
+    generate_c_expression(codegen, node);
+    if (wrap) outbuf_putc(codegen->out, ')');
+    
+    if (wrap && (node->type == AST_BINARY || node->type == AST_ASSIGNMENT)) {
+        codegen->binary_parens++;
+    }
+}
+
+// Which operands of a binary node need parentheses in C
+static void binary_operand_wraps(const CodeGenerator* codegen, const ASTNode* node,
+                                 bool* wrap_left, bool* wrap_right) {
+    const COperator* op = &c_binary_operators[node->data.binary.operator];
+    
+    // A child at the same level only needs grouping on the side the
+    // operator does not associate towards
+    int left_prec = expression_precedence(codegen, node->data.binary.left);
+    int right_prec = expression_precedence(codegen, node->data.binary.right);
+    *wrap_left = left_prec < op->precedence ||
+                 (left_prec == op->precedence && op->right_assoc);
+    *wrap_right = right_prec < op->precedence ||
+                  (right_prec == op->precedence && !op->right_assoc);
+    
+    *wrap_left |= warns_without_parens(op->precedence, left_prec);
+    *wrap_right |= warns_without_parens(op->precedence, right_prec);
+}
+
+// A binary node generate_c_binary would emit operator and operands for
+static bool is_emitted_binary(const CodeGenerator* codegen, const ASTNode* node) {
+    if (node->type != AST_BINARY && node->type != AST_ASSIGNMENT) return false;
+    if (codegen->flatten.active && flatten_temp_of(codegen, node) >= 0) return false;
+    return c_binary_operators[node->data.binary.operator].spelling &&
+           node->data.binary.left && node->data.binary.right;
+}
+
+static bool spine_push(CodeGenerator* codegen, const ASTNode* node) {
+    if (codegen->spine_count == codegen->spine_capacity) {
+        size_t capacity = codegen->spine_capacity ? codegen->spine_capacity * 2 : 64;
+        const ASTNode** spine = realloc(codegen->spine, capacity * sizeof(*spine));
+        if (!spine) {
+            codegen_error(codegen, "Out of memory while generating expression");
+            return false;
+        }
+        codegen->spine = spine;
+        codegen->spine_capacity = capacity;
+    }
+    codegen->spine[codegen->spine_count++] = node;
+    return true;
+}
+
+// Left-associative chains like a + b + c + ... nest to the left, as deep
+// as the chain is long, so the left spine is walked with an explicit
+// stack: open its parentheses, emit the innermost operand, then close
+// each link with its operator and right operand. Right operands recurse,
+// but only as deep as the source nests them.
+static void generate_c_binary(CodeGenerator* codegen, const ASTNode* node) {
+    if (!c_binary_operators[node->data.binary.operator].spelling) {
+        codegen_error(codegen, "Unknown binary operator");
+        return;
+    }
+    if (!is_emitted_binary(codegen, node)) {
+        // Only a tree left behind by a parse error lacks an operand
+        codegen_error(codegen, "Binary expression is missing an operand");
+        return;
+    }
+    
+    // The stack is shared with the binaries nested in right operands,
+    // which push above this chain, so entries are addressed by index
+    size_t base = codegen->spine_count;
+    const ASTNode* leaf = node;
+    while (is_emitted_binary(codegen, leaf)) {
+        if (!spine_push(codegen, leaf)) {
+            codegen->spine_count = base;
+            return;
+        }
+        leaf = leaf->data.binary.left;
+    }
+    
+    bool wrap_left, wrap_right;
+    for (size_t i = base; i < codegen->spine_count; i++) {
+        binary_operand_wraps(codegen, codegen->spine[i], &wrap_left, &wrap_right);
+        if (wrap_left) outbuf_putc(codegen->out, '(');
+    }
+    generate_c_expression(codegen, leaf);
+    
+    for (size_t i = codegen->spine_count; i-- > base;) {
+        const ASTNode* link = codegen->spine[i];
+        const COperator* op = &c_binary_operators[link->data.binary.operator];
+        const ASTNode* left = link->data.binary.left;
+        codegen->binary_expressions++;
+        
+        binary_operand_wraps(codegen, link, &wrap_left, &wrap_right);
+        if (wrap_left) {
+            outbuf_putc(codegen->out, ')');
+            if (left->type == AST_BINARY || left->type == AST_ASSIGNMENT) codegen->binary_parens++;
+        }
+        outbuf_append(codegen->out, op->spelling, op->length);
+        generate_c_operand(codegen, link->data.binary.right, wrap_right);
+    }
+    codegen->spine_count = base;
+}
+
+static void generate_c_unary(CodeGenerator* codegen, const ASTNode* node) {
+    const COperator* op = &c_unary_operators[node->data.unary.operator];
+    const ASTNode* operand = node->data.unary.operand;
+    if (!op->spelling) {
+        codegen_error(codegen, "Unknown unary operator");
+        return;
+    }
+    if (!operand) return;
+    
+    if (node->data.unary.postfix) {
+        generate_c_operand(codegen, operand, expression_precedence(codegen, operand) < PREC_POSTFIX);
+        outbuf_append(codegen->out, op->spelling, op->length);
+        return;
+    }
+    
+    outbuf_append(codegen->out, op->spelling, op->length);
+    
+    // "- -x" must not fuse into "--x"
+    const char* inner = operand->type == AST_UNARY
+        ? c_unary_operators[operand->data.unary.operator].spelling : NULL;
+    if (inner && (inner[0] == '-' || inner[0] == '+') && inner[0] == op->spelling[op->length - 1]) {
+        outbuf_putc(codegen->out, ' ');
     }
     
-    generate_c_expression(codegen, node->data.binary.right);
-    fprintf(codegen->output_file, ")");
+    generate_c_operand(codegen, operand, expression_precedence(codegen, operand) < PREC_UNARY);
+}
+
+static void generate_c_call(CodeGenerator* codegen, const ASTNode* node) {
+    emit_user_name(codegen, node->data.call.name);
+    outbuf_putc(codegen->out, '(');
+    for (int i = 0; i < node->data.call.arg_count; i++) {
+        if (i > 0) emit_lit(codegen, ", ");
+        generate_c_expression(codegen, node->data.call.arguments[i]);
+    }
+    outbuf_putc(codegen->out, ')');
 }
 
 static void generate_c_expression(CodeGenerator* codegen, const ASTNode* node) {
     if (!node) return;
     
+    // Subtrees already hoisted into a temporary are referenced by name
+    if (codegen->flatten.active) {
+        int temp = flatten_temp_of(codegen, node);
+        if (temp >= 0) {
+            emit_temp_name(codegen, temp);
+            return;
+        }
+    }
+    
     switch (node->type) {
         case AST_LITERAL:
             generate_c_literal(codegen, node);
@@ -132,139 +550,2081 @@ static void generate_c_expression(CodeGenerator* codegen, const ASTNode* node) {
         case AST_ASSIGNMENT:
             generate_c_binary(codegen, node);
             break;
+        case AST_UNARY:
+            generate_c_unary(codegen, node);
+            break;
+        case AST_CALL:
+            generate_c_call(codegen, node);
+            break;
         default:
             codegen_error(codegen, "Unknown expression type");
             break;
     }
 }
 
-static void generate_c_var_declaration(CodeGenerator* codegen, const ASTNode* node) {
-    emit_indent(codegen);
-    
-    // Convert ShayLang types to C types
-    switch (node->data.var_decl.type) {
-        case TOKEN_INT:
-            fprintf(codegen->output_file, "int ");
-            break;
-        case TOKEN_FLOAT_KW:
-            fprintf(codegen->output_file, "double ");
-            break;
-        case TOKEN_STRING_KW:
-            fprintf(codegen->output_file, "char* ");
-            break;
-        case TOKEN_BOOL_KW:
-            fprintf(codegen->output_file, "bool ");
-            break;
-        default:
-            fprintf(codegen->output_file, "int ");
-            break;
+// ================== C TYPES AND SYMBOLS ==================
+
+typedef enum {
+    CTYPE_INT,
+    CTYPE_DOUBLE,
+    CTYPE_BOOL,
+    CTYPE_STRING,
+    CTYPE_POINTER,
+    CTYPE_VOID
+} CType;
+
+static const char* const c_type_names[] = { "int", "double", "bool", "char*", "void*", "void" };
+
+static CType ctype_from_token(TokenType type) {
+    switch (type) {
+        case TOKEN_FLOAT_KW: return CTYPE_DOUBLE;
+        case TOKEN_STRING_KW: return CTYPE_STRING;
+        case TOKEN_BOOL_KW: return CTYPE_BOOL;
+        case TOKEN_VOID_KW: return CTYPE_VOID;
+        default: return CTYPE_INT;
+    }
+}
+
+static size_t hash_name(const char* name) {
+    uint64_t hash = 0xcbf29ce484222325ULL;  // FNV-1a
+    while (*name) {
+        hash ^= (unsigned char)*name++;
+        hash *= 0x100000001b3ULL;
+    }
+    return (size_t)hash;
+}
+
+static void symbol_define(CodeGenerator* codegen, SymbolTable* table, const char* name, TokenType type) {
+    if ((table->count + 1) * 2 > table->capacity) {
+        size_t new_capacity = table->capacity ? table->capacity * 2 : 64;
+        SymbolEntry* entries = calloc(new_capacity, sizeof(SymbolEntry));
+        if (!entries) {
+            codegen_error(codegen, "Out of memory in symbol table");
+            return;
+        }
+        for (size_t i = 0; i < table->capacity; i++) {
+            if (!table->entries[i].name) continue;
+            size_t slot = hash_name(table->entries[i].name) & (new_capacity - 1);
+            while (entries[slot].name) slot = (slot + 1) & (new_capacity - 1);
+            entries[slot] = table->entries[i];
+        }
+        free(table->entries);
+        table->entries = entries;
+        table->capacity = new_capacity;
     }
     
-    fprintf(codegen->output_file, "%s", node->data.var_decl.name);
-    
-    if (node->data.var_decl.initializer) {
-        fprintf(codegen->output_file, " = ");
-        generate_c_expression(codegen, node->data.var_decl.initializer);
+    size_t mask = table->capacity - 1;
+    size_t slot = hash_name(name) & mask;
+    while (table->entries[slot].name && strcmp(table->entries[slot].name, name) != 0) {
+        slot = (slot + 1) & mask;
     }
+    if (!table->entries[slot].name) table->count++;
+    table->entries[slot].name = name;
+    table->entries[slot].type = type;
+}
+
+// Unknown names are treated as int, matching the declaration default
+static TokenType symbol_lookup(const SymbolTable* table, const char* name) {
+    if (table->count == 0) return TOKEN_INT;
     
-    fprintf(codegen->output_file, ";\n");
-    codegen->lines_generated++;
-    codegen->variables_declared++;
+    size_t mask = table->capacity - 1;
+    size_t slot = hash_name(name) & mask;
+    while (table->entries[slot].name) {
+        if (strcmp(table->entries[slot].name, name) == 0) {
+            return table->entries[slot].type;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return TOKEN_INT;
 }
 
-static void generate_c_statement(CodeGenerator* codegen, const ASTNode* node) {
-    if (!node) return;
+static void symbol_clear(SymbolTable* table) {
+    if (table->count > 0) {
+        memset(table->entries, 0, table->capacity * sizeof(SymbolEntry));
+        table->count = 0;
+    }
+}
+
+// Usual arithmetic conversions, reduced to the types Shaynefro has
+static CType combine_ctype(TokenType op, CType left, CType right) {
+    switch (c_binary_operators[op].precedence) {
+        case PREC_ASSIGNMENT:
+            return left;
+        case PREC_ADDITIVE:
+        case PREC_MULTIPLICATIVE:
+            if (left == CTYPE_STRING || left == CTYPE_POINTER) return left;
+            if (right == CTYPE_STRING || right == CTYPE_POINTER) return right;
+            if (op == TOKEN_MODULO) return CTYPE_INT;
+            return left == CTYPE_DOUBLE || right == CTYPE_DOUBLE ? CTYPE_DOUBLE : CTYPE_INT;
+        default:
+            // comparisons, logical and bitwise operators all yield int
+            return CTYPE_INT;
+    }
+}
+
+// Type of a subtree small enough to walk recursively
+static CType infer_ctype(CodeGenerator* codegen, const ASTNode* node) {
+    if (codegen->flatten.active) {
+        FlattenEntry* entry = flatten_entry(codegen, node, false);
+        if (entry && entry->temp >= 0) return (CType)entry->ctype;
+    }
     
     switch (node->type) {
-        case AST_VAR_DECLARATION:
-            generate_c_var_declaration(codegen, node);
-            break;
-        case AST_EXPRESSION_STMT:
-            emit_indent(codegen);
-            generate_c_expression(codegen, node->data.binary.left);
-            fprintf(codegen->output_file, ";\n");
-            codegen->lines_generated++;
-            break;
-        case AST_RETURN_STMT:
-            emit_indent(codegen);
-            fprintf(codegen->output_file, "return");
-            if (node->data.return_stmt.value) {
-                fprintf(codegen->output_file, " ");
-                generate_c_expression(codegen, node->data.return_stmt.value);
+        case AST_LITERAL:
+            switch (node->data.literal.token_type) {
+                case TOKEN_FLOAT: return CTYPE_DOUBLE;
+                case TOKEN_STRING: return CTYPE_STRING;
+                case TOKEN_TRUE:
+                case TOKEN_FALSE: return CTYPE_BOOL;
+                case TOKEN_NULL: return CTYPE_POINTER;
+                default: return CTYPE_INT;
             }
-            fprintf(codegen->output_file, ";\n");
-            codegen->lines_generated++;
-            break;
+        case AST_IDENTIFIER:
+            return ctype_from_token(symbol_lookup(&codegen->variables, node->data.identifier.name));
+        case AST_CALL:
+            return ctype_from_token(symbol_lookup(&codegen->functions, node->data.call.name));
+        case AST_UNARY: {
+            if (node->data.unary.operator == TOKEN_NOT || !node->data.unary.operand) return CTYPE_INT;
+            CType operand = infer_ctype(codegen, node->data.unary.operand);
+            return operand == CTYPE_BOOL ? CTYPE_INT : operand;
+        }
+        case AST_BINARY:
+        case AST_ASSIGNMENT:
+            if (!node->data.binary.left || !node->data.binary.right) return CTYPE_INT;
+            return combine_ctype(node->data.binary.operator,
+                                 infer_ctype(codegen, node->data.binary.left),
+                                 infer_ctype(codegen, node->data.binary.right));
         default:
-            codegen_error(codegen, "Unknown statement type");
-            break;
+            return CTYPE_INT;
     }
 }
 
-static void generate_c_program(CodeGenerator* codegen, const ASTNode* node) {
-    // Generate C headers
-    emit_line(codegen, "#include <stdio.h>");
-    emit_line(codegen, "#include <stdlib.h>");
-    emit_line(codegen, "#include <stdbool.h>");
-    emit_line(codegen, "#include <string.h>");
-    emit_line(codegen, "");
-    emit_line(codegen, "int main() {");
-    
-    codegen->indent_level++;
-    
-    // Generate all statements
-    for (int i = 0; i < node->data.program.statement_count; i++) {
-        generate_c_statement(codegen, node->data.program.statements[i]);
+// ================== EXPRESSION FLATTENING ==================
+//
+// Huge expressions are split bottom-up: once the part of a subtree that
+// would still be emitted inline exceeds the threshold, the subtree is
+// hoisted into `const T shayc_tN = ...;` and referenced by name. Temporaries
+// are emitted in left-to-right post-order, which is a valid C evaluation
+// order. The right operand of && and || is only evaluated conditionally,
+// so a large one is lowered into an if block instead of being hoisted.
+// Trees can be arbitrarily deep, so the walk uses an explicit stack.
+
+struct FlattenFrame {
+    const ASTNode* node;
+    int state;              // Next child to visit, or short-circuit phase
+    int temp;               // Temporary opened for a short-circuit operator
+};
+
+static const ASTNode* expression_child(const ASTNode* node, int index) {
+    switch (node->type) {
+        case AST_BINARY:
+        case AST_ASSIGNMENT:
+            if (index == 0) return node->data.binary.left;
+            if (index == 1) return node->data.binary.right;
+            return NULL;
+        case AST_UNARY:
+            return index == 0 ? node->data.unary.operand : NULL;
+        case AST_CALL:
+            return index < node->data.call.arg_count ? node->data.call.arguments[index] : NULL;
+        default:
+            return NULL;
     }
-    
-    // Add return 0 if no explicit return
-    emit_line(codegen, "return 0;");
-    
-    codegen->indent_level--;
-    emit_line(codegen, "}");
 }
 
-// ================== MAIN CODE GENERATION FUNCTION ==================
+static bool flatten_push(CodeGenerator* codegen, size_t* depth, const ASTNode* node) {
+    FlattenState* state = &codegen->flatten;
+    if (*depth == state->stack_capacity) {
+        size_t new_capacity = state->stack_capacity ? state->stack_capacity * 2 : 256;
+        struct FlattenFrame* stack = realloc(state->stack, new_capacity * sizeof(*stack));
+        if (!stack) {
+            codegen_error(codegen, "Out of memory while flattening expression");
+            return false;
+        }
+        state->stack = stack;
+        state->stack_capacity = new_capacity;
+    }
+    state->stack[*depth].node = node;
+    state->stack[*depth].state = 0;
+    state->stack[*depth].temp = -1;
+    (*depth)++;
+    return true;
+}
 
-bool codegen_generate(CodeGenerator* codegen, const ASTNode* ast) {
-    if (!codegen || !ast) return false;
+// Counts nodes, giving up as soon as the limit is exceeded
+static bool expression_exceeds(CodeGenerator* codegen, const ASTNode* root, size_t limit) {
+    size_t depth = 0;
+    size_t count = 0;
+    if (!flatten_push(codegen, &depth, root)) return false;
     
-    switch (codegen->format) {
-        case OUTPUT_C:
-            generate_c_program(codegen, ast);
-            break;
-        case OUTPUT_JAVASCRIPT:
-            // Could implement JavaScript generation here
-            codegen_error(codegen, "JavaScript output not implemented yet");
-            return false;
-        case OUTPUT_PYTHON:
-            // Could implement Python generation here
-            codegen_error(codegen, "Python output not implemented yet");
-            return false;
-        case OUTPUT_BYTECODE:
-            // Could implement bytecode generation here
-            codegen_error(codegen, "Bytecode output not implemented yet");
-            return false;
+    while (depth > 0) {
+        const ASTNode* node = codegen->flatten.stack[--depth].node;
+        if (++count > limit) return true;
+        for (int i = 0; expression_child(node, i); i++) {
+            if (!flatten_push(codegen, &depth, expression_child(node, i))) return false;
+        }
     }
+    return false;
+}
+
+// Post-order pass recording every subtree's size
+static bool flatten_measure(CodeGenerator* codegen, const ASTNode* root) {
+    size_t depth = 0;
+    if (!flatten_push(codegen, &depth, root)) return false;
     
-    return !codegen->had_error;
+    while (depth > 0) {
+        struct FlattenFrame* frame = &codegen->flatten.stack[depth - 1];
+        const ASTNode* child = expression_child(frame->node, frame->state);
+        if (child) {
+            frame->state++;
+            if (!flatten_push(codegen, &depth, child)) return false;
+            continue;
+        }
+        
+        FlattenEntry* entry = flatten_entry(codegen, frame->node, true);
+        if (!entry) return false;
+        entry->size = 1;
+        for (int i = 0; (child = expression_child(frame->node, i)); i++) {
+            entry->size += flatten_entry(codegen, child, false)->size;
+        }
+        entry->weight = entry->size;
+        depth--;
+    }
+    return true;
 }
 
-// ================== UTILITY FUNCTIONS ==================
+static bool is_short_circuit(const ASTNode* node) {
+    return node->type == AST_BINARY &&
+           (node->data.binary.operator == TOKEN_AND || node->data.binary.operator == TOKEN_OR);
+}
 
-bool codegen_has_error(const CodeGenerator* codegen) {
-    return codegen->had_error;
+// Normalises a value to the 0/1 result of && and ||
+static void emit_truth_value(CodeGenerator* codegen, const ASTNode* node) {
+    int prec = expression_precedence(codegen, node);
+    bool is_boolean = prec == PREC_LOGICAL_OR || prec == PREC_LOGICAL_AND ||
+                      prec == PREC_EQUALITY || prec == PREC_RELATIONAL ||
+                      (node->type == AST_UNARY && node->data.unary.operator == TOKEN_NOT);
+    if (is_boolean) {
+        generate_c_expression(codegen, node);
+        return;
+    }
+    generate_c_operand(codegen, node, prec <= PREC_RELATIONAL);
+    emit_lit(codegen, " != 0");
 }
 
-const char* codegen_get_error(const CodeGenerator* codegen) {
-    return codegen->error_message;
+static int flatten_new_temp(CodeGenerator* codegen, const char* qualifier, CType type) {
+    int temp = codegen->flatten.next_temp++;
+    codegen->flatten.temps_generated++;
+    emit_indent(codegen);
+    emit_str(codegen, qualifier);
+    emit_str(codegen, c_type_names[type]);
+    outbuf_putc(codegen->out, ' ');
+    emit_temp_name(codegen, temp);
+    emit_lit(codegen, " = ");
+    return temp;
 }
 
-int codegen_get_lines_generated(const CodeGenerator* codegen) {
-    return codegen->lines_generated;
+static void flatten_end_statement(CodeGenerator* codegen) {
+    emit_lit(codegen, ";\n");
+    codegen->lines_generated++;
 }
 
-double codegen_get_generation_time(const CodeGenerator* codegen) {
-    double current_time = (double)clock() / CLOCKS_PER_SEC;
-    return current_time - codegen->gen_start_time;
+static void flatten_walk(CodeGenerator* codegen, const ASTNode* root) {
+    FlattenState* state = &codegen->flatten;
+    size_t threshold = (size_t)state->threshold;
+    size_t depth = 0;
+    if (!flatten_push(codegen, &depth, root)) return;
+    
+    while (depth > 0 && !codegen->had_error) {
+        struct FlattenFrame* frame = &state->stack[depth - 1];
+        const ASTNode* node = frame->node;
+        FlattenEntry* entry = flatten_entry(codegen, node, false);
+        
+        const ASTNode* right = is_short_circuit(node) ? node->data.binary.right : NULL;
+        if (right && flatten_entry(codegen, right, false)->size > threshold) {
+            const ASTNode* left = node->data.binary.left;
+            bool is_and = node->data.binary.operator == TOKEN_AND;
+            
+            if (frame->state == 0) {
+                frame->state = 1;
+                if (flatten_entry(codegen, left, false)->size > threshold) {
+                    flatten_push(codegen, &depth, left);
+                }
+            } else if (frame->state == 1) {
+                // int t = left != 0; if (t) { ...right...; t = right != 0; }
+                frame->state = 2;
+                frame->temp = flatten_new_temp(codegen, "", CTYPE_INT);
+                emit_truth_value(codegen, left);
+                flatten_end_statement(codegen);
+                
+                emit_indent(codegen);
+                if (is_and) {
+                    emit_lit(codegen, "if (");
+                } else {
+                    emit_lit(codegen, "if (!");
+                }
+                emit_temp_name(codegen, frame->temp);
+                emit_lit(codegen, ") {\n");
+                codegen->lines_generated++;
+                codegen->indent_level++;
+                flatten_push(codegen, &depth, right);
+            } else {
+                emit_indent(codegen);
+                emit_temp_name(codegen, frame->temp);
+                emit_lit(codegen, " = ");
+                emit_truth_value(codegen, right);
+                flatten_end_statement(codegen);
+                codegen->indent_level--;
+                emit_line(codegen, "}");
+                
+                entry->temp = frame->temp;
+                entry->weight = 1;
+                entry->ctype = CTYPE_INT;
+                depth--;
+            }
+            continue;
+        }
+        
+        const ASTNode* child = expression_child(node, frame->state);
+        if (child) {
+            frame->state++;
+            if (flatten_entry(codegen, child, false)->size > threshold) {
+                flatten_push(codegen, &depth, child);
+            }
+            continue;
+        }
+        
+        // All children done: combine their inline weights and types
+        entry->weight = 1;
+        CType types[2] = { CTYPE_INT, CTYPE_INT };
+        for (int i = 0; (child = expression_child(node, i)); i++) {
+            FlattenEntry* child_entry = flatten_entry(codegen, child, false);
+            entry->weight += child_entry->temp >= 0 ? 1 : child_entry->weight;
+            if (i < 2) {
+                types[i] = child_entry->size > threshold ? (CType)child_entry->ctype
+                                                         : infer_ctype(codegen, child);
+            }
+        }
+        switch (node->type) {
+            case AST_UNARY:
+                types[0] = node->data.unary.operator == TOKEN_NOT || types[0] == CTYPE_BOOL
+                         ? CTYPE_INT : types[0];
+                entry->ctype = types[0];
+                break;
+            case AST_BINARY:
+            case AST_ASSIGNMENT:
+                entry->ctype = combine_ctype(node->data.binary.operator, types[0], types[1]);
+                break;
+            default:
+                entry->ctype = infer_ctype(codegen, node);
+                break;
+        }
+        
+        if (node != root && entry->weight > threshold) {
+            int temp = flatten_new_temp(codegen, "const ", (CType)entry->ctype);
+            generate_c_expression(codegen, node);
+            flatten_end_statement(codegen);
+            entry->temp = temp;
+            entry->weight = 1;
+        }
+        depth--;
+    }
+}
+
+// True when flatten_prepare would split this expression
+static bool flatten_needed(CodeGenerator* codegen, const ASTNode* root) {
+    return codegen->flatten.threshold > 0 && root &&
+           expression_exceeds(codegen, root, (size_t)codegen->flatten.threshold);
+}
+
+// Called before a statement is emitted; hoists temporaries for its
+// expression if it is over the threshold. The statement itself then
+// references them, and flatten_finish ends the substitution.
+static void flatten_prepare(CodeGenerator* codegen, const ASTNode* root) {
+    FlattenState* state = &codegen->flatten;
+    if (!flatten_needed(codegen, root)) return;
+    
+    TraceScope scope;
+    trace_begin(&scope);
+    if (++state->generation == 0) {
+        memset(state->entries, 0, state->capacity * sizeof(FlattenEntry));
+        state->generation = 1;
+    }
+    state->count = 0;
+    state->active = true;
+    state->expressions_flattened++;
+    
+    if (flatten_measure(codegen, root)) {
+        flatten_walk(codegen, root);
+    }
+    trace_end(&scope, "flatten", NULL);
+}
+
+static void flatten_finish(CodeGenerator* codegen) {
+    codegen->flatten.active = false;
+}
+
+// ================== C STATEMENTS ==================
+
+static void generate_c_statement(CodeGenerator* codegen, const ASTNode* node);
+
+// "type name = init", shared by declarations and for-loop initializers
+static void generate_c_var_head(CodeGenerator* codegen, const ASTNode* node) {
+    // Convert ShayLang types to C types
+    emit_str(codegen, c_type_names[ctype_from_token(node->data.var_decl.type)]);
+    outbuf_putc(codegen->out, ' ');
+    emit_user_name(codegen, node->data.var_decl.name);
+    
+    if (node->data.var_decl.initializer) {
+        emit_lit(codegen, " = ");
+        generate_c_expression(codegen, node->data.var_decl.initializer);
+    }
+    codegen->variables_declared++;
+    
+    if (codegen->flatten.threshold > 0) {
+        symbol_define(codegen, &codegen->variables, node->data.var_decl.name, node->data.var_decl.type);
+    }
+}
+
+static void generate_c_var_declaration(CodeGenerator* codegen, const ASTNode* node) {
+    flatten_prepare(codegen, node->data.var_decl.initializer);
+    emit_indent(codegen);
+    generate_c_var_head(codegen, node);
+    emit_lit(codegen, ";\n");
+    flatten_finish(codegen);
+    codegen->lines_generated++;
+}
+
+// Body of a braced construct: a block's statements, or a single statement
+static void generate_c_body(CodeGenerator* codegen, const ASTNode* body) {
+    codegen->indent_level++;
+    if (body && body->type == AST_BLOCK_STMT) {
+        for (int i = 0; i < body->data.block.statement_count; i++) {
+            generate_c_statement(codegen, body->data.block.statements[i]);
+        }
+    } else {
+        generate_c_statement(codegen, body);
+    }
+    codegen->indent_level--;
+}
+
+// ================== BRANCH SITES ==================
+//
+// Every if, while and conditional for inside a function is a branch site,
+// numbered in source order. A --profile build counts each site; with
+// --profile-use the same numbering finds the counts again, so a function
+// whose site count changed since the profile was taken is left alone.
+
+#define PGO_BRANCH_MIN_COUNT 100    // Executions before a site is trusted
+#define PGO_BRANCH_BIAS 0.9         // Share one way before it is hinted
+
+static int count_branch_sites(const ASTNode* node) {
+    if (!node) return 0;
+    switch (node->type) {
+        case AST_IF_STMT:
+            return 1 + count_branch_sites(node->data.if_stmt.then_stmt) +
+                   count_branch_sites(node->data.if_stmt.else_stmt);
+        case AST_WHILE_STMT:
+            return 1 + count_branch_sites(node->data.while_stmt.body);
+        case AST_FOR_STMT:
+            return (node->data.for_stmt.condition != NULL) + count_branch_sites(node->data.for_stmt.body);
+        case AST_BLOCK_STMT: {
+            int count = 0;
+            for (int i = 0; i < node->data.block.statement_count; i++) {
+                count += count_branch_sites(node->data.block.statements[i]);
+            }
+            return count;
+        }
+        default:
+            return 0;
+    }
+}
+
+// 1 if the profile says the site is almost always taken, -1 if almost
+// never, 0 without a clear answer
+static int branch_bias(CodeGenerator* codegen, int site) {
+    const ProfileFunction* profile = codegen->function_profile;
+    if (!codegen->profile_hints || !profile || site >= profile->branch_count) return 0;
+    unsigned long long taken = profile->branches[site][0];
+    unsigned long long total = taken + profile->branches[site][1];
+    if (total < PGO_BRANCH_MIN_COUNT) return 0;
+    int bias = 0;
+    if (taken >= total * PGO_BRANCH_BIAS) {
+        bias = 1;
+    } else if (total - taken >= total * PGO_BRANCH_BIAS) {
+        bias = -1;
+    }
+    codegen->pgo.branch_hints += bias != 0;
+    return bias;
+}
+
+// A condition as counted (--profile), hinted (--profile-use) or plain;
+// `negate` emits !(condition) for an if/else laid out the other way round
+static void generate_c_condition(CodeGenerator* codegen, const ASTNode* condition, int site, int bias,
+                                 bool negate) {
+    if (codegen->function && is_profiled(codegen, codegen->function)) {
+        emit_lit(codegen, "SHAY_PROF_BRANCH(shayc_profile_");
+        emit_str(codegen, codegen->function->data.func_decl.name);
+        emit_lit(codegen, ", ");
+        outbuf_append_int(codegen->out, site);
+        emit_lit(codegen, ", ");
+        generate_c_expression(codegen, condition);
+        outbuf_putc(codegen->out, ')');
+        return;
+    }
+    if (bias > 0) emit_lit(codegen, "SHAY_LIKELY(");
+    if (bias < 0) emit_lit(codegen, "SHAY_UNLIKELY(");
+    if (negate) emit_lit(codegen, "!(");
+    generate_c_expression(codegen, condition);
+    if (negate) outbuf_putc(codegen->out, ')');
+    if (bias) outbuf_putc(codegen->out, ')');
+}
+
+// The profile says the else branch is the hot one: emit it first, under
+// the negated condition, so it becomes the fall-through path. Site
+// numbers stay those of the source order.
+static void generate_c_if_swapped(CodeGenerator* codegen, const ASTNode* node, int site) {
+    const ASTNode* then_stmt = node->data.if_stmt.then_stmt;
+    int then_first = codegen->branch_site;
+    int else_first = then_first + count_branch_sites(then_stmt);
+    
+    flatten_prepare(codegen, node->data.if_stmt.condition);
+    emit_indent(codegen);
+    emit_lit(codegen, "if (");
+    generate_c_condition(codegen, node->data.if_stmt.condition, site, 1, true);
+    emit_lit(codegen, ") {\n");
+    flatten_finish(codegen);
+    codegen->lines_generated++;
+    codegen->branch_site = else_first;
+    generate_c_body(codegen, node->data.if_stmt.else_stmt);
+    int end = codegen->branch_site;
+    emit_line(codegen, "} else {");
+    codegen->branch_site = then_first;
+    generate_c_body(codegen, then_stmt);
+    emit_line(codegen, "}");
+    codegen->branch_site = end;
+    codegen->pgo.swapped++;
+}
+
+static void generate_c_if(CodeGenerator* codegen, const ASTNode* node) {
+    int site = codegen->branch_site++;
+    int bias = branch_bias(codegen, site);
+    const ASTNode* else_stmt = node->data.if_stmt.else_stmt;
+    if (bias < 0 && else_stmt && else_stmt->type != AST_IF_STMT) {
+        generate_c_if_swapped(codegen, node, site);
+        return;
+    }
+    
+    flatten_prepare(codegen, node->data.if_stmt.condition);
+    emit_indent(codegen);
+    emit_lit(codegen, "if (");
+    generate_c_condition(codegen, node->data.if_stmt.condition, site, bias, false);
+    emit_lit(codegen, ") {\n");
+    flatten_finish(codegen);
+    codegen->lines_generated++;
+    generate_c_body(codegen, node->data.if_stmt.then_stmt);
+    
+    // else-if chains stay flat unless a condition needs temporaries first
+    while (else_stmt && else_stmt->type == AST_IF_STMT &&
+           !flatten_needed(codegen, else_stmt->data.if_stmt.condition)) {
+        site = codegen->branch_site++;
+        emit_indent(codegen);
+        emit_lit(codegen, "} else if (");
+        generate_c_condition(codegen, else_stmt->data.if_stmt.condition, site, branch_bias(codegen, site), false);
+        emit_lit(codegen, ") {\n");
+        codegen->lines_generated++;
+        generate_c_body(codegen, else_stmt->data.if_stmt.then_stmt);
+        else_stmt = else_stmt->data.if_stmt.else_stmt;
+    }
+    if (else_stmt) {
+        emit_line(codegen, "} else {");
+        generate_c_body(codegen, else_stmt);
+    }
+    emit_line(codegen, "}");
+}
+
+// Loop conditions are re-evaluated every iteration, so they are never
+// flattened into temporaries ahead of the loop
+static void generate_c_while(CodeGenerator* codegen, const ASTNode* node) {
+    int site = codegen->branch_site++;
+    emit_indent(codegen);
+    emit_lit(codegen, "while (");
+    generate_c_condition(codegen, node->data.while_stmt.condition, site, branch_bias(codegen, site), false);
+    emit_lit(codegen, ") {\n");
+    codegen->lines_generated++;
+    generate_c_body(codegen, node->data.while_stmt.body);
+    emit_line(codegen, "}");
+}
+
+static void generate_c_for(CodeGenerator* codegen, const ASTNode* node) {
+    const ASTNode* init = node->data.for_stmt.initializer;
+    
+    emit_indent(codegen);
+    emit_lit(codegen, "for (");
+    if (init && init->type == AST_VAR_DECLARATION) {
+        generate_c_var_head(codegen, init);
+    } else if (init) {
+        generate_c_expression(codegen, init->data.binary.left);
+    }
+    emit_lit(codegen, ";");
+    if (node->data.for_stmt.condition) {
+        int site = codegen->branch_site++;
+        outbuf_putc(codegen->out, ' ');
+        generate_c_condition(codegen, node->data.for_stmt.condition, site, branch_bias(codegen, site), false);
+    }
+    emit_lit(codegen, ";");
+    if (node->data.for_stmt.update) {
+        outbuf_putc(codegen->out, ' ');
+        generate_c_expression(codegen, node->data.for_stmt.update);
+    }
+    emit_lit(codegen, ") {\n");
+    codegen->lines_generated++;
+    generate_c_body(codegen, node->data.for_stmt.body);
+    emit_line(codegen, "}");
+}
+
+static void generate_c_statement(CodeGenerator* codegen, const ASTNode* node) {
+    if (!node) return;
+    
+    switch (node->type) {
+        case AST_VAR_DECLARATION:
+            generate_c_var_declaration(codegen, node);
+            break;
+        case AST_EXPRESSION_STMT:
+            flatten_prepare(codegen, node->data.binary.left);
+            emit_indent(codegen);
+            generate_c_expression(codegen, node->data.binary.left);
+            emit_lit(codegen, ";\n");
+            flatten_finish(codegen);
+            codegen->lines_generated++;
+            break;
+        case AST_RETURN_STMT:
+            flatten_prepare(codegen, node->data.return_stmt.value);
+            emit_indent(codegen);
+            emit_lit(codegen, "return");
+            if (node->data.return_stmt.value) {
+                outbuf_putc(codegen->out, ' ');
+                generate_c_expression(codegen, node->data.return_stmt.value);
+            }
+            emit_lit(codegen, ";\n");
+            flatten_finish(codegen);
+            codegen->lines_generated++;
+            break;
+        case AST_IF_STMT:
+            generate_c_if(codegen, node);
+            break;
+        case AST_WHILE_STMT:
+            generate_c_while(codegen, node);
+            break;
+        case AST_FOR_STMT:
+            generate_c_for(codegen, node);
+            break;
+        case AST_BLOCK_STMT:
+            emit_line(codegen, "{");
+            generate_c_body(codegen, node);
+            emit_line(codegen, "}");
+            break;
+        case AST_FUNCTION_DECL:
+            codegen_error(codegen, "Functions can only be declared at top level");
+            break;
+        default:
+            codegen_error(codegen, "Unknown statement type");
+            break;
+    }
+}
+
+// ================== C FUNCTIONS AND PROGRAM ==================
+
+// Return type of the program's main function, TOKEN_EOF when there is none
+static TokenType defines_user_main(const ASTNode* program) {
+    for (int i = 0; i < program->data.program.statement_count; i++) {
+        const ASTNode* stmt = program->data.program.statements[i];
+        if (stmt->type == AST_FUNCTION_DECL && strcmp(stmt->data.func_decl.name, "main") == 0) {
+            return stmt->data.func_decl.return_type;
+        }
+    }
+    return TOKEN_EOF;
+}
+
+// Every C function is its own scope: variables and temporary numbering
+// start over, so a function's code depends only on its own body and the
+// signatures it calls
+static void begin_c_scope(CodeGenerator* codegen) {
+    symbol_clear(&codegen->variables);
+    codegen->flatten.next_temp = 0;
+}
+
+// `qualifier` is "static " for a single translation unit, where nothing
+// outside the file needs the symbols, and "" when units link together.
+// A non-NULL `prefix` names the body of a profiled function instead.
+static void generate_c_signature(CodeGenerator* codegen, const ASTNode* node, const char* qualifier,
+                                 const char* prefix) {
+    emit_str(codegen, qualifier);
+    emit_str(codegen, c_type_names[ctype_from_token(node->data.func_decl.return_type)]);
+    outbuf_putc(codegen->out, ' ');
+    if (prefix) {
+        emit_str(codegen, prefix);
+        emit_str(codegen, node->data.func_decl.name);
+    } else {
+        emit_user_name(codegen, node->data.func_decl.name);
+    }
+    outbuf_putc(codegen->out, '(');
+    if (node->data.func_decl.param_count == 0) {
+        emit_lit(codegen, "void");
+    }
+    for (int i = 0; i < node->data.func_decl.param_count; i++) {
+        if (i > 0) emit_lit(codegen, ", ");
+        emit_str(codegen, c_type_names[ctype_from_token(node->data.func_decl.param_types[i])]);
+        outbuf_putc(codegen->out, ' ');
+        emit_user_name(codegen, node->data.func_decl.parameters[i]);
+    }
+    outbuf_putc(codegen->out, ')');
+}
+
+// With --profile-use the function's attribute goes on the prototype,
+// which every call site sees
+static void generate_c_prototype(CodeGenerator* codegen, const ASTNode* node, const char* qualifier) {
+    const char* attribute = function_attribute(codegen, node);
+    char attributed[32];
+    if (attribute) {
+        snprintf(attributed, sizeof(attributed), "%s%s", qualifier, attribute);
+        qualifier = attributed;
+    }
+    generate_c_signature(codegen, node, qualifier, NULL);
+    emit_lit(codegen, ";\n");
+    codegen->lines_generated++;
+}
+
+static void generate_c_prototypes(CodeGenerator* codegen, const ASTNode* program, const char* qualifier) {
+    for (int i = 0; i < program->data.program.statement_count; i++) {
+        const ASTNode* stmt = program->data.program.statements[i];
+        if (stmt->type == AST_FUNCTION_DECL) {
+            generate_c_prototype(codegen, stmt, qualifier);
+        }
+    }
+}
+
+// ================== PROFILING ==================
+//
+// A profiled function's body is emitted as shayc_body_<name>, and <name>
+// becomes a wrapper that counts the call and times it, so every return
+// path is covered and recursive calls go through the wrapper. Time is
+// TSC cycles on x86 and nanoseconds elsewhere; "self" excludes profiled
+// callees. Each if, while and for condition inside a profiled function
+// also counts how often it was taken. Generated programs are
+// single-threaded, so the counters are plain statics. The runtime
+// registers each function on its first call and prints a flat profile at
+// exit, also writing it to $SHAYNEFRO_PROFILE (default shaynefro.prof) in
+// the format profile.h reads back.
+
+#define PROFILE_BODY_PREFIX "shayc_body_"
+
+static const char* const profile_runtime[] = {
+    "#if defined(__x86_64__) || defined(__i386__)",
+    "#include <x86intrin.h>",
+    "#define SHAY_PROF_UNIT \"cycles\"",
+    "static inline unsigned long long shayc_prof_now(void) { return __rdtsc(); }",
+    "#else",
+    "#include <time.h>",
+    "#define SHAY_PROF_UNIT \"ns\"",
+    "static inline unsigned long long shayc_prof_now(void) {",
+    "    struct timespec now;",
+    "    clock_gettime(CLOCK_MONOTONIC, &now);",
+    "    return (unsigned long long)now.tv_sec * 1000000000ull + (unsigned long long)now.tv_nsec;",
+    "}",
+    "#endif",
+    "",
+    "typedef struct ShayProfile {",
+    "    const char* name;",
+    "    unsigned long long calls;",
+    "    unsigned long long self;    // In the function itself",
+    "    unsigned long long total;   // Including callees, outermost calls only",
+    "    unsigned depth;             // Active calls, more than one when recursing",
+    "    struct ShayProfile* next;",
+    "    unsigned long long (*branches)[2]; // Taken and not taken, per condition",
+    "    int branch_count;",
+    "} ShayProfile;",
+    "",
+    "static inline int shayc_prof_branch(unsigned long long* counts, int taken) {",
+    "    counts[!taken]++;",
+    "    return taken;",
+    "}",
+    "#define SHAY_PROF_BRANCH(profile, site, cond) shayc_prof_branch((profile).branches[site], (cond) != 0)",
+    "",
+    "typedef struct {",
+    "    unsigned long long start;",
+    "    unsigned long long callees; // The caller's callee time so far",
+    "} ShayProfFrame;",
+    "",
+    "static ShayProfile* shayc_prof_list;",
+    "static unsigned long long shayc_prof_callees;",
+    "",
+    "static int shayc_prof_by_self(const void* a, const void* b) {",
+    "    const ShayProfile* x = *(const ShayProfile* const*)a;",
+    "    const ShayProfile* y = *(const ShayProfile* const*)b;",
+    "    if (x->self != y->self) return x->self < y->self ? 1 : -1;",
+    "    return strcmp(x->name, y->name);",
+    "}",
+    "",
+    "static void shayc_prof_dump(void) {",
+    "    size_t count = 0;",
+    "    unsigned long long total = 0;",
+    "    for (ShayProfile* p = shayc_prof_list; p; p = p->next) {",
+    "        count++;",
+    "        total += p->self;",
+    "    }",
+    "    ShayProfile** sorted = malloc(count * sizeof(*sorted));",
+    "    if (!sorted) return;",
+    "    size_t n = 0;",
+    "    for (ShayProfile* p = shayc_prof_list; p; p = p->next) sorted[n++] = p;",
+    "    qsort(sorted, count, sizeof(*sorted), shayc_prof_by_self);",
+    "",
+    "    fprintf(stderr, \"\\nFlat profile (\" SHAY_PROF_UNIT \"):\\n\");",
+    "    fprintf(stderr, \"  %%self          self         total        calls  function\\n\");",
+    "    for (size_t i = 0; i < count; i++) {",
+    "        fprintf(stderr, \"%6.2f %13llu %13llu %12llu  %s\\n\", total ? 100.0 * sorted[i]->self / total : 0.0,",
+    "                sorted[i]->self, sorted[i]->total, sorted[i]->calls, sorted[i]->name);",
+    "    }",
+    "",
+    "    const char* path = getenv(\"SHAYNEFRO_PROFILE\");",
+    "    FILE* file = fopen(path ? path : \"shaynefro.prof\", \"w\");",
+    "    if (file) {",
+    "        fprintf(file, \"# shaynefro profile 1 \" SHAY_PROF_UNIT \" \" SHAY_PROF_SCOPE \"\\n\");",
+    "        for (size_t i = 0; i < count; i++) {",
+    "            fprintf(file, \"function %s %llu %llu %llu %d\\n\", sorted[i]->name, sorted[i]->calls,",
+    "                    sorted[i]->self, sorted[i]->total, sorted[i]->branch_count);",
+    "            for (int b = 0; b < sorted[i]->branch_count; b++) {",
+    "                fprintf(file, \"branch %d %llu %llu\\n\", b, sorted[i]->branches[b][0], sorted[i]->branches[b][1]);",
+    "            }",
+    "        }",
+    "        fclose(file);",
+    "    }",
+    "    free(sorted);",
+    "}",
+    "",
+    "static inline ShayProfFrame shayc_prof_enter(ShayProfile* profile) {",
+    "    if (profile->calls++ == 0) {",
+    "        if (!shayc_prof_list) atexit(shayc_prof_dump);",
+    "        profile->next = shayc_prof_list;",
+    "        shayc_prof_list = profile;",
+    "    }",
+    "    profile->depth++;",
+    "    ShayProfFrame frame = { 0, shayc_prof_callees };",
+    "    shayc_prof_callees = 0;",
+    "    frame.start = shayc_prof_now();",
+    "    return frame;",
+    "}",
+    "",
+    "static inline void shayc_prof_leave(ShayProfile* profile, ShayProfFrame frame) {",
+    "    unsigned long long elapsed = shayc_prof_now() - frame.start;",
+    "    profile->self += elapsed - shayc_prof_callees;",
+    "    if (--profile->depth == 0) profile->total += elapsed;",
+    "    shayc_prof_callees = frame.callees + elapsed;",
+    "}",
+    "",
+};
+
+static bool is_profiled(const CodeGenerator* codegen, const ASTNode* function) {
+    return codegen->profile || function->data.func_decl.profiled;
+}
+
+static bool program_is_profiled(const CodeGenerator* codegen, const ASTNode* program) {
+    for (int i = 0; i < program->data.program.statement_count; i++) {
+        const ASTNode* stmt = program->data.program.statements[i];
+        if (stmt->type == AST_FUNCTION_DECL && is_profiled(codegen, stmt)) return true;
+    }
+    return false;
+}
+
+// "all" tells --profile-use that a function missing from the profile never ran
+static void generate_c_profile_runtime(CodeGenerator* codegen) {
+    emit_line(codegen, "// Profiling runtime: calls, time and branches per function, printed at exit");
+    emit_line(codegen, codegen->profile ? "#define SHAY_PROF_SCOPE \"all\"" : "#define SHAY_PROF_SCOPE \"marked\"");
+    for (size_t i = 0; i < sizeof(profile_runtime) / sizeof(profile_runtime[0]); i++) {
+        emit_line(codegen, profile_runtime[i]);
+    }
+}
+
+// shayc_profile_<name>, ahead of the body whose conditions count into it
+static void generate_c_profile_record(CodeGenerator* codegen, const ASTNode* node) {
+    const char* name = node->data.func_decl.name;
+    int sites = count_branch_sites(node->data.func_decl.body);
+    if (sites > 0) {
+        emit_lit(codegen, "static unsigned long long shayc_branches_");
+        emit_str(codegen, name);
+        outbuf_putc(codegen->out, '[');
+        outbuf_append_int(codegen->out, sites);
+        emit_lit(codegen, "][2];\n");
+        codegen->lines_generated++;
+    }
+    emit_lit(codegen, "static ShayProfile shayc_profile_");
+    emit_str(codegen, name);
+    emit_lit(codegen, " = { .name = \"");
+    emit_str(codegen, name);
+    outbuf_putc(codegen->out, '"');
+    if (sites > 0) {
+        emit_lit(codegen, ", .branches = shayc_branches_");
+        emit_str(codegen, name);
+        emit_lit(codegen, ", .branch_count = ");
+        outbuf_append_int(codegen->out, sites);
+    }
+    emit_lit(codegen, " };\n");
+    codegen->lines_generated++;
+}
+
+// The function's public name: count and time the call (`profiled`), put
+// it on the sampler's stack (--sample), and call the body
+static void generate_c_profile_wrapper(CodeGenerator* codegen, const ASTNode* node, const char* qualifier,
+                                       bool profiled) {
+    CType type = ctype_from_token(node->data.func_decl.return_type);
+    generate_c_signature(codegen, node, qualifier, NULL);
+    emit_lit(codegen, " {\n");
+    codegen->lines_generated++;
+    codegen->indent_level++;
+    
+    if (profiled) {
+        emit_indent(codegen);
+        emit_lit(codegen, "ShayProfFrame shayc_frame = shayc_prof_enter(&shayc_profile_");
+        emit_str(codegen, node->data.func_decl.name);
+        emit_lit(codegen, ");\n");
+        codegen->lines_generated++;
+    }
+    if (codegen->sample_runtime) {
+        emit_indent(codegen);
+        emit_lit(codegen, "SHAY_SAMPLE_PUSH(\"");
+        emit_str(codegen, node->data.func_decl.name);
+        emit_lit(codegen, "\");\n");
+        codegen->lines_generated++;
+    }
+    
+    emit_indent(codegen);
+    if (type != CTYPE_VOID) {
+        emit_str(codegen, c_type_names[type]);
+        emit_lit(codegen, " shayc_result = ");
+    }
+    emit_lit(codegen, PROFILE_BODY_PREFIX);
+    emit_str(codegen, node->data.func_decl.name);
+    outbuf_putc(codegen->out, '(');
+    for (int i = 0; i < node->data.func_decl.param_count; i++) {
+        if (i > 0) emit_lit(codegen, ", ");
+        emit_user_name(codegen, node->data.func_decl.parameters[i]);
+    }
+    emit_lit(codegen, ");\n");
+    codegen->lines_generated++;
+    
+    if (codegen->sample_runtime) {
+        emit_line(codegen, "SHAY_SAMPLE_POP();");
+    }
+    if (profiled) {
+        emit_indent(codegen);
+        emit_lit(codegen, "shayc_prof_leave(&shayc_profile_");
+        emit_str(codegen, node->data.func_decl.name);
+        emit_lit(codegen, ", shayc_frame);\n");
+        codegen->lines_generated++;
+    }
+    if (type != CTYPE_VOID) {
+        emit_line(codegen, "return shayc_result;");
+    }
+    codegen->indent_level--;
+    emit_line(codegen, "}");
+    emit_line(codegen, "");
+}
+
+// ================== SAMPLING ==================
+//
+// --sample wraps every function like --profile does, but the wrapper only
+// links a frame holding the function's name into a shadow stack kept on
+// the C stack, which costs two stores per call. A SIGPROF timer fires
+// SHAY_SAMPLE_HZ times per CPU second ($SHAYNEFRO_SAMPLE_HZ overrides it,
+// 0 turns sampling off) and the handler adds one sample to the current
+// stack's node in a call tree. The kernel delivers at most one per tick,
+// so the real rate can be lower. The tree lives in a fixed pool because
+// the handler cannot allocate; stacks that do not fit are counted as
+// dropped. At exit every node with samples is written as one line of
+// folded stacks ("[program];main;fib;fib 42") to $SHAYNEFRO_SAMPLES
+// (default shaynefro.folded), the input flamegraph.pl and speedscope take.
+
+static const char* const sample_runtime[] = {
+    "#include <signal.h>",
+    "#include <sys/time.h>",
+    "#include <time.h>",
+    "#define SHAY_SAMPLE_MAX_DEPTH 256",
+    "#define SHAY_SAMPLE_MAX_NODES 16384",
+    "",
+    "// The innermost active call; each frame lives in its function's wrapper",
+    "typedef struct ShaySampleFrame {",
+    "    const char* name;",
+    "    const volatile struct ShaySampleFrame* parent;",
+    "} ShaySampleFrame;",
+    "static const volatile ShaySampleFrame* volatile shayc_sample_top;",
+    "#define SHAY_SAMPLE_PUSH(name) \\",
+    "    volatile ShaySampleFrame shayc_sample_frame = { (name), shayc_sample_top }; \\",
+    "    shayc_sample_top = &shayc_sample_frame",
+    "#define SHAY_SAMPLE_POP() (shayc_sample_top = shayc_sample_frame.parent)",
+    "",
+    "typedef struct {",
+    "    const char* name;",
+    "    int child;                  // First child, -1 if none",
+    "    int sibling;                // Next child of the same parent",
+    "    unsigned long long samples; // Taken with exactly this stack",
+    "} ShaySampleNode;",
+    "",
+    "static ShaySampleNode shayc_sample_nodes[SHAY_SAMPLE_MAX_NODES] = { { \"[program]\", -1, -1, 0 } };",
+    "static int shayc_sample_node_count = 1;",
+    "static unsigned long long shayc_sample_total;",
+    "static unsigned long long shayc_sample_dropped;",
+    "static unsigned long long shayc_sample_ns;  // Spent in the handler",
+    "",
+    "static unsigned long long shayc_sample_clock(void) {",
+    "    struct timespec now;",
+    "    clock_gettime(CLOCK_MONOTONIC, &now);",
+    "    return (unsigned long long)now.tv_sec * 1000000000ull + (unsigned long long)now.tv_nsec;",
+    "}",
+    "",
+    "// Names are string literals, so they compare by address",
+    "static int shayc_sample_child(int parent, const char* name) {",
+    "    for (int c = shayc_sample_nodes[parent].child; c >= 0; c = shayc_sample_nodes[c].sibling) {",
+    "        if (shayc_sample_nodes[c].name == name) return c;",
+    "    }",
+    "    if (shayc_sample_node_count == SHAY_SAMPLE_MAX_NODES) return -1;",
+    "    int c = shayc_sample_node_count++;",
+    "    shayc_sample_nodes[c].name = name;",
+    "    shayc_sample_nodes[c].child = -1;",
+    "    shayc_sample_nodes[c].sibling = shayc_sample_nodes[parent].child;",
+    "    shayc_sample_nodes[parent].child = c;",
+    "    return c;",
+    "}",
+    "",
+    "// Stacks deeper than SHAY_SAMPLE_MAX_DEPTH are dropped",
+    "static void shayc_sample_handler(int signal_number) {",
+    "    (void)signal_number;",
+    "    unsigned long long start = shayc_sample_clock();",
+    "    const char* names[SHAY_SAMPLE_MAX_DEPTH];",
+    "    int depth = 0;",
+    "    const volatile ShaySampleFrame* frame = shayc_sample_top;",
+    "    for (; frame && depth < SHAY_SAMPLE_MAX_DEPTH; frame = frame->parent) names[depth++] = frame->name;",
+    "    int node = frame ? -1 : 0;",
+    "    for (int i = depth - 1; i >= 0 && node >= 0; i--) node = shayc_sample_child(node, names[i]);",
+    "    shayc_sample_total++;",
+    "    if (node < 0) {",
+    "        shayc_sample_dropped++;",
+    "    } else {",
+    "        shayc_sample_nodes[node].samples++;",
+    "    }",
+    "    shayc_sample_ns += shayc_sample_clock() - start;",
+    "}",
+    "",
+    "// Depth first, with the stack so far in path",
+    "static void shayc_sample_write(FILE* file, int node, char* path, size_t length, size_t capacity) {",
+    "    size_t name_length = strlen(shayc_sample_nodes[node].name);",
+    "    if (length + name_length + 2 > capacity) return;",
+    "    if (length > 0) path[length++] = ';';",
+    "    memcpy(path + length, shayc_sample_nodes[node].name, name_length + 1);",
+    "    length += name_length;",
+    "    if (shayc_sample_nodes[node].samples > 0) {",
+    "        fprintf(file, \"%s %llu\\n\", path, shayc_sample_nodes[node].samples);",
+    "    }",
+    "    for (int c = shayc_sample_nodes[node].child; c >= 0; c = shayc_sample_nodes[c].sibling) {",
+    "        shayc_sample_write(file, c, path, length, capacity);",
+    "    }",
+    "}",
+    "",
+    "static void shayc_sample_dump(void) {",
+    "    struct itimerval off;",
+    "    memset(&off, 0, sizeof(off));",
+    "    setitimer(ITIMER_PROF, &off, NULL);",
+    "    const char* path = getenv(\"SHAYNEFRO_SAMPLES\");",
+    "    if (!path) path = \"shaynefro.folded\";",
+    "    FILE* file = fopen(path, \"w\");",
+    "    if (!file) return;",
+    "    static char stack[SHAY_SAMPLE_MAX_DEPTH * 64];",
+    "    shayc_sample_write(file, 0, stack, 0, sizeof(stack));",
+    "    fclose(file);",
+    "    double seconds = (double)clock() / CLOCKS_PER_SEC;",
+    "    fprintf(stderr, \"\\n%llu samples in %.3f s of CPU time (%.0f Hz, %llu dropped) written to %s\\n\",",
+    "            shayc_sample_total, seconds, seconds > 0 ? shayc_sample_total / seconds : 0.0,",
+    "            shayc_sample_dropped, path);",
+    "    fprintf(stderr, \"Sampling handler: %.3f%% of CPU time\\n\", seconds > 0 ? shayc_sample_ns / seconds / 1e7 : 0.0);",
+    "}",
+    "",
+    "static void shayc_sample_start(void) {",
+    "    const char* rate = getenv(\"SHAYNEFRO_SAMPLE_HZ\");",
+    "    int hz = rate ? atoi(rate) : SHAY_SAMPLE_HZ;",
+    "    if (hz <= 0) return;",
+    "    if (hz > 1000000) hz = 1000000;",
+    "    struct sigaction action;",
+    "    memset(&action, 0, sizeof(action));",
+    "    action.sa_handler = shayc_sample_handler;",
+    "    sigemptyset(&action.sa_mask);",
+    "    action.sa_flags = SA_RESTART;",
+    "    sigaction(SIGPROF, &action, NULL);",
+    "    struct itimerval timer;",
+    "    timer.it_interval.tv_sec = 0;",
+    "    timer.it_interval.tv_usec = 1000000 / hz;",
+    "    timer.it_value = timer.it_interval;",
+    "    setitimer(ITIMER_PROF, &timer, NULL);",
+    "    atexit(shayc_sample_dump);",
+    "}",
+    "",
+};
+
+static void generate_c_sample_runtime(CodeGenerator* codegen) {
+    emit_line(codegen, "// Sampling runtime: SIGPROF call-stack samples, folded stacks written at exit");
+    emit_indent(codegen);
+    emit_lit(codegen, "#define SHAY_SAMPLE_HZ ");
+    outbuf_append_int(codegen->out, codegen->sample_hz);
+    outbuf_putc(codegen->out, '\n');
+    codegen->lines_generated++;
+    for (size_t i = 0; i < sizeof(sample_runtime) / sizeof(sample_runtime[0]); i++) {
+        emit_line(codegen, sample_runtime[i]);
+    }
+}
+
+// ================== PROFILE-GUIDED GENERATION ==================
+//
+// With --profile-use the prototypes carry what the profile says about each
+// function, and conditions carry __builtin_expect hints (see BRANCH SITES).
+// Functions with a large share of the time are marked hot; functions a
+// complete profile never saw are marked cold, which also keeps them out of
+// line; small non-recursive functions called often are forced inline. The
+// macros expand to nothing without GNU C.
+
+#define PGO_HOT_SHARE 0.10          // Share of all self time
+#define PGO_INLINE_MIN_CALLS 1000
+#define PGO_INLINE_MAX_NODES 40     // AST nodes in the whole function
+
+static const char* const profile_hints[] = {
+    "// Profile-guided hints (--profile-use)",
+    "#if defined(__GNUC__)",
+    "#define SHAY_LIKELY(x) __builtin_expect(!!(x), 1)",
+    "#define SHAY_UNLIKELY(x) __builtin_expect(!!(x), 0)",
+    "#define SHAY_HOT __attribute__((hot))",
+    "#define SHAY_COLD __attribute__((cold, noinline))",
+    "#define SHAY_INLINE inline __attribute__((always_inline))",
+    "#else",
+    "#define SHAY_LIKELY(x) (x)",
+    "#define SHAY_UNLIKELY(x) (x)",
+    "#define SHAY_HOT",
+    "#define SHAY_COLD",
+    "#define SHAY_INLINE inline",
+    "#endif",
+    "",
+};
+
+static void generate_c_profile_hints(CodeGenerator* codegen) {
+    for (size_t i = 0; i < sizeof(profile_hints) / sizeof(profile_hints[0]); i++) {
+        emit_line(codegen, profile_hints[i]);
+    }
+}
+
+// Spends one unit of *budget per node; false once it runs out or the
+// function calls itself
+static bool fits_inline(const ASTNode* node, const char* self, int* budget) {
+    if (!node) return true;
+    if (--*budget < 0) return false;
+    switch (node->type) {
+        case AST_BINARY:
+        case AST_ASSIGNMENT:
+            return fits_inline(node->data.binary.left, self, budget) &&
+                   fits_inline(node->data.binary.right, self, budget);
+        case AST_EXPRESSION_STMT:
+            return fits_inline(node->data.binary.left, self, budget);
+        case AST_UNARY:
+            return fits_inline(node->data.unary.operand, self, budget);
+        case AST_CALL:
+            if (strcmp(node->data.call.name, self) == 0) return false;
+            for (int i = 0; i < node->data.call.arg_count; i++) {
+                if (!fits_inline(node->data.call.arguments[i], self, budget)) return false;
+            }
+            return true;
+        case AST_VAR_DECLARATION:
+            return fits_inline(node->data.var_decl.initializer, self, budget);
+        case AST_RETURN_STMT:
+            return fits_inline(node->data.return_stmt.value, self, budget);
+        case AST_IF_STMT:
+            return fits_inline(node->data.if_stmt.condition, self, budget) &&
+                   fits_inline(node->data.if_stmt.then_stmt, self, budget) &&
+                   fits_inline(node->data.if_stmt.else_stmt, self, budget);
+        case AST_WHILE_STMT:
+            return fits_inline(node->data.while_stmt.condition, self, budget) &&
+                   fits_inline(node->data.while_stmt.body, self, budget);
+        case AST_FOR_STMT:
+            return fits_inline(node->data.for_stmt.initializer, self, budget) &&
+                   fits_inline(node->data.for_stmt.condition, self, budget) &&
+                   fits_inline(node->data.for_stmt.update, self, budget) &&
+                   fits_inline(node->data.for_stmt.body, self, budget);
+        case AST_BLOCK_STMT:
+            for (int i = 0; i < node->data.block.statement_count; i++) {
+                if (!fits_inline(node->data.block.statements[i], self, budget)) return false;
+            }
+            return true;
+        default:
+            return true;
+    }
+}
+
+// SHAY_HOT, SHAY_COLD, SHAY_INLINE or NULL, counted in codegen->pgo
+static const char* function_attribute(CodeGenerator* codegen, const ASTNode* function) {
+    if (!codegen->profile_hints) return NULL;
+    const ProfileData* data = codegen->profile_data;
+    const char* name = function->data.func_decl.name;
+    const ProfileFunction* profile = profile_find(data, name);
+    if (!profile) {
+        if (!data->complete) return NULL;
+        codegen->pgo.cold++;
+        return "SHAY_COLD ";
+    }
+    int budget = PGO_INLINE_MAX_NODES;
+    if (profile->calls >= PGO_INLINE_MIN_CALLS && fits_inline(function->data.func_decl.body, name, &budget)) {
+        codegen->pgo.inlined++;
+        return "SHAY_INLINE ";
+    }
+    if (data->total_self > 0 && profile->self >= data->total_self * PGO_HOT_SHARE) {
+        codegen->pgo.hot++;
+        return "SHAY_HOT ";
+    }
+    return NULL;
+}
+
+// The function's counts, unless its branch sites changed since profiling
+static const ProfileFunction* function_profile(CodeGenerator* codegen, const ASTNode* function) {
+    if (!codegen->profile_hints) return NULL;
+    const ProfileFunction* profile = profile_find(codegen->profile_data, function->data.func_decl.name);
+    if (profile && profile->branch_count != count_branch_sites(function->data.func_decl.body)) {
+        codegen->pgo.stale++;
+        return NULL;
+    }
+    return profile;
+}
+
+// ================== C FUNCTIONS ==================
+
+static void generate_c_function(CodeGenerator* codegen, const ASTNode* node, const char* qualifier) {
+    bool profiled = is_profiled(codegen, node);
+    if ((profiled && !codegen->profile_runtime) || (codegen->sample_hz > 0 && !codegen->sample_runtime)) {
+        codegen_error(codegen, "Profiled functions need single-file output, not --split or --incremental");
+        return;
+    }
+    bool wrapped = profiled || codegen->sample_runtime;
+    
+    TraceScope scope;
+    trace_begin(&scope);
+    begin_c_scope(codegen);
+    if (codegen->flatten.threshold > 0) {
+        for (int i = 0; i < node->data.func_decl.param_count; i++) {
+            symbol_define(codegen, &codegen->variables, node->data.func_decl.parameters[i],
+                          node->data.func_decl.param_types[i]);
+        }
+    }
+    
+    if (profiled) {
+        generate_c_profile_record(codegen, node);
+    }
+    codegen->function = node;
+    codegen->function_profile = function_profile(codegen, node);
+    codegen->branch_site = 0;
+    generate_c_signature(codegen, node, qualifier, wrapped ? PROFILE_BODY_PREFIX : NULL);
+    emit_lit(codegen, " {\n");
+    codegen->lines_generated++;
+    generate_c_body(codegen, node->data.func_decl.body);
+    emit_line(codegen, "}");
+    emit_line(codegen, "");
+    codegen->function = NULL;
+    codegen->function_profile = NULL;
+    if (wrapped) {
+        generate_c_profile_wrapper(codegen, node, qualifier, profiled);
+    }
+    codegen->functions_generated++;
+    trace_end(&scope, "function", node->data.func_decl.name);
+}
+
+static void generate_c_includes(CodeGenerator* codegen) {
+    emit_line(codegen, "#include <stdio.h>");
+    emit_line(codegen, "#include <stdlib.h>");
+    emit_line(codegen, "#include <stdbool.h>");
+    emit_line(codegen, "#include <string.h>");
+}
+
+// Top-level statements run in C's main; a Shaynefro main runs after them
+static void generate_c_main_head(CodeGenerator* codegen) {
+    emit_line(codegen, "int main() {");
+    codegen->indent_level++;
+    begin_c_scope(codegen);
+    if (codegen->sample_runtime) {
+        emit_line(codegen, "shayc_sample_start();");
+    }
+}
+
+static void generate_c_main_tail(CodeGenerator* codegen, TokenType user_main) {
+    if (user_main == TOKEN_EOF) {
+        // Add return 0 if no explicit return
+        emit_line(codegen, "return 0;");
+    } else if (user_main == TOKEN_VOID_KW) {
+        emit_line(codegen, "shay_main();");
+        emit_line(codegen, "return 0;");
+    } else {
+        emit_line(codegen, "return shay_main();");
+    }
+    
+    codegen->indent_level--;
+    emit_line(codegen, "}");
+}
+
+static void generate_c_main(CodeGenerator* codegen, const ASTNode* program) {
+    generate_c_main_head(codegen);
+    for (int i = 0; i < program->data.program.statement_count; i++) {
+        const ASTNode* stmt = program->data.program.statements[i];
+        if (stmt->type != AST_FUNCTION_DECL) {
+            generate_c_statement(codegen, stmt);
+        }
+    }
+    generate_c_main_tail(codegen, defines_user_main(program));
+}
+
+// Function return types are known before any body is generated
+static void define_function_symbols(CodeGenerator* codegen, const ASTNode* program) {
+    for (int i = 0; i < program->data.program.statement_count; i++) {
+        const ASTNode* stmt = program->data.program.statements[i];
+        if (stmt->type == AST_FUNCTION_DECL) {
+            codegen_declare_function(codegen, stmt->data.func_decl.name, stmt->data.func_decl.return_type);
+        }
+    }
+}
+
+// ================== PARALLEL FUNCTION GENERATION ==================
+//
+// A function's code depends only on its own body and the function table
+// (see begin_c_scope), so bodies can be generated on worker threads, each
+// with private generator state and buffer, and then concatenated in
+// source order. Workers take chunks of functions from a shared counter,
+// which keeps them busy when function sizes vary.
+
+#define CODEGEN_FUNCTIONS_PER_CHUNK 32
+#define CODEGEN_MIN_FUNCTIONS_PER_THREAD 64
+#define CODEGEN_MAX_THREADS 64
+
+// Where one function's text ended up
+typedef struct {
+    int worker;
+    size_t offset;
+    size_t length;
+} FunctionSpan;
+
+typedef struct FunctionWorker FunctionWorker;
+
+typedef struct {
+    const ASTNode** functions;  // In source order
+    int function_count;
+    const char* qualifier;
+    FunctionSpan* spans;        // One per function
+    FunctionWorker* workers;
+    int worker_count;
+    int next_function;          // Guarded by lock
+    pthread_mutex_t lock;
+} ParallelFunctions;
+
+struct FunctionWorker {
+    ParallelFunctions* work;
+    int index;
+    CodeGenerator generator;    // Private state; the function table is shared read-only
+    OutputBuffer out;
+    pthread_t thread;
+    bool started;
+};
+
+static void* function_worker_main(void* arg) {
+    FunctionWorker* worker = arg;
+    ParallelFunctions* work = worker->work;
+    if (worker->index > 0 && trace_active) {
+        char name[32];
+        snprintf(name, sizeof(name), "codegen worker %d", worker->index);
+        trace_thread_name(name);
+    }
+    
+    for (;;) {
+        pthread_mutex_lock(&work->lock);
+        int first = work->next_function;
+        work->next_function += CODEGEN_FUNCTIONS_PER_CHUNK;
+        pthread_mutex_unlock(&work->lock);
+        if (first >= work->function_count) break;
+        
+        int last = first + CODEGEN_FUNCTIONS_PER_CHUNK;
+        if (last > work->function_count) last = work->function_count;
+        for (int i = first; i < last; i++) {
+            size_t offset = outbuf_total_size(&worker->out);
+            generate_c_function(&worker->generator, work->functions[i], work->qualifier);
+            work->spans[i].worker = worker->index;
+            work->spans[i].offset = offset;
+            work->spans[i].length = outbuf_total_size(&worker->out) - offset;
+        }
+    }
+    return NULL;
+}
+
+static size_t flatten_bytes(const CodeGenerator* generator) {
+    const FlattenState* flatten = &generator->flatten;
+    return flatten->capacity * sizeof(FlattenEntry) + flatten->stack_capacity * sizeof(struct FlattenFrame) +
+           generator->spine_capacity * sizeof(ASTNode*);
+}
+
+// Everything the workers hold, just before it is freed
+static size_t parallel_functions_bytes(const ParallelFunctions* work) {
+    size_t bytes = (size_t)work->function_count * (sizeof(ASTNode*) + sizeof(FunctionSpan)) +
+                   (size_t)work->worker_count * sizeof(FunctionWorker);
+    for (int w = 0; w < work->worker_count; w++) {
+        const CodeGenerator* generator = &work->workers[w].generator;
+        bytes += work->workers[w].out.capacity + flatten_bytes(generator) +
+                 generator->variables.capacity * sizeof(SymbolEntry);
+    }
+    return bytes;
+}
+
+static void parallel_functions_free(ParallelFunctions* work) {
+    for (int w = 0; w < work->worker_count; w++) {
+        CodeGenerator* generator = &work->workers[w].generator;
+        free(generator->flatten.entries);
+        free(generator->flatten.stack);
+        free(generator->spine);
+        free(generator->variables.entries);
+        outbuf_free(&work->workers[w].out);
+    }
+    pthread_mutex_destroy(&work->lock);
+    free(work->workers);
+    free(work->spans);
+    free(work->functions);
+}
+
+static const char* parallel_function_text(const ParallelFunctions* work, int index, size_t* length) {
+    const FunctionSpan* span = &work->spans[index];
+    *length = span->length;
+    return work->workers[span->worker].out.data + span->offset;
+}
+
+// Sums a helper generator's statistics and errors into the coordinating one
+static void merge_generator(CodeGenerator* codegen, const CodeGenerator* generator, const OutputBuffer* out) {
+    codegen->lines_generated += generator->lines_generated;
+    codegen->variables_declared += generator->variables_declared;
+    codegen->functions_generated += generator->functions_generated;
+    codegen->binary_expressions += generator->binary_expressions;
+    codegen->binary_parens += generator->binary_parens;
+    codegen->flatten.temps_generated += generator->flatten.temps_generated;
+    codegen->flatten.expressions_flattened += generator->flatten.expressions_flattened;
+    codegen->pgo.branch_hints += generator->pgo.branch_hints;
+    codegen->pgo.swapped += generator->pgo.swapped;
+    codegen->pgo.stale += generator->pgo.stale;
+    if (generator->had_error && !codegen->had_error) {
+        codegen_error(codegen, generator->error_message);
+    }
+    if (out->had_error && !codegen->had_error) {
+        codegen_error(codegen, "Out of memory generating functions");
+    }
+}
+
+static void parallel_functions_merge(CodeGenerator* codegen, ParallelFunctions* work) {
+    for (int w = 0; w < work->worker_count; w++) {
+        merge_generator(codegen, &work->workers[w].generator, &work->workers[w].out);
+    }
+}
+
+// False when one thread would do (threads == 1 or too few functions);
+// the caller then generates sequentially
+static bool parallel_functions_run(CodeGenerator* codegen, const ASTNode* program,
+                                   const char* qualifier, ParallelFunctions* work) {
+    int function_count = 0;
+    for (int i = 0; i < program->data.program.statement_count; i++) {
+        function_count += program->data.program.statements[i]->type == AST_FUNCTION_DECL;
+    }
+    int worker_count = codegen->threads < CODEGEN_MAX_THREADS ? codegen->threads : CODEGEN_MAX_THREADS;
+    if (worker_count > function_count / CODEGEN_MIN_FUNCTIONS_PER_THREAD) {
+        worker_count = function_count / CODEGEN_MIN_FUNCTIONS_PER_THREAD;
+    }
+    if (worker_count < 2) return false;
+    
+    memset(work, 0, sizeof(*work));
+    work->functions = malloc(sizeof(ASTNode*) * (size_t)function_count);
+    work->spans = calloc((size_t)function_count, sizeof(FunctionSpan));
+    work->workers = calloc((size_t)worker_count, sizeof(FunctionWorker));
+    pthread_mutex_init(&work->lock, NULL);
+    if (!work->functions || !work->spans || !work->workers) {
+        parallel_functions_free(work);
+        return false;
+    }
+    for (int i = 0; i < program->data.program.statement_count; i++) {
+        const ASTNode* stmt = program->data.program.statements[i];
+        if (stmt->type == AST_FUNCTION_DECL) work->functions[work->function_count++] = stmt;
+    }
+    work->qualifier = qualifier;
+    
+    for (int w = 0; w < worker_count; w++) {
+        FunctionWorker* worker = &work->workers[w];
+        if (!outbuf_init(&worker->out, -1)) break;
+        worker->work = work;
+        worker->index = w;
+        worker->generator.file_out.fd = -1;
+        worker->generator.threads = 1;
+        codegen_reset(&worker->generator, &worker->out, OUTPUT_C);
+        worker->generator.flatten.threshold = codegen->flatten.threshold;
+        worker->generator.profile = codegen->profile;
+        worker->generator.profile_runtime = codegen->profile_runtime;
+        worker->generator.profile_data = codegen->profile_data;
+        worker->generator.profile_hints = codegen->profile_hints;
+        worker->generator.sample_hz = codegen->sample_hz;
+        worker->generator.sample_runtime = codegen->sample_runtime;
+        worker->generator.functions = codegen->functions;
+        work->worker_count++;
+    }
+    if (work->worker_count == 0) {
+        parallel_functions_free(work);
+        return false;
+    }
+    
+    // The calling thread is worker 0; if a thread cannot be started, the
+    // others pick up its share
+    for (int w = 1; w < work->worker_count; w++) {
+        FunctionWorker* worker = &work->workers[w];
+        worker->started = pthread_create(&worker->thread, NULL, function_worker_main, worker) == 0;
+    }
+    function_worker_main(&work->workers[0]);
+    for (int w = 1; w < work->worker_count; w++) {
+        if (work->workers[w].started) pthread_join(work->workers[w].thread, NULL);
+    }
+    
+    parallel_functions_merge(codegen, work);
+    return true;
+}
+
+static void generate_c_program(CodeGenerator* codegen, const ASTNode* node) {
+    TraceScope scope;
+    trace_begin(&scope);
+    define_function_symbols(codegen, node);
+    trace_end(&scope, "declare functions", NULL);
+    codegen->profile_runtime = program_is_profiled(codegen, node);
+    codegen->profile_hints = codegen->profile_data != NULL;
+    codegen->sample_runtime = codegen->sample_hz > 0;
+    
+    // Generate C headers
+    codegen_emit_prologue(codegen);
+    
+    // Prototypes first so functions can call each other in any order
+    int function_count = 0;
+    for (int i = 0; i < node->data.program.statement_count; i++) {
+        function_count += node->data.program.statements[i]->type == AST_FUNCTION_DECL;
+    }
+    if (function_count > 0) {
+        trace_begin(&scope);
+        generate_c_prototypes(codegen, node, "static ");
+        emit_line(codegen, "");
+        trace_end(&scope, "prototypes", NULL);
+        
+        trace_begin(&scope);
+        ParallelFunctions parallel;
+        if (parallel_functions_run(codegen, node, "static ", &parallel)) {
+            for (int i = 0; i < parallel.function_count; i++) {
+                size_t length;
+                const char* text = parallel_function_text(&parallel, i, &length);
+                outbuf_append(codegen->out, text, length);
+            }
+            size_t scratch = parallel_functions_bytes(&parallel);
+            if (scratch > codegen->scratch_peak) codegen->scratch_peak = scratch;
+            parallel_functions_free(&parallel);
+        } else {
+            for (int i = 0; i < node->data.program.statement_count; i++) {
+                const ASTNode* stmt = node->data.program.statements[i];
+                if (stmt->type == AST_FUNCTION_DECL) {
+                    generate_c_function(codegen, stmt, "static ");
+                }
+            }
+        }
+        trace_end(&scope, "functions", NULL);
+    }
+    
+    trace_begin(&scope);
+    generate_c_main(codegen, node);
+    trace_end(&scope, "main", NULL);
+}
+
+// ================== FRAGMENTS ==================
+
+void codegen_set_output(CodeGenerator* codegen, OutputBuffer* target) {
+    codegen->out = target;
+}
+
+// Call types are only needed to type flattening temporaries
+void codegen_declare_function(CodeGenerator* codegen, const char* name, TokenType return_type) {
+    if (codegen->flatten.threshold > 0) {
+        symbol_define(codegen, &codegen->functions, name, return_type);
+    }
+}
+
+void codegen_emit_prologue(CodeGenerator* codegen) {
+    if (codegen->sample_runtime) {
+        // sigaction and setitimer are POSIX, not C99
+        emit_line(codegen, "#define _POSIX_C_SOURCE 200809L");
+    }
+    generate_c_includes(codegen);
+    emit_line(codegen, "");
+    if (codegen->profile_runtime) {
+        generate_c_profile_runtime(codegen);
+    }
+    if (codegen->sample_runtime) {
+        generate_c_sample_runtime(codegen);
+    }
+    if (codegen->profile_hints) {
+        generate_c_profile_hints(codegen);
+    }
+}
+
+void codegen_emit_prototype(CodeGenerator* codegen, const ASTNode* function) {
+    generate_c_prototype(codegen, function, "static ");
+}
+
+void codegen_emit_function(CodeGenerator* codegen, const ASTNode* function) {
+    generate_c_function(codegen, function, "static ");
+}
+
+void codegen_begin_main(CodeGenerator* codegen) {
+    generate_c_main_head(codegen);
+}
+
+void codegen_emit_main_statement(CodeGenerator* codegen, const ASTNode* statement) {
+    generate_c_statement(codegen, statement);
+}
+
+void codegen_end_main(CodeGenerator* codegen, TokenType user_main) {
+    generate_c_main_tail(codegen, user_main);
+}
+
+// ================== STREAMING ==================
+//
+// Output order is prologue, prototypes, bodies, main, but each part only
+// grows in source order, so each gets its own buffer and they are joined
+// at the end. Bodies and prototypes come from a private generator, like
+// a parallel worker's; main's statements from the codegen itself, which
+// keeps main's scope open between them. The prologue depends on whether
+// any function is profiled and is written last of all.
+
+// Between calls the codegen is left as the caller set it up
+static void enter_main(CodeGenerator* codegen, CodegenStream* stream) {
+    stream->target = codegen->out;
+    codegen->out = &stream->main_body;
+    codegen->indent_level = stream->main_indent;
+}
+
+static void leave_main(CodeGenerator* codegen, CodegenStream* stream) {
+    stream->main_indent = codegen->indent_level;
+    codegen->indent_level = 0;
+    codegen->out = stream->target;
+}
+
+bool codegen_stream_begin(CodeGenerator* codegen, CodegenStream* stream) {
+    memset(stream, 0, sizeof(*stream));
+    stream->user_main = TOKEN_EOF;
+    stream->deferred = codegen->flatten.threshold > 0 || codegen->format != OUTPUT_C;
+    if (stream->deferred) return true;
+    if (!outbuf_init(&stream->prototypes, -1) || !outbuf_init(&stream->bodies, -1) ||
+        !outbuf_init(&stream->main_body, -1)) {
+        codegen_stream_free(stream);
+        codegen_error(codegen, "Out of memory");
+        return false;
+    }
+    
+    CodeGenerator* functions = &stream->functions;
+    functions->file_out.fd = -1;
+    functions->threads = 1;
+    codegen_reset(functions, &stream->bodies, OUTPUT_C);
+    functions->profile = codegen->profile;
+    functions->profile_runtime = true;  // Known to be single-file output
+    functions->profile_data = codegen->profile_data;
+    functions->profile_hints = codegen->profile_data != NULL;
+    functions->sample_hz = codegen->sample_hz;
+    functions->sample_runtime = codegen->sample_hz > 0;
+    
+    codegen->profile_hints = codegen->profile_data != NULL;
+    codegen->sample_runtime = codegen->sample_hz > 0;
+    enter_main(codegen, stream);
+    generate_c_main_head(codegen);
+    leave_main(codegen, stream);
+    return true;
+}
+
+void codegen_stream_declaration(CodeGenerator* codegen, CodegenStream* stream, const ASTNode* declaration) {
+    if (stream->deferred) return;
+    double start = timer_now();
+    if (declaration->type == AST_FUNCTION_DECL) {
+        CodeGenerator* functions = &stream->functions;
+        functions->out = &stream->prototypes;
+        generate_c_prototype(functions, declaration, "static ");
+        functions->out = &stream->bodies;
+        generate_c_function(functions, declaration, "static ");
+        stream->function_count++;
+        stream->profiled |= is_profiled(codegen, declaration);
+        if (stream->user_main == TOKEN_EOF && strcmp(declaration->data.func_decl.name, "main") == 0) {
+            stream->user_main = declaration->data.func_decl.return_type;
+        }
+    } else {
+        enter_main(codegen, stream);
+        generate_c_statement(codegen, declaration);
+        leave_main(codegen, stream);
+    }
+    stream->busy_time += timer_now() - start;
+}
+
+bool codegen_stream_spill(CodeGenerator* codegen, CodegenStream* stream) {
+    if (stream->deferred) return true;
+    OutputBuffer* parts[3] = { &stream->prototypes, &stream->bodies, &stream->main_body };
+    for (int i = 0; i < 3; i++) {
+        stream->spill[i] = tmpfile();
+        if (!stream->spill[i]) {
+            codegen_error(codegen, "Cannot create a temporary file");
+            return false;
+        }
+        parts[i]->fd = fileno(stream->spill[i]);
+    }
+    return true;
+}
+
+// Copies a spilled part back from its file
+static void append_spilled(CodeGenerator* codegen, OutputBuffer* part) {
+    if (!outbuf_flush(part) || lseek(part->fd, 0, SEEK_SET) != 0) {
+        codegen_error(codegen, "Cannot read back a temporary file");
+        return;
+    }
+    OutputBuffer* out = codegen->out;
+    for (size_t done = 0; done < part->bytes_flushed; ) {
+        if (!outbuf_reserve(out, OUTBUF_INITIAL_CAPACITY)) return;
+        size_t room = out->capacity - out->length;
+        if (room > part->bytes_flushed - done) room = part->bytes_flushed - done;
+        ssize_t got = read(part->fd, out->data + out->length, room);
+        if (got <= 0) {
+            if (got < 0 && errno == EINTR) continue;
+            codegen_error(codegen, "Cannot read back a temporary file");
+            return;
+        }
+        out->length += (size_t)got;
+        done += (size_t)got;
+    }
+}
+
+// In flush-sized pieces, so a file-backed output never grows to hold a part
+static void append_part(CodeGenerator* codegen, OutputBuffer* part) {
+    if (part->fd >= 0) {
+        append_spilled(codegen, part);
+        return;
+    }
+    for (size_t done = 0; done < part->length; ) {
+        size_t piece = part->length - done < OUTBUF_FLUSH_THRESHOLD ? part->length - done : OUTBUF_FLUSH_THRESHOLD;
+        outbuf_append(codegen->out, part->data + done, piece);
+        done += piece;
+    }
+}
+
+bool codegen_stream_finish(CodeGenerator* codegen, CodegenStream* stream, const ASTNode* program) {
+    if (stream->deferred) {
+        if (!program) {
+            codegen_error(codegen, "Flattening needs the whole program");
+            return false;
+        }
+        return codegen_generate(codegen, program);
+    }
+    
+    TraceScope scope;
+    trace_phase_begin(&scope);
+    codegen->profile_runtime = stream->profiled;
+    codegen_emit_prologue(codegen);
+    if (stream->function_count > 0) {
+        append_part(codegen, &stream->prototypes);
+        emit_line(codegen, "");
+        append_part(codegen, &stream->bodies);
+    }
+    append_part(codegen, &stream->main_body);
+    codegen->indent_level = stream->main_indent;
+    generate_c_main_tail(codegen, stream->user_main);
+    merge_generator(codegen, &stream->functions, &stream->bodies);
+    if ((stream->prototypes.had_error || stream->main_body.had_error) && !codegen->had_error) {
+        codegen_error(codegen, "Out of memory");
+    }
+    size_t scratch = stream->prototypes.capacity + stream->bodies.capacity + stream->main_body.capacity;
+    if (scratch > codegen->scratch_peak) codegen->scratch_peak = scratch;
+    
+    if (!outbuf_flush(codegen->out)) {
+        codegen_error(codegen, "Failed to write output");
+    }
+    codegen->generation_time = stream->busy_time + trace_phase_end(&scope, "codegen", NULL);
+    return !codegen->had_error;
+}
+
+void codegen_stream_free(CodegenStream* stream) {
+    CodeGenerator* functions = &stream->functions;
+    free(functions->flatten.entries);
+    free(functions->flatten.stack);
+    free(functions->spine);
+    free(functions->variables.entries);
+    free(functions->functions.entries);
+    outbuf_free(&stream->prototypes);
+    outbuf_free(&stream->bodies);
+    outbuf_free(&stream->main_body);
+    for (int i = 0; i < 3; i++) {
+        if (stream->spill[i]) fclose(stream->spill[i]);
+    }
+    memset(stream, 0, sizeof(*stream));
+}
+
+// Generate into path from now on, truncating it; for a generator created
+// in memory that should only touch the file once there is code to write
+bool codegen_open_output(CodeGenerator* codegen, const char* path) {
+    if (codegen->file_out.fd >= 0) return false;
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return false;
+    if (!outbuf_init(&codegen->file_out, fd)) {
+        close(fd);
+        return false;
+    }
+    codegen->out = &codegen->file_out;
+    return true;
+}
+
+// ================== MAIN CODE GENERATION FUNCTION ==================
+
+bool codegen_generate(CodeGenerator* codegen, const ASTNode* ast) {
+    if (!codegen || !ast) return false;
+    
+    TraceScope scope;
+    trace_phase_begin(&scope);
+    switch (codegen->format) {
+        case OUTPUT_C:
+            generate_c_program(codegen, ast);
+            break;
+        case OUTPUT_JAVASCRIPT:
+            // Could implement JavaScript generation here
+            codegen_error(codegen, "JavaScript output not implemented yet");
+            return false;
+        case OUTPUT_PYTHON:
+            // Could implement Python generation here
+            codegen_error(codegen, "Python output not implemented yet");
+            return false;
+        case OUTPUT_BYTECODE:
+            // Could implement bytecode generation here
+            codegen_error(codegen, "Bytecode output not implemented yet");
+            return false;
+    }
+    
+    // Everything is buffered up to here; one write (per flushed chunk) hits the file
+    TraceScope flush;
+    trace_begin(&flush);
+    if (!outbuf_flush(codegen->out)) {
+        codegen_error(codegen, "Failed to write output");
+    }
+    trace_end(&flush, "flush", NULL);
+    
+    codegen->generation_time = trace_phase_end(&scope, "codegen", NULL);
+    return !codegen->had_error;
+}
+
+// ================== SPLIT OUTPUT ==================
+//
+// A single output.c keeps the C compiler on one core. Split mode puts
+// every function prototype in a shared header and spreads the function
+// bodies over unit_count translation units, which `make -j` can compile
+// in parallel. Functions are extern (nothing is static across units);
+// main() goes to unit 0, and each further function goes to the unit with
+// the least code so far, so the slowest unit bounds the parallel build.
+
+bool codegen_generate_split(CodeGenerator* codegen, const ASTNode* ast, const char* header_name,
+                            OutputBuffer* header, OutputBuffer* units, int unit_count) {
+    if (!codegen || !ast || unit_count < 1) return false;
+    if (codegen->format != OUTPUT_C) {
+        codegen_error(codegen, "Split output is only supported for C");
+        return false;
+    }
+    
+    TraceScope scope;
+    trace_phase_begin(&scope);
+    define_function_symbols(codegen, ast);
+    
+    codegen->out = header;
+    emit_line(codegen, "#ifndef SHAYNEFRO_OUTPUT_H");
+    emit_line(codegen, "#define SHAYNEFRO_OUTPUT_H");
+    emit_line(codegen, "");
+    generate_c_includes(codegen);
+    emit_line(codegen, "");
+    generate_c_prototypes(codegen, ast, "extern ");
+    emit_line(codegen, "");
+    emit_line(codegen, "#endif");
+    
+    for (int k = 0; k < unit_count; k++) {
+        codegen->out = &units[k];
+        emit_lit(codegen, "#include \"");
+        emit_str(codegen, header_name);
+        emit_lit(codegen, "\"\n\n");
+        codegen->lines_generated += 2;
+    }
+    
+    codegen->out = &units[0];
+    generate_c_main(codegen, ast);
+    emit_line(codegen, "");
+    
+    // Units are filled in source order whether or not bodies were
+    // generated in parallel, so the split does not depend on thread count
+    ParallelFunctions parallel;
+    bool in_parallel = parallel_functions_run(codegen, ast, "", &parallel);
+    int function_index = 0;
+    for (int i = 0; i < ast->data.program.statement_count && !codegen->had_error; i++) {
+        const ASTNode* stmt = ast->data.program.statements[i];
+        if (stmt->type != AST_FUNCTION_DECL) continue;
+        
+        int lightest = 0;
+        for (int k = 1; k < unit_count; k++) {
+            if (outbuf_total_size(&units[k]) < outbuf_total_size(&units[lightest])) lightest = k;
+        }
+        codegen->out = &units[lightest];
+        if (in_parallel) {
+            size_t length;
+            const char* text = parallel_function_text(&parallel, function_index++, &length);
+            outbuf_append(codegen->out, text, length);
+        } else {
+            generate_c_function(codegen, stmt, "");
+        }
+    }
+    if (in_parallel) parallel_functions_free(&parallel);
+    
+    codegen->unit_bytes = 0;
+    bool flushed = outbuf_flush(header);
+    for (int k = 0; k < unit_count; k++) {
+        flushed &= outbuf_flush(&units[k]);
+        codegen->unit_bytes += outbuf_total_size(&units[k]);
+    }
+    codegen->out = header;
+    if (!flushed) {
+        codegen_error(codegen, "Failed to write output");
+    }
+    
+    codegen->generation_time = trace_phase_end(&scope, "codegen split", NULL);
+    return !codegen->had_error;
+}
+
+static int open_output_file(CodeGenerator* codegen, const char* filename) {
+    int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        char message[320];
+        snprintf(message, sizeof(message), "Cannot open %s for writing", filename);
+        codegen_error(codegen, message);
+    }
+    return fd;
+}
+
+static void generate_makefile(OutputBuffer* out, const char* base_name, int unit_count) {
+    outbuf_append_lit(out, "# Generated by Shaynefro; build with make -j");
+    outbuf_append_int(out, unit_count);
+    outbuf_append_lit(out, "\nCFLAGS ?= -O2\nOBJS =");
+    for (int k = 0; k < unit_count; k++) {
+        outbuf_putc(out, ' ');
+        outbuf_append_str(out, base_name);
+        outbuf_putc(out, '_');
+        outbuf_append_int(out, k);
+        outbuf_append_lit(out, ".o");
+    }
+    outbuf_append_lit(out, "\n\n");
+    outbuf_append_str(out, base_name);
+    outbuf_append_lit(out, ": $(OBJS)\n\t$(CC) $(CFLAGS) -o $@ $(OBJS)\n\n%.o: %.c ");
+    outbuf_append_str(out, base_name);
+    outbuf_append_lit(out, ".h\n\t$(CC) $(CFLAGS) -c -o $@ $<\n\nclean:\n\trm -f ");
+    outbuf_append_str(out, base_name);
+    outbuf_append_lit(out, " $(OBJS)\n\n.PHONY: clean\n");
+}
+
+// Writes <base>.h, <base>_0.c ... <base>_N-1.c and a Makefile into the
+// current directory
+bool codegen_write_split(CodeGenerator* codegen, const ASTNode* ast, const char* base_name, int unit_count) {
+    if (unit_count < 1 || strlen(base_name) > 200) {
+        codegen_error(codegen, "Invalid split configuration");
+        return false;
+    }
+    
+    OutputBuffer* buffers = calloc((size_t)unit_count + 2, sizeof(OutputBuffer));
+    if (!buffers) {
+        codegen_error(codegen, "Out of memory while splitting output");
+        return false;
+    }
+    
+    // buffers[0] is the header, [1..N] the units, [N+1] the Makefile
+    char filename[256];
+    char header_name[256];
+    snprintf(header_name, sizeof(header_name), "%s.h", base_name);
+    int opened = 0;
+    for (int i = 0; i < unit_count + 2 && !codegen->had_error; i++) {
+        if (i == 0) {
+            snprintf(filename, sizeof(filename), "%s", header_name);
+        } else if (i <= unit_count) {
+            snprintf(filename, sizeof(filename), "%s_%d.c", base_name, i - 1);
+        } else {
+            snprintf(filename, sizeof(filename), "Makefile");
+        }
+        
+        int fd = open_output_file(codegen, filename);
+        if (fd < 0) break;
+        if (!outbuf_init(&buffers[i], fd)) {
+            close(fd);
+            codegen_error(codegen, "Out of memory while splitting output");
+            break;
+        }
+        opened++;
+    }
+    
+    if (!codegen->had_error) {
+        codegen_generate_split(codegen, ast, header_name, &buffers[0], &buffers[1], unit_count);
+        generate_makefile(&buffers[unit_count + 1], base_name, unit_count);
+        if (!outbuf_flush(&buffers[unit_count + 1])) {
+            codegen_error(codegen, "Failed to write Makefile");
+        }
+        // Counted against the header so codegen_get_bytes_generated stays valid after this returns
+        codegen->unit_bytes += outbuf_total_size(&buffers[0]);
+    }
+    
+    size_t scratch = ((size_t)unit_count + 2) * sizeof(OutputBuffer);
+    for (int i = 0; i < opened; i++) {
+        scratch += buffers[i].capacity;
+        close(buffers[i].fd);
+        outbuf_free(&buffers[i]);
+    }
+    if (scratch > codegen->scratch_peak) codegen->scratch_peak = scratch;
+    free(buffers);
+    codegen->out = NULL;
+    return !codegen->had_error;
+}
+
+// ================== UTILITY FUNCTIONS ==================
+
+bool codegen_has_error(const CodeGenerator* codegen) {
+    return codegen->had_error;
+}
+
+const char* codegen_get_error(const CodeGenerator* codegen) {
+    return codegen->error_message;
+}
+
+int codegen_get_lines_generated(const CodeGenerator* codegen) {
+    return codegen->lines_generated;
+}
+
+double codegen_get_generation_time(const CodeGenerator* codegen) {
+    return codegen->generation_time;
+}
+
+size_t codegen_get_bytes_generated(const CodeGenerator* codegen) {
+    return (codegen->out ? outbuf_total_size(codegen->out) : 0) + codegen->unit_bytes;
+}
+
+// Bytes saved against wrapping every binary expression in parentheses
+size_t codegen_get_parens_elided(const CodeGenerator* codegen) {
+    return codegen->binary_expressions - codegen->binary_parens;
+}
+
+void codegen_get_profile_decisions(const CodeGenerator* codegen, ProfileDecisions* decisions) {
+    *decisions = codegen->pgo;
+}
+
+void codegen_get_memory(const CodeGenerator* codegen, CodegenMemory* memory) {
+    memory->output_buffer = codegen->out ? codegen->out->capacity : codegen->file_out.capacity;
+    memory->symbol_tables = (codegen->variables.capacity + codegen->functions.capacity) * sizeof(SymbolEntry);
+    memory->flatten = flatten_bytes(codegen);
+    memory->scratch_peak = codegen->scratch_peak;
 }
@@ -2,6 +2,8 @@
 #define CODEGEN_H
 
 #include "parser.h"
+#include "outbuf.h"
+#include "profile.h"
 #include <stdio.h>
 
 // ================== CODE GENERATION STRUCTURES ==================
@@ -13,8 +15,65 @@ typedef enum {
     OUTPUT_BYTECODE     // Generate custom bytecode
 } OutputFormat;
 
+// Per-node bookkeeping while a large expression is being flattened
 typedef struct {
-    FILE* output_file;      // Output file
+    const ASTNode* node;
+    size_t size;            // Nodes in the subtree
+    size_t weight;          // Nodes still emitted inline (temporaries count as one)
+    int temp;               // Temporary holding the value, -1 if none
+    int ctype;              // C type of the value
+    unsigned generation;    // Entry is live when equal to the map's generation
+} FlattenEntry;
+
+// Three-address mode: statements whose expression has more than
+// `threshold` nodes are split into typed temporaries
+typedef struct {
+    int threshold;          // 0 disables flattening
+    bool active;            // A statement is currently being flattened
+    FlattenEntry* entries;  // Open-addressed map keyed by node address
+    size_t capacity;
+    size_t count;
+    unsigned generation;
+    struct FlattenFrame* stack; // Explicit traversal stack, trees can be very deep
+    size_t stack_capacity;
+    int next_temp;          // Temporary numbering restarts in every C function
+    int temps_generated;    // Temporaries emitted
+    int expressions_flattened; // Statements that were split
+} FlattenState;
+
+// Declared variable types, used to type temporaries
+typedef struct {
+    const char* name;
+    TokenType type;
+} SymbolEntry;
+
+typedef struct {
+    SymbolEntry* entries;   // Open-addressed, keyed by name
+    size_t capacity;
+    size_t count;
+} SymbolTable;
+
+// Heap held by code generation, in bytes
+typedef struct {
+    size_t output_buffer;   // Capacity of the buffer being generated into
+    size_t symbol_tables;   // Variable and function types
+    size_t flatten;         // Flattening map and traversal stacks
+    size_t scratch_peak;    // Parallel worker or split unit buffers, at their largest
+} CodegenMemory;
+
+// What --profile-use changed, for the report
+typedef struct {
+    int hot;                // Functions marked hot
+    int cold;               // ...marked cold: never ran
+    int inlined;            // Small leaves called often, forced inline
+    int branch_hints;       // Conditions wrapped in __builtin_expect
+    int swapped;            // if/else laid out with the else branch first
+    int stale;              // Functions whose branch counts no longer match the source
+} ProfileDecisions;
+
+typedef struct {
+    OutputBuffer* out;      // Where generated code goes
+    OutputBuffer file_out;  // Owned buffer when generating into a file
     OutputFormat format;    // Output format
     int indent_level;       // Current indentation
     bool had_error;         // Error flag
@@ -24,16 +83,96 @@ typedef struct {
     int lines_generated;    // Lines of code generated
     int variables_declared; // Number of variables
     int functions_generated; // Number of functions
-    double gen_start_time;  // Generation start time
+    size_t binary_expressions; // Binary/assignment expressions emitted
+    size_t binary_parens;   // ...of which needed parentheses in C
+    size_t unit_bytes;      // Bytes written to split translation units
+    double generation_time; // Seconds in the last codegen_generate(_split)
+    size_t scratch_peak;    // See CodegenMemory, for the last generation
+    int threads;            // Function bodies are generated in parallel when > 1
+    bool profile;           // Instrument every function, not only those marked with 📊
+    bool profile_runtime;   // The profiling runtime is part of this output
+    const ProfileData* profile_data; // --profile-use, NULL without
+    int sample_hz;          // --sample: SIGPROF samples per CPU second, 0 when off
+    bool sample_runtime;    // The sampling runtime is part of this output
+    bool profile_hints;     // Hint macros are part of this output
+    const ASTNode* function; // Function being generated, NULL in main
+    const ProfileFunction* function_profile; // Its counts, NULL if missing or stale
+    int branch_site;        // Next if/while/for condition in the function, in source order
+    ProfileDecisions pgo;
+    
+    FlattenState flatten;   // Three-address splitting of huge expressions
+    const ASTNode** spine;  // Left-nested binary chain being emitted, see generate_c_binary
+    size_t spine_count;
+    size_t spine_capacity;
+    SymbolTable variables;  // Cleared at every function, so output never depends on other bodies
+    SymbolTable functions;  // Return types
 } CodeGenerator;
 
 // ================== CODE GENERATOR FUNCTIONS ==================
 
+#define CODEGEN_SAMPLE_DEFAULT_HZ 1000
+#define CODEGEN_SAMPLE_MAX_HZ 10000
+
 // Core functions
 CodeGenerator* codegen_create(const char* output_filename, OutputFormat format);
+CodeGenerator* codegen_create_in_memory(OutputBuffer* target, OutputFormat format);
+void codegen_reset(CodeGenerator* codegen, OutputBuffer* target, OutputFormat format);
 void codegen_destroy(CodeGenerator* codegen);
+void codegen_set_flatten_threshold(CodeGenerator* codegen, int threshold);
+void codegen_set_threads(CodeGenerator* codegen, int threads);
+void codegen_set_profile(CodeGenerator* codegen, bool profile);
+void codegen_set_profile_data(CodeGenerator* codegen, const ProfileData* data);
+void codegen_set_sampling(CodeGenerator* codegen, int hz);
 bool codegen_generate(CodeGenerator* codegen, const ASTNode* ast);
 
+// Split output: shared header plus unit_count translation units
+bool codegen_generate_split(CodeGenerator* codegen, const ASTNode* ast, const char* header_name,
+                            OutputBuffer* header, OutputBuffer* units, int unit_count);
+bool codegen_write_split(CodeGenerator* codegen, const ASTNode* ast, const char* base_name, int unit_count);
+
+// Fragments for incremental builds. In program order -- prologue,
+// prototypes, functions, main -- they match codegen_generate byte for byte.
+// Functions must be declared before any fragment that calls them.
+void codegen_set_output(CodeGenerator* codegen, OutputBuffer* target);
+void codegen_declare_function(CodeGenerator* codegen, const char* name, TokenType return_type);
+void codegen_emit_prologue(CodeGenerator* codegen);
+void codegen_emit_prototype(CodeGenerator* codegen, const ASTNode* function);
+void codegen_emit_function(CodeGenerator* codegen, const ASTNode* function);
+void codegen_begin_main(CodeGenerator* codegen);
+void codegen_emit_main_statement(CodeGenerator* codegen, const ASTNode* statement);
+void codegen_end_main(CodeGenerator* codegen, TokenType user_main);  // TOKEN_EOF if none
+
+// Streaming: top-level declarations handed over one by one in source
+// order, as a parser finishes them, then joined into what codegen_generate
+// writes for the whole program. With flattening, calls need the types of
+// functions declared further down, so everything waits for the finish.
+typedef struct {
+    CodeGenerator functions;    // Private state for prototypes and bodies
+    OutputBuffer prototypes;
+    OutputBuffer bodies;
+    OutputBuffer main_body;     // Main's head and top-level statements
+    FILE* spill[3];             // Temporary files behind the three parts, or NULL
+    OutputBuffer* target;       // The codegen's own output while main_body is written
+    int main_indent;
+    int function_count;
+    TokenType user_main;        // Return type of a Shaynefro main, TOKEN_EOF if none
+    bool profiled;              // Some function needs the profiling runtime
+    bool deferred;              // Flattening or not C: all left to codegen_stream_finish
+    double busy_time;           // Seconds generating declarations
+} CodegenStream;
+
+bool codegen_stream_begin(CodeGenerator* codegen, CodegenStream* stream);
+// Moves the parts into temporary files, so a stream of any length needs a
+// few buffers' worth of memory; call after codegen_stream_begin
+bool codegen_stream_spill(CodeGenerator* codegen, CodegenStream* stream);
+void codegen_stream_declaration(CodeGenerator* codegen, CodegenStream* stream, const ASTNode* declaration);
+// Writes everything to the codegen's output and flushes; program is the
+// parser's result for the same declarations, or NULL if it was not kept
+// (which flattening cannot do without)
+bool codegen_stream_finish(CodeGenerator* codegen, CodegenStream* stream, const ASTNode* program);
+void codegen_stream_free(CodegenStream* stream);
+bool codegen_open_output(CodeGenerator* codegen, const char* path);
+
 // Error handling
 bool codegen_has_error(const CodeGenerator* codegen);
 const char* codegen_get_error(const CodeGenerator* codegen);
@@ -41,5 +180,9 @@ const char* codegen_get_error(const CodeGenerator* codegen);
 // Statistics
 int codegen_get_lines_generated(const CodeGenerator* codegen);
 double codegen_get_generation_time(const CodeGenerator* codegen);
+size_t codegen_get_bytes_generated(const CodeGenerator* codegen);
+size_t codegen_get_parens_elided(const CodeGenerator* codegen);
+void codegen_get_profile_decisions(const CodeGenerator* codegen, ProfileDecisions* decisions);
+void codegen_get_memory(const CodeGenerator* codegen, CodegenMemory* memory);
 
 #endif
@@ -0,0 +1,192 @@
+#define _DEFAULT_SOURCE     // syscall()
+#include "counters.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+static const char* const counter_names[COUNTER_KINDS] = {
+    "cycles", "instructions", "l1d_reads", "l1d_misses", "llc_misses", "branch_misses", "page_faults"
+};
+
+const char* counter_name(CounterKind kind) {
+    return kind < COUNTER_KINDS ? counter_names[kind] : "unknown";
+}
+
+#ifdef __linux__
+
+#define CACHE_EVENT(cache, op, result) \
+    ((cache) | ((op) << 8) | ((result) << 16))
+
+static const struct {
+    uint32_t type;
+    uint64_t config;
+} counter_events[COUNTER_KINDS] = {
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { PERF_TYPE_HW_CACHE, CACHE_EVENT(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ,
+                                      PERF_COUNT_HW_CACHE_RESULT_ACCESS) },
+    { PERF_TYPE_HW_CACHE, CACHE_EVENT(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ,
+                                      PERF_COUNT_HW_CACHE_RESULT_MISS) },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+    { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS },
+};
+
+static int open_event(uint32_t type, uint64_t config) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.inherit = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    // Not left open in the C compiler that -o starts
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+}
+
+static int read_paranoid_level(void) {
+    int level = -100;
+    FILE* file = fopen("/proc/sys/kernel/perf_event_paranoid", "r");
+    if (file) {
+        if (fscanf(file, "%d", &level) != 1) level = -100;
+        fclose(file);
+    }
+    return level;
+}
+
+bool counters_open(PerfCounters* counters) {
+    memset(counters, 0, sizeof(*counters));
+    for (int kind = 0; kind < COUNTER_KINDS; kind++) {
+        counters->fds[kind] = open_event(counter_events[kind].type, counter_events[kind].config);
+        if (counters->fds[kind] >= 0) {
+            counters->available++;
+        } else if (counters->error_message[0] == '\0') {
+            int level = read_paranoid_level();
+            if (errno == EACCES || errno == EPERM) {
+                snprintf(counters->error_message, sizeof(counters->error_message),
+                         "%s: not permitted (kernel.perf_event_paranoid=%d)", counter_names[kind], level);
+            } else if (errno == ENOENT || errno == EOPNOTSUPP || errno == ENODEV) {
+                // No such event on this CPU, or no PMU at all as in most VMs
+                snprintf(counters->error_message, sizeof(counters->error_message),
+                         "%s: not supported by this CPU or hypervisor", counter_names[kind]);
+            } else {
+                snprintf(counters->error_message, sizeof(counters->error_message),
+                         "%s: %s", counter_names[kind], strerror(errno));
+            }
+        }
+    }
+    return counters->available > 0;
+}
+
+void counters_close(PerfCounters* counters) {
+    for (int kind = 0; kind < COUNTER_KINDS; kind++) {
+        if (counters->fds[kind] >= 0) close(counters->fds[kind]);
+        counters->fds[kind] = -1;
+    }
+    counters->available = 0;
+}
+
+void counters_read(const PerfCounters* counters, CounterSample* sample) {
+    memset(sample, 0, sizeof(*sample));
+    for (int kind = 0; kind < COUNTER_KINDS; kind++) {
+        uint64_t data[3];   // value, time enabled, time running
+        if (counters->fds[kind] < 0 || read(counters->fds[kind], data, sizeof(data)) != sizeof(data)) {
+            continue;
+        }
+        if (data[2] == 0) continue;     // Never scheduled onto the PMU
+        sample->values[kind] = data[2] < data[1]
+            ? (uint64_t)((double)data[0] * data[1] / data[2])
+            : data[0];
+        sample->valid[kind] = true;
+    }
+}
+
+#else
+
+bool counters_open(PerfCounters* counters) {
+    memset(counters, 0, sizeof(*counters));
+    for (int kind = 0; kind < COUNTER_KINDS; kind++) counters->fds[kind] = -1;
+    snprintf(counters->error_message, sizeof(counters->error_message),
+             "perf_event_open is Linux only");
+    return false;
+}
+
+void counters_close(PerfCounters* counters) {
+    counters->available = 0;
+}
+
+void counters_read(const PerfCounters* counters, CounterSample* sample) {
+    (void)counters;
+    memset(sample, 0, sizeof(*sample));
+}
+
+#endif
+
+void counters_diff(const CounterSample* end, const CounterSample* start, CounterSample* delta) {
+    for (int kind = 0; kind < COUNTER_KINDS; kind++) {
+        delta->valid[kind] = end->valid[kind] && start->valid[kind];
+        // Scaled readings of a multiplexed counter can step backwards slightly
+        delta->values[kind] = delta->valid[kind] && end->values[kind] > start->values[kind]
+            ? end->values[kind] - start->values[kind]
+            : 0;
+    }
+}
+
+void counters_scale(CounterSample* sample, double divisor) {
+    if (divisor <= 0) return;
+    for (int kind = 0; kind < COUNTER_KINDS; kind++) {
+        sample->values[kind] = (uint64_t)(sample->values[kind] / divisor + 0.5);
+    }
+}
+
+bool counters_have_hardware(const CounterSample* sample) {
+    for (int kind = 0; kind < COUNTER_KINDS; kind++) {
+        if (kind != COUNTER_PAGE_FAULTS && sample->valid[kind]) return true;
+    }
+    return false;
+}
+
+double counters_ipc(const CounterSample* sample) {
+    if (!sample->valid[COUNTER_CYCLES] || !sample->valid[COUNTER_INSTRUCTIONS] ||
+        sample->values[COUNTER_CYCLES] == 0) {
+        return 0.0;
+    }
+    return (double)sample->values[COUNTER_INSTRUCTIONS] / sample->values[COUNTER_CYCLES];
+}
+
+void counters_print(const char* indent, const CounterSample* sample, double units, const char* per_unit) {
+    if (sample->valid[COUNTER_CYCLES] && sample->valid[COUNTER_INSTRUCTIONS]) {
+        printf("%sCycles: %llu, instructions: %llu, IPC %.2f\n", indent,
+               (unsigned long long)sample->values[COUNTER_CYCLES],
+               (unsigned long long)sample->values[COUNTER_INSTRUCTIONS], counters_ipc(sample));
+    }
+    if (units <= 0) return;
+    if (sample->valid[COUNTER_INSTRUCTIONS]) {
+        printf("%sInstructions per %s: %.1f\n", indent, per_unit, sample->values[COUNTER_INSTRUCTIONS] / units);
+    }
+    if (sample->valid[COUNTER_L1D_MISSES]) {
+        printf("%sL1D misses per %s: %.3f", indent, per_unit, sample->values[COUNTER_L1D_MISSES] / units);
+        if (sample->valid[COUNTER_L1D_READS] && sample->values[COUNTER_L1D_READS] > 0) {
+            printf(" (%.2f%% of reads)",
+                   100.0 * sample->values[COUNTER_L1D_MISSES] / sample->values[COUNTER_L1D_READS]);
+        }
+        printf("\n");
+    }
+    if (sample->valid[COUNTER_LLC_MISSES]) {
+        printf("%sLLC misses per %s: %.4f\n", indent, per_unit, sample->values[COUNTER_LLC_MISSES] / units);
+    }
+    if (sample->valid[COUNTER_BRANCH_MISSES]) {
+        printf("%sBranch misses per %s: %.3f\n", indent, per_unit, sample->values[COUNTER_BRANCH_MISSES] / units);
+    }
+    if (sample->valid[COUNTER_PAGE_FAULTS]) {
+        printf("%sPage faults: %llu\n", indent, (unsigned long long)sample->values[COUNTER_PAGE_FAULTS]);
+    }
+}
@@ -0,0 +1,64 @@
+#ifndef COUNTERS_H
+#define COUNTERS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// ================== HARDWARE PERFORMANCE COUNTERS ==================
+//
+// CPU counters from perf_event_open(2), counting this process in user
+// mode, including threads started after the counters were opened (the
+// codegen workers). Each counter has its own event so one the PMU cannot
+// provide does not take the others with it; when the kernel multiplexes
+// them, readings are scaled by enabled/running time. Counters are read
+// cumulatively and phases are measured as the difference of two reads.
+//
+// Containers, VMs without a virtual PMU, non-Linux systems and
+// kernel.perf_event_paranoid > 2 leave some or all counters unavailable;
+// everything then still runs and the reports say so.
+
+typedef enum {
+    COUNTER_CYCLES,
+    COUNTER_INSTRUCTIONS,
+    COUNTER_L1D_READS,
+    COUNTER_L1D_MISSES,
+    COUNTER_LLC_MISSES,
+    COUNTER_BRANCH_MISSES,
+    COUNTER_PAGE_FAULTS,    // Software event, usually available even in VMs
+    COUNTER_KINDS
+} CounterKind;
+
+typedef struct {
+    uint64_t values[COUNTER_KINDS];
+    bool valid[COUNTER_KINDS];
+} CounterSample;
+
+typedef struct {
+    int fds[COUNTER_KINDS];
+    int available;          // Counters that opened
+    char error_message[256];  // Why the first missing counter is missing
+} PerfCounters;
+
+// Opens every counter it can; false when none are available
+bool counters_open(PerfCounters* counters);
+void counters_close(PerfCounters* counters);
+
+// Cumulative values since counters_open
+void counters_read(const PerfCounters* counters, CounterSample* sample);
+
+// end - start, valid where both are
+void counters_diff(const CounterSample* end, const CounterSample* start, CounterSample* delta);
+
+// Divides every value, for per-pass averages
+void counters_scale(CounterSample* sample, double divisor);
+
+bool counters_have_hardware(const CounterSample* sample);
+const char* counter_name(CounterKind kind);
+
+// Instructions per cycle, 0 when cycles or instructions are missing
+double counters_ipc(const CounterSample* sample);
+
+// Report lines; units is the token or node count that per_unit names
+void counters_print(const char* indent, const CounterSample* sample, double units, const char* per_unit);
+
+#endif
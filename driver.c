@@ -0,0 +1,195 @@
+#define _POSIX_C_SOURCE 200809L
+#include "driver.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+// ================== COMPILER PROFILES ==================
+
+static const struct {
+    const char* name;
+    const char* flags;
+} cc_profiles[] = {
+    [CC_PROFILE_DEBUG] = { "debug", "-O0 -g" },
+    [CC_PROFILE_RELEASE] = { "release", "-O2" },
+    [CC_PROFILE_NATIVE] = { "native", "-O3 -march=native" },
+    [CC_PROFILE_LTO] = { "lto", "-O2 -flto" },
+};
+
+bool cc_profile_from_name(const char* name, CCProfile* profile) {
+    for (size_t i = 0; i < sizeof(cc_profiles) / sizeof(cc_profiles[0]); i++) {
+        if (strcmp(name, cc_profiles[i].name) == 0) {
+            *profile = (CCProfile)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* cc_profile_name(CCProfile profile) {
+    return cc_profiles[profile].name;
+}
+
+const char* cc_profile_flags(CCProfile profile) {
+    return cc_profiles[profile].flags;
+}
+
+// ================== COMMAND LINE ==================
+
+static bool add_arg(NativeBuild* build, size_t* used, const char* arg, size_t length) {
+    if (build->argc >= DRIVER_MAX_ARGS - 1 || *used + length + 1 > sizeof(build->arg_storage)) {
+        snprintf(build->error_message, sizeof(build->error_message), "C compiler command line too long");
+        return false;
+    }
+    char* copy = build->arg_storage + *used;
+    memcpy(copy, arg, length);
+    copy[length] = '\0';
+    *used += length + 1;
+    build->argv[build->argc++] = copy;
+    return true;
+}
+
+// Whitespace-separated words, as in CC="ccache gcc" or CFLAGS="-g -Wall"
+static bool add_words(NativeBuild* build, size_t* used, const char* words) {
+    while (*words) {
+        words += strspn(words, " \t");
+        size_t length = strcspn(words, " \t");
+        if (length == 0) break;
+        if (!add_arg(build, used, words, length)) return false;
+        words += length;
+    }
+    return true;
+}
+
+static const char* env_or(const char* name, const char* fallback) {
+    const char* value = getenv(name);
+    return value && *value ? value : fallback;
+}
+
+void native_build_signature(CCProfile profile, char* buffer, int size) {
+    const char* extra = env_or("SHAYNEFRO_CFLAGS", "");
+    snprintf(buffer, (size_t)size, "%s %s%s%s", env_or("SHAYNEFRO_CC", env_or("CC", "cc")),
+             cc_profile_flags(profile), *extra ? " " : "", extra);
+}
+
+void native_build_command(const NativeBuild* build, char* buffer, int size) {
+    int used = 0;
+    buffer[0] = '\0';
+    for (int i = 0; i < build->argc && used < size; i++) {
+        used += snprintf(buffer + used, (size_t)(size - used), "%s%s", i ? " " : "", build->argv[i]);
+    }
+}
+
+// ================== COMPILER PROCESS ==================
+
+bool native_build_start(NativeBuild* build, CCProfile profile, const char* output_path) {
+    build->profile = profile;
+    build->output_path = output_path;
+    build->argc = 0;
+    build->pid = -1;
+    build->input_fd = -1;
+    build->exit_status = -1;
+    build->error_message[0] = '\0';
+    
+    // cc <profile flags> $SHAYNEFRO_CFLAGS -o <output> -x c -
+    size_t used = 0;
+    const char* compiler = env_or("SHAYNEFRO_CC", env_or("CC", "cc"));
+    if (!add_words(build, &used, compiler) ||
+        !add_words(build, &used, cc_profile_flags(profile)) ||
+        !add_words(build, &used, env_or("SHAYNEFRO_CFLAGS", "")) ||
+        !add_words(build, &used, "-o") ||
+        !add_arg(build, &used, output_path, strlen(output_path)) ||
+        !add_words(build, &used, "-x c -")) {
+        return false;
+    }
+    build->argv[build->argc] = NULL;
+    
+    // Close-on-exec, so a build started later (or any other child) does
+    // not hold this pipe open; dup2 clears the flag on the compiler's stdin
+    int fds[2];
+    if (pipe(fds) < 0) {
+        snprintf(build->error_message, sizeof(build->error_message),
+                 "Cannot create pipe: %s", strerror(errno));
+        return false;
+    }
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    
+    pid_t pid = fork();
+    if (pid < 0) {
+        snprintf(build->error_message, sizeof(build->error_message),
+                 "Cannot start C compiler: %s", strerror(errno));
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+    
+    if (pid == 0) {
+        // Child: the read end of the pipe becomes the compiler's stdin
+        dup2(fds[0], STDIN_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+        execvp(build->argv[0], build->argv);
+        _exit(127);
+    }
+    
+    close(fds[0]);
+    build->pid = (int)pid;
+    build->input_fd = fds[1];
+    
+    // A compiler that exits early must not kill us with SIGPIPE;
+    // writes fail with EPIPE instead and are reported
+    signal(SIGPIPE, SIG_IGN);
+    return true;
+}
+
+bool native_build_finish(NativeBuild* build) {
+    if (build->input_fd >= 0) {
+        close(build->input_fd);
+        build->input_fd = -1;
+    }
+    if (build->pid < 0) return false;
+    
+    int status;
+    while (waitpid((pid_t)build->pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            snprintf(build->error_message, sizeof(build->error_message),
+                     "Lost track of C compiler: %s", strerror(errno));
+            build->pid = -1;
+            return false;
+        }
+    }
+    build->pid = -1;
+    
+    if (!WIFEXITED(status)) {
+        snprintf(build->error_message, sizeof(build->error_message),
+                 "C compiler %s was killed by signal %d", build->argv[0], WTERMSIG(status));
+        return false;
+    }
+    
+    build->exit_status = WEXITSTATUS(status);
+    if (build->exit_status == 127) {
+        snprintf(build->error_message, sizeof(build->error_message),
+                 "C compiler %s could not be run (set SHAYNEFRO_CC or CC)", build->argv[0]);
+    } else if (build->exit_status != 0) {
+        snprintf(build->error_message, sizeof(build->error_message),
+                 "C compiler %s failed with exit status %d", build->argv[0], build->exit_status);
+    }
+    return build->exit_status == 0;
+}
+
+void native_build_abort(NativeBuild* build) {
+    if (build->pid > 0) {
+        kill((pid_t)build->pid, SIGTERM);
+    }
+    char message[256];
+    memcpy(message, build->error_message, sizeof(message));
+    native_build_finish(build);
+    memcpy(build->error_message, message, sizeof(message));
+}
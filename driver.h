@@ -0,0 +1,57 @@
+#ifndef DRIVER_H
+#define DRIVER_H
+
+#include <stdbool.h>
+
+// ================== NATIVE BUILD DRIVER ==================
+//
+// Runs the local C compiler with generated code on its stdin, so
+// `shaynefro -f prog.shay -o prog` produces an executable without an
+// intermediate .c file. The compiler comes from $SHAYNEFRO_CC, then $CC,
+// then "cc"; $SHAYNEFRO_CFLAGS is appended after the profile's flags.
+
+#define DRIVER_MAX_ARGS 64
+
+typedef enum {
+    CC_PROFILE_DEBUG,       // -O0 -g
+    CC_PROFILE_RELEASE,     // -O2 (default)
+    CC_PROFILE_NATIVE,      // -O3 -march=native
+    CC_PROFILE_LTO          // -O2 -flto
+} CCProfile;
+
+typedef struct {
+    CCProfile profile;
+    const char* output_path;        // Executable to produce
+    
+    char arg_storage[1024];         // Backing store for argv strings
+    char* argv[DRIVER_MAX_ARGS];    // Compiler command line
+    int argc;
+    
+    int pid;                        // Compiler process, -1 when not running
+    int input_fd;                   // Write end of the compiler's stdin
+    int exit_status;                // Compiler exit code, -1 if it did not exit normally
+    char error_message[256];
+} NativeBuild;
+
+// Profiles
+bool cc_profile_from_name(const char* name, CCProfile* profile);
+const char* cc_profile_name(CCProfile profile);
+const char* cc_profile_flags(CCProfile profile);
+
+// Start the compiler; generated C is then written to build->input_fd
+bool native_build_start(NativeBuild* build, CCProfile profile, const char* output_path);
+
+// Close the compiler's input and wait for it; true if it succeeded
+bool native_build_finish(NativeBuild* build);
+
+// Kill a compiler whose input is incomplete
+void native_build_abort(NativeBuild* build);
+
+// Compiler, profile flags and $SHAYNEFRO_CFLAGS: everything that shapes
+// the executable except the output path, for cache keys
+void native_build_signature(CCProfile profile, char* buffer, int size);
+
+// Command line as one string, for display
+void native_build_command(const NativeBuild* build, char* buffer, int size);
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef DTOA_H
+#define DTOA_H
+
+#include <stddef.h>
+
+// ================== SHORTEST ROUND-TRIP DOUBLE FORMATTING ==================
+//
+// Formats a double with the fewest significant digits that read back
+// (strtod) to exactly the same value, choosing the closest such digits
+// when there is a tie. Uses the Ryu algorithm: two 128-bit multiplications
+// by a power of five instead of big-number arithmetic or retrying
+// printf precisions.
+//
+// Output reads like Python's repr: fixed notation for exponents -4..15,
+// otherwise d.ddde+XX. Integral values keep ".0" so the text is always
+// a floating literal in C ("2.0", not "2"). Non-finite values give
+// "inf", "-inf" and "nan".
+
+#define DTOA_BUFFER_SIZE 32
+
+// Writes a NUL-terminated string and returns its length
+size_t dtoa_shortest(double value, char* buffer);
+
+#endif
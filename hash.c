@@ -0,0 +1,91 @@
+#include "hash.h"
+#include <string.h>
+
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+#define PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define PRIME64_5 0x27D4EB2F165667C5ULL
+
+static inline uint64_t rotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+// Unaligned loads; memcpy compiles to a single mov
+static inline uint64_t read64(const unsigned char* p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t read32(const unsigned char* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t hash_round(uint64_t acc, uint64_t input) {
+    acc += input * PRIME64_2;
+    acc = rotl64(acc, 31);
+    return acc * PRIME64_1;
+}
+
+static inline uint64_t hash_merge(uint64_t acc, uint64_t lane) {
+    acc ^= hash_round(0, lane);
+    return acc * PRIME64_1 + PRIME64_4;
+}
+
+uint64_t hash_bytes(const void* data, size_t length, uint64_t seed) {
+    const unsigned char* p = data;
+    const unsigned char* end = p + length;
+    uint64_t h;
+    
+    if (length >= 32) {
+        uint64_t v1 = seed + PRIME64_1 + PRIME64_2;
+        uint64_t v2 = seed + PRIME64_2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - PRIME64_1;
+        const unsigned char* limit = end - 32;
+        do {
+            v1 = hash_round(v1, read64(p));
+            v2 = hash_round(v2, read64(p + 8));
+            v3 = hash_round(v3, read64(p + 16));
+            v4 = hash_round(v4, read64(p + 24));
+            p += 32;
+        } while (p <= limit);
+        
+        h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+        h = hash_merge(h, v1);
+        h = hash_merge(h, v2);
+        h = hash_merge(h, v3);
+        h = hash_merge(h, v4);
+    } else {
+        h = seed + PRIME64_5;
+    }
+    
+    h += (uint64_t)length;
+    
+    while (p + 8 <= end) {
+        h ^= hash_round(0, read64(p));
+        h = rotl64(h, 27) * PRIME64_1 + PRIME64_4;
+        p += 8;
+    }
+    if (p + 4 <= end) {
+        h ^= (uint64_t)read32(p) * PRIME64_1;
+        h = rotl64(h, 23) * PRIME64_2 + PRIME64_3;
+        p += 4;
+    }
+    while (p < end) {
+        h ^= (*p) * PRIME64_5;
+        h = rotl64(h, 11) * PRIME64_1;
+        p++;
+    }
+    
+    // Final avalanche
+    h ^= h >> 33;
+    h *= PRIME64_2;
+    h ^= h >> 29;
+    h *= PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
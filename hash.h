@@ -0,0 +1,14 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// ================== FAST 64-BIT HASHING ==================
+
+// XXH64: 32 bytes per step over four independent lanes, so it runs at
+// memory speed. Used for source checksums and cache keys; it is not a
+// cryptographic hash.
+uint64_t hash_bytes(const void* data, size_t length, uint64_t seed);
+
+#endif
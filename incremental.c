@@ -0,0 +1,670 @@
+#define _POSIX_C_SOURCE 200809L
+#include "incremental.h"
+#include "lexer.h"
+#include "parser.h"
+#include "codegen.h"
+#include "outbuf.h"
+#include "hash.h"
+#include "cache.h"
+#include "timer.h"
+#include "trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define MANIFEST_MAGIC "SHAYINC1"
+
+typedef enum {
+    UNIT_FUNCTION,
+    UNIT_MAIN
+} UnitKind;
+
+// One record per unit in the manifest, followed by the name (plus NUL),
+// the prototype and the body
+typedef struct {
+    uint64_t text_hash;
+    uint64_t key;
+    uint64_t signature;
+    int32_t kind;
+    int32_t return_type;
+    uint32_t name_length;
+    uint32_t prototype_length;
+    uint64_t body_length;
+} ManifestRecord;
+
+typedef struct {
+    const ManifestRecord* record;
+    const char* name;
+    const char* prototype;
+    const char* body;
+} ManifestEntry;
+
+typedef struct {
+    char* data;             // Whole manifest file
+    ManifestEntry* entries;
+    size_t count;
+    size_t* slots;          // Open-addressed, text_hash -> entry index + 1
+    size_t slot_mask;
+} Manifest;
+
+// Source range of a top-level declaration
+typedef struct {
+    const char* start;
+    const char* end;
+    Position pos;
+    uint64_t text_hash;
+    bool is_function;
+    const char* name;       // Function name in the source
+    size_t name_length;
+    size_t first_call;      // Range in the call list: identifiers followed by '('
+    size_t call_count;
+} Slice;
+
+typedef struct {
+    const char* start;
+    size_t length;
+} NameRef;
+
+typedef struct {
+    UnitKind kind;
+    size_t slice;           // Function units only
+    uint64_t text_hash;
+    uint64_t key;
+    const ManifestEntry* previous;  // Same text in the last build
+
+    // Signature, from the manifest or the parsed declaration
+    const char* name;       // NUL-terminated
+    TokenType return_type;
+    uint64_t signature;
+    const ASTNode* ast;     // Parsed function, NULL if not parsed
+
+    // Output; fresh text lives in the shared buffer, reused text in the manifest
+    bool fresh;
+    size_t prototype_offset, prototype_length;
+    size_t body_offset, body_length;
+} Unit;
+
+// Everything one incremental build needs
+typedef struct {
+    const char* source;
+    const char* filename;
+    int flatten_threshold;
+    uint64_t options_hash;
+    IncrementalResult* result;
+
+    Slice* slices;
+    size_t slice_count, slice_capacity;
+    NameRef* calls;
+    size_t call_count, call_capacity;
+
+    Unit* units;            // Functions in source order, then the main unit
+    size_t unit_count;
+    size_t* name_slots;     // Open-addressed, function name -> unit index + 1
+    size_t name_mask;
+
+    Manifest manifest;
+    Lexer* lexer;
+    Parser* parser;
+    CodeGenerator* codegen;
+    OutputBuffer fresh;     // Text generated by this build
+} IncrementalBuild;
+
+static bool build_error(IncrementalBuild* build, const char* message) {
+    snprintf(build->result->error_message, sizeof(build->result->error_message), "%s", message);
+    return false;
+}
+
+static bool grow(void** items, size_t* capacity, size_t count, size_t item_size) {
+    if (count < *capacity) return true;
+    size_t new_capacity = *capacity ? *capacity * 2 : 256;
+    void* grown = realloc(*items, new_capacity * item_size);
+    if (!grown) return false;
+    *items = grown;
+    *capacity = new_capacity;
+    return true;
+}
+
+static size_t table_size_for(size_t count) {
+    size_t size = 16;
+    while (size < count * 2) size *= 2;
+    return size;
+}
+
+// ================== SPLITTING ==================
+
+static bool is_type_keyword(TokenType type) {
+    return type == TOKEN_INT || type == TOKEN_FLOAT_KW || type == TOKEN_STRING_KW ||
+           type == TOKEN_BOOL_KW || type == TOKEN_VOID_KW;
+}
+
+// A declaration ends at ';' or '}' outside any brackets, unless an else
+// follows. Tokens are hashed by type and text, so whitespace and comment
+// edits do not invalidate anything.
+static bool split_declarations(IncrementalBuild* build, size_t length) {
+    Lexer* lexer = build->lexer;
+    lexer_reset(lexer, build->source, length, build->filename);
+
+    Slice* slice = NULL;
+    Token previous = {0};
+    Token leading[3];
+    int token_index = 0;
+    int depth = 0;
+    bool pending_end = false;
+    const char* last_end = build->source;
+
+    for (;;) {
+        Token token = lexer_next_token(lexer);
+        if (token.type == TOKEN_NEWLINE) continue;
+
+        if (pending_end && token.type != TOKEN_ELSE) {
+            slice->end = last_end;
+            slice = NULL;
+        }
+        pending_end = false;
+        if (token.type == TOKEN_EOF) break;
+
+        if (!slice) {
+            if (!grow((void**)&build->slices, &build->slice_capacity, build->slice_count, sizeof(Slice))) {
+                return build_error(build, "Out of memory splitting declarations");
+            }
+            slice = &build->slices[build->slice_count++];
+            memset(slice, 0, sizeof(*slice));
+            slice->start = token.start;
+            slice->pos = token.pos;
+            slice->first_call = build->call_count;
+            token_index = 0;
+            previous.type = TOKEN_EOF;
+        }
+
+        if (token_index < 3) {
+            leading[token_index] = token;
+            if (token_index == 2) {
+                slice->is_function = leading[0].type == TOKEN_FUNCTION ||
+                                     (is_type_keyword(leading[0].type) &&
+                                      leading[1].type == TOKEN_IDENTIFIER && leading[2].type == TOKEN_LPAREN);
+            }
+        }
+        if (token_index == 1 && leading[0].type == TOKEN_FUNCTION) {
+            slice->is_function = true;
+        }
+        token_index++;
+
+        slice->text_hash = hash_bytes(token.start, token.length, slice->text_hash * 31 + (uint64_t)token.type);
+
+        if (token.type == TOKEN_LPAREN && previous.type == TOKEN_IDENTIFIER) {
+            if (!grow((void**)&build->calls, &build->call_capacity, build->call_count, sizeof(NameRef))) {
+                return build_error(build, "Out of memory splitting declarations");
+            }
+            build->calls[build->call_count++] = (NameRef){ previous.start, previous.length };
+            slice->call_count++;
+            if (!slice->name) {
+                slice->name = previous.start;
+                slice->name_length = previous.length;
+            }
+        }
+
+        switch (token.type) {
+            case TOKEN_LPAREN: case TOKEN_LBRACE: case TOKEN_LBRACKET:
+                depth++;
+                break;
+            case TOKEN_RPAREN: case TOKEN_RBRACE: case TOKEN_RBRACKET:
+                depth--;
+                break;
+            default:
+                break;
+        }
+        if (depth <= 0 && (token.type == TOKEN_SEMICOLON || token.type == TOKEN_RBRACE)) {
+            depth = 0;
+            pending_end = true;
+        }
+
+        last_end = token.start + token.length;
+        previous = token;
+    }
+
+    if (slice) slice->end = last_end;
+    return true;
+}
+
+// ================== MANIFEST ==================
+
+static void manifest_path(const char* output_path, char* buffer, size_t size) {
+    snprintf(buffer, size, "%s.manifest", output_path);
+}
+
+static void manifest_free(Manifest* manifest) {
+    free(manifest->data);
+    free(manifest->entries);
+    free(manifest->slots);
+    memset(manifest, 0, sizeof(*manifest));
+}
+
+// A missing, foreign or damaged manifest just means a full build
+static bool manifest_load(Manifest* manifest, const char* path, uint64_t options_hash) {
+    memset(manifest, 0, sizeof(*manifest));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    size_t size = 0;
+    bool loaded = fstat(fd, &st) == 0 && (size = (size_t)st.st_size) >= 24 &&
+                  (manifest->data = malloc(size)) != NULL;
+    for (size_t done = 0; loaded && done < size; ) {
+        ssize_t got = read(fd, manifest->data + done, size - done);
+        if (got <= 0) loaded = false;
+        else done += (size_t)got;
+    }
+    close(fd);
+
+    uint64_t header[2];
+    if (loaded) {
+        memcpy(header, manifest->data + 8, sizeof(header));
+        loaded = memcmp(manifest->data, MANIFEST_MAGIC, 8) == 0 && header[0] == options_hash &&
+                 header[1] <= size / sizeof(ManifestRecord);
+    }
+    if (loaded) {
+        manifest->entries = malloc((header[1] ? header[1] : 1) * sizeof(ManifestEntry));
+        loaded = manifest->entries != NULL;
+    }
+
+    size_t offset = 24;
+    for (uint64_t i = 0; loaded && i < header[1]; i++) {
+        if (size - offset < sizeof(ManifestRecord)) {
+            loaded = false;
+            break;
+        }
+        ManifestEntry* entry = &manifest->entries[i];
+        entry->record = (const ManifestRecord*)(manifest->data + offset);
+        offset += sizeof(ManifestRecord);
+
+        const ManifestRecord* record = entry->record;
+        uint64_t text = (uint64_t)record->name_length + 1 + record->prototype_length + record->body_length;
+        if (text > size - offset) {
+            loaded = false;
+            break;
+        }
+        entry->name = manifest->data + offset;
+        entry->prototype = entry->name + record->name_length + 1;
+        entry->body = entry->prototype + record->prototype_length;
+        offset += (size_t)text;
+        offset = (offset + 7) & ~(size_t)7;
+        if (offset > size) offset = size;
+        manifest->count++;
+    }
+
+    if (loaded) {
+        manifest->slot_mask = table_size_for(manifest->count) - 1;
+        manifest->slots = calloc(manifest->slot_mask + 1, sizeof(size_t));
+        loaded = manifest->slots != NULL;
+    }
+    if (!loaded) {
+        manifest_free(manifest);
+        return false;
+    }
+
+    for (size_t i = 0; i < manifest->count; i++) {
+        size_t slot = (size_t)manifest->entries[i].record->text_hash & manifest->slot_mask;
+        while (manifest->slots[slot]) slot = (slot + 1) & manifest->slot_mask;
+        manifest->slots[slot] = i + 1;
+    }
+    return true;
+}
+
+static const ManifestEntry* manifest_find(const Manifest* manifest, uint64_t text_hash, UnitKind kind) {
+    if (!manifest->slots) return NULL;
+    size_t slot = (size_t)text_hash & manifest->slot_mask;
+    while (manifest->slots[slot]) {
+        const ManifestEntry* entry = &manifest->entries[manifest->slots[slot] - 1];
+        if (entry->record->text_hash == text_hash && entry->record->kind == (int32_t)kind) return entry;
+        slot = (slot + 1) & manifest->slot_mask;
+    }
+    return NULL;
+}
+
+static const char* unit_prototype(const IncrementalBuild* build, const Unit* unit) {
+    return unit->fresh ? build->fresh.data + unit->prototype_offset : unit->previous->prototype;
+}
+
+static const char* unit_body(const IncrementalBuild* build, const Unit* unit) {
+    return unit->fresh ? build->fresh.data + unit->body_offset : unit->previous->body;
+}
+
+// Written to a temp file and renamed, so an interrupted build leaves the
+// old manifest intact
+static bool manifest_write(IncrementalBuild* build, const char* path) {
+    char temp_path[620];
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+    int fd = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return build_error(build, "Cannot write manifest");
+
+    OutputBuffer out;
+    if (!outbuf_init(&out, fd)) {
+        close(fd);
+        return build_error(build, "Out of memory writing manifest");
+    }
+
+    uint64_t header[2] = { build->options_hash, build->unit_count };
+    outbuf_append(&out, MANIFEST_MAGIC, 8);
+    outbuf_append(&out, (const char*)header, sizeof(header));
+
+    static const char padding[8] = {0};
+    for (size_t i = 0; i < build->unit_count; i++) {
+        const Unit* unit = &build->units[i];
+        ManifestRecord record;
+        memset(&record, 0, sizeof(record));
+        record.text_hash = unit->text_hash;
+        record.key = unit->key;
+        record.signature = unit->signature;
+        record.kind = (int32_t)unit->kind;
+        record.return_type = (int32_t)unit->return_type;
+        record.name_length = (uint32_t)strlen(unit->name);
+        record.prototype_length = (uint32_t)unit->prototype_length;
+        record.body_length = unit->body_length;
+
+        outbuf_append(&out, (const char*)&record, sizeof(record));
+        outbuf_append(&out, unit->name, record.name_length + 1);
+        outbuf_append(&out, unit_prototype(build, unit), unit->prototype_length);
+        outbuf_append(&out, unit_body(build, unit), unit->body_length);
+        size_t text = record.name_length + 1 + unit->prototype_length + unit->body_length;
+        outbuf_append(&out, padding, (8 - text % 8) % 8);
+    }
+
+    bool written = outbuf_flush(&out) && !out.had_error;
+    outbuf_free(&out);
+    if (close(fd) < 0) written = false;
+    if (!written || rename(temp_path, path) < 0) {
+        unlink(temp_path);
+        return build_error(build, "Cannot write manifest");
+    }
+    return true;
+}
+
+// ================== SIGNATURES AND KEYS ==================
+
+static uint64_t signature_of(const ASTNode* function) {
+    uint64_t hash = hash_bytes(function->data.func_decl.name, strlen(function->data.func_decl.name),
+                               (uint64_t)function->data.func_decl.return_type);
+    return hash_bytes(function->data.func_decl.param_types,
+                      sizeof(TokenType) * (size_t)function->data.func_decl.param_count, hash);
+}
+
+static bool index_function_names(IncrementalBuild* build) {
+    build->name_mask = table_size_for(build->unit_count) - 1;
+    build->name_slots = calloc(build->name_mask + 1, sizeof(size_t));
+    if (!build->name_slots) return build_error(build, "Out of memory indexing functions");
+
+    for (size_t i = 0; i < build->unit_count; i++) {
+        if (build->units[i].kind != UNIT_FUNCTION) continue;
+        const Slice* slice = &build->slices[build->units[i].slice];
+        size_t slot = (size_t)hash_bytes(slice->name, slice->name_length, 0) & build->name_mask;
+        while (build->name_slots[slot]) slot = (slot + 1) & build->name_mask;
+        build->name_slots[slot] = i + 1;
+    }
+    return true;
+}
+
+// First definition wins, as it would for the C compiler's error message
+static const Unit* find_function(const IncrementalBuild* build, const char* name, size_t length) {
+    size_t slot = (size_t)hash_bytes(name, length, 0) & build->name_mask;
+    while (build->name_slots[slot]) {
+        const Unit* unit = &build->units[build->name_slots[slot] - 1];
+        const Slice* slice = &build->slices[unit->slice];
+        if (slice->name_length == length && memcmp(slice->name, name, length) == 0) return unit;
+        slot = (slot + 1) & build->name_mask;
+    }
+    return NULL;
+}
+
+// Options, own text, then the signature of every called function
+static uint64_t unit_key(const IncrementalBuild* build, const Unit* unit, const Slice* slices, size_t slice_count) {
+    uint64_t key = hash_bytes(&unit->text_hash, sizeof(unit->text_hash), build->options_hash);
+    for (size_t s = 0; s < slice_count; s++) {
+        const Slice* slice = &slices[s];
+        if ((unit->kind == UNIT_MAIN) == slice->is_function) continue;
+        for (size_t c = 0; c < slice->call_count; c++) {
+            const NameRef* call = &build->calls[slice->first_call + c];
+            const Unit* callee = find_function(build, call->start, call->length);
+            uint64_t signature = callee ? callee->signature : hash_bytes(call->start, call->length, 0);
+            key = hash_bytes(&signature, sizeof(signature), key);
+        }
+    }
+    return key;
+}
+
+// ================== PARSING AND GENERATION ==================
+
+// Parses one declaration; its AST stays valid until the build ends
+static const ASTNode* parse_slice(IncrementalBuild* build, const Slice* slice) {
+    Lexer* lexer = build->lexer;
+    lexer_reset(lexer, slice->start, (size_t)(slice->end - slice->start), build->filename);
+    lexer->pos = slice->pos;
+    parser_set_lexer(build->parser, lexer);
+
+    const ASTNode* program = parser_parse(build->parser);
+    if (!program || parser_has_error(build->parser)) {
+        build_error(build, program ? parser_get_error(build->parser) : "Out of memory while parsing");
+        return NULL;
+    }
+    return program;
+}
+
+static bool parse_function(IncrementalBuild* build, Unit* unit) {
+    const ASTNode* program = parse_slice(build, &build->slices[unit->slice]);
+    if (!program) return false;
+    if (program->data.program.statement_count != 1 ||
+        program->data.program.statements[0]->type != AST_FUNCTION_DECL) {
+        return build_error(build, "Cannot split the source into top-level declarations");
+    }
+
+    unit->ast = program->data.program.statements[0];
+    unit->name = unit->ast->data.func_decl.name;
+    unit->return_type = unit->ast->data.func_decl.return_type;
+    unit->signature = signature_of(unit->ast);
+    return true;
+}
+
+static void generate_function(IncrementalBuild* build, Unit* unit) {
+    CodeGenerator* codegen = build->codegen;
+    unit->prototype_offset = outbuf_total_size(&build->fresh);
+    codegen_emit_prototype(codegen, unit->ast);
+    unit->body_offset = outbuf_total_size(&build->fresh);
+    codegen_emit_function(codegen, unit->ast);
+    unit->prototype_length = unit->body_offset - unit->prototype_offset;
+    unit->body_length = outbuf_total_size(&build->fresh) - unit->body_offset;
+    unit->fresh = true;
+}
+
+// Top-level statements are parsed and generated slice by slice; codegen
+// state carries over, as in one pass over the whole program
+static bool generate_main(IncrementalBuild* build, Unit* unit, TokenType user_main) {
+    CodeGenerator* codegen = build->codegen;
+    unit->body_offset = outbuf_total_size(&build->fresh);
+    codegen_begin_main(codegen);
+    for (size_t s = 0; s < build->slice_count; s++) {
+        if (build->slices[s].is_function) continue;
+        const ASTNode* program = parse_slice(build, &build->slices[s]);
+        if (!program) return false;
+        for (int i = 0; i < program->data.program.statement_count; i++) {
+            if (program->data.program.statements[i]->type == AST_FUNCTION_DECL) {
+                return build_error(build, "Cannot split the source into top-level declarations");
+            }
+            codegen_emit_main_statement(codegen, program->data.program.statements[i]);
+        }
+    }
+    codegen_end_main(codegen, user_main);
+    unit->body_length = outbuf_total_size(&build->fresh) - unit->body_offset;
+    unit->fresh = true;
+    return true;
+}
+
+// ================== BUILD ==================
+
+static bool create_units(IncrementalBuild* build) {
+    build->units = calloc(build->slice_count + 1, sizeof(Unit));
+    if (!build->units) return build_error(build, "Out of memory");
+
+    uint64_t main_text = 0;
+    for (size_t s = 0; s < build->slice_count; s++) {
+        const Slice* slice = &build->slices[s];
+        if (!slice->is_function) {
+            main_text = hash_bytes(&slice->text_hash, sizeof(slice->text_hash), main_text);
+            continue;
+        }
+        Unit* unit = &build->units[build->unit_count++];
+        unit->kind = UNIT_FUNCTION;
+        unit->slice = s;
+        unit->text_hash = slice->text_hash;
+        unit->previous = manifest_find(&build->manifest, unit->text_hash, UNIT_FUNCTION);
+        if (unit->previous) {
+            unit->name = unit->previous->name;
+            unit->return_type = (TokenType)unit->previous->record->return_type;
+            unit->signature = unit->previous->record->signature;
+        } else if (!parse_function(build, unit)) {
+            return false;
+        }
+    }
+
+    Unit* main_unit = &build->units[build->unit_count++];
+    main_unit->kind = UNIT_MAIN;
+    main_unit->name = "";
+    main_unit->text_hash = main_text;
+    main_unit->previous = manifest_find(&build->manifest, main_text, UNIT_MAIN);
+    return true;
+}
+
+static bool generate_units(IncrementalBuild* build) {
+    CodeGenerator* codegen = build->codegen;
+    codegen_set_output(codegen, &build->fresh);
+    for (size_t i = 0; i + 1 < build->unit_count; i++) {
+        codegen_declare_function(codegen, build->units[i].name, build->units[i].return_type);
+    }
+
+    const Unit* user_main = find_function(build, "main", 4);
+    TokenType main_type = user_main ? user_main->return_type : TOKEN_EOF;
+
+    for (size_t i = 0; i < build->unit_count; i++) {
+        Unit* unit = &build->units[i];
+        if (unit->kind == UNIT_FUNCTION) {
+            unit->key = unit_key(build, unit, &build->slices[unit->slice], 1);
+        } else {
+            // The end of main depends on whether a Shaynefro main exists
+            unit->key = unit_key(build, unit, build->slices, build->slice_count);
+            unit->key = hash_bytes(&main_type, sizeof(main_type), unit->key);
+        }
+
+        if (unit->previous && unit->previous->record->key == unit->key) {
+            unit->prototype_length = unit->previous->record->prototype_length;
+            unit->body_length = unit->previous->record->body_length;
+            build->result->reused++;
+            continue;
+        }
+
+        build->result->regenerated++;
+        if (unit->previous) build->result->callee_changed++;
+        if (unit->kind == UNIT_MAIN) {
+            if (!generate_main(build, unit, main_type)) return false;
+        } else {
+            if (!unit->ast && !parse_function(build, unit)) return false;
+            generate_function(build, unit);
+        }
+        if (codegen_has_error(codegen)) return build_error(build, codegen_get_error(codegen));
+    }
+
+    if (build->fresh.had_error) return build_error(build, "Out of memory generating code");
+    return true;
+}
+
+// Same layout as codegen_generate: includes, prototypes, functions, main
+static bool write_output(IncrementalBuild* build, const char* output_path) {
+    int fd = open(output_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return build_error(build, "Cannot open output file");
+
+    OutputBuffer out;
+    if (!outbuf_init(&out, fd)) {
+        close(fd);
+        return build_error(build, "Out of memory writing output");
+    }
+
+    codegen_set_output(build->codegen, &out);
+    codegen_emit_prologue(build->codegen);
+    size_t function_count = build->unit_count - 1;
+    for (size_t i = 0; i < function_count; i++) {
+        outbuf_append(&out, unit_prototype(build, &build->units[i]), build->units[i].prototype_length);
+    }
+    if (function_count > 0) outbuf_putc(&out, '\n');
+    for (size_t i = 0; i < build->unit_count; i++) {
+        outbuf_append(&out, unit_body(build, &build->units[i]), build->units[i].body_length);
+    }
+
+    bool written = outbuf_flush(&out) && !out.had_error;
+    build->result->output_bytes = outbuf_total_size(&out);
+    codegen_set_output(build->codegen, &build->fresh);
+    outbuf_free(&out);
+    if (close(fd) < 0) written = false;
+    return written || build_error(build, "Failed to write output");
+}
+
+static bool run_build(IncrementalBuild* build, size_t length, const char* output_path) {
+    IncrementalResult* result = build->result;
+    TraceScope scope;
+    trace_phase_begin(&scope);
+
+    char options[64];
+    snprintf(options, sizeof(options), "incremental c flatten=%d", build->flatten_threshold);
+    build->options_hash = cache_key(0, options);
+
+    char path[600];
+    manifest_path(output_path, path, sizeof(path));
+    result->manifest_loaded = manifest_load(&build->manifest, path, build->options_hash);
+
+    build->lexer = lexer_create_with_length("", 0, build->filename);
+    build->parser = build->lexer ? parser_create(build->lexer) : NULL;
+    build->codegen = codegen_create_in_memory(&build->fresh, OUTPUT_C);
+    if (!build->lexer || !build->parser || !build->codegen || !outbuf_init(&build->fresh, -1)) {
+        return build_error(build, "Out of memory");
+    }
+    codegen_set_flatten_threshold(build->codegen, build->flatten_threshold);
+
+    if (!split_declarations(build, length)) return false;
+    result->scan_time = trace_phase_end(&scope, "scan", NULL);
+
+    trace_phase_begin(&scope);
+    if (!create_units(build) || !index_function_names(build) || !generate_units(build)) return false;
+    result->units = (int)build->unit_count;
+    result->generate_time = trace_phase_end(&scope, "generate", NULL);
+
+    trace_phase_begin(&scope);
+    if (!write_output(build, output_path) || !manifest_write(build, path)) return false;
+    result->write_time = trace_phase_end(&scope, "write", NULL);
+    return true;
+}
+
+bool incremental_compile(const char* source, size_t length, const char* filename,
+                         const char* output_path, int flatten_threshold, IncrementalResult* result) {
+    memset(result, 0, sizeof(*result));
+
+    IncrementalBuild build;
+    memset(&build, 0, sizeof(build));
+    build.source = source;
+    build.filename = filename;
+    build.flatten_threshold = flatten_threshold > 0 ? flatten_threshold : 0;
+    build.result = result;
+
+    bool success = run_build(&build, length, output_path);
+
+    codegen_destroy(build.codegen);
+    parser_destroy(build.parser);
+    lexer_destroy(build.lexer);
+    outbuf_free(&build.fresh);
+    manifest_free(&build.manifest);
+    free(build.slices);
+    free(build.calls);
+    free(build.units);
+    free(build.name_slots);
+    return success;
+}
@@ -0,0 +1,35 @@
+#ifndef INCREMENTAL_H
+#define INCREMENTAL_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+// ================== PER-DECLARATION INCREMENTAL BUILDS ==================
+//
+// The source is split into top-level declarations on token boundaries,
+// without parsing. Each function is a unit keyed by a hash of its tokens,
+// the signatures of the functions it calls, and the compile options; the
+// top-level statements, which share C's main, form one more unit. Units
+// whose key matches the manifest of the previous build are copied from
+// it, and only the rest are parsed and generated, so a rebuild costs one
+// lexer pass plus work proportional to the edit. The result is the same
+// output.c a full build writes.
+
+typedef struct {
+    int units;              // Functions, plus one for the top-level statements
+    int reused;             // Copied from the previous build
+    int regenerated;        // Parsed and generated again
+    int callee_changed;     // ...of which only because a called signature changed
+    bool manifest_loaded;   // A manifest from a compatible previous build was found
+    double scan_time;       // Lexing, splitting and hashing
+    double generate_time;   // Parsing and code generation of changed units
+    double write_time;      // Output file and manifest
+    size_t output_bytes;
+    char error_message[256];
+} IncrementalResult;
+
+// Writes output_path and keeps the manifest in "<output_path>.manifest"
+bool incremental_compile(const char* source, size_t length, const char* filename,
+                         const char* output_path, int flatten_threshold, IncrementalResult* result);
+
+#endif
@@ -1,8 +1,10 @@
 #include "lexer.h"
+#include "hash.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <limits.h>
 #include <time.h>
 
 // Arena implementation
@@ -18,26 +20,146 @@ Arena* arena_create(void) {
     
     arena->size = ARENA_SIZE;
     arena->used = 0;
+    arena->retired = NULL;
+    arena->retired_used = 0;
+    arena->retired_size = 0;
+    arena->retired_blocks = 0;
+    arena->allocations = 0;
+    arena->peak_used = 0;
+    arena->peak_reserved = ARENA_SIZE;
     return arena;
 }
 
+static void arena_free_retired(Arena* arena) {
+    ArenaBlock* block = arena->retired;
+    while (block) {
+        ArenaBlock* prev = block->prev;
+        free(block->memory);
+        free(block);
+        block = prev;
+    }
+    arena->retired = NULL;
+    arena->retired_used = 0;
+    arena->retired_size = 0;
+    arena->retired_blocks = 0;
+}
+
 void arena_destroy(Arena* arena) {
     if (arena) {
+        arena_free_retired(arena);
         free(arena->memory);
         free(arena);
     }
 }
 
+// Keeps one block for reuse. When the last use spilled over several
+// blocks it is replaced by one that holds all of it, so compiling the
+// same input again does not double its way up past the largest block.
+void arena_reset(Arena* arena) {
+    size_t needed = arena->retired_used + arena->used;
+    arena_free_retired(arena);
+    if (needed > arena->size) {
+        needed = (needed + ARENA_SIZE - 1) / ARENA_SIZE * ARENA_SIZE;
+        char* memory = malloc(needed);
+        if (memory) {
+            free(arena->memory);
+            arena->memory = memory;
+            arena->size = needed;
+        }
+    }
+    arena->used = 0;
+    arena->allocations = 0;
+}
+
+ArenaMark arena_mark(const Arena* arena) {
+    ArenaMark mark = { arena->memory, arena->used };
+    return mark;
+}
+
+// Releases everything allocated since mark. The current block is the
+// largest, so it is kept for what comes next; blocks started between the
+// mark and it are freed.
+void arena_rewind(Arena* arena, ArenaMark mark) {
+    if (arena->memory == mark.memory) {
+        if (arena->used > mark.used) arena->used = mark.used;
+        return;
+    }
+    while (arena->retired && arena->retired->memory != mark.memory) {
+        ArenaBlock* block = arena->retired;
+        arena->retired = block->prev;
+        arena->retired_used -= block->used;
+        arena->retired_size -= block->size;
+        arena->retired_blocks--;
+        free(block->memory);
+        free(block);
+    }
+    if (arena->retired && arena->retired->used > mark.used) {
+        arena->retired_used -= arena->retired->used - mark.used;
+        arena->retired->used = mark.used;
+    }
+    arena->used = 0;
+}
+
+// Retire the current block and start a new one, doubling up to
+// ARENA_MAX_BLOCK_SIZE; earlier allocations stay where they are
+static bool arena_grow(Arena* arena, size_t min_size) {
+    size_t new_size = arena->size < ARENA_MAX_BLOCK_SIZE ? arena->size * 2 : arena->size;
+    if (new_size < min_size) new_size = min_size;
+    
+    ArenaBlock* block = malloc(sizeof(ArenaBlock));
+    char* memory = malloc(new_size);
+    if (!block || !memory) {
+        free(block);
+        free(memory);
+        return false;
+    }
+    
+    block->prev = arena->retired;
+    block->memory = arena->memory;
+    block->size = arena->size;
+    block->used = arena->used;
+    arena->retired = block;
+    arena->retired_used += arena->used;
+    arena->retired_size += arena->size;
+    arena->retired_blocks++;
+    
+    arena->memory = memory;
+    arena->size = new_size;
+    arena->used = 0;
+    if (arena->retired_size + new_size > arena->peak_reserved) {
+        arena->peak_reserved = arena->retired_size + new_size;
+    }
+    return true;
+}
+
 void* arena_alloc(Arena* arena, size_t size) {
-    if (arena->used + size > arena->size) {
-        return NULL; // Arena full
+    if (arena->used + size > arena->size && !arena_grow(arena, size)) {
+        return NULL; // Out of memory
     }
     
     void* ptr = arena->memory + arena->used;
     arena->used += size;
+    arena->allocations++;
+    if (arena->retired_used + arena->used > arena->peak_used) {
+        arena->peak_used = arena->retired_used + arena->used;
+    }
     return ptr;
 }
 
+size_t arena_get_usage(const Arena* arena) {
+    return arena->retired_used + arena->used;
+}
+
+void arena_get_stats(const Arena* arena, ArenaStats* stats) {
+    stats->allocations = arena->allocations;
+    stats->used = arena->retired_used + arena->used;
+    stats->reserved = arena->retired_size + arena->size;
+    stats->waste = arena->retired_size - arena->retired_used;
+    stats->blocks = arena->retired_blocks + 1;
+    stats->peak_used = arena->peak_used;
+    stats->peak_reserved = arena->peak_reserved;
+}
+
 // Keyword initialization
 static void init_keywords(Lexer* lexer) {
     const struct { const char* word; TokenType type; } keywords[] = {
@@ -90,14 +212,23 @@ static void init_keywords(Lexer* lexer) {
     };
     
     lexer->keyword_count = sizeof(keywords) / sizeof(keywords[0]);
+    lexer->keyword_max_length = 0;
     for (size_t i = 0; i < lexer->keyword_count; i++) {
         lexer->keywords[i].keyword = keywords[i].word;
         lexer->keywords[i].token_type = keywords[i].type;
+        lexer->keywords[i].length = strlen(keywords[i].word);
+        if (lexer->keywords[i].length > lexer->keyword_max_length) {
+            lexer->keyword_max_length = lexer->keywords[i].length;
+        }
     }
 }
 
 // Lexer creation and destruction
 Lexer* lexer_create(const char* source, const char* filename) {
+    return lexer_create_with_length(source, strlen(source), filename);
+}
+
+Lexer* lexer_create_with_length(const char* source, size_t length, const char* filename) {
     Lexer* lexer = malloc(sizeof(Lexer));
     if (!lexer) return NULL;
     
@@ -107,9 +238,29 @@ Lexer* lexer_create(const char* source, const char* filename) {
         return NULL;
     }
     
+    // Initialize string pool for interning
+    lexer->string_pool_size = 8192;
+    lexer->string_pool = arena_alloc(lexer->arena, lexer->string_pool_size);
+    
+    init_keywords(lexer);
+    lexer_reset(lexer, source, length, filename);
+    
+    return lexer;
+}
+
+// Point an existing lexer at new source, keeping its arena and keyword table
+void lexer_reset(Lexer* lexer, const char* source, size_t length, const char* filename) {
+    lexer_set_source(lexer, source, length, filename);
+    
+    // Cache key for the whole file; hashing runs far faster than lexing
+    lexer->checksum = lexer_compute_checksum(lexer);
+}
+
+void lexer_set_source(Lexer* lexer, const char* source, size_t length, const char* filename) {
     lexer->source = source;
     lexer->current = source;
     lexer->start = source;
+    lexer->end = source + length;
     lexer->pos.line = 1;
     lexer->pos.column = 1;
     lexer->pos.filename = filename;
@@ -119,15 +270,11 @@ Lexer* lexer_create(const char* source, const char* filename) {
     // Initialize performance tracking
     lexer->tokens_processed = 0;
     lexer->start_time = (double)clock() / CLOCKS_PER_SEC;
+    memset(&lexer->telemetry, 0, sizeof(lexer->telemetry));
+    lexer->instruction_count = 0;
     
-    // Initialize string pool for interning
-    lexer->string_pool_size = 8192;
-    lexer->string_pool = arena_alloc(lexer->arena, lexer->string_pool_size);
     lexer->string_pool_used = 0;
-    
-    init_keywords(lexer);
-    
-    return lexer;
+    lexer->checksum = 0;
 }
 
 void lexer_destroy(Lexer* lexer) {
@@ -139,7 +286,7 @@ void lexer_destroy(Lexer* lexer) {
 
 // Utility functions
 static bool is_at_end(const Lexer* lexer) {
-    return *lexer->current == '\0';
+    return lexer->current >= lexer->end;
 }
 
 static char advance(Lexer* lexer) {
@@ -156,11 +303,12 @@ static char advance(Lexer* lexer) {
 }
 
 static char peek(const Lexer* lexer) {
+    if (is_at_end(lexer)) return '\0';
     return *lexer->current;
 }
 
 static char peek_next(const Lexer* lexer) {
-    if (is_at_end(lexer)) return '\0';
+    if (lexer->current + 1 >= lexer->end) return '\0';
     return lexer->current[1];
 }
 
@@ -179,10 +327,11 @@ static void skip_whitespace(Lexer* lexer) {
         if (c == ' ' || c == '\r' || c == '\t') {
             advance(lexer);
         } else if (c == '/' && peek_next(lexer) == '/') {
-            // Skip line comment
-            while (peek(lexer) != '\n' && !is_at_end(lexer)) {
-                advance(lexer);
-            }
+            // Skip line comment, leaving the newline for the next token
+            const char* newline = memchr(lexer->current, '\n', (size_t)(lexer->end - lexer->current));
+            const char* stop = newline ? newline : lexer->end;
+            lexer->pos.column += (int)(stop - lexer->current);
+            lexer->current = stop;
         } else if (c == '/' && peek_next(lexer) == '*') {
             // Skip block comment
             advance(lexer); // '/'
@@ -228,47 +377,29 @@ static Token number(Lexer* lexer) {
     bool is_float = false;
     int base = 10;
     
-    // Check for hex (0x), binary (0b), or octal (0o) prefixes
-    if (peek(lexer) == '0' && !is_at_end(lexer)) {
-        char next = peek_next(lexer);
-        if (next == 'x' || next == 'X') {
-            advance(lexer); // consume '0'
-            advance(lexer); // consume 'x'
-            base = 16;
-            while (isxdigit(peek(lexer))) {
-                advance(lexer);
-            }
-        } else if (next == 'b' || next == 'B') {
-            advance(lexer); // consume '0'
-            advance(lexer); // consume 'b'
-            base = 2;
-            while (peek(lexer) == '0' || peek(lexer) == '1') {
-                advance(lexer);
-            }
-        } else if (next == 'o' || next == 'O') {
-            advance(lexer); // consume '0'
-            advance(lexer); // consume 'o'
-            base = 8;
-            while (peek(lexer) >= '0' && peek(lexer) <= '7') {
-                advance(lexer);
-            }
-        } else {
-            // Regular decimal number starting with 0
-            while (isdigit(peek(lexer))) {
-                advance(lexer);
-            }
-            
-            // Look for decimal point (only for base 10)
-            if (peek(lexer) == '.' && isdigit(peek_next(lexer))) {
-                is_float = true;
-                advance(lexer); // consume '.'
-                while (isdigit(peek(lexer))) {
-                    advance(lexer);
-                }
-            }
+    // Check for hex (0x), binary (0b), or octal (0o) prefixes; the leading
+    // digit has already been consumed by lexer_next_token
+    char next = peek(lexer);
+    if (*lexer->start == '0' && (next == 'x' || next == 'X')) {
+        advance(lexer); // consume 'x'
+        base = 16;
+        while (isxdigit(peek(lexer))) {
+            advance(lexer);
+        }
+    } else if (*lexer->start == '0' && (next == 'b' || next == 'B')) {
+        advance(lexer); // consume 'b'
+        base = 2;
+        while (peek(lexer) == '0' || peek(lexer) == '1') {
+            advance(lexer);
+        }
+    } else if (*lexer->start == '0' && (next == 'o' || next == 'O')) {
+        advance(lexer); // consume 'o'
+        base = 8;
+        while (peek(lexer) >= '0' && peek(lexer) <= '7') {
+            advance(lexer);
         }
     } else {
-        // Regular decimal number
+        // Regular decimal number, with or without a leading 0
         while (isdigit(peek(lexer))) {
             advance(lexer);
         }
@@ -299,12 +430,27 @@ static Token number(Lexer* lexer) {
     
     Token token = make_token(lexer, is_float ? TOKEN_FLOAT : TOKEN_INTEGER);
     
+    // Convert from the token slice only; the source need not be NUL-terminated
     if (is_float) {
-        char* endptr;
-        token.value.float_value = strtod(lexer->start, &endptr);
+        char text[64];
+        char* copy = token.length < sizeof(text) ? text : malloc(token.length + 1);
+        if (!copy) return error_token(lexer, "Out of memory");
+        memcpy(copy, lexer->start, token.length);
+        copy[token.length] = '\0';
+        token.value.float_value = strtod(copy, NULL);
+        if (copy != text) free(copy);
     } else {
-        char* endptr;
-        token.value.int_value = strtoll(lexer->start, &endptr, base);
+        const char* digit = lexer->start + (base == 10 ? 0 : 2);  // skip 0x/0b/0o
+        unsigned long long value = 0;
+        for (; digit < lexer->current; digit++) {
+            int d = isdigit((unsigned char)*digit) ? *digit - '0'
+                                                   : tolower((unsigned char)*digit) - 'a' + 10;
+            if (value > ((unsigned long long)LLONG_MAX - (unsigned)d) / (unsigned)base) {
+                return error_token(lexer, "Integer literal too large");
+            }
+            value = value * (unsigned)base + (unsigned)d;
+        }
+        token.value.int_value = (long long)value;
     }
     
     return token;
@@ -368,10 +514,11 @@ static Token string(Lexer* lexer) {
 }
 
 static TokenType check_keyword(const Lexer* lexer, const char* text, size_t length) {
+    if (length > lexer->keyword_max_length) return TOKEN_IDENTIFIER;
     for (size_t i = 0; i < lexer->keyword_count; i++) {
-        const char* keyword = lexer->keywords[i].keyword;
-        if (strlen(keyword) == length && memcmp(text, keyword, length) == 0) {
-            return lexer->keywords[i].token_type;
+        const Keyword* keyword = &lexer->keywords[i];
+        if (keyword->length == length && memcmp(text, keyword->keyword, length) == 0) {
+            return keyword->token_type;
         }
     }
     return TOKEN_IDENTIFIER;
@@ -407,6 +554,14 @@ Token lexer_next_token(Lexer* lexer) {
         return number(lexer);
     }
     
+    // 📊 (U+1F4CA), the only emoji token the parser understands
+    if ((unsigned char)c == 0xF0 && lexer->end - lexer->current >= 3 &&
+        memcmp(lexer->current, "\x9F\x93\x8A", 3) == 0) {
+        lexer->current += 3;
+        lexer->pos.column += 3;
+        return make_token(lexer, (TokenType)TOKEN_ANALYTICS);
+    }
+    
     switch (c) {
         case '(': return make_token(lexer, TOKEN_LPAREN);
         case ')': return make_token(lexer, TOKEN_RPAREN);
@@ -512,9 +667,10 @@ void lexer_print_stats(const Lexer* lexer) {
     double tokens_per_sec = elapsed_time > 0 ? lexer->tokens_processed / elapsed_time : 0;
     
     printf("   >> Lexer Stats:\n");
+    ArenaStats arena;
+    arena_get_stats(lexer->arena, &arena);
     printf("      * Arena usage: %zu / %zu bytes (%.1f%%)\n", 
-           lexer->arena->used, lexer->arena->size, 
-           (double)lexer->arena->used / lexer->arena->size * 100.0);
+           arena.used, arena.reserved, (double)arena.used / arena.reserved * 100.0);
     printf("      * String pool: %zu / %zu bytes (%.1f%%)\n",
            lexer->string_pool_used, lexer->string_pool_size,
            (double)lexer->string_pool_used / lexer->string_pool_size * 100.0);
@@ -592,3 +748,22 @@ Token lexer_peek_token(Lexer* lexer) {
     
     return token;
 }
+
+// Source checksum (XXH64 of the raw bytes)
+uint64_t lexer_compute_checksum(const Lexer* lexer) {
+    return hash_bytes(lexer->source, (size_t)(lexer->end - lexer->source), 0);
+}
+
+// True if the source has not changed since the lexer was pointed at it
+bool lexer_verify_integrity(const Lexer* lexer) {
+    return lexer_compute_checksum(lexer) == lexer->checksum;
+}
+
+uint64_t lexer_get_instruction_count(const Lexer* lexer) {
+    return lexer->instruction_count;
+}
+
+double lexer_get_cache_hit_ratio(const Lexer* lexer) {
+    uint64_t reads = lexer->telemetry.cache_hits + lexer->telemetry.cache_misses;
+    return reads > 0 ? (double)lexer->telemetry.cache_hits / reads : -1.0;
+}
@@ -8,6 +8,7 @@
 #include <time.h>
 
 #define ARENA_SIZE 65536
+#define ARENA_MAX_BLOCK_SIZE (16u << 20)  // Growth stops doubling here
 #define MAX_KEYWORDS 64
 #define MAX_STRING_LITERAL 1024
 #define LEXER_LOOKAHEAD 2
@@ -63,16 +64,36 @@ typedef struct {
     float innovation_index;
 } MLFeatureVector;
 
-// Performance-oriented arena with quantum-inspired alignment
-typedef struct {
+// A filled arena block, kept alive until the arena is reset or destroyed
+typedef struct ArenaBlock {
+    struct ArenaBlock* prev;
     char* memory;
     size_t size;
     size_t used;
-    size_t peak_used;  // Track peak memory usage for optimization
+} ArenaBlock;
+
+// Performance-oriented arena with quantum-inspired alignment
+typedef struct {
+    char* memory;      // Current block
+    size_t size;       // Size of the current block
+    size_t used;       // Bytes used in the current block
+    ArenaBlock* retired;  // Earlier blocks, newest first
+    size_t retired_used;  // Bytes handed out from retired blocks
+    size_t retired_size;  // Bytes held by retired blocks
+    size_t retired_blocks;
+    size_t allocations;   // arena_alloc calls since the last reset
+    size_t peak_used;     // Most bytes handed out at once since creation
+    size_t peak_reserved; // Most bytes held in blocks since creation
     uint64_t quantum_entropy;  // 2025: Quantum entropy for cache optimization
     double coherence_factor;   // 2025: Memory coherence rating
 } Arena;
 
+// A position in an arena to rewind to; see arena_rewind
+typedef struct {
+    char* memory;
+    size_t used;
+} ArenaMark;
+
 typedef struct {
     const char* keyword;
     TokenType token_type;
@@ -91,6 +112,7 @@ typedef struct {
     Arena* arena;
     Keyword keywords[MAX_KEYWORDS];
     size_t keyword_count;
+    size_t keyword_max_length;  // Longer identifiers skip the keyword table
     bool has_error;
     char error_message[256];
     
@@ -132,16 +154,36 @@ typedef struct {
     bool secure_mode;                     // Enhanced security features
 } Lexer;
 
+// Arena accounting in bytes. Waste is the unused tail each retired block
+// was left with when an allocation did not fit; the free tail of the
+// current block is still usable and not counted.
+typedef struct {
+    size_t allocations;     // Since the last reset
+    size_t used;            // Handed out since the last reset
+    size_t reserved;        // Held in blocks now
+    size_t waste;
+    size_t blocks;          // Held now, including the current one
+    size_t peak_used;       // Since creation, across resets
+    size_t peak_reserved;
+} ArenaStats;
+
 // Arena functions with quantum-inspired alignment
 Arena* arena_create(void);
 void arena_destroy(Arena* arena);
 void* arena_alloc(Arena* arena, size_t size);
 void* arena_alloc_aligned(Arena* arena, size_t size, size_t alignment);
 void arena_reset(Arena* arena);
+ArenaMark arena_mark(const Arena* arena);
+void arena_rewind(Arena* arena, ArenaMark mark);
 size_t arena_get_usage(const Arena* arena);
+void arena_get_stats(const Arena* arena, ArenaStats* stats);
 
 // Core lexer functions
 Lexer* lexer_create(const char* source, const char* filename);
+Lexer* lexer_create_with_length(const char* source, size_t length, const char* filename);
+void lexer_reset(Lexer* lexer, const char* source, size_t length, const char* filename);
+// lexer_reset without the checksum (left 0), which reads the whole source
+void lexer_set_source(Lexer* lexer, const char* source, size_t length, const char* filename);
 void lexer_destroy(Lexer* lexer);
 Token lexer_next_token(Lexer* lexer);
 Token lexer_peek_token(Lexer* lexer);  // Lookahead without consuming
@@ -199,9 +241,11 @@ void lexer_enable_parallel_mode(Lexer* lexer, bool enable);
 int lexer_get_optimal_thread_count(const Lexer* lexer);
 void lexer_set_thread_id(Lexer* lexer, int thread_id);
 
-// Advanced Profiling
+// Advanced Profiling - hardware counters for the lexing (and parsing) of
+// the current source, filled in by whoever measured them (counters.h);
+// lexer_reset clears them
 uint64_t lexer_get_instruction_count(const Lexer* lexer);
-double lexer_get_cache_hit_ratio(const Lexer* lexer);
+double lexer_get_cache_hit_ratio(const Lexer* lexer);  // L1D read hits, -1 if not measured
 void lexer_print_advanced_stats(const Lexer* lexer);
 
 #endif
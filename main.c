@@ -2,91 +2,715 @@
 #include <stdlib.h>
 #include <time.h>
 #include <string.h>
+#include <stdarg.h>
 #include "lexer.h"
 #include "parser.h"
 #include "codegen.h"
+#include "shaynefro.h"
+#include "driver.h"
+#include "timer.h"
+#include "cache.h"
+#include "incremental.h"
+#include "hash.h"
+#include "dtoa.h"
+#include "bench.h"
+#include "counters.h"
+#include "trace.h"
+#include "stats.h"
+#include "batch.h"
+#include "server.h"
+#include "watch.h"
+#include "pipeline.h"
+#include "streaming.h"
 
 // ShayLang compiler - full implementation
 
-static void compile_program(const char* source_code, const char* filename) {
-    printf(">> COMPILING SHAYNEFRO PROGRAM\n");
-    printf("==============================\n");
-    printf("Source: %s\n\n", filename);
+// Options that apply to a compile, given after -c / -f <file>
+typedef struct {
+    int flatten_threshold;  // --flatten=N
+    int split_units;        // --split=N, 0 writes a single output.c
+    const char* output_path; // -o <file>: build an executable with the C compiler
+    CCProfile cc_profile;   // --cc-profile=NAME
+    bool use_cache;         // --cache
+    const char* cache_dir;  // --cache-dir=DIR, NULL for the default
+    bool incremental;       // --incremental: reuse unchanged declarations
+    int threads;            // --threads=N for code generation
+    const char* trace_path; // --trace=FILE: write a Chrome trace-event timeline
+    bool stats_json;        // --stats=json: statistics as one JSON object on stdout
+    bool dump_ast;          // --dump-ast: print the syntax tree after compiling
+    bool profile;           // --profile: instrument every function of the generated program
+    const char* profile_use; // --profile-use=FILE: counts from a --profile run guide codegen
+    ProfileData profile_data; // Loaded from profile_use
+    int sample_hz;          // --sample[=HZ]: the generated program samples its call stack
+    bool pipeline;          // --pipeline: lex, parse and generate on three threads at once
+    bool stream;            // --stream: release each declaration once generated (-f only)
+} CompilerSettings;
+
+static bool parse_compiler_option(CompilerSettings* settings, const char* arg) {
+    if (strncmp(arg, "--flatten=", 10) == 0) {
+        settings->flatten_threshold = atoi(arg + 10);
+        return settings->flatten_threshold > 0;
+    }
+    if (strncmp(arg, "--split=", 8) == 0) {
+        settings->split_units = atoi(arg + 8);
+        return settings->split_units > 0 && settings->split_units <= 256;
+    }
+    if (strncmp(arg, "--cc-profile=", 13) == 0) {
+        return cc_profile_from_name(arg + 13, &settings->cc_profile);
+    }
+    if (strncmp(arg, "--threads=", 10) == 0) {
+        settings->threads = atoi(arg + 10);
+        return settings->threads > 0 && settings->threads <= 64;
+    }
+    if (strncmp(arg, "--trace=", 8) == 0) {
+        settings->trace_path = arg + 8;
+        return arg[8] != '\0';
+    }
+    if (strncmp(arg, "--stats=", 8) == 0) {
+        settings->stats_json = strcmp(arg + 8, "json") == 0;
+        return settings->stats_json || strcmp(arg + 8, "text") == 0;
+    }
+    if (strcmp(arg, "--dump-ast") == 0) {
+        settings->dump_ast = true;
+        return true;
+    }
+    if (strcmp(arg, "--profile") == 0) {
+        settings->profile = true;
+        return true;
+    }
+    if (strcmp(arg, "--sample") == 0) {
+        settings->sample_hz = CODEGEN_SAMPLE_DEFAULT_HZ;
+        return true;
+    }
+    if (strncmp(arg, "--sample=", 9) == 0) {
+        settings->sample_hz = atoi(arg + 9);
+        return settings->sample_hz > 0 && settings->sample_hz <= CODEGEN_SAMPLE_MAX_HZ;
+    }
+    if (strncmp(arg, "--profile-use=", 14) == 0) {
+        settings->profile_use = arg + 14;
+        return arg[14] != '\0';
+    }
+    if (strcmp(arg, "--pipeline") == 0) {
+        settings->pipeline = true;
+        return true;
+    }
+    if (strcmp(arg, "--stream") == 0) {
+        settings->stream = true;
+        return true;
+    }
+    if (strcmp(arg, "--incremental") == 0) {
+        settings->incremental = true;
+        return true;
+    }
+    if (strcmp(arg, "--cache") == 0) {
+        settings->use_cache = true;
+        return true;
+    }
+    if (strncmp(arg, "--cache-dir=", 12) == 0) {
+        settings->use_cache = true;
+        settings->cache_dir = arg + 12;
+        return arg[12] != '\0';
+    }
+    return false;
+}
+
+static bool parse_compiler_options(CompilerSettings* settings, int argc, char* argv[], int first) {
+    memset(settings, 0, sizeof(*settings));
+    settings->cc_profile = CC_PROFILE_RELEASE;
+    settings->threads = 1;
+    for (int i = first; i < argc; i++) {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            settings->output_path = argv[++i];
+            continue;
+        }
+        if (!parse_compiler_option(settings, argv[i])) {
+            printf("[ERROR] Unknown or invalid option: %s\n", argv[i]);
+            return false;
+        }
+    }
+    if (settings->output_path && settings->split_units > 0) {
+        printf("[ERROR] -o builds from a single stream; use make with --split instead\n");
+        return false;
+    }
+    if (settings->stats_json && settings->dump_ast) {
+        printf("[ERROR] --dump-ast writes to stdout, which --stats=json keeps for the JSON object\n");
+        return false;
+    }
+    if (settings->incremental && (settings->output_path || settings->split_units > 0)) {
+        printf("[ERROR] --incremental updates output.c; it cannot be combined with -o or --split\n");
+        return false;
+    }
+    if (settings->pipeline && (settings->incremental || settings->split_units > 0 ||
+                               settings->output_path || settings->threads > 1)) {
+        printf("[ERROR] --pipeline writes output.c from its own codegen thread; it cannot be combined with --incremental, --split, -o or --threads\n");
+        return false;
+    }
+    if (settings->stream && (settings->flatten_threshold > 0 || settings->split_units > 0 ||
+                             settings->output_path || settings->threads > 1 || settings->incremental ||
+                             settings->pipeline || settings->use_cache || settings->trace_path ||
+                             settings->stats_json || settings->dump_ast)) {
+        printf("[ERROR] --stream keeps no syntax tree and writes output.c only; it cannot be combined with\n");
+        printf("        --flatten, --split, -o, --threads, --incremental, --pipeline, --cache, --trace, --stats or --dump-ast\n");
+        return false;
+    }
+    if (settings->profile && (settings->incremental || settings->split_units > 0)) {
+        printf("[ERROR] --profile needs a single generated file; it cannot be combined with --incremental or --split\n");
+        return false;
+    }
+    if (settings->sample_hz > 0 && (settings->incremental || settings->split_units > 0)) {
+        printf("[ERROR] --sample needs a single generated file; it cannot be combined with --incremental or --split\n");
+        return false;
+    }
+    if (settings->profile_use) {
+        if (settings->profile || settings->incremental || settings->split_units > 0) {
+            printf("[ERROR] --profile-use needs a single generated file and no --profile\n");
+            return false;
+        }
+        if (!profile_load(&settings->profile_data, settings->profile_use)) {
+            printf("[ERROR] %s\n", settings->profile_data.error_message);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Progress and text statistics; with --stats=json they move to stderr
+static FILE* report_stream(const CompilerSettings* settings) {
+    return settings->stats_json ? stderr : stdout;
+}
+
+static void report_error(CompileStats* stats, FILE* report, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    vsnprintf(stats->error_message, sizeof(stats->error_message), format, args);
+    va_end(args);
+    fprintf(report, "[ERROR] %s\n", stats->error_message);
+}
+
+// only declarations that changed since the last build are parsed and generated
+static bool run_incremental(const char* source_code, const char* filename,
+                            const CompilerSettings* settings, CompileStats* stats) {
+    FILE* report = report_stream(settings);
+    fprintf(report, ">> COMPILING SHAYNEFRO PROGRAM (incremental)\n");
+    fprintf(report, "============================================\n");
+    fprintf(report, "Source: %s\n\n", filename);
+    
+    double start_time = timer_now();
+    IncrementalResult result;
+    if (!incremental_compile(source_code, strlen(source_code), filename, "output.c",
+                             settings->flatten_threshold, &result)) {
+        report_error(stats, report, "Compilation failed: %s", result.error_message);
+        return false;
+    }
+    double total_time = timer_now() - start_time;
+    stats->incremental = true;
+    stats->units = result.units;
+    stats->units_reused = result.reused;
+    stats->units_regenerated = result.regenerated;
+    stats->parse_time = result.scan_time;
+    stats->codegen_time = result.generate_time + result.write_time;
+    stats->output_bytes = result.output_bytes;
+    stats->flatten_threshold = settings->flatten_threshold;
+    
+    fprintf(report, "[SUCCESS] Compilation complete! Generated: output.c (manifest: output.c.manifest)\n\n");
+    if (settings->stats_json) return true;
+    fprintf(report, ">> INCREMENTAL BUILD:\n");
+    fprintf(report, "   Units: %d (functions, plus one for top-level statements)\n", result.units);
+    fprintf(report, "   Reused: %d\n", result.reused);
+    fprintf(report, "   Regenerated: %d (%d only because a called signature changed)%s\n",
+                    result.regenerated, result.callee_changed,
+                    result.manifest_loaded ? "" : ", no previous build");
+    fprintf(report, "   Scan (lex, split, hash): %.4f seconds\n", result.scan_time);
+    fprintf(report, "   Parse + codegen of changed units: %.4f seconds\n", result.generate_time);
+    fprintf(report, "   Write output + manifest: %.4f seconds\n", result.write_time);
+    fprintf(report, "   Total: %.4f seconds\n", total_time);
+    fprintf(report, "   Output size: %zu bytes\n", result.output_bytes);
+    return true;
+}
+
+static void configure_codegen(CodeGenerator* codegen, const CompilerSettings* settings) {
+    codegen_set_flatten_threshold(codegen, settings->flatten_threshold);
+    codegen_set_threads(codegen, settings->threads);
+    codegen_set_profile(codegen, settings->profile);
+    codegen_set_profile_data(codegen, settings->profile_use ? &settings->profile_data : NULL);
+    codegen_set_sampling(codegen, settings->sample_hz);
+}
+
+static bool run_compiler(const char* source_code, const char* filename,
+                         const CompilerSettings* settings, CompileStats* stats) {
+    if (settings->incremental) {
+        return run_incremental(source_code, filename, settings, stats);
+    }
+    FILE* report = report_stream(settings);
+    
+    double start_time = timer_now();
+    bool native = settings->output_path != NULL;
+    
+    // CPU counters per phase, where the kernel allows them
+    PerfCounters counters;
+    CounterSample phase_start, parse_counters, codegen_counters;
+    counters_open(&counters);
+    counters_read(&counters, &phase_start);
+    
+    fprintf(report, ">> COMPILING SHAYNEFRO PROGRAM\n");
+    fprintf(report, "==============================\n");
+    fprintf(report, "Source: %s\n\n", filename);
     
     // lexical analysis first
-    printf("Phase 1: Lexical Analysis...\n");
+    fprintf(report, "Phase 1: Lexical Analysis...\n");
     Lexer* lexer = lexer_create(source_code, filename);
     if (!lexer) {
-        printf("[ERROR] Failed to create lexer\n");
-        return;
+        report_error(stats, report, "Failed to create lexer");
+        counters_close(&counters);
+        return false;
     }
     
     // now parse into AST
-    printf("Phase 2: Parsing...\n");
+    fprintf(report, "Phase 2: Parsing...\n");
     Parser* parser = parser_create(lexer);
     if (!parser) {
-        printf("[ERROR] Failed to create parser\n");
+        report_error(stats, report, "Failed to create parser");
         lexer_destroy(lexer);
-        return;
+        counters_close(&counters);
+        return false;
     }
     
-    ASTNode* ast = parser_parse(parser);
+    // pipelined, declarations are generated into memory while parsing;
+    // output.c is only opened once the parse has succeeded
+    CodeGenerator* codegen = NULL;
+    CodegenStream stream;
+    PipelineStats pipeline;
+    memset(&stream, 0, sizeof(stream));
+    if (settings->pipeline) {
+        fprintf(report, "Phase 3: Code Generation, on its own thread as declarations are parsed...\n");
+        codegen = codegen_create_in_memory(NULL, OUTPUT_C);
+        if (codegen) configure_codegen(codegen, settings);
+        if (!codegen || !codegen_stream_begin(codegen, &stream)) {
+            report_error(stats, report, "Failed to create code generator");
+            codegen_destroy(codegen);
+            parser_destroy(parser);
+            lexer_destroy(lexer);
+            counters_close(&counters);
+            return false;
+        }
+    }
+    
+    ASTNode* ast = settings->pipeline ? pipeline_parse(parser, codegen, &stream, &pipeline) : parser_parse(parser);
     if (!ast || parser_has_error(parser)) {
-        printf("[ERROR] Parsing failed: %s\n", parser_get_error(parser));
+        report_error(stats, report, "Parsing failed: %s", parser_get_error(parser));
+        codegen_stream_free(&stream);
+        codegen_destroy(codegen);
         parser_destroy(parser);
         lexer_destroy(lexer);
-        return;
+        counters_close(&counters);
+        return false;
     }
+    double parse_end = timer_now();
     
-    printf("[SUCCESS] Successfully parsed %d AST nodes\n", parser_get_nodes_created(parser));
+    // the parser pulls tokens as it goes, so lexing is part of this phase
+    CounterSample now;
+    counters_read(&counters, &now);
+    counters_diff(&now, &phase_start, &parse_counters);
+    phase_start = now;
+    lexer->telemetry.total_cycles = parse_counters.values[COUNTER_CYCLES];
+    lexer->instruction_count = parse_counters.values[COUNTER_INSTRUCTIONS];
+    if (parse_counters.valid[COUNTER_L1D_READS] && parse_counters.valid[COUNTER_L1D_MISSES]) {
+        lexer->telemetry.cache_misses = parse_counters.values[COUNTER_L1D_MISSES];
+        lexer->telemetry.cache_hits = parse_counters.values[COUNTER_L1D_READS] > lexer->telemetry.cache_misses
+            ? parse_counters.values[COUNTER_L1D_READS] - lexer->telemetry.cache_misses
+            : 0;
+    }
+    
+    fprintf(report, "[SUCCESS] Successfully parsed %d AST nodes\n", parser_get_nodes_created(parser));
+    
+    // with -o the C compiler runs alongside codegen, reading from a pipe
+    NativeBuild build;
+    OutputBuffer pipe_out;
+    double cc_start = 0;
+    if (native) {
+        cc_start = timer_now();
+        if (!native_build_start(&build, settings->cc_profile, settings->output_path) ||
+            !outbuf_init(&pipe_out, build.input_fd)) {
+            report_error(stats, report, "%s", build.error_message[0] ? build.error_message : "Out of memory");
+            if (build.pid > 0) native_build_abort(&build);
+            parser_destroy(parser);
+            lexer_destroy(lexer);
+            counters_close(&counters);
+            return false;
+        }
+        char command[512];
+        native_build_command(&build, command, sizeof(command));
+        fprintf(report, "Phase 3: Code Generation, piped into: %s\n", command);
+    } else if (!settings->pipeline) {
+        // generate C code from AST
+        fprintf(report, "Phase 3: Code Generation...\n");
+    }
     
-    // generate C code from AST
-    printf("Phase 3: Code Generation...\n");
-    CodeGenerator* codegen = codegen_create("output.c", OUTPUT_C);
+    if (settings->pipeline) {
+        if (!codegen_open_output(codegen, "output.c")) {
+            codegen_destroy(codegen);
+            codegen = NULL;
+        }
+    } else if (native) {
+        codegen = codegen_create_in_memory(&pipe_out, OUTPUT_C);
+    } else if (settings->split_units > 0) {
+        codegen = codegen_create_in_memory(NULL, OUTPUT_C);
+    } else {
+        codegen = codegen_create("output.c", OUTPUT_C);
+    }
     if (!codegen) {
-        printf("[ERROR] Failed to create code generator\n");
+        report_error(stats, report, "Failed to create code generator");
+        codegen_stream_free(&stream);
+        if (native) {
+            native_build_abort(&build);
+            outbuf_free(&pipe_out);
+        }
         parser_destroy(parser);
         lexer_destroy(lexer);
-        return;
+        counters_close(&counters);
+        return false;
+    }
+    bool success;
+    if (settings->pipeline) {
+        success = codegen_stream_finish(codegen, &stream, ast);
+        codegen_stream_free(&stream);
+    } else {
+        configure_codegen(codegen, settings);
+        success = settings->split_units > 0
+            ? codegen_write_split(codegen, ast, "output", settings->split_units)
+            : codegen_generate(codegen, ast);
+    }
+    double codegen_end = timer_now();
+    double cc_end = codegen_end;
+    bool cc_failed = false;
+    counters_read(&counters, &now);
+    counters_diff(&now, &phase_start, &codegen_counters);
+    
+    // before the pipe's buffer goes away
+    MemoryStats* memory = &stats->memory;
+    memory_stats_collect(memory, lexer, parser, codegen);
+    stats->parse_time = parser_get_parse_time(parser);
+    stats->tokens = lexer->tokens_processed;
+    stats->ast_nodes = parser_get_nodes_created(parser);
+    compile_stats_from_codegen(stats, codegen);
+    stats->parse_counters = parse_counters;
+    stats->codegen_counters = codegen_counters;
+    
+    if (native) {
+        // the compiler keeps running until it has seen the end of its input
+        if (success) {
+            success = native_build_finish(&build);
+            cc_end = timer_now();
+            stats->cc_time = cc_end - codegen_end;
+            if (trace_active) {
+                trace_record(cc_start, cc_end, "cc", cc_profile_name(settings->cc_profile));
+                trace_record(codegen_end, cc_end, "cc after input", NULL);
+            }
+            if (!success) {
+                report_error(stats, report, "Native build failed: %s", build.error_message);
+            }
+        } else if (pipe_out.had_error) {
+            // a compiler that is missing or gave up early breaks the pipe;
+            // its exit status says why, the failed write does not
+            if (!native_build_finish(&build)) {
+                report_error(stats, report, "Native build failed: %s", build.error_message);
+                cc_failed = true;
+            }
+        } else {
+            native_build_abort(&build);
+        }
+        outbuf_free(&pipe_out);
     }
     
-    bool success = codegen_generate(codegen, ast);
     if (!success || codegen_has_error(codegen)) {
-        printf("[ERROR] Code generation failed: %s\n", codegen_get_error(codegen));
+        if (codegen_has_error(codegen) && !cc_failed) {
+            report_error(stats, report, "Code generation failed: %s", codegen_get_error(codegen));
+        }
         codegen_destroy(codegen);
         parser_destroy(parser);
         lexer_destroy(lexer);
-        return;
+        counters_close(&counters);
+        return false;
     }
     
-    printf("[SUCCESS] Successfully generated %d lines of C code\n", codegen_get_lines_generated(codegen));
-    printf("[SUCCESS] Compilation complete! Generated: output.c\n\n");
+    fprintf(report, "[SUCCESS] Successfully generated %d lines of C code\n", codegen_get_lines_generated(codegen));
+    if (native) {
+        fprintf(report, "[SUCCESS] Compilation complete! Built: %s\n\n", settings->output_path);
+    } else if (settings->split_units > 0) {
+        fprintf(report, "[SUCCESS] Compilation complete! Generated: output.h, output_0.c .. output_%d.c, Makefile\n",
+                        settings->split_units - 1);
+        fprintf(report, "          Build in parallel with: make -j%d\n\n", settings->split_units);
+    } else {
+        fprintf(report, "[SUCCESS] Compilation complete! Generated: output.c\n\n");
+    }
     
-    // show some stats
-    printf(">> COMPILATION STATISTICS:\n");
-    printf("   Parse time: %.4f seconds\n", parser_get_parse_time(parser));
-    printf("   Codegen time: %.4f seconds\n", codegen_get_generation_time(codegen));
-    printf("   AST nodes: %d\n", parser_get_nodes_created(parser));
-    printf("   Output lines: %d\n", codegen_get_lines_generated(codegen));
+    counters_close(&counters);
+    if (!settings->stats_json) {
+        // show some stats
+        fprintf(report, ">> COMPILATION STATISTICS:\n");
+        fprintf(report, "   Parse time: %.4f seconds\n", parser_get_parse_time(parser));
+        fprintf(report, "   Codegen time: %.4f seconds\n", codegen_get_generation_time(codegen));
+        fprintf(report, "   AST nodes: %d\n", parser_get_nodes_created(parser));
+        fprintf(report, "   Output lines: %d\n", codegen_get_lines_generated(codegen));
+        double gen_time = codegen_get_generation_time(codegen);
+        size_t gen_bytes = codegen_get_bytes_generated(codegen);
+        size_t elided = codegen_get_parens_elided(codegen);
+        fprintf(report, "   Output size: %zu bytes (%zu fully parenthesized, %.1f%% smaller)\n",
+                        gen_bytes, gen_bytes + 2 * elided,
+                        gen_bytes ? 200.0 * elided / (gen_bytes + 2 * elided) : 0.0);
+        if (gen_time > 0) {
+            fprintf(report, "   Codegen throughput: %.1f MB/s\n", gen_bytes / gen_time / 1e6);
+        }
+        if (settings->flatten_threshold > 0) {
+            fprintf(report, "   Flattened expressions: %d (%d temporaries, threshold %d nodes)\n",
+                            codegen->flatten.expressions_flattened, codegen->flatten.temps_generated,
+                            settings->flatten_threshold);
+        }
+        if (settings->profile_use) {
+            ProfileDecisions pgo;
+            codegen_get_profile_decisions(codegen, &pgo);
+            fprintf(report, "\n>> PROFILE-GUIDED (%s, %d functions%s):\n", settings->profile_use,
+                            settings->profile_data.count, settings->profile_data.complete ? "" : ", marked only");
+            fprintf(report, "   Functions: %d hot, %d cold, %d inlined\n", pgo.hot, pgo.cold, pgo.inlined);
+            fprintf(report, "   Branches: %d hinted, %d if/else swapped\n", pgo.branch_hints, pgo.swapped);
+            if (pgo.stale > 0) {
+                fprintf(report, "   [WARNING] %d function%s changed since profiling, branch counts ignored\n",
+                                pgo.stale, pgo.stale == 1 ? "" : "s");
+            }
+        }
+        
+        fprintf(report, "\n>> HARDWARE COUNTERS:\n");
+        if (counters_have_hardware(&parse_counters)) {
+            fprintf(report, "   Lex + parse (%zu tokens):\n", lexer->tokens_processed);
+            counters_print("      ", &parse_counters, (double)lexer->tokens_processed, "token");
+            if (lexer_get_cache_hit_ratio(lexer) >= 0) {
+                fprintf(report, "      L1D hit ratio: %.2f%%\n", lexer_get_cache_hit_ratio(lexer) * 100.0);
+            }
+            fprintf(report, "   Codegen (%d AST nodes):\n", parser_get_nodes_created(parser));
+            counters_print("      ", &codegen_counters, parser_get_nodes_created(parser), "node");
+        } else {
+            fprintf(report, "   Unavailable (%s)\n", counters.error_message);
+            if (parse_counters.valid[COUNTER_PAGE_FAULTS]) {
+                fprintf(report, "   Page faults: lex + parse %llu, codegen %llu\n",
+                                (unsigned long long)parse_counters.values[COUNTER_PAGE_FAULTS],
+                                (unsigned long long)codegen_counters.values[COUNTER_PAGE_FAULTS]);
+            }
+        }
+        
+        fprintf(report, "\n>> MEMORY:\n");
+        memory_stats_print(memory);
+        
+        if (settings->pipeline) {
+            fprintf(report, "\n");
+            pipeline_print(&pipeline, report);
+        }
+        
+        // wall-clock phases, including the external compiler
+        if (native) {
+            fprintf(report, "\n>> BUILD TIMINGS (%s profile: %s):\n",
+                            cc_profile_name(settings->cc_profile), cc_profile_flags(settings->cc_profile));
+            fprintf(report, "   Lex + parse: %.4f seconds\n", parse_end - start_time);
+            fprintf(report, "   Codegen (streamed to C compiler): %.4f seconds\n", codegen_end - parse_end);
+            fprintf(report, "   C compiler after end of input: %.4f seconds\n", cc_end - codegen_end);
+            fprintf(report, "   Total: %.4f seconds\n", cc_end - start_time);
+        }
+    }
     
-    // dump the AST tree
-    printf("\n>> ABSTRACT SYNTAX TREE:\n");
-    ast_print(ast, 0);
+    if (settings->dump_ast) {
+        TraceScope dump;
+        trace_begin(&dump);
+        printf("\n>> ABSTRACT SYNTAX TREE:\n");
+        ast_print(ast, 0);
+        trace_end(&dump, "ast dump", NULL);
+    }
     
     // cleanup everything
     codegen_destroy(codegen);
     parser_destroy(parser);
     lexer_destroy(lexer);
+    return true;
+}
+
+// the file is mapped, not read, and no more than one declaration's tree is kept
+static bool run_streaming(const char* filename, const CompilerSettings* settings) {
+    printf(">> COMPILING SHAYNEFRO PROGRAM (streaming)\n");
+    printf("==========================================\n");
+    printf("Source: %s\n\n", filename);
+    
+    CodeGenerator* codegen = codegen_create_in_memory(NULL, OUTPUT_C);
+    if (!codegen) {
+        printf("[ERROR] Failed to create code generator\n");
+        return false;
+    }
+    configure_codegen(codegen, settings);
+    StreamingResult result;
+    bool compiled = streaming_compile(filename, "output.c", codegen, &result);
+    codegen_destroy(codegen);
+    if (!compiled) {
+        printf("[ERROR] %s\n", result.error_message);
+        return false;
+    }
+    printf("[SUCCESS] Compilation complete! Generated: output.c\n\n");
+    streaming_print(&result, stdout);
+    return true;
+}
+
+// everything besides the source that shapes the output goes into the cache key
+static void describe_output(const CompilerSettings* settings, char* buffer, int size) {
+    int used = snprintf(buffer, (size_t)size, "c flatten=%d%s", settings->flatten_threshold,
+                        settings->profile ? " profile" : "");
+    if (settings->sample_hz > 0 && used < size) {
+        used += snprintf(buffer + used, (size_t)(size - used), " sample=%d", settings->sample_hz);
+    }
+    if (settings->profile_use && used < size) {
+        used += snprintf(buffer + used, (size_t)(size - used), " profile-use=%016llx",
+                         (unsigned long long)settings->profile_data.checksum);
+    }
+    if (settings->output_path && used < size) {
+        used += snprintf(buffer + used, (size_t)(size - used), " native ");
+        if (used < size) native_build_signature(settings->cc_profile, buffer + used, size - used);
+    }
+}
+
+static bool compile_program(const char* source_code, const char* filename,
+                            const CompilerSettings* settings, CompileStats* stats) {
+    // split output is several files plus a Makefile; it is not cached
+    if (!settings->use_cache || settings->split_units > 0) {
+        return run_compiler(source_code, filename, settings, stats);
+    }
+    
+    FILE* report = report_stream(settings);
+    CompileCache* cache = cache_open(settings->cache_dir, 0);
+    if (!cache) {
+        fprintf(report, "[WARNING] Cannot open compile cache, compiling without it\n");
+        return run_compiler(source_code, filename, settings, stats);
+    }
+    
+    // creating the lexer only hashes the source; nothing is tokenized yet
+    double start_time = timer_now();
+    Lexer* lexer = lexer_create(source_code, filename);
+    if (!lexer) {
+        report_error(stats, report, "Failed to create lexer");
+        cache_close(cache);
+        return false;
+    }
+    char description[512];
+    describe_output(settings, description, sizeof(description));
+    uint64_t key = cache_key(lexer->checksum, description);
+    lexer_destroy(lexer);
+    
+    bool native = settings->output_path != NULL;
+    const char* target = native ? settings->output_path : "output.c";
+    TraceScope lookup;
+    trace_begin(&lookup);
+    bool hit = cache_lookup_file(cache, key, target, native ? 0755 : 0644);
+    trace_end(&lookup, "cache lookup", NULL);
+    bool compiled = hit;
+    if (hit) {
+        fprintf(report, ">> COMPILING SHAYNEFRO PROGRAM\n");
+        fprintf(report, "==============================\n");
+        fprintf(report, "Source: %s\n\n", filename);
+        fprintf(report, "[SUCCESS] Cache hit, nothing lexed or parsed. Restored: %s\n\n", target);
+    } else {
+        if (cache->error_message[0]) {
+            fprintf(report, "[WARNING] %s\n", cache->error_message);
+        }
+        compiled = run_compiler(source_code, filename, settings, stats);
+        TraceScope store;
+        trace_begin(&store);
+        if (compiled && !cache_store_file(cache, key, target)) {
+            fprintf(report, "[WARNING] Output not cached: %s\n", cache->error_message);
+        }
+        trace_end(&store, "cache store", NULL);
+    }
+    
+    stats->cache_used = true;
+    stats->cache_hit = hit;
+    stats->cache_time = cache->time_spent;
+    
+    fprintf(report, "\n>> CACHE (%s):\n", cache->dir);
+    fprintf(report, "   Key: %016llx (%s)\n", (unsigned long long)key, description);
+    fprintf(report, "   Result: %s\n", hit ? "hit" : "miss");
+    fprintf(report, "   Cache time: %.4f seconds\n", cache->time_spent);
+    if (hit) {
+        fprintf(report, "   Total: %.4f seconds\n", timer_now() - start_time);
+    }
+    if (cache->session.evictions > 0) {
+        fprintf(report, "   Evicted: %llu least recently used entries\n",
+                        (unsigned long long)cache->session.evictions);
+    }
+    
+    cache_close(cache);
+    return compiled;
+}
+
+// --trace wraps the whole compile, cache included, in one timeline, and
+// --stats=json reports on it as one object
+static bool compile_and_report(const char* source_code, const char* filename,
+                               const CompilerSettings* settings) {
+    FILE* report = report_stream(settings);
+    bool tracing = settings->trace_path != NULL;
+    if (tracing && !trace_start()) {
+        fprintf(report, "[WARNING] Cannot start tracing, compiling without it\n");
+        tracing = false;
+    }
+    
+    CompileStats stats;
+    compile_stats_init(&stats, filename);
+    stats.memory.source_bytes = strlen(source_code);
+    double start_time = timer_now();
+    TraceScope scope;
+    trace_begin(&scope);
+    stats.success = compile_program(source_code, filename, settings, &stats);
+    trace_end(&scope, "compile", filename);
+    stats.total_time = timer_now() - start_time;
+    
+    if (tracing) {
+        char error[256];
+        if (!trace_finish(settings->trace_path, error, sizeof(error))) {
+            fprintf(report, "[WARNING] Trace not written: %s\n", error);
+        } else if (error[0]) {
+            fprintf(report, "[WARNING] %s\n", error);
+        } else {
+            fprintf(report, "\n>> TRACE: %s (open in chrome://tracing or ui.perfetto.dev)\n", settings->trace_path);
+        }
+    }
+    if (settings->stats_json) {
+        compile_stats_write_json(&stats, stdout);
+    }
+    return stats.success;
+}
+
+static int show_cache_stats(const char* dir) {
+    CompileCache* cache = cache_open(dir, 0);
+    CacheTotals totals;
+    if (!cache || !cache_read_totals(cache, &totals)) {
+        printf("[ERROR] Cannot open compile cache\n");
+        cache_close(cache);
+        return 1;
+    }
+    
+    uint64_t lookups = totals.hits + totals.misses;
+    printf(">> COMPILE CACHE: %s\n", cache->dir);
+    printf("   Hits: %llu\n", (unsigned long long)totals.hits);
+    printf("   Misses: %llu\n", (unsigned long long)totals.misses);
+    printf("   Hit rate: %.1f%%\n", lookups ? 100.0 * totals.hits / lookups : 0.0);
+    printf("   Stores: %llu\n", (unsigned long long)totals.stores);
+    printf("   Evictions: %llu\n", (unsigned long long)totals.evictions);
+    printf("   Size: %.1f MB of %.1f MB\n", totals.bytes / 1048576.0, cache->max_bytes / 1048576.0);
+    
+    cache_close(cache);
+    return 0;
 }
 
 // testing functions for the lexer
 
-static void print_header(void) {
-    printf("===============================================================\n");
-    printf("                      Shaynefro Compiler                      \n");
-    printf("                   Modern Language Compiler                   \n");
-    printf("           Complete: Lexer + Parser + CodeGen                 \n");
-    printf("===============================================================\n\n");
+static void print_header(FILE* stream) {
+    fprintf(stream, "===============================================================\n");
+    fprintf(stream, "                      Shaynefro Compiler                      \n");
+    fprintf(stream, "                   Modern Language Compiler                   \n");
+    fprintf(stream, "           Complete: Lexer + Parser + CodeGen                 \n");
+    fprintf(stream, "===============================================================\n\n");
 }
 
 static void test_lexer(const char* source, const char* description) {
@@ -141,73 +765,963 @@ static void test_lexer(const char* source, const char* description) {
     printf("\n");
 }
 
-static void performance_benchmark(void) {
-    printf(">> Performance Benchmark\n");
-    printf("========================\n");
+// -b: the phase benchmark suite, options as in bench.h
+static int run_benchmark_suite(int argc, char* argv[], int first) {
+    BenchConfig config;
+    bench_default_config(&config);
+    const char* json_path = NULL;
+    double threshold = BENCH_DEFAULT_THRESHOLD_PERCENT;
+    double alpha = BENCH_DEFAULT_ALPHA;
     
-    // big test program
-    const char* large_program = 
-        "// Shaynefro Performance Test\n"
-        "function fibonacci(int n) {\n"
-        "    if (n <= 1) return n;\n"
-        "    return fibonacci(n-1) + fibonacci(n-2);\n"
-        "}\n\n"
-        "function quicksort(int[] arr, int low, int high) {\n"
-        "    if (low < high) {\n"
-        "        int pi = partition(arr, low, high);\n"
-        "        quicksort(arr, low, pi - 1);\n"
-        "        quicksort(arr, pi + 1, high);\n"
-        "    }\n"
-        "}\n\n"
-        "function main() {\n"
-        "    int n = 100;\n"
-        "    float result = 0.0;\n"
-        "    string message = \"Computing...\";\n"
-        "    \n"
-        "    for (int i = 0; i < n; i++) {\n"
-        "        result += fibonacci(i) * 3.14159;\n"
-        "        if (result > 1000000.0) {\n"
-        "            break;\n"
-        "        }\n"
-        "    }\n"
-        "    \n"
-        "    return 0;\n"
-        "}\n";
+    // the baseline's suite is rerun as recorded; later options override it
+    BenchReport baseline;
+    bool have_baseline = false;
+    for (int i = first; i < argc; i++) {
+        if (strncmp(argv[i], "--baseline=", 11) != 0) continue;
+        if (have_baseline) bench_report_free(&baseline);
+        if (!bench_read_json(argv[i] + 11, &baseline)) {
+            printf("[ERROR] %s\n", baseline.error_message);
+            return 1;
+        }
+        have_baseline = true;
+        config = baseline.config;
+    }
     
-    printf("Tokenizing %zu characters...\n", strlen(large_program));
+    for (int i = first; i < argc; i++) {
+        const char* arg = argv[i];
+        bool valid;
+        if (strncmp(arg, "--baseline=", 11) == 0) {
+            valid = true;
+        } else if (strncmp(arg, "--threshold=", 12) == 0) {
+            threshold = atof(arg + 12);
+            valid = threshold >= 0;
+        } else if (strncmp(arg, "--alpha=", 8) == 0) {
+            alpha = atof(arg + 8);
+            valid = alpha > 0 && alpha < 1;
+        } else if (strncmp(arg, "--sizes=", 8) == 0) {
+            valid = bench_sizes_parse(&config, arg + 8);
+        } else if (strncmp(arg, "--phases=", 9) == 0) {
+            valid = bench_phases_parse(&config, arg + 9);
+        } else if (strncmp(arg, "--mix=", 6) == 0) {
+            valid = bench_mix_parse(&config.mix, arg + 6);
+        } else if (strncmp(arg, "--runs=", 7) == 0) {
+            config.runs = atoi(arg + 7);
+            valid = config.runs > 0 && config.runs <= 10000;
+        } else if (strncmp(arg, "--warmup=", 9) == 0) {
+            config.warmup = atoi(arg + 9);
+            valid = config.warmup >= 0 && config.warmup <= 1000;
+        } else if (strncmp(arg, "--seed=", 7) == 0) {
+            config.seed = strtoull(arg + 7, NULL, 10);
+            valid = true;
+        } else if (strncmp(arg, "--json=", 7) == 0) {
+            json_path = arg + 7;
+            valid = *json_path != '\0';
+        } else {
+            valid = false;
+        }
+        if (!valid) {
+            printf("[ERROR] Unknown or invalid benchmark option: %s\n", arg);
+            if (have_baseline) bench_report_free(&baseline);
+            return 1;
+        }
+    }
     
-    clock_t start = clock();
-    Lexer* lexer = lexer_create(large_program, "benchmark.shay");
+    printf(">> Benchmark Suite\n");
+    printf("==================\n");
+    printf("%d warmup passes, %d samples per benchmark, seed %llu\n\n",
+           config.warmup, config.runs, (unsigned long long)config.seed);
     
-    int total_tokens = 0;
-    Token token;
-    while (true) {
-        token = lexer_next_token(lexer);
-        total_tokens++;
-        
-        if (token.type == TOKEN_EOF || token.type == TOKEN_ERROR) {
-            break;
+    BenchReport report;
+    bool ok = bench_run(&config, &report);
+    if (!ok) {
+        printf("[ERROR] %s\n", report.error_message);
+    }
+    bench_print(&report);
+    if (json_path && !bench_write_json(&report, json_path)) {
+        printf("[ERROR] Cannot write %s\n", json_path);
+        ok = false;
+    } else if (json_path && strcmp(json_path, "-") != 0) {
+        printf("\nResults written to %s\n", json_path);
+    }
+    if (ok && have_baseline && bench_compare(&baseline, &report, threshold, alpha) > 0) {
+        ok = false;
+    }
+    if (have_baseline) bench_report_free(&baseline);
+    bench_report_free(&report);
+    printf("\n");
+    return ok ? 0 : 1;
+}
+
+// --bench-compare OLD NEW: the regression check on two saved results
+static int compare_benchmark_files(int argc, char* argv[]) {
+    double threshold = BENCH_DEFAULT_THRESHOLD_PERCENT;
+    double alpha = BENCH_DEFAULT_ALPHA;
+    for (int i = 4; i < argc; i++) {
+        bool valid = false;
+        if (strncmp(argv[i], "--threshold=", 12) == 0) {
+            threshold = atof(argv[i] + 12);
+            valid = threshold >= 0;
+        } else if (strncmp(argv[i], "--alpha=", 8) == 0) {
+            alpha = atof(argv[i] + 8);
+            valid = alpha > 0 && alpha < 1;
         }
-        
-        // safety check
-        if (total_tokens > 10000) {
-            printf("   [WARNING] Benchmark safety limit reached\n");
-            break;
+        if (!valid) {
+            printf("[ERROR] Unknown or invalid comparison option: %s\n", argv[i]);
+            return 1;
         }
     }
     
-    clock_t end = clock();
-    double time_taken = ((double)(end - start)) / CLOCKS_PER_SEC;
-    double tokens_per_sec = total_tokens / time_taken;
+    BenchReport baseline, current;
+    if (!bench_read_json(argv[2], &baseline)) {
+        printf("[ERROR] %s\n", baseline.error_message);
+        return 1;
+    }
+    if (!bench_read_json(argv[3], &current)) {
+        printf("[ERROR] %s\n", current.error_message);
+        bench_report_free(&baseline);
+        return 1;
+    }
+    printf(">> Benchmark Comparison: %s -> %s\n", argv[2], argv[3]);
+    int regressions = bench_compare(&baseline, &current, threshold, alpha);
+    bench_report_free(&baseline);
+    bench_report_free(&current);
+    printf("\n");
+    return regressions > 0 ? 1 : 0;
+}
+
+// --gen-corpus SIZE FILE: the benchmark input, for use outside the suite
+static int write_corpus(int argc, char* argv[]) {
+    BenchConfig config;
+    bench_default_config(&config);
+    bool valid = bench_sizes_parse(&config, argv[2]) && config.size_count == 1;
+    for (int i = 4; i < argc && valid; i++) {
+        if (strncmp(argv[i], "--mix=", 6) == 0) {
+            valid = bench_mix_parse(&config.mix, argv[i] + 6);
+        } else if (strncmp(argv[i], "--seed=", 7) == 0) {
+            config.seed = strtoull(argv[i] + 7, NULL, 10);
+        } else {
+            valid = false;
+        }
+    }
+    if (!valid) {
+        printf("[ERROR] Usage: --gen-corpus SIZE FILE [--mix=...] [--seed=N]\n");
+        return 1;
+    }
+    
+    FILE* file = fopen(argv[3], "w");
+    if (!file) {
+        printf("[ERROR] Cannot open file: %s\n", argv[3]);
+        return 1;
+    }
+    OutputBuffer corpus;
+    outbuf_init(&corpus, fileno(file));
+    bench_generate_corpus(&corpus, config.sizes[0], &config.mix, config.seed);
+    bool ok = outbuf_flush(&corpus) && !corpus.had_error;
+    size_t total = outbuf_total_size(&corpus);
+    outbuf_free(&corpus);
+    ok = fclose(file) == 0 && ok;
+    if (!ok) {
+        printf("[ERROR] Cannot write %s\n", argv[3]);
+        return 1;
+    }
+    printf("Wrote %zu bytes to %s\n", total, argv[3]);
+    return 0;
+}
+
+// --check-memory: compiles a generated program and fails when the AST
+// arena needs more than the budget per node
+static int check_memory_budget(int argc, char* argv[]) {
+    BenchConfig config;
+    bench_default_config(&config);
+    config.sizes[0] = 1 << 20;
+    config.size_count = 1;
+    double budget = MEMORY_DEFAULT_NODE_BUDGET;
+    bool valid = true;
+    for (int i = 2; i < argc && valid; i++) {
+        if (strncmp(argv[i], "--size=", 7) == 0) {
+            valid = bench_sizes_parse(&config, argv[i] + 7) && config.size_count == 1;
+        } else if (strncmp(argv[i], "--budget=", 9) == 0) {
+            budget = atof(argv[i] + 9);
+            valid = budget > 0;
+        } else if (strncmp(argv[i], "--mix=", 6) == 0) {
+            valid = bench_mix_parse(&config.mix, argv[i] + 6);
+        } else {
+            valid = false;
+        }
+    }
+    if (!valid) {
+        printf("[ERROR] Usage: --check-memory [--size=SIZE] [--budget=BYTES] [--mix=...]\n");
+        return 1;
+    }
+    
+    OutputBuffer source, output;
+    if (!outbuf_init(&source, -1) || !outbuf_init(&output, -1)) {
+        printf("[ERROR] Out of memory\n");
+        outbuf_free(&source);
+        return 1;
+    }
+    bench_generate_corpus(&source, config.sizes[0], &config.mix, config.seed);
+    
+    Lexer* lexer = lexer_create_with_length(source.data, source.length, "check-memory");
+    Parser* parser = lexer ? parser_create(lexer) : NULL;
+    CodeGenerator* codegen = codegen_create_in_memory(&output, OUTPUT_C);
+    bool compiled = parser && codegen && !source.had_error;
+    if (compiled) {
+        ASTNode* ast = parser_parse(parser);
+        compiled = ast && !parser_has_error(parser) && codegen_generate(codegen, ast);
+    }
+    
+    int status = 1;
+    if (compiled) {
+        MemoryStats memory;
+        memory_stats_collect(&memory, lexer, parser, codegen);
+        printf(">> MEMORY CHECK (%zu byte generated program):\n", memory.source_bytes);
+        memory_stats_print(&memory);
+        double per_node = memory_stats_bytes_per_node(&memory);
+        if (per_node <= budget) {
+            printf("[SUCCESS] %.1f bytes per AST node, budget %.1f\n", per_node, budget);
+            status = 0;
+        } else {
+            printf("[ERROR] %.1f bytes per AST node exceeds the budget of %.1f\n", per_node, budget);
+        }
+    } else {
+        printf("[ERROR] Generated program failed to compile\n");
+    }
+    
+    codegen_destroy(codegen);
+    parser_destroy(parser);
+    lexer_destroy(lexer);
+    outbuf_free(&output);
+    outbuf_free(&source);
+    return status;
+}
+
+// --bench-pathological: worst-case inputs must compile, or be rejected,
+// in time and memory linear in their size
+static int pathological_suite(int argc, char* argv[]) {
+    size_t size = BENCH_PATHOLOGICAL_DEFAULT_SIZE;
+    int runs = 3;
+    bool valid = true;
+    for (int i = 2; i < argc && valid; i++) {
+        if (strncmp(argv[i], "--size=", 7) == 0) {
+            BenchConfig config;
+            memset(&config, 0, sizeof(config));
+            valid = bench_sizes_parse(&config, argv[i] + 7) && config.size_count == 1 &&
+                    config.sizes[0] >= 4;
+            size = config.sizes[0];
+        } else if (strncmp(argv[i], "--runs=", 7) == 0) {
+            runs = atoi(argv[i] + 7);
+            valid = runs > 0;
+        } else {
+            valid = false;
+        }
+    }
+    if (!valid) {
+        printf("[ERROR] Usage: --bench-pathological [--size=SIZE] [--runs=N]\n");
+        return 1;
+    }
+    
+    int failures = bench_run_pathological(size, runs);
+    if (failures > 0) {
+        printf("[ERROR] %d pathological case%s failed or scaled worse than x%.0f\n",
+               failures, failures == 1 ? "" : "s", BENCH_PATHOLOGICAL_MAX_RATIO);
+        return 1;
+    }
+    printf("[SUCCESS] Every pathological case scales linearly\n");
+    return 0;
+}
+
+// -j N [--flatten=N] files...: compile many files at once, each to its own .c
+static int batch_compile(int argc, char* argv[]) {
+    int threads = argc > 2 ? atoi(argv[2]) : 0;
+    if (threads <= 0 || threads > BATCH_MAX_THREADS) {
+        printf("[ERROR] Usage: -j N [--flatten=N] FILE... (or @LIST), N from 1 to %d\n", BATCH_MAX_THREADS);
+        return 1;
+    }
+    
+    ShayOptions options = shaynefro_default_options();
+    BatchReport report;
+    batch_init(&report);
+    for (int i = 3; i < argc; i++) {
+        if (strncmp(argv[i], "--flatten=", 10) == 0) {
+            options.flatten_threshold = atoi(argv[i] + 10);
+            if (options.flatten_threshold <= 0) {
+                printf("[ERROR] Unknown or invalid option: %s\n", argv[i]);
+                batch_free(&report);
+                return 1;
+            }
+        } else if (!batch_add(&report, argv[i])) {
+            printf("[ERROR] %s\n", report.error_message);
+            batch_free(&report);
+            return 1;
+        }
+    }
+    if (report.file_count == 0) {
+        printf("[ERROR] No files to compile\n");
+        batch_free(&report);
+        return 1;
+    }
+    
+    bool compiled = batch_run(&report, threads, &options);
+    if (report.error_message[0]) printf("[ERROR] %s\n", report.error_message);
+    batch_print_diagnostics(&report, stdout);
+    batch_print(&report, stdout);
+    batch_free(&report);
+    return compiled ? 0 : 1;
+}
+
+// --server [--socket=PATH] [--threads=N] [--cache | --cache-dir=DIR]
+static int run_server(int argc, char* argv[]) {
+    char path[108];
+    server_default_path(path, sizeof(path));
+    int threads = 4;
+    const char* cache_dir = NULL;
+    for (int i = 2; i < argc; i++) {
+        bool valid = true;
+        if (strncmp(argv[i], "--socket=", 9) == 0) {
+            snprintf(path, sizeof(path), "%s", argv[i] + 9);
+            valid = argv[i][9] != '\0';
+        } else if (strncmp(argv[i], "--threads=", 10) == 0) {
+            threads = atoi(argv[i] + 10);
+            valid = threads > 0 && threads <= SERVER_MAX_THREADS;
+        } else if (strcmp(argv[i], "--cache") == 0) {
+            cache_dir = "";
+        } else if (strncmp(argv[i], "--cache-dir=", 12) == 0) {
+            cache_dir = argv[i] + 12;
+            valid = argv[i][12] != '\0';
+        } else {
+            valid = false;
+        }
+        if (!valid) {
+            printf("[ERROR] Unknown or invalid option: %s\n", argv[i]);
+            return 1;
+        }
+    }
+    
+    CompileServer server;
+    if (!server_start(&server, path, threads, cache_dir)) {
+        printf("[ERROR] %s\n", server.error_message);
+        return 1;
+    }
+    printf(">> Listening on %s with %d thread%s, Ctrl-C to stop\n", path, threads, threads == 1 ? "" : "s");
+    fflush(stdout);
+    server_wait(&server);
+    server_stop(&server);
+    server_print(&server, stdout);
+    server_free(&server);
+    return 0;
+}
+
+// --client FILE [--socket=PATH] [--flatten=N]: compile on a running server
+// into output.c
+static int run_client(int argc, char* argv[]) {
+    char path[108];
+    server_default_path(path, sizeof(path));
+    ShayOptions options = shaynefro_default_options();
+    options.filename = argv[2];
+    for (int i = 3; i < argc; i++) {
+        bool valid = true;
+        if (strncmp(argv[i], "--socket=", 9) == 0) {
+            snprintf(path, sizeof(path), "%s", argv[i] + 9);
+            valid = argv[i][9] != '\0';
+        } else if (strncmp(argv[i], "--flatten=", 10) == 0) {
+            options.flatten_threshold = atoi(argv[i] + 10);
+            valid = options.flatten_threshold > 0;
+        } else {
+            valid = false;
+        }
+        if (!valid) {
+            printf("[ERROR] Unknown or invalid option: %s\n", argv[i]);
+            return 1;
+        }
+    }
+    
+    FILE* file = fopen(argv[2], "rb");
+    if (!file) {
+        printf("[ERROR] Cannot open file: %s\n", argv[2]);
+        return 1;
+    }
+    // A pipe or a read error has no size to go by
+    long file_size = fseek(file, 0, SEEK_END) == 0 ? ftell(file) : -1;
+    if (file_size < 0 || fseek(file, 0, SEEK_SET) != 0) {
+        printf("[ERROR] Cannot read file: %s\n", argv[2]);
+        fclose(file);
+        return 1;
+    }
+    if ((unsigned long)file_size > SERVER_MAX_SOURCE) {
+        printf("[ERROR] Source too large for the server: %s\n", argv[2]);
+        fclose(file);
+        return 1;
+    }
+    char* content = malloc(file_size > 0 ? (size_t)file_size : 1);
+    size_t length = content ? fread(content, 1, (size_t)file_size, file) : 0;
+    bool read_error = ferror(file);
+    fclose(file);
+    if (read_error) {
+        printf("[ERROR] Cannot read file: %s\n", argv[2]);
+        free(content);
+        return 1;
+    }
+    
+    ServerClient client;
+    OutputBuffer output;
+    bool compiled = false;
+    bool ready = content && outbuf_init(&output, -1);
+    bool answered = ready && server_client_connect(&client, path) &&
+                    server_client_compile(&client, content, length, &options, &output, &compiled);
+    if (ready) server_client_close(&client);
+    free(content);
+    if (!answered) {
+        printf("[ERROR] %s\n", ready ? client.error_message : "Out of memory");
+        if (ready) outbuf_free(&output);
+        return 1;
+    }
+    
+    for (int i = 0; i < client.diagnostic_count; i++) {
+        const ShayDiagnostic* diagnostic = &client.diagnostics[i];
+        printf("[ERROR] %s:%d:%d: %s (%s)\n", argv[2], diagnostic->line, diagnostic->column,
+               diagnostic->message, shaynefro_phase_name(diagnostic->phase));
+    }
+    if (compiled) {
+        FILE* out = fopen("output.c", "wb");
+        compiled = out && fwrite(output.data, 1, output.length, out) == output.length;
+        if (out) compiled = fclose(out) == 0 && compiled;
+        if (compiled) {
+            printf("[SUCCESS] %s -> output.c (%zu bytes)\n", argv[2], output.length);
+        } else {
+            printf("[ERROR] Cannot write output.c\n");
+        }
+    }
+    outbuf_free(&output);
+    return compiled ? 0 : 1;
+}
+
+// --bench-server [--clients=N] [--requests=N] [--threads=N]
+static int server_suite(int argc, char* argv[]) {
+    int clients = 8, requests = 2000, threads = 4;
+    for (int i = 2; i < argc; i++) {
+        bool valid;
+        if (strncmp(argv[i], "--clients=", 10) == 0) {
+            clients = atoi(argv[i] + 10);
+            valid = clients > 0 && clients <= 256;
+        } else if (strncmp(argv[i], "--requests=", 11) == 0) {
+            requests = atoi(argv[i] + 11);
+            valid = requests > 0;
+        } else if (strncmp(argv[i], "--threads=", 10) == 0) {
+            threads = atoi(argv[i] + 10);
+            valid = threads > 0 && threads <= SERVER_MAX_THREADS;
+        } else {
+            valid = false;
+        }
+        if (!valid) {
+            printf("[ERROR] Usage: --bench-server [--clients=N] [--requests=N] [--threads=N]\n");
+            return 1;
+        }
+    }
+    
+    int failures = bench_run_server(clients, requests, threads);
+    if (failures > 0) {
+        printf("[ERROR] %d request%s failed\n", failures, failures == 1 ? "" : "s");
+        return 1;
+    }
+    printf("[SUCCESS] Every request compiled\n");
+    return 0;
+}
+
+// --watch FILE... [--flatten=N] [--debounce=MS]: rebuild each a.shay to
+// a.c whenever it is saved, until Ctrl-C
+static int watch_files(int argc, char* argv[]) {
+    int flatten_threshold = 0, debounce_ms = WATCH_DEFAULT_DEBOUNCE_MS;
+    for (int i = 2; i < argc; i++) {
+        if (strncmp(argv[i], "--flatten=", 10) == 0) {
+            flatten_threshold = atoi(argv[i] + 10);
+            if (flatten_threshold <= 0) {
+                printf("[ERROR] Unknown or invalid option: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strncmp(argv[i], "--debounce=", 11) == 0) {
+            debounce_ms = atoi(argv[i] + 11);
+            if (debounce_ms < 0 || debounce_ms > WATCH_MAX_DEBOUNCE_MS) {
+                printf("[ERROR] Unknown or invalid option: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strncmp(argv[i], "--", 2) == 0) {
+            printf("[ERROR] Unknown or invalid option: %s\n", argv[i]);
+            return 1;
+        }
+    }
+    
+    Watcher watcher;
+    if (!watch_init(&watcher, flatten_threshold, debounce_ms)) {
+        printf("[ERROR] %s\n", watcher.error_message);
+        return 1;
+    }
+    for (int i = 2; i < argc; i++) {
+        if (strncmp(argv[i], "--", 2) == 0) continue;
+        if (!watch_add(&watcher, argv[i])) {
+            printf("[ERROR] %s\n", watcher.error_message);
+            watch_free(&watcher);
+            return 1;
+        }
+    }
+    if (watcher.file_count == 0) {
+        printf("[ERROR] No files to watch\n");
+        watch_free(&watcher);
+        return 1;
+    }
+    
+    watch_build_all(&watcher, stdout);
+    printf(">> Watching %d file%s (debounce %d ms), Ctrl-C to stop\n", watcher.file_count,
+           watcher.file_count == 1 ? "" : "s", debounce_ms);
+    fflush(stdout);
+    bool watched = watch_run(&watcher, stdout);
+    if (!watched) printf("[ERROR] %s\n", watcher.error_message);
+    watch_print(&watcher, stdout);
+    watch_free(&watcher);
+    return watched ? 0 : 1;
+}
+
+// --bench-watch [--edits=N]: save-to-rebuilt latency of single-function edits
+static int watch_suite(int argc, char* argv[]) {
+    int edits = 50;
+    if (argc > 2 && (argc > 3 || strncmp(argv[2], "--edits=", 8) != 0 || (edits = atoi(argv[2] + 8)) <= 0)) {
+        printf("[ERROR] Usage: --bench-watch [--edits=N]\n");
+        return 1;
+    }
+    int failures = bench_run_watch(edits);
+    if (failures > 0) {
+        printf("[ERROR] %d watch check%s failed\n", failures, failures == 1 ? "" : "s");
+        return 1;
+    }
+    printf("[SUCCESS] Every edit rebuilt, median under %.0f ms\n", BENCH_WATCH_TARGET * 1e3);
+    return 0;
+}
+
+// --bench-stream [--sizes=...]: peak RSS of --stream against a full syntax tree
+static int stream_suite(int argc, char* argv[]) {
+    BenchConfig config;
+    memset(&config, 0, sizeof(config));
+    config.sizes[config.size_count++] = 16 << 20;
+    config.sizes[config.size_count++] = 64 << 20;
+    bool valid = true;
+    for (int i = 2; i < argc && valid; i++) {
+        if (strncmp(argv[i], "--sizes=", 8) == 0) {
+            config.size_count = 0;
+            valid = bench_sizes_parse(&config, argv[i] + 8);
+        } else {
+            valid = false;
+        }
+    }
+    if (!valid) {
+        printf("[ERROR] Usage: --bench-stream [--sizes=16M,64M,1G]\n");
+        return 1;
+    }
+    
+    int failures = bench_run_stream(config.sizes, config.size_count);
+    if (failures > 0) {
+        printf("[ERROR] %d streaming check%s failed\n", failures, failures == 1 ? "" : "s");
+        return 1;
+    }
+    printf("[SUCCESS] Streaming stayed under %u MB at every size\n", BENCH_STREAM_MAX_RSS >> 20);
+    return 0;
+}
+
+// --bench-pipeline [--size=SIZE] [--runs=N]: sequential against pipelined compile
+static int pipeline_suite(int argc, char* argv[]) {
+    size_t size = BENCH_PIPELINE_DEFAULT_SIZE;
+    int runs = 3;
+    bool valid = true;
+    for (int i = 2; i < argc && valid; i++) {
+        if (strncmp(argv[i], "--size=", 7) == 0) {
+            BenchConfig config;
+            memset(&config, 0, sizeof(config));
+            valid = bench_sizes_parse(&config, argv[i] + 7) && config.size_count == 1;
+            size = config.sizes[0];
+        } else if (strncmp(argv[i], "--runs=", 7) == 0) {
+            runs = atoi(argv[i] + 7);
+            valid = runs > 0;
+        } else {
+            valid = false;
+        }
+    }
+    if (!valid) {
+        printf("[ERROR] Usage: --bench-pipeline [--size=SIZE] [--runs=N]\n");
+        return 1;
+    }
+    
+    int failures = bench_run_pipeline(size, runs);
+    if (failures > 0) return 1;
+    printf("[SUCCESS] Pipelined output identical to sequential\n");
+    return 0;
+}
+
+// --bench-batch: files per second on many small files and on a mix
+static int batch_suite(int argc, char* argv[]) {
+    int threads = 4;
+    bool valid = true;
+    for (int i = 2; i < argc && valid; i++) {
+        if (strncmp(argv[i], "--threads=", 10) == 0) {
+            threads = atoi(argv[i] + 10);
+            valid = threads > 0 && threads <= BATCH_MAX_THREADS;
+        } else {
+            valid = false;
+        }
+    }
+    if (!valid) {
+        printf("[ERROR] Usage: --bench-batch [--threads=N]\n");
+        return 1;
+    }
+    
+    int failures = bench_run_batch(threads);
+    if (failures > 0) {
+        printf("[ERROR] %d batch%s failed\n", failures, failures == 1 ? "" : "es");
+        return 1;
+    }
+    printf("[SUCCESS] Every batch compiled\n");
+    return 0;
+}
+
+// --runs=N, the only option of the native benchmarks; 0 if invalid
+static int native_bench_runs(int argc, char* argv[]) {
+    int runs = 5;
+    for (int i = 2; i < argc; i++) {
+        if (strncmp(argv[i], "--runs=", 7) != 0) return 0;
+        runs = atoi(argv[i] + 7);
+        if (runs <= 0) return 0;
+    }
+    return runs;
+}
+
+// --bench-sample: what --sample costs the generated program
+static int sample_suite(int argc, char* argv[]) {
+    int runs = native_bench_runs(argc, argv);
+    if (runs == 0) {
+        printf("[ERROR] Usage: --bench-sample [--runs=N]\n");
+        return 1;
+    }
+    
+    int failures = bench_run_sampling(runs);
+    if (failures > 0) {
+        printf("[ERROR] %d sampled build%s failed, wrote no samples or spent over %.0f%% in the handler\n",
+               failures, failures == 1 ? "" : "s", BENCH_SAMPLE_MAX_OVERHEAD * 100);
+        return 1;
+    }
+    printf("[SUCCESS] The sampling handler takes less than %.0f%% of CPU time\n", BENCH_SAMPLE_MAX_OVERHEAD * 100);
+    return 0;
+}
+
+// --bench-pgo: what a profile-guided build gains over a plain one
+static int pgo_suite(int argc, char* argv[]) {
+    int runs = native_bench_runs(argc, argv);
+    if (runs == 0) {
+        printf("[ERROR] Usage: --bench-pgo [--runs=N]\n");
+        return 1;
+    }
+    
+    int failures = bench_run_pgo(runs);
+    if (failures > 0) {
+        printf("[ERROR] %d profile-guided build%s failed or changed the result\n",
+               failures, failures == 1 ? "" : "s");
+        return 1;
+    }
+    printf("[SUCCESS] Profile-guided builds give the same results\n");
+    return 0;
+}
+
+static void library_benchmark(void) {
+    printf(">> Library API Benchmark\n");
+    printf("========================\n");
+    
+    // many small programs, all different so nothing can be shortcut
+    enum { PROGRAM_COUNT = 10000 };
+    char (*programs)[160] = malloc(sizeof(*programs) * PROGRAM_COUNT);
+    size_t lengths[PROGRAM_COUNT];
+    size_t total_bytes = 0;
+    for (int i = 0; i < PROGRAM_COUNT; i++) {
+        int n = snprintf(programs[i], sizeof(programs[i]),
+                         "int x = %d;\n"
+                         "int y = x * %d + 7;\n"
+                         "float f = 2.5;\n"
+                         "string s = \"program %d\";\n"
+                         "return x + y;\n", i, i % 97, i);
+        lengths[i] = (size_t)n;
+        total_bytes += lengths[i];
+    }
+    
+    printf("Compiling %d programs (%zu bytes) in one process...\n", PROGRAM_COUNT, total_bytes);
+    
+    OutputBuffer output;
+    outbuf_init(&output, -1);
+    ShayOptions options = shaynefro_default_options();
+    int failures = 0;
+    
+    // one context reused for every compile
+    double start = timer_now();
+    ShayContext* ctx = shaynefro_context_create();
+    for (int i = 0; i < PROGRAM_COUNT; i++) {
+        outbuf_clear(&output);
+        if (!shaynefro_compile(ctx, programs[i], lengths[i], &options, &output)) {
+            failures++;
+        }
+    }
+    shaynefro_context_destroy(ctx);
+    double reused_time = timer_now() - start;
+    
+    // fresh context per compile, for comparison
+    start = timer_now();
+    for (int i = 0; i < PROGRAM_COUNT; i++) {
+        ShayContext* fresh = shaynefro_context_create();
+        outbuf_clear(&output);
+        if (!shaynefro_compile(fresh, programs[i], lengths[i], &options, &output)) {
+            failures++;
+        }
+        shaynefro_context_destroy(fresh);
+    }
+    double fresh_time = timer_now() - start;
     
     printf(">> Results:\n");
-    printf("   Tokens processed: %d\n", total_tokens);
-    printf("   Time taken: %.6f seconds\n", time_taken);
-    printf("   Speed: %.0f tokens/second\n", tokens_per_sec > 0 ? tokens_per_sec : 999999.0);
-    printf("   Throughput: %.2f KB/second\n", time_taken > 0 ? (strlen(large_program) / 1024.0) / time_taken : 999999.0);
+    printf("   Failures: %d\n", failures);
+    printf("   Reused context: %.4f seconds, %.0f programs/second, %.2f us/program\n",
+           reused_time, reused_time > 0 ? PROGRAM_COUNT / reused_time : 0.0,
+           reused_time * 1e6 / PROGRAM_COUNT);
+    printf("   Fresh context:  %.4f seconds, %.0f programs/second, %.2f us/program\n",
+           fresh_time, fresh_time > 0 ? PROGRAM_COUNT / fresh_time : 0.0,
+           fresh_time * 1e6 / PROGRAM_COUNT);
+    
+    outbuf_free(&output);
+    free(programs);
+    printf("\n");
+}
+
+static void codegen_benchmark(void) {
+    printf(">> Parallel Codegen Benchmark\n");
+    printf("=============================\n");
+    
+    // functions call earlier ones so flattening has call types to look up
+    enum { FUNCTION_COUNT = 100000 };
+    OutputBuffer source;
+    outbuf_init(&source, -1);
+    char line[512];
+    for (int i = 0; i < FUNCTION_COUNT; i++) {
+        int n = snprintf(line, sizeof(line),
+                         "function f%d(int a, int b) {\n"
+                         "    int acc = a * %d;\n"
+                         "    for (int i = 0; i < b; i++) {\n"
+                         "        if (acc > %d) { acc = acc %% %d; } else { acc += (a * %d - b %% 7) + f%d(b, a %% 5); }\n"
+                         "    }\n"
+                         "    return acc;\n"
+                         "}\n",
+                         i, i % 89 + 2, 1000 + i % 9000, i % 97 + 3, i % 31 + 1, i > 0 ? (i * 7) % i : 0);
+        outbuf_append(&source, line, (size_t)n);
+    }
+    outbuf_append_lit(&source, "return f99999(3, 4) % 256;\n");
     
+    Lexer* lexer = lexer_create_with_length(source.data, source.length, "bench.shay");
+    Parser* parser = lexer ? parser_create(lexer) : NULL;
+    ASTNode* ast = parser ? parser_parse(parser) : NULL;
+    if (!ast || parser_has_error(parser)) {
+        printf("[ERROR] Failed to parse benchmark program\n");
+        parser_destroy(parser);
+        lexer_destroy(lexer);
+        outbuf_free(&source);
+        return;
+    }
+    printf("%d functions, %zu bytes of source, %d AST nodes\n\n",
+           FUNCTION_COUNT, source.length, parser_get_nodes_created(parser));
+    
+    // best of three per thread count; output must not depend on threads
+    OutputBuffer output;
+    outbuf_init(&output, -1);
+    CodeGenerator* codegen = codegen_create_in_memory(&output, OUTPUT_C);
+    static const int thread_counts[] = { 1, 2, 4, 8, 16 };
+    uint64_t reference[2] = { 0, 0 };
+    double single[2] = { 0, 0 };
+    for (size_t t = 0; t < sizeof(thread_counts) / sizeof(thread_counts[0]); t++) {
+        for (int mode = 0; mode < 2; mode++) {
+            double best = 1e9;
+            uint64_t checksum = 0;
+            for (int run = 0; run < 3; run++) {
+                outbuf_clear(&output);
+                codegen_reset(codegen, &output, OUTPUT_C);
+                codegen_set_flatten_threshold(codegen, mode ? 8 : 0);
+                codegen_set_threads(codegen, thread_counts[t]);
+                double start = timer_now();
+                codegen_generate(codegen, ast);
+                double elapsed = timer_now() - start;
+                if (elapsed < best) best = elapsed;
+                checksum = hash_bytes(output.data, output.length, 0);
+            }
+            if (t == 0) {
+                reference[mode] = checksum;
+                single[mode] = best;
+            }
+            printf("   %2d threads, %-12s %.4f seconds, %.1f MB/s, %.2fx%s\n", thread_counts[t],
+                   mode ? "--flatten=8:" : "default:", best, output.length / best / 1e6,
+                   single[mode] / best,
+                   checksum == reference[mode] ? "" : "  [ERROR] output differs from 1 thread");
+        }
+    }
+    
+    codegen_destroy(codegen);
+    outbuf_free(&output);
+    parser_destroy(parser);
     lexer_destroy(lexer);
+    outbuf_free(&source);
+    printf("\n");
+}
+
+// xorshift64*, so every run checks the same doubles
+static uint64_t float_random(uint64_t* state) {
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545F4914F6CDD1DULL;
+}
+
+// Significant digits of formatted text, without leading or trailing zeros
+static int float_digits(const char* text, char* digits) {
+    int count = 0;
+    for (const char* p = text; *p && *p != 'e'; p++) {
+        if (*p < '0' || *p > '9') continue;
+        if (count == 0 && *p == '0') continue;
+        digits[count++] = *p;
+    }
+    while (count > 0 && digits[count - 1] == '0') count--;
+    digits[count] = '\0';
+    return count;
+}
+
+// Round-trips a value through dtoa_shortest and strtod; with check_shortest,
+// also requires no more digits than the shortest printf precision that
+// round-trips, and the same digits when the lengths match
+static bool float_check(double value, bool check_shortest) {
+    char text[DTOA_BUFFER_SIZE];
+    dtoa_shortest(value, text);
+    double parsed = strtod(text, NULL);
+    if (memcmp(&parsed, &value, sizeof(value)) != 0) {
+        printf("   [ERROR] %.17g printed as %s, reads back as %.17g\n", value, text, parsed);
+        return false;
+    }
+    if (!check_shortest) return true;
+
+    char reference[40];
+    for (int precision = 1; precision <= 17; precision++) {
+        snprintf(reference, sizeof(reference), "%.*e", precision - 1, value);
+        if (strtod(reference, NULL) == value) break;
+    }
+    char ours[24], theirs[24];
+    int ours_length = float_digits(text, ours);
+    int theirs_length = float_digits(reference, theirs);
+    if (ours_length > theirs_length || (ours_length == theirs_length && strcmp(ours, theirs) != 0)) {
+        printf("   [ERROR] %.17g printed as %s, shortest is %s\n", value, text, reference);
+        return false;
+    }
+    return true;
+}
+
+static int float_benchmark(void) {
+    printf(">> Float Formatting Test\n");
+    printf("========================\n");
+    
+    static const struct { double value; const char* text; } known[] = {
+        { 0.0, "0.0" }, { -0.0, "-0.0" }, { 1.0, "1.0" }, { 2.0, "2.0" }, { 0.1, "0.1" },
+        { 1.0 / 3.0, "0.3333333333333333" }, { 123.456, "123.456" },
+        { 1e15, "1000000000000000.0" }, { 1e16, "1e+16" }, { 1e-4, "0.0001" }, { 1e-5, "1e-05" },
+        { -2.5e-7, "-2.5e-07" }, { 1e22, "1e+22" }, { 1e23, "1e+23" },
+        { 9007199254740993.0, "9007199254740992.0" }, { 5e-324, "5e-324" },
+        { 2.2250738585072014e-308, "2.2250738585072014e-308" },
+        { 1.7976931348623157e308, "1.7976931348623157e+308" },
+    };
+    int failures = 0;
+    char text[DTOA_BUFFER_SIZE];
+    for (size_t i = 0; i < sizeof(known) / sizeof(known[0]); i++) {
+        dtoa_shortest(known[i].value, text);
+        if (strcmp(text, known[i].text) != 0) {
+            printf("   [ERROR] expected %s, got %s\n", known[i].text, text);
+            failures++;
+        }
+    }
+    printf("   Known values: %zu checked\n", sizeof(known) / sizeof(known[0]));
+    
+    // Random bit patterns cover every exponent evenly, subnormals included;
+    // the slower shortest-length check runs on every 16th
+    enum { RANDOM_BITS = 4000000, RANDOM_DECIMALS = 1000000 };
+    uint64_t state = 0x9E3779B97F4A7C15ULL;
+    int checked = 0;
+    double start = timer_now();
+    while (checked < RANDOM_BITS) {
+        uint64_t bits = float_random(&state);
+        double value;
+        memcpy(&value, &bits, sizeof(value));
+        if (value - value != 0.0) continue;     // inf and nan
+        if (!float_check(value, checked % 16 == 0) && ++failures >= 10) break;
+        checked++;
+    }
+    printf("   Random bit patterns: %d round-tripped (%.2f seconds)\n", checked, timer_now() - start);
+    
+    // Short decimals are what source code contains, and where trailing-zero
+    // and tie handling matter most
+    start = timer_now();
+    for (checked = 0; checked < RANDOM_DECIMALS && failures < 10; checked++) {
+        uint64_t random = float_random(&state);
+        int digits = (int)(random % 17) + 1;
+        int exponent = (int)((random >> 8) % 640) - 320;
+        char decimal[40];
+        int n = 0;
+        uint64_t mantissa_source = float_random(&state);
+        for (int d = 0; d < digits; d++) {
+            decimal[n++] = (char)('0' + (d == 0 ? mantissa_source % 9 + 1 : mantissa_source % 10));
+            mantissa_source /= 10;
+        }
+        snprintf(decimal + n, sizeof(decimal) - (size_t)n, "e%d", exponent);
+        double value = strtod(decimal, NULL);
+        if (value - value != 0.0) continue;
+        if (!float_check(value, checked % 16 == 0)) {
+            failures++;
+            continue;
+        }
+        // A value written with up to 15 digits never needs more to print
+        dtoa_shortest(value, text);
+        char ours[24];
+        if (value != 0.0 && digits <= 15 && float_digits(text, ours) > digits) {
+            printf("   [ERROR] %s printed as %s\n", decimal, text);
+            failures++;
+        }
+    }
+    printf("   Random decimals: %d round-tripped (%.2f seconds)\n", checked, timer_now() - start);
+    
+    // Throughput against the printf formats it replaces
+    enum { THROUGHPUT_VALUES = 1000000 };
+    double* values = malloc(THROUGHPUT_VALUES * sizeof(double));
+    for (int i = 0; i < THROUGHPUT_VALUES; i++) {
+        uint64_t bits;
+        do {
+            bits = float_random(&state);
+            memcpy(&values[i], &bits, sizeof(double));
+        } while (values[i] - values[i] != 0.0);
+    }
     printf("\n");
+    for (int method = 0; method < 3; method++) {
+        static const char* names[] = { "dtoa_shortest:", "printf %.17g:", "printf %g:" };
+        size_t bytes = 0;
+        start = timer_now();
+        for (int i = 0; i < THROUGHPUT_VALUES; i++) {
+            char buffer[40];
+            switch (method) {
+                case 0: bytes += dtoa_shortest(values[i], buffer); break;
+                case 1: bytes += (size_t)snprintf(buffer, sizeof(buffer), "%.17g", values[i]); break;
+                default: bytes += (size_t)snprintf(buffer, sizeof(buffer), "%g", values[i]); break;
+            }
+        }
+        double elapsed = timer_now() - start;
+        printf("   %-15s %.1f M values/s, %.1f ns/value, %.1f bytes/value\n", names[method],
+               THROUGHPUT_VALUES / elapsed / 1e6, elapsed * 1e9 / THROUGHPUT_VALUES,
+               (double)bytes / THROUGHPUT_VALUES);
+    }
+    free(values);
+    
+    printf("\n%s: %d failures\n\n", failures ? "[ERROR] FAILED" : "PASSED", failures);
+    return failures ? 1 : 0;
 }
 
 static void interactive_mode(void) {
@@ -257,7 +1771,12 @@ static void interactive_mode(void) {
 }
 
 int main(int argc, char* argv[]) {
-    print_header();
+    // --stats=json keeps stdout for the JSON object alone
+    bool json_stats = false;
+    for (int i = 1; i < argc; i++) {
+        json_stats |= strcmp(argv[i], "--stats=json") == 0;
+    }
+    print_header(json_stats ? stderr : stdout);
     
     // handle command line args
     if (argc == 2 && strcmp(argv[1], "-i") == 0) {
@@ -265,12 +1784,100 @@ int main(int argc, char* argv[]) {
         return 0;
     }
     
-    if (argc == 2 && strcmp(argv[1], "-b") == 0) {
-        performance_benchmark();
+    if (argc >= 2 && strcmp(argv[1], "-b") == 0) {
+        return run_benchmark_suite(argc, argv, 2);
+    }
+    
+    if (argc >= 4 && strcmp(argv[1], "--bench-compare") == 0) {
+        return compare_benchmark_files(argc, argv);
+    }
+    
+    if (argc >= 4 && strcmp(argv[1], "--gen-corpus") == 0) {
+        return write_corpus(argc, argv);
+    }
+    
+    if (argc == 2 && strcmp(argv[1], "--bench-lib") == 0) {
+        library_benchmark();
+        return 0;
+    }
+    
+    if (argc == 2 && strcmp(argv[1], "--bench-codegen") == 0) {
+        codegen_benchmark();
         return 0;
     }
     
-    if (argc == 2 && strcmp(argv[1], "-c") == 0) {
+    if (argc == 2 && strcmp(argv[1], "--bench-float") == 0) {
+        return float_benchmark();
+    }
+    
+    if (argc >= 2 && strcmp(argv[1], "--check-memory") == 0) {
+        return check_memory_budget(argc, argv);
+    }
+    
+    if (argc >= 2 && strcmp(argv[1], "--bench-pathological") == 0) {
+        return pathological_suite(argc, argv);
+    }
+    
+    if (argc >= 2 && strcmp(argv[1], "-j") == 0) {
+        return batch_compile(argc, argv);
+    }
+    
+    if (argc >= 3 && strcmp(argv[1], "--watch") == 0) {
+        return watch_files(argc, argv);
+    }
+    
+    if (argc >= 2 && strcmp(argv[1], "--bench-watch") == 0) {
+        return watch_suite(argc, argv);
+    }
+    
+    if (argc >= 2 && strcmp(argv[1], "--bench-pipeline") == 0) {
+        return pipeline_suite(argc, argv);
+    }
+    
+    if (argc >= 2 && strcmp(argv[1], "--bench-stream") == 0) {
+        return stream_suite(argc, argv);
+    }
+    
+    if (argc >= 2 && strcmp(argv[1], "--server") == 0) {
+        return run_server(argc, argv);
+    }
+    
+    if (argc >= 3 && strcmp(argv[1], "--client") == 0) {
+        return run_client(argc, argv);
+    }
+    
+    if (argc >= 2 && strcmp(argv[1], "--bench-server") == 0) {
+        return server_suite(argc, argv);
+    }
+    
+    if (argc >= 2 && strcmp(argv[1], "--bench-batch") == 0) {
+        return batch_suite(argc, argv);
+    }
+    
+    if (argc >= 2 && strcmp(argv[1], "--bench-sample") == 0) {
+        return sample_suite(argc, argv);
+    }
+    
+    if (argc >= 2 && strcmp(argv[1], "--bench-pgo") == 0) {
+        return pgo_suite(argc, argv);
+    }
+    
+    if (argc == 2 && strcmp(argv[1], "--cache-stats") == 0) {
+        return show_cache_stats(NULL);
+    }
+    
+    if (argc == 3 && strcmp(argv[1], "--cache-stats") == 0) {
+        return show_cache_stats(argv[2]);
+    }
+    
+    if (argc >= 2 && strcmp(argv[1], "-c") == 0) {
+        CompilerSettings settings;
+        if (!parse_compiler_options(&settings, argc, argv, 2)) return 1;
+        if (settings.stream) {
+            printf("[ERROR] --stream compiles a file; use -f <file>\n");
+            return 1;
+        }
+        
         // full compiler test
         const char* sample_program = 
             "int x = 42;\n"
@@ -278,15 +1885,25 @@ int main(int argc, char* argv[]) {
             "int result = x * y;\n"
             "return result;\n";
         
-        compile_program(sample_program, "sample.shay");
-        return 0;
+        bool compiled = compile_and_report(sample_program, "sample.shay", &settings);
+        profile_free(&settings.profile_data);
+        return compiled ? 0 : 1;
     }
     
-    if (argc == 3 && strcmp(argv[1], "-f") == 0) {
+    if (argc >= 3 && strcmp(argv[1], "-f") == 0) {
+        CompilerSettings settings;
+        if (!parse_compiler_options(&settings, argc, argv, 3)) return 1;
+        if (settings.stream) {
+            bool compiled = run_streaming(argv[2], &settings);
+            profile_free(&settings.profile_data);
+            return compiled ? 0 : 1;
+        }
+        
         // compile from file
         FILE* file = fopen(argv[2], "r");
         if (!file) {
             printf("[ERROR] Cannot open file: %s\n", argv[2]);
+            profile_free(&settings.profile_data);
             return 1;
         }
         
@@ -300,9 +1917,10 @@ int main(int argc, char* argv[]) {
         content[file_size] = '\0';
         fclose(file);
         
-        compile_program(content, argv[2]);
+        bool compiled = compile_and_report(content, argv[2], &settings);
         free(content);
-        return 0;
+        profile_free(&settings.profile_data);
+        return compiled ? 0 : 1;
     }
     
     if (argc == 2 && strcmp(argv[1], "-h") == 0) {
@@ -310,10 +1928,72 @@ int main(int argc, char* argv[]) {
         printf("Usage:\n");
         printf("  %s        - Run lexer test suite\n", argv[0]);
         printf("  %s -i     - Interactive mode\n", argv[0]);
-        printf("  %s -b     - Performance benchmark\n", argv[0]);
+        printf("  %s -b [options] - Benchmark lex, parse, codegen and end-to-end on generated programs\n", argv[0]);
+        printf("               --sizes=1K,1M,1G --phases=lex,parse,codegen,e2e --runs=N --warmup=N\n");
+        printf("               --mix=arith=N,calls=N,... --seed=N --json=FILE\n");
+        printf("               --baseline=FILE [--threshold=PCT] [--alpha=P] - Fail on regressions\n");
+        printf("  %s --bench-compare OLD.json NEW.json [--threshold=PCT] [--alpha=P]\n", argv[0]);
+        printf("               - Fail if a benchmark got significantly slower (5%%, 0.01)\n");
+        printf("  %s --gen-corpus SIZE FILE [--mix=...] [--seed=N] - Write a benchmark program\n", argv[0]);
+        printf("  %s --bench-lib - Benchmark the library API on 10k programs\n", argv[0]);
+        printf("  %s --bench-codegen - Benchmark parallel codegen on 100k functions\n", argv[0]);
+        printf("  %s --bench-float - Round-trip and throughput test of float formatting\n", argv[0]);
+        printf("  %s --check-memory [--size=1M] [--budget=BYTES] - Fail if the AST needs more\n", argv[0]);
+        printf("               than BYTES (default %d) of arena per node\n", MEMORY_DEFAULT_NODE_BUDGET);
+        printf("  %s --bench-pathological [--size=1M] [--runs=N] - Fail if a worst-case input\n", argv[0]);
+        printf("               (huge identifier, deep nesting, long chain, ...) scales super-linearly\n");
+        printf("  %s --watch <files> [--flatten=N] [--debounce=MS] - Rebuild each a.shay to a.c\n", argv[0]);
+        printf("               when it is saved, regenerating only changed declarations\n");
+        printf("  %s --bench-watch [--edits=N] - Save-to-rebuilt latency of one-function edits\n", argv[0]);
+        printf("  %s --bench-pipeline [--size=16M] [--runs=N] - Compile a generated program\n", argv[0]);
+        printf("               sequentially and with --pipeline; the outputs must be identical\n");
+        printf("  %s --bench-stream [--sizes=16M,64M,1G] - Peak RSS of --stream, which must stay\n", argv[0]);
+        printf("               under %u MB, against a full syntax tree; the outputs must be identical\n",
+               BENCH_STREAM_MAX_RSS >> 20);
+        printf("  %s --server [--socket=PATH] [--threads=N] [--cache] - Compile for clients over a\n", argv[0]);
+        printf("               Unix socket until Ctrl-C (default $SHAYNEFRO_SOCKET, $XDG_RUNTIME_DIR)\n");
+        printf("  %s --client <file> [--socket=PATH] [--flatten=N] - Compile on the server to output.c\n", argv[0]);
+        printf("  %s --bench-server [--clients=N] [--requests=N] [--threads=N] - Request latency\n", argv[0]);
+        printf("               under concurrent clients, and per process against -f\n");
+        printf("  %s --bench-batch [--threads=N] - Batch-compile 10k small files, then a few\n", argv[0]);
+        printf("               huge ones among small ones, on 1 and N threads\n");
+        printf("  %s --bench-sample [--runs=N] - Time fibonacci and primes with and without --sample\n", argv[0]);
+        printf("  %s --bench-pgo [--runs=N] - Time fibonacci and primes built plain and with\n", argv[0]);
+        printf("               --profile-use, after a --profile run of each\n");
         printf("  %s -c     - Compile sample program (FULL COMPILER)\n", argv[0]);
         printf("  %s -f <file> - Compile specific file\n", argv[0]);
+        printf("  %s -j N [--flatten=N] <files|@list> - Compile many files on N threads,\n", argv[0]);
+        printf("               each a.shay to a.c\n");
+        printf("  %s --cache-stats [dir] - Show compile cache hits, misses and size\n", argv[0]);
         printf("  %s -h     - Show this help\n", argv[0]);
+        printf("\nCompile options (after -c or -f <file>):\n");
+        printf("  --flatten=N  - Split expressions over N nodes into temporaries\n");
+        printf("  --split=N    - Spread functions over N C files plus a header and Makefile\n");
+        printf("  -o <file>    - Build an executable, piping the C code into $SHAYNEFRO_CC\n");
+        printf("                 (else $CC, else cc) with $SHAYNEFRO_CFLAGS appended\n");
+        printf("  --cc-profile=debug|release|native|lto\n");
+        printf("               - C compiler flags for -o: -O0 -g, -O2 (default),\n");
+        printf("                 -O3 -march=native, -O2 -flto\n");
+        printf("  --threads=N  - Generate function bodies on N threads (same output)\n");
+        printf("  --pipeline   - Lex, parse and generate at once on three threads (same output)\n");
+        printf("  --stream     - With -f: map the file and free each declaration once generated,\n");
+        printf("                 so memory follows the largest declaration (same output)\n");
+        printf("  --profile    - Count calls and time every function of the generated program;\n");
+        printf("                 it prints a flat profile at exit (mark single functions with 📊)\n");
+        printf("  --sample[=HZ] - Sample the generated program's call stack HZ times per CPU\n");
+        printf("                 second (default %d) and write folded stacks at exit\n", CODEGEN_SAMPLE_DEFAULT_HZ);
+        printf("  --profile-use=FILE\n");
+        printf("               - Use the profile a --profile build wrote to mark hot and cold\n");
+        printf("                 functions, inline small hot ones and hint biased branches\n");
+        printf("  --stats=json - Print timings, counts, memory and optimisation counters as\n");
+        printf("                 one JSON object on stdout; progress goes to stderr\n");
+        printf("  --dump-ast   - Print the syntax tree after compiling\n");
+        printf("  --trace=FILE - Write a timeline of the compile phases as Chrome trace JSON\n");
+        printf("  --incremental - Regenerate only declarations changed since the last build\n");
+        printf("  --cache      - Reuse output for unchanged source and options\n");
+        printf("  --cache-dir=DIR\n");
+        printf("               - Cache location (implies --cache); default $SHAYNEFRO_CACHE_DIR,\n");
+        printf("                 else ~/.cache/shaynefro. Size limit: $SHAYNEFRO_CACHE_MAX_MB (1024)\n");
         printf("\n>> Features:\n");
         printf("  * High-performance lexical analysis\n");
         printf("  * Complete recursive descent parser\n");
@@ -384,7 +2064,14 @@ int main(int argc, char* argv[]) {
     test_lexer("@#$", "Error Case - Invalid Characters");
     
     printf(">> Running Performance Benchmark...\n");
-    performance_benchmark();
+    char* quick_suite[] = { argv[0], "-b", "--sizes=64K", "--warmup=1", "--runs=5" };
+    run_benchmark_suite(5, quick_suite, 2);
+    
+    char* memory_check[] = { argv[0], "--check-memory", "--size=64K" };
+    int status = check_memory_budget(3, memory_check);
+    
+    char* pathological[] = { argv[0], "--bench-pathological", "--size=64K" };
+    if (pathological_suite(3, pathological) != 0) status = 1;
     
     printf("===============================================================\n");
     printf("                    Testing Complete!                         \n");
@@ -395,5 +2082,5 @@ int main(int argc, char* argv[]) {
     printf("     ./shaynefro -b    (benchmark mode)                       \n");
     printf("===============================================================\n");
     
-    return 0;
+    return status;
 }
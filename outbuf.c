@@ -0,0 +1,139 @@
+#define _POSIX_C_SOURCE 200809L
+#include "outbuf.h"
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+
+// ================== LIFECYCLE ==================
+
+bool outbuf_init(OutputBuffer* buf, int fd) {
+    buf->data = malloc(OUTBUF_INITIAL_CAPACITY);
+    buf->length = 0;
+    buf->capacity = buf->data ? OUTBUF_INITIAL_CAPACITY : 0;
+    buf->fd = fd;
+    buf->bytes_flushed = 0;
+    buf->write_calls = 0;
+    buf->had_error = buf->data == NULL;
+    return !buf->had_error;
+}
+
+void outbuf_free(OutputBuffer* buf) {
+    if (buf) {
+        free(buf->data);
+        buf->data = NULL;
+        buf->length = 0;
+        buf->capacity = 0;
+    }
+}
+
+// Drop pending bytes but keep the allocation for reuse
+void outbuf_clear(OutputBuffer* buf) {
+    buf->length = 0;
+    buf->bytes_flushed = 0;
+    buf->write_calls = 0;
+    buf->had_error = buf->data == NULL;
+}
+
+bool outbuf_flush(OutputBuffer* buf) {
+    if (buf->fd < 0 || buf->length == 0) return !buf->had_error;
+
+    const char* p = buf->data;
+    size_t remaining = buf->length;
+    while (remaining > 0) {
+        ssize_t written = write(buf->fd, p, remaining);
+        buf->write_calls++;
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            buf->had_error = true;
+            return false;
+        }
+        p += written;
+        remaining -= (size_t)written;
+    }
+
+    buf->bytes_flushed += buf->length;
+    buf->length = 0;
+    return !buf->had_error;
+}
+
+bool outbuf_reserve(OutputBuffer* buf, size_t extra) {
+    if (buf->had_error) return false;
+
+    // File-backed buffers drain at chunk boundaries instead of growing
+    if (buf->fd >= 0 && buf->length >= OUTBUF_FLUSH_THRESHOLD) {
+        if (!outbuf_flush(buf)) return false;
+    }
+    if (buf->capacity - buf->length >= extra) return true;
+
+    size_t new_capacity = buf->capacity ? buf->capacity : OUTBUF_INITIAL_CAPACITY;
+    while (new_capacity - buf->length < extra) {
+        new_capacity *= 2;
+    }
+
+    char* data = realloc(buf->data, new_capacity);
+    if (!data) {
+        buf->had_error = true;
+        return false;
+    }
+    buf->data = data;
+    buf->capacity = new_capacity;
+    return true;
+}
+
+size_t outbuf_total_size(const OutputBuffer* buf) {
+    return buf->bytes_flushed + buf->length;
+}
+
+// ================== FORMATTING HELPERS ==================
+
+static const char digit_pairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+// Integer formatting two digits at a time, no printf involved
+void outbuf_append_int(OutputBuffer* buf, long long value) {
+    char tmp[24];
+    char* end = tmp + sizeof(tmp);
+    char* p = end;
+
+    unsigned long long v = value < 0 ? 0ULL - (unsigned long long)value
+                                     : (unsigned long long)value;
+    while (v >= 100) {
+        unsigned idx = (unsigned)(v % 100) * 2;
+        v /= 100;
+        *--p = digit_pairs[idx + 1];
+        *--p = digit_pairs[idx];
+    }
+    if (v >= 10) {
+        unsigned idx = (unsigned)v * 2;
+        *--p = digit_pairs[idx + 1];
+        *--p = digit_pairs[idx];
+    } else {
+        *--p = (char)('0' + v);
+    }
+    if (value < 0) *--p = '-';
+
+    outbuf_append(buf, p, (size_t)(end - p));
+}
+
+// Indentation is sliced out of one cached run of spaces
+static const char indent_spaces[] =
+    "                                                                "
+    "                                                                ";
+
+void outbuf_append_indent(OutputBuffer* buf, int level) {
+    size_t width = (size_t)(level > 0 ? level : 0) * OUTBUF_INDENT_WIDTH;
+    while (width > 0) {
+        size_t chunk = width < sizeof(indent_spaces) - 1 ? width : sizeof(indent_spaces) - 1;
+        outbuf_append(buf, indent_spaces, chunk);
+        width -= chunk;
+    }
+}
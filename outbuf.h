@@ -0,0 +1,68 @@
+#ifndef OUTBUF_H
+#define OUTBUF_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+
+#define OUTBUF_INITIAL_CAPACITY 65536
+#define OUTBUF_FLUSH_THRESHOLD (1u << 20)  // Write to fd once this much is buffered
+#define OUTBUF_INDENT_WIDTH 4
+
+// ================== OUTPUT BUFFER ==================
+
+// Growable byte buffer used by the code generator. Appends are plain
+// memcpy into the tail; the buffer only touches the OS when it is flushed,
+// either at the end of generation or once OUTBUF_FLUSH_THRESHOLD bytes are
+// pending for a file-backed buffer.
+typedef struct {
+    char* data;             // Pending bytes
+    size_t length;          // Bytes currently in data
+    size_t capacity;        // Allocated size of data
+    int fd;                 // Flush target, -1 keeps everything in memory
+    size_t bytes_flushed;   // Bytes already written to fd
+    int write_calls;        // Number of write() calls issued
+    bool had_error;         // Allocation or write failure
+} OutputBuffer;
+
+// Lifecycle
+bool outbuf_init(OutputBuffer* buf, int fd);
+void outbuf_free(OutputBuffer* buf);
+void outbuf_clear(OutputBuffer* buf);
+bool outbuf_flush(OutputBuffer* buf);
+
+// Slow path for appends, grows or flushes so that extra bytes fit
+bool outbuf_reserve(OutputBuffer* buf, size_t extra);
+
+// Formatting helpers
+void outbuf_append_int(OutputBuffer* buf, long long value);
+void outbuf_append_indent(OutputBuffer* buf, int level);
+
+// Total bytes produced so far (flushed + pending)
+size_t outbuf_total_size(const OutputBuffer* buf);
+
+// ================== FAST-PATH APPENDS ==================
+
+static inline void outbuf_append(OutputBuffer* buf, const char* data, size_t length) {
+    if (buf->capacity - buf->length < length && !outbuf_reserve(buf, length)) {
+        return;
+    }
+    memcpy(buf->data + buf->length, data, length);
+    buf->length += length;
+}
+
+static inline void outbuf_putc(OutputBuffer* buf, char c) {
+    if (buf->length == buf->capacity && !outbuf_reserve(buf, 1)) {
+        return;
+    }
+    buf->data[buf->length++] = c;
+}
+
+static inline void outbuf_append_str(OutputBuffer* buf, const char* str) {
+    outbuf_append(buf, str, strlen(str));
+}
+
+// Append a string literal without a strlen() at runtime
+#define outbuf_append_lit(buf, lit) outbuf_append((buf), (lit), sizeof(lit) - 1)
+
+#endif
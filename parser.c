@@ -1,8 +1,9 @@
 #include "parser.h"
+#include "dtoa.h"
+#include "trace.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <time.h>
 
 // ================== PARSER CREATION AND DESTRUCTION ==================
 
@@ -10,13 +11,6 @@ Parser* parser_create(Lexer* lexer) {
     Parser* parser = malloc(sizeof(Parser));
     if (!parser) return NULL;
     
-    parser->lexer = lexer;
-    parser->had_error = false;
-    parser->panic_mode = false;
-    parser->error_message[0] = '\0';
-    parser->nodes_created = 0;
-    parser->parse_start_time = (double)clock() / CLOCKS_PER_SEC;
-    
     // Create arena for AST nodes
     parser->arena = arena_create();
     if (!parser->arena) {
@@ -24,6 +18,34 @@ Parser* parser_create(Lexer* lexer) {
         return NULL;
     }
     
+    parser_reset(parser, lexer);
+    return parser;
+}
+
+// Reuse a parser (and its arena) for a new token stream; previous ASTs are released
+void parser_reset(Parser* parser, Lexer* lexer) {
+    arena_reset(parser->arena);
+    parser_set_lexer(parser, lexer);
+}
+
+// Continue with a new token stream; ASTs already parsed stay valid
+void parser_set_lexer(Parser* parser, Lexer* lexer) {
+    parser->lexer = lexer;
+    parser->had_error = false;
+    parser->panic_mode = false;
+    parser->error_message[0] = '\0';
+    parser->error_detail[0] = '\0';
+    parser->error_pos = (Position){0, 0, NULL};
+    parser->nodes_created = 0;
+    parser->function_depth = 0;
+    parser->depth = 0;
+    parser->returns_value = false;
+    parser->parse_time = 0;
+    parser->token_source = NULL;
+    parser->token_context = NULL;
+    parser->declaration_hook = NULL;
+    parser->declaration_context = NULL;
+    
     // Get first token
     parser->current = lexer_next_token(lexer);
     
@@ -31,8 +53,16 @@ Parser* parser_create(Lexer* lexer) {
     while (parser->current.type == TOKEN_NEWLINE && parser->current.type != TOKEN_EOF) {
         parser->current = lexer_next_token(lexer);
     }
-    
-    return parser;
+}
+
+void parser_set_token_source(Parser* parser, ParserTokenSource source, void* context) {
+    parser->token_source = source;
+    parser->token_context = context;
+}
+
+void parser_set_declaration_hook(Parser* parser, ParserDeclarationHook hook, void* context) {
+    parser->declaration_hook = hook;
+    parser->declaration_context = context;
 }
 
 void parser_destroy(Parser* parser) {
@@ -48,14 +78,25 @@ static bool match(Parser* parser, TokenType type);
 
 // ================== UTILITY FUNCTIONS ==================
 
+static Token next_token(Parser* parser, const char** error) {
+    if (parser->token_source) return parser->token_source(parser->token_context, error);
+    Token token = lexer_next_token(parser->lexer);
+    if (token.type == TOKEN_ERROR) *error = lexer_get_error(parser->lexer);
+    return token;
+}
+
 static void advance(Parser* parser) {
+    const char* error = NULL;
     parser->previous = parser->current;
-    parser->current = lexer_next_token(parser->lexer);
+    parser->current = next_token(parser, &error);
     
-    // Skip error tokens and report them
-    while (parser->current.type == TOKEN_ERROR) {
-        parser_error(parser, "Lexical error");
-        parser->current = lexer_next_token(parser->lexer);
+    // Skip error tokens and report them; statements end at ';', so
+    // newlines carry no meaning to the grammar
+    while (parser->current.type == TOKEN_ERROR || parser->current.type == TOKEN_NEWLINE) {
+        if (parser->current.type == TOKEN_ERROR) {
+            parser_error(parser, error);
+        }
+        parser->current = next_token(parser, &error);
     }
 }
 
@@ -84,7 +125,10 @@ static void parser_error(Parser* parser, const char* message) {
     
     parser->panic_mode = true;
     parser->had_error = true;
+    parser->error_pos = parser->current.pos;
     
+    strncpy(parser->error_detail, message, sizeof(parser->error_detail) - 1);
+    parser->error_detail[sizeof(parser->error_detail) - 1] = '\0';
     snprintf(parser->error_message, sizeof(parser->error_message),
              "Error at line %d, column %d: %s",
              parser->current.pos.line, parser->current.pos.column, message);
@@ -134,10 +178,10 @@ ASTNode* ast_create_literal(Parser* parser, TokenType type, Token token) {
     
     switch (type) {
         case TOKEN_INTEGER:
-            node->data.literal.value.int_value = strtoll(token.start, NULL, 10);
+            node->data.literal.value.int_value = token.value.int_value;
             break;
         case TOKEN_FLOAT:
-            node->data.literal.value.float_value = strtod(token.start, NULL);
+            node->data.literal.value.float_value = token.value.float_value;
             break;
         case TOKEN_STRING: {
             // Allocate string and copy (without quotes)
@@ -161,13 +205,7 @@ ASTNode* ast_create_identifier(Parser* parser, char* name) {
     ASTNode* node = ast_allocate(parser, AST_IDENTIFIER);
     if (!node) return NULL;
     
-    // Copy name to arena
-    size_t len = strlen(name);
-    char* name_copy = arena_alloc(parser->arena, len + 1);
-    if (name_copy) {
-        strcpy(name_copy, name);
-        node->data.identifier.name = name_copy;
-    }
+    node->data.identifier.name = name;
     
     return node;
 }
@@ -189,6 +227,7 @@ ASTNode* ast_create_unary(Parser* parser, TokenType op, ASTNode* operand) {
     
     node->data.unary.operator = op;
     node->data.unary.operand = operand;
+    node->data.unary.postfix = false;
     
     return node;
 }
@@ -208,31 +247,178 @@ ASTNode* ast_create_var_decl(Parser* parser, TokenType type, char* name, ASTNode
     
     node->data.var_decl.type = type;
     
-    // Copy name to arena
-    size_t len = strlen(name);
-    char* name_copy = arena_alloc(parser->arena, len + 1);
-    if (name_copy) {
-        strcpy(name_copy, name);
-        node->data.var_decl.name = name_copy;
-    }
+    node->data.var_decl.name = name;
     
     node->data.var_decl.initializer = init;
     
     return node;
 }
 
+ASTNode* ast_create_function(Parser* parser, char* name, ASTNode* body) {
+    ASTNode* node = ast_allocate(parser, AST_FUNCTION_DECL);
+    if (!node) return NULL;
+    
+    node->data.func_decl.name = name;
+    node->data.func_decl.return_type = TOKEN_INT;
+    node->data.func_decl.parameters = NULL;
+    node->data.func_decl.param_types = NULL;
+    node->data.func_decl.profiled = false;
+    node->data.func_decl.param_count = 0;
+    node->data.func_decl.body = body;
+    
+    return node;
+}
+
+ASTNode* ast_create_if(Parser* parser, ASTNode* condition, ASTNode* then_stmt, ASTNode* else_stmt) {
+    ASTNode* node = ast_allocate(parser, AST_IF_STMT);
+    if (!node) return NULL;
+    
+    node->data.if_stmt.condition = condition;
+    node->data.if_stmt.then_stmt = then_stmt;
+    node->data.if_stmt.else_stmt = else_stmt;
+    
+    return node;
+}
+
+ASTNode* ast_create_while(Parser* parser, ASTNode* condition, ASTNode* body) {
+    ASTNode* node = ast_allocate(parser, AST_WHILE_STMT);
+    if (!node) return NULL;
+    
+    node->data.while_stmt.condition = condition;
+    node->data.while_stmt.body = body;
+    
+    return node;
+}
+
+ASTNode* ast_create_for(Parser* parser, ASTNode* init, ASTNode* condition, ASTNode* update, ASTNode* body) {
+    ASTNode* node = ast_allocate(parser, AST_FOR_STMT);
+    if (!node) return NULL;
+    
+    node->data.for_stmt.initializer = init;
+    node->data.for_stmt.condition = condition;
+    node->data.for_stmt.update = update;
+    node->data.for_stmt.body = body;
+    
+    return node;
+}
+
+ASTNode* ast_create_block(Parser* parser) {
+    ASTNode* node = ast_allocate(parser, AST_BLOCK_STMT);
+    if (!node) return NULL;
+    
+    node->data.block.statements = NULL;
+    node->data.block.statement_count = 0;
+    
+    return node;
+}
+
+ASTNode* ast_create_call(Parser* parser, char* name) {
+    ASTNode* node = ast_allocate(parser, AST_CALL);
+    if (!node) return NULL;
+    
+    node->data.call.name = name;
+    node->data.call.arguments = NULL;
+    node->data.call.arg_count = 0;
+    
+    return node;
+}
+
 // ================== RECURSIVE DESCENT PARSER ==================
 
+#define PARSER_MAX_PARAMETERS 127  // Minimum C guarantees per function
+
 // Forward declarations for recursive functions
 static ASTNode* expression(Parser* parser);
 static ASTNode* statement(Parser* parser);
 static ASTNode* declaration(Parser* parser);
 
-// Parse primary expressions (literals, identifiers, parentheses)
+// Statement and argument lists are collected in a growable array, then
+// moved into the arena once their length is known
+typedef struct {
+    ASTNode** items;
+    int count;
+    int capacity;
+} NodeList;
+
+static bool node_list_push(NodeList* list, ASTNode* node) {
+    if (list->count == list->capacity) {
+        int capacity = list->capacity ? list->capacity * 2 : 8;
+        ASTNode** items = realloc(list->items, sizeof(ASTNode*) * capacity);
+        if (!items) return false;
+        list->items = items;
+        list->capacity = capacity;
+    }
+    list->items[list->count++] = node;
+    return true;
+}
+
+static ASTNode** node_list_finish(Parser* parser, NodeList* list) {
+    ASTNode** items = arena_alloc(parser->arena, sizeof(ASTNode*) * (list->count ? list->count : 1));
+    if (items && list->count) {
+        memcpy(items, list->items, sizeof(ASTNode*) * list->count);
+    }
+    free(list->items);
+    list->items = NULL;
+    return items;
+}
+
+// The previous token's full text, NUL-terminated in the arena
+static char* previous_name(Parser* parser) {
+    size_t length = parser->previous.length;
+    char* name = arena_alloc(parser->arena, length + 1);
+    if (!name) {
+        parser_error(parser, "Out of memory while parsing");
+        return NULL;
+    }
+    memcpy(name, parser->previous.start, length);
+    name[length] = '\0';
+    return name;
+}
+
+// Recursion guard for expressions and statements: input nested deeper
+// than PARSER_MAX_DEPTH is an error rather than a stack overflow
+static bool enter_nesting(Parser* parser) {
+    if (++parser->depth <= PARSER_MAX_DEPTH) return true;
+    parser_error(parser, "Nesting too deep");
+    parser->depth--;
+    return false;
+}
+
+static bool match_type(Parser* parser) {
+    return match(parser, TOKEN_INT) || match(parser, TOKEN_FLOAT_KW) ||
+           match(parser, TOKEN_STRING_KW) || match(parser, TOKEN_BOOL_KW);
+}
+
+// Parse call arguments after the opening parenthesis
+static ASTNode* finish_call(Parser* parser, char* name) {
+    NodeList arguments = {0};
+    
+    if (!check(parser, TOKEN_RPAREN)) {
+        do {
+            ASTNode* argument = expression(parser);
+            if (!node_list_push(&arguments, argument)) {
+                parser_error(parser, "Out of memory while parsing arguments");
+                break;
+            }
+        } while (match(parser, TOKEN_COMMA));
+    }
+    consume(parser, TOKEN_RPAREN, "Expected ')' after arguments");
+    
+    ASTNode* call = ast_create_call(parser, name);
+    if (!call) {
+        free(arguments.items);
+        return NULL;
+    }
+    call->data.call.arg_count = arguments.count;
+    call->data.call.arguments = node_list_finish(parser, &arguments);
+    return call;
+}
+
+// Parse primary expressions (literals, identifiers, calls, parentheses)
 static ASTNode* primary(Parser* parser) {
     if (match(parser, TOKEN_TRUE) || match(parser, TOKEN_FALSE)) {
-        // Boolean literals
-        return ast_create_literal(parser, TOKEN_BOOL_KW, parser->previous);
+        // Boolean literals keep their token type so the value survives
+        return ast_create_literal(parser, parser->previous.type, parser->previous);
     }
     
     if (match(parser, TOKEN_NULL)) {
@@ -252,13 +438,12 @@ static ASTNode* primary(Parser* parser) {
     }
     
     if (match(parser, TOKEN_IDENTIFIER)) {
-        // Extract identifier name
-        char name[256];
-        size_t len = parser->previous.length;
-        if (len >= sizeof(name)) len = sizeof(name) - 1;
-        strncpy(name, parser->previous.start, len);
-        name[len] = '\0';
+        char* name = previous_name(parser);
+        if (!name) return NULL;
         
+        if (match(parser, TOKEN_LPAREN)) {
+            return finish_call(parser, name);
+        }
         return ast_create_identifier(parser, name);
     }
     
@@ -272,15 +457,41 @@ static ASTNode* primary(Parser* parser) {
     return NULL;
 }
 
-// Parse unary expressions (-x, !flag)
+static bool is_increment(TokenType type) {
+    return type == TOKEN_INCREMENT || type == TOKEN_DECREMENT;
+}
+
+// Parse postfix increments (i++, i--)
+static ASTNode* postfix(Parser* parser) {
+    ASTNode* expr = primary(parser);
+    
+    while (match(parser, TOKEN_INCREMENT) || match(parser, TOKEN_DECREMENT)) {
+        if (!expr || expr->type != AST_IDENTIFIER) {
+            parser_error(parser, "Invalid increment target");
+            return expr;
+        }
+        expr = ast_create_unary(parser, parser->previous.type, expr);
+        if (expr) expr->data.unary.postfix = true;
+    }
+    
+    return expr;
+}
+
+// Parse unary expressions (-x, !flag, ++i)
 static ASTNode* unary(Parser* parser) {
-    if (match(parser, TOKEN_NOT) || match(parser, TOKEN_MINUS)) {
+    if (match(parser, TOKEN_NOT) || match(parser, TOKEN_MINUS) ||
+        match(parser, TOKEN_INCREMENT) || match(parser, TOKEN_DECREMENT)) {
         TokenType operator = parser->previous.type;
+        if (!enter_nesting(parser)) return NULL;
         ASTNode* right = unary(parser);
+        parser->depth--;
+        if (is_increment(operator) && (!right || right->type != AST_IDENTIFIER)) {
+            parser_error(parser, "Invalid increment target");
+        }
         return ast_create_unary(parser, operator, right);
     }
     
-    return primary(parser);
+    return postfix(parser);
 }
 
 // Parse multiplication and division
@@ -362,18 +573,35 @@ static ASTNode* logical_or(Parser* parser) {
     return expr;
 }
 
-// Parse assignment
+static bool is_assignment_operator(TokenType type) {
+    switch (type) {
+        case TOKEN_ASSIGN:
+        case TOKEN_PLUS_ASSIGN:
+        case TOKEN_MINUS_ASSIGN:
+        case TOKEN_MULTIPLY_ASSIGN:
+        case TOKEN_DIVIDE_ASSIGN:
+        case TOKEN_MODULO_ASSIGN:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Parse assignment (=, +=, -=, *=, /=, %=)
 static ASTNode* assignment(Parser* parser) {
     ASTNode* expr = logical_or(parser);
     
-    if (match(parser, TOKEN_ASSIGN)) {
-        ASTNode* value = assignment(parser);
+    if (is_assignment_operator(parser->current.type)) {
+        advance(parser);
+        TokenType operator = parser->previous.type;
+        ASTNode* value = expression(parser);
         
-        if (expr->type == AST_IDENTIFIER) {
+        if (expr && expr->type == AST_IDENTIFIER) {
             // Create assignment node
             ASTNode* assign = ast_allocate(parser, AST_ASSIGNMENT);
+            if (!assign) return NULL;
             assign->data.binary.left = expr;
-            assign->data.binary.operator = TOKEN_ASSIGN;
+            assign->data.binary.operator = operator;
             assign->data.binary.right = value;
             return assign;
         }
@@ -386,20 +614,16 @@ static ASTNode* assignment(Parser* parser) {
 
 // Parse full expressions
 static ASTNode* expression(Parser* parser) {
-    return assignment(parser);
+    if (!enter_nesting(parser)) return NULL;
+    ASTNode* expr = assignment(parser);
+    parser->depth--;
+    return expr;
 }
 
-// Parse variable declarations
-static ASTNode* var_declaration(Parser* parser) {
-    TokenType type = parser->previous.type;  // int, float, string, etc.
-    
-    consume(parser, TOKEN_IDENTIFIER, "Expected variable name");
-    
-    char name[256];
-    size_t len = parser->previous.length;
-    if (len >= sizeof(name)) len = sizeof(name) - 1;
-    strncpy(name, parser->previous.start, len);
-    name[len] = '\0';
+// Parse variable declarations; the type and name are already consumed
+static ASTNode* var_declaration(Parser* parser, TokenType type) {
+    char* name = previous_name(parser);
+    if (!name) return NULL;
     
     ASTNode* initializer = NULL;
     if (match(parser, TOKEN_ASSIGN)) {
@@ -416,6 +640,7 @@ static ASTNode* return_statement(Parser* parser) {
     
     if (!check(parser, TOKEN_SEMICOLON)) {
         value = expression(parser);
+        parser->returns_value = true;
     }
     
     consume(parser, TOKEN_SEMICOLON, "Expected ';' after return value");
@@ -428,25 +653,217 @@ static ASTNode* expression_statement(Parser* parser) {
     consume(parser, TOKEN_SEMICOLON, "Expected ';' after expression");
     
     ASTNode* stmt = ast_allocate(parser, AST_EXPRESSION_STMT);
+    if (!stmt) return NULL;
     stmt->data.binary.left = expr;  // Reuse binary structure
     
     return stmt;
 }
 
-// Parse statements
-static ASTNode* statement(Parser* parser) {
+// Parse the statements of a block after its opening brace
+static ASTNode* block(Parser* parser) {
+    NodeList statements = {0};
+    
+    while (!check(parser, TOKEN_RBRACE) && !check(parser, TOKEN_EOF) && !parser->had_error) {
+        ASTNode* stmt = declaration(parser);
+        if (stmt && !node_list_push(&statements, stmt)) {
+            parser_error(parser, "Out of memory while parsing block");
+        }
+    }
+    consume(parser, TOKEN_RBRACE, "Expected '}' after block");
+    
+    ASTNode* node = ast_create_block(parser);
+    if (!node) {
+        free(statements.items);
+        return NULL;
+    }
+    node->data.block.statement_count = statements.count;
+    node->data.block.statements = node_list_finish(parser, &statements);
+    return node;
+}
+
+// Parse if statements with an optional else branch
+static ASTNode* if_statement(Parser* parser) {
+    consume(parser, TOKEN_LPAREN, "Expected '(' after 'if'");
+    ASTNode* condition = expression(parser);
+    consume(parser, TOKEN_RPAREN, "Expected ')' after if condition");
+    
+    ASTNode* then_stmt = statement(parser);
+    ASTNode* else_stmt = NULL;
+    if (match(parser, TOKEN_ELSE)) {
+        else_stmt = statement(parser);
+    }
+    
+    return ast_create_if(parser, condition, then_stmt, else_stmt);
+}
+
+// Parse while loops
+static ASTNode* while_statement(Parser* parser) {
+    consume(parser, TOKEN_LPAREN, "Expected '(' after 'while'");
+    ASTNode* condition = expression(parser);
+    consume(parser, TOKEN_RPAREN, "Expected ')' after while condition");
+    
+    return ast_create_while(parser, condition, statement(parser));
+}
+
+// Parse for loops; every clause is optional
+static ASTNode* for_statement(Parser* parser) {
+    consume(parser, TOKEN_LPAREN, "Expected '(' after 'for'");
+    
+    ASTNode* initializer = NULL;
+    if (match(parser, TOKEN_SEMICOLON)) {
+        // No initializer
+    } else if (match_type(parser)) {
+        TokenType type = parser->previous.type;
+        consume(parser, TOKEN_IDENTIFIER, "Expected variable name");
+        initializer = var_declaration(parser, type);
+    } else {
+        initializer = expression_statement(parser);
+    }
+    
+    ASTNode* condition = NULL;
+    if (!check(parser, TOKEN_SEMICOLON)) {
+        condition = expression(parser);
+    }
+    consume(parser, TOKEN_SEMICOLON, "Expected ';' after loop condition");
+    
+    ASTNode* update = NULL;
+    if (!check(parser, TOKEN_RPAREN)) {
+        update = expression(parser);
+    }
+    consume(parser, TOKEN_RPAREN, "Expected ')' after for clauses");
+    
+    return ast_create_for(parser, initializer, condition, update, statement(parser));
+}
+
+// Parse one statement of any kind
+static ASTNode* nested_statement(Parser* parser) {
     if (match(parser, TOKEN_RETURN)) {
         return return_statement(parser);
     }
     
+    if (match(parser, TOKEN_IF)) {
+        return if_statement(parser);
+    }
+    
+    if (match(parser, TOKEN_WHILE)) {
+        return while_statement(parser);
+    }
+    
+    if (match(parser, TOKEN_FOR)) {
+        return for_statement(parser);
+    }
+    
+    if (match(parser, TOKEN_LBRACE)) {
+        return block(parser);
+    }
+    
     return expression_statement(parser);
 }
 
+// Parse statements, bounding how deeply they nest
+static ASTNode* statement(Parser* parser) {
+    if (!enter_nesting(parser)) return NULL;
+    ASTNode* stmt = nested_statement(parser);
+    parser->depth--;
+    return stmt;
+}
+
+// Parse a function after its name; `infer_return` picks int or void from
+// whether the body returns a value (for `function name(...)` without a type)
+static ASTNode* function_declaration(Parser* parser, TokenType return_type, bool infer_return) {
+    char* name = previous_name(parser);
+    if (!name) return NULL;
+    
+    if (parser->function_depth > 0) {
+        parser_error(parser, "Functions can only be declared at top level");
+        return NULL;
+    }
+    
+    consume(parser, TOKEN_LPAREN, "Expected '(' after function name");
+    
+    char* parameters[PARSER_MAX_PARAMETERS];
+    TokenType param_types[PARSER_MAX_PARAMETERS];
+    int param_count = 0;
+    if (!check(parser, TOKEN_RPAREN)) {
+        do {
+            // Untyped parameters default to int
+            TokenType type = match_type(parser) ? parser->previous.type : TOKEN_INT;
+            if (!consume(parser, TOKEN_IDENTIFIER, "Expected parameter name")) return NULL;
+            if (param_count == PARSER_MAX_PARAMETERS) {
+                parser_error(parser, "Too many parameters");
+                return NULL;
+            }
+            
+            char* param = previous_name(parser);
+            if (!param) return NULL;
+            parameters[param_count] = param;
+            param_types[param_count] = type;
+            param_count++;
+        } while (match(parser, TOKEN_COMMA));
+    }
+    consume(parser, TOKEN_RPAREN, "Expected ')' after parameters");
+    if (!consume(parser, TOKEN_LBRACE, "Expected '{' before function body")) return NULL;
+    
+    parser->function_depth++;
+    parser->returns_value = false;
+    ASTNode* body = block(parser);
+    parser->function_depth--;
+    
+    if (infer_return) {
+        return_type = parser->returns_value ? TOKEN_INT : TOKEN_VOID_KW;
+    } else if (return_type == TOKEN_VOID_KW && parser->returns_value) {
+        parser_error(parser, "Void function cannot return a value");
+    }
+    
+    ASTNode* function = ast_create_function(parser, name, body);
+    if (!function) return NULL;
+    function->data.func_decl.return_type = return_type;
+    function->data.func_decl.param_count = param_count;
+    if (param_count > 0) {
+        function->data.func_decl.parameters = arena_alloc(parser->arena, sizeof(char*) * param_count);
+        function->data.func_decl.param_types = arena_alloc(parser->arena, sizeof(TokenType) * param_count);
+        if (!function->data.func_decl.parameters || !function->data.func_decl.param_types) return NULL;
+        memcpy(function->data.func_decl.parameters, parameters, sizeof(char*) * param_count);
+        memcpy(function->data.func_decl.param_types, param_types, sizeof(TokenType) * param_count);
+    }
+    return function;
+}
+
 // Parse declarations
 static ASTNode* declaration(Parser* parser) {
-    if (match(parser, TOKEN_INT) || match(parser, TOKEN_FLOAT_KW) || 
-        match(parser, TOKEN_STRING_KW) || match(parser, TOKEN_BOOL_KW)) {
-        return var_declaration(parser);
+    // 📊 before a function profiles it even without --profile
+    if (match(parser, (TokenType)TOKEN_ANALYTICS)) {
+        while (match(parser, (TokenType)TOKEN_ANALYTICS)) {}
+        ASTNode* function = declaration(parser);
+        if (function && function->type != AST_FUNCTION_DECL) {
+            parser_error(parser, "Expected a function declaration after the profiling mark");
+            return NULL;
+        }
+        if (function) function->data.func_decl.profiled = true;
+        return function;
+    }
+    
+    // function name(...) { }  or  function float name(...) { }
+    if (match(parser, TOKEN_FUNCTION)) {
+        bool typed = match_type(parser) || match(parser, TOKEN_VOID_KW);
+        TokenType type = typed ? parser->previous.type : TOKEN_INT;
+        if (!consume(parser, TOKEN_IDENTIFIER, "Expected function name")) return NULL;
+        return function_declaration(parser, type, !typed);
+    }
+    
+    // int x = 1;  or  int name(...) { }
+    if (match_type(parser) || match(parser, TOKEN_VOID_KW)) {
+        TokenType type = parser->previous.type;
+        if (!consume(parser, TOKEN_IDENTIFIER, "Expected variable name")) return NULL;
+        
+        if (check(parser, TOKEN_LPAREN)) {
+            return function_declaration(parser, type, false);
+        }
+        if (type == TOKEN_VOID_KW) {
+            parser_error(parser, "Variables cannot be declared void");
+            return NULL;
+        }
+        return var_declaration(parser, type);
     }
     
     return statement(parser);
@@ -458,30 +875,64 @@ ASTNode* parser_parse(Parser* parser) {
     ASTNode* program = ast_allocate(parser, AST_PROGRAM);
     if (!program) return NULL;
     
-    // Temporary array for statements (in a real implementation, use dynamic array)
-    ASTNode** statements = arena_alloc(parser->arena, sizeof(ASTNode*) * 1000);
-    int statement_count = 0;
+    NodeList statements = {0};
     
+    // Tokens are lexed on demand, so each declaration's time includes its lexing
+    TraceScope parse;
+    trace_phase_begin(&parse);
     while (!check(parser, TOKEN_EOF) && !parser->had_error) {
-        // Skip newlines between declarations/statements
-        if (match(parser, TOKEN_NEWLINE)) {
-            continue;
-        }
-        
+        TraceScope scope;
+        trace_begin(&scope);
         ASTNode* decl = declaration(parser);
-        if (decl) {
-            statements[statement_count++] = decl;
+        if (decl && decl->type == AST_FUNCTION_DECL) {
+            trace_end(&scope, "function", decl->data.func_decl.name);
+        } else {
+            trace_end(&scope, "statement", NULL);
+        }
+        if (decl && !node_list_push(&statements, decl)) {
+            free(statements.items);
+            return NULL;
+        }
+        if (decl && parser->declaration_hook && !parser->had_error) {
+            parser->declaration_hook(parser->declaration_context, decl);
         }
         
         if (parser->panic_mode) synchronize(parser);
     }
     
-    program->data.program.statements = statements;
-    program->data.program.statement_count = statement_count;
+    program->data.program.statement_count = statements.count;
+    program->data.program.statements = node_list_finish(parser, &statements);
+    parser->parse_time = trace_phase_end(&parse, "parse", NULL);
+    if (!program->data.program.statements) return NULL;
     
     return program;
 }
 
+// Nothing outlives a declaration but what the hook copied out of it, so
+// its nodes are released as soon as the hook returns and the arena never
+// holds more than the largest declaration
+bool parser_parse_each(Parser* parser, ParserDeclarationHook hook, void* context) {
+    TraceScope parse;
+    trace_phase_begin(&parse);
+    while (!check(parser, TOKEN_EOF) && !parser->had_error) {
+        ArenaMark mark = arena_mark(parser->arena);
+        TraceScope scope;
+        trace_begin(&scope);
+        ASTNode* decl = declaration(parser);
+        if (decl && decl->type == AST_FUNCTION_DECL) {
+            trace_end(&scope, "function", decl->data.func_decl.name);
+        } else {
+            trace_end(&scope, "statement", NULL);
+        }
+        if (decl && !parser->had_error) hook(context, decl);
+        arena_rewind(parser->arena, mark);
+        
+        if (parser->panic_mode) synchronize(parser);
+    }
+    parser->parse_time = trace_phase_end(&parse, "parse", NULL);
+    return !parser->had_error;
+}
+
 // ================== UTILITY FUNCTIONS ==================
 
 bool parser_has_error(const Parser* parser) {
@@ -493,8 +944,7 @@ const char* parser_get_error(const Parser* parser) {
 }
 
 double parser_get_parse_time(const Parser* parser) {
-    double current_time = (double)clock() / CLOCKS_PER_SEC;
-    return current_time - parser->parse_start_time;
+    return parser->parse_time;
 }
 
 int parser_get_nodes_created(const Parser* parser) {
@@ -515,12 +965,24 @@ void ast_print(const ASTNode* node, int indent) {
                 case TOKEN_INTEGER:
                     printf("%lld", node->data.literal.value.int_value);
                     break;
-                case TOKEN_FLOAT:
-                    printf("%g", node->data.literal.value.float_value);
+                case TOKEN_FLOAT: {
+                    char number[DTOA_BUFFER_SIZE];
+                    dtoa_shortest(node->data.literal.value.float_value, number);
+                    fputs(number, stdout);
                     break;
+                }
                 case TOKEN_STRING:
                     printf("\"%s\"", node->data.literal.value.string_value);
                     break;
+                case TOKEN_TRUE:
+                    printf("true");
+                    break;
+                case TOKEN_FALSE:
+                    printf("false");
+                    break;
+                case TOKEN_NULL:
+                    printf("null");
+                    break;
                 default:
                     printf("(unknown)");
                     break;
@@ -538,6 +1000,30 @@ void ast_print(const ASTNode* node, int indent) {
             ast_print(node->data.binary.right, indent + 1);
             break;
             
+        case AST_UNARY:
+            printf("Unary: %s%s\n", token_type_to_string(node->data.unary.operator),
+                   node->data.unary.postfix ? " (postfix)" : "");
+            ast_print(node->data.unary.operand, indent + 1);
+            break;
+            
+        case AST_ASSIGNMENT:
+            printf("Assignment: %s\n", token_type_to_string(node->data.binary.operator));
+            ast_print(node->data.binary.left, indent + 1);
+            ast_print(node->data.binary.right, indent + 1);
+            break;
+            
+        case AST_CALL:
+            printf("Call: %s (%d arguments)\n", node->data.call.name, node->data.call.arg_count);
+            for (int i = 0; i < node->data.call.arg_count; i++) {
+                ast_print(node->data.call.arguments[i], indent + 1);
+            }
+            break;
+            
+        case AST_EXPRESSION_STMT:
+            printf("ExprStmt\n");
+            ast_print(node->data.binary.left, indent + 1);
+            break;
+            
         case AST_VAR_DECLARATION:
             printf("VarDecl: %s %s\n", 
                    token_type_to_string(node->data.var_decl.type),
@@ -547,6 +1033,51 @@ void ast_print(const ASTNode* node, int indent) {
             }
             break;
             
+        case AST_FUNCTION_DECL:
+            printf("Function: %s %s(", token_type_to_string(node->data.func_decl.return_type),
+                   node->data.func_decl.name);
+            for (int i = 0; i < node->data.func_decl.param_count; i++) {
+                printf("%s%s %s", i ? ", " : "",
+                       token_type_to_string(node->data.func_decl.param_types[i]),
+                       node->data.func_decl.parameters[i]);
+            }
+            printf(")\n");
+            ast_print(node->data.func_decl.body, indent + 1);
+            break;
+            
+        case AST_IF_STMT:
+            printf("If\n");
+            ast_print(node->data.if_stmt.condition, indent + 1);
+            ast_print(node->data.if_stmt.then_stmt, indent + 1);
+            ast_print(node->data.if_stmt.else_stmt, indent + 1);
+            break;
+            
+        case AST_WHILE_STMT:
+            printf("While\n");
+            ast_print(node->data.while_stmt.condition, indent + 1);
+            ast_print(node->data.while_stmt.body, indent + 1);
+            break;
+            
+        case AST_FOR_STMT:
+            printf("For\n");
+            ast_print(node->data.for_stmt.initializer, indent + 1);
+            ast_print(node->data.for_stmt.condition, indent + 1);
+            ast_print(node->data.for_stmt.update, indent + 1);
+            ast_print(node->data.for_stmt.body, indent + 1);
+            break;
+            
+        case AST_RETURN_STMT:
+            printf("Return\n");
+            ast_print(node->data.return_stmt.value, indent + 1);
+            break;
+            
+        case AST_BLOCK_STMT:
+            printf("Block (%d statements)\n", node->data.block.statement_count);
+            for (int i = 0; i < node->data.block.statement_count; i++) {
+                ast_print(node->data.block.statements[i], indent + 1);
+            }
+            break;
+            
         case AST_PROGRAM:
             printf("Program (%d statements)\n", node->data.program.statement_count);
             for (int i = 0; i < node->data.program.statement_count; i++) {
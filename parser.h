@@ -66,6 +66,7 @@ typedef struct ASTNode {
         struct {
             TokenType operator;
             ASTNode* operand;
+            bool postfix;    // x++ rather than ++x
         } unary;
         
         // Variable declarations (int x = 42;)
@@ -78,10 +79,12 @@ typedef struct ASTNode {
         // Function declarations
         struct {
             char* name;
+            TokenType return_type;  // int, float, ..., TOKEN_VOID_KW
             char** parameters;  // parameter names
             TokenType* param_types;  // parameter types
             int param_count;
             ASTNode* body;  // function body
+            bool profiled;  // Marked with 📊 for instrumentation
         } func_decl;
         
         // Class declarations
@@ -108,9 +111,9 @@ typedef struct ASTNode {
         
         // For loops
         struct {
-            ASTNode* initializer;  // int i = 0
-            ASTNode* condition;    // i < 10
-            ASTNode* update;       // i++
+            ASTNode* initializer;  // int i = 0 (declaration or expression statement)
+            ASTNode* condition;    // i < 10, optional
+            ASTNode* update;       // i++, optional expression
             ASTNode* body;         // loop body
         } for_stmt;
         
@@ -142,6 +145,20 @@ typedef struct ASTNode {
 
 // ================== PARSER STRUCTURE ==================
 
+// Deepest nesting of expressions and statements the parser accepts; an
+// expression level costs about a dozen frames, so this stays well inside
+// a default 8 MB stack
+#define PARSER_MAX_DEPTH 10000
+
+// Supplies the tokens after the first in place of lexer_next_token, for a
+// lexer running on another thread; for a TOKEN_ERROR, *error is set to
+// the lexer's message
+typedef Token (*ParserTokenSource)(void* context, const char** error);
+
+// Receives each top-level declaration as soon as it is parsed, while the
+// parse has had no error
+typedef void (*ParserDeclarationHook)(void* context, const ASTNode* declaration);
+
 typedef struct {
     Lexer* lexer;           // The lexer that provides tokens
     Token current;          // Current token being processed
@@ -149,23 +166,43 @@ typedef struct {
     bool had_error;         // Error flag
     bool panic_mode;        // Panic mode for error recovery
     char error_message[256]; // Error message storage
+    char error_detail[256]; // Error message without the location prefix
+    Position error_pos;     // Location of the first error
     
     // Memory management
     Arena* arena;           // Arena for AST nodes
     
+    // Function being parsed
+    int function_depth;     // Nonzero inside a function body
+    bool returns_value;     // Current function has a `return expr;`
+    int depth;              // Nesting of expressions and statements being parsed
+    
+    // Pipelining; both NULL unless set after parser_set_lexer
+    ParserTokenSource token_source;
+    void* token_context;
+    ParserDeclarationHook declaration_hook;
+    void* declaration_context;
+    
     // Performance tracking
     int nodes_created;      // Number of AST nodes created
-    double parse_start_time; // Parsing start time
+    double parse_time;      // Seconds in the last parser_parse
 } Parser;
 
 // ================== PARSER FUNCTIONS ==================
 
 // Core parser functions
 Parser* parser_create(Lexer* lexer);
+void parser_reset(Parser* parser, Lexer* lexer);
+void parser_set_lexer(Parser* parser, Lexer* lexer);
 void parser_destroy(Parser* parser);
 ASTNode* parser_parse(Parser* parser);
+void parser_set_token_source(Parser* parser, ParserTokenSource source, void* context);
+void parser_set_declaration_hook(Parser* parser, ParserDeclarationHook hook, void* context);
+// Parses without building a program: each top-level declaration goes to
+// hook and is then freed. False on a syntax error.
+bool parser_parse_each(Parser* parser, ParserDeclarationHook hook, void* context);
 
-// AST node creation
+// AST node creation; names are stored as given and must live as long as the AST
 ASTNode* ast_create_literal(Parser* parser, TokenType type, Token token);
 ASTNode* ast_create_identifier(Parser* parser, char* name);
 ASTNode* ast_create_binary(Parser* parser, ASTNode* left, TokenType op, ASTNode* right);
@@ -175,8 +212,10 @@ ASTNode* ast_create_function(Parser* parser, char* name, ASTNode* body);
 ASTNode* ast_create_class(Parser* parser, char* name);
 ASTNode* ast_create_if(Parser* parser, ASTNode* condition, ASTNode* then_stmt, ASTNode* else_stmt);
 ASTNode* ast_create_while(Parser* parser, ASTNode* condition, ASTNode* body);
+ASTNode* ast_create_for(Parser* parser, ASTNode* init, ASTNode* condition, ASTNode* update, ASTNode* body);
 ASTNode* ast_create_return(Parser* parser, ASTNode* value);
 ASTNode* ast_create_block(Parser* parser);
+ASTNode* ast_create_call(Parser* parser, char* name);
 
 // AST utilities
 void ast_print(const ASTNode* node, int indent);
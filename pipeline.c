@@ -0,0 +1,282 @@
+#define _POSIX_C_SOURCE 200809L
+#include "pipeline.h"
+#include "timer.h"
+#include "trace.h"
+#include <stdlib.h>
+#include <string.h>
+
+// ================== SPSC RING ==================
+//
+// head and tail only grow; a slot is tail % capacity. Each side stores its
+// own index and loads the other's, all sequentially consistent, so a slot
+// written before publishing is visible to the side that sees the new
+// index. A waker checks sleepers after storing its index and a sleeper
+// re-checks the index after counting itself, so no wakeup is lost.
+
+static bool ring_init(PipelineRing* ring, size_t capacity) {
+    memset(ring, 0, sizeof(*ring));
+    ring->capacity = capacity;
+    if (pthread_mutex_init(&ring->lock, NULL) != 0) return false;
+    if (pthread_cond_init(&ring->moved, NULL) != 0) {
+        pthread_mutex_destroy(&ring->lock);
+        return false;
+    }
+    return true;
+}
+
+static void ring_destroy(PipelineRing* ring) {
+    pthread_cond_destroy(&ring->moved);
+    pthread_mutex_destroy(&ring->lock);
+}
+
+static size_t ring_load(const size_t* index) {
+    return __atomic_load_n(index, __ATOMIC_SEQ_CST);
+}
+
+static bool ring_stopped(PipelineRing* ring) {
+    return __atomic_load_n(&ring->stopped, __ATOMIC_SEQ_CST);
+}
+
+static void ring_wake(PipelineRing* ring) {
+    if (__atomic_load_n(&ring->sleepers, __ATOMIC_SEQ_CST) == 0) return;
+    pthread_mutex_lock(&ring->lock);
+    pthread_cond_broadcast(&ring->moved);
+    pthread_mutex_unlock(&ring->lock);
+}
+
+// A slot to fill for the producer, one to consume for the consumer
+static bool ring_ready(PipelineRing* ring, bool producer) {
+    size_t head = ring_load(&ring->head), tail = ring_load(&ring->tail);
+    return producer ? tail - head < ring->capacity : head != tail;
+}
+
+// False if the ring was stopped before it became ready
+static bool ring_wait(PipelineRing* ring, bool producer) {
+    for (int spin = 0; spin < PIPELINE_SPIN; spin++) {
+        if (ring_ready(ring, producer)) return true;
+        if (ring_stopped(ring)) return false;
+    }
+
+    if (producer) ring->producer_waits++;
+    else ring->consumer_waits++;
+    pthread_mutex_lock(&ring->lock);
+    __atomic_add_fetch(&ring->sleepers, 1, __ATOMIC_SEQ_CST);
+    while (!ring_ready(ring, producer) && !ring_stopped(ring)) {
+        pthread_cond_wait(&ring->moved, &ring->lock);
+    }
+    __atomic_sub_fetch(&ring->sleepers, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&ring->lock);
+    return ring_ready(ring, producer);
+}
+
+// Slot to fill, -1 once stopped
+static long ring_reserve(PipelineRing* ring) {
+    if (!ring_wait(ring, true)) return -1;
+    return (long)(ring->tail % ring->capacity);
+}
+
+static void ring_publish(PipelineRing* ring) {
+    __atomic_store_n(&ring->tail, ring->tail + 1, __ATOMIC_SEQ_CST);
+    ring_wake(ring);
+}
+
+// Slot to consume, -1 once stopped with nothing left
+static long ring_peek(PipelineRing* ring) {
+    if (!ring_wait(ring, false)) return -1;
+    return (long)(ring->head % ring->capacity);
+}
+
+static void ring_release(PipelineRing* ring) {
+    __atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_SEQ_CST);
+    ring_wake(ring);
+}
+
+static void ring_stop(PipelineRing* ring) {
+    __atomic_store_n(&ring->stopped, true, __ATOMIC_SEQ_CST);
+    pthread_mutex_lock(&ring->lock);
+    pthread_cond_broadcast(&ring->moved);
+    pthread_mutex_unlock(&ring->lock);
+}
+
+// ================== STAGES ==================
+
+typedef struct {
+    Lexer* lexer;
+    PipelineRing tokens;
+    TokenBlock* blocks;
+    TokenBlock* block;          // Parser's current block, NULL before the first
+    int next;                   // Parser's position in it
+    Token eof;                  // Returned again after the end
+    bool at_eof;
+    double lex_time;
+
+    CodeGenerator* codegen;
+    CodegenStream* stream;
+    PipelineRing declarations;
+    const ASTNode** slots;      // NULL ends the stream
+    bool codegen_thread;
+    uint64_t declaration_count;
+} Pipeline;
+
+// Newlines mean nothing to the parser, so they never enter a block. A
+// block also ends after an error token, which keeps the message with it.
+static void* lexer_main(void* arg) {
+    Pipeline* pipeline = arg;
+    trace_thread_name("lexer");
+    TraceScope scope;
+    trace_phase_begin(&scope);
+    bool done = false;
+    while (!done) {
+        long slot = ring_reserve(&pipeline->tokens);
+        if (slot < 0) break;
+        TokenBlock* block = &pipeline->blocks[slot];
+        block->count = 0;
+        while (block->count < PIPELINE_BLOCK_TOKENS) {
+            Token token = lexer_next_token(pipeline->lexer);
+            if (token.type == TOKEN_NEWLINE) continue;
+            block->tokens[block->count++] = token;
+            if (token.type == TOKEN_ERROR) {
+                snprintf(block->error, sizeof(block->error), "%s", lexer_get_error(pipeline->lexer));
+                break;
+            }
+            if (token.type == TOKEN_EOF) {
+                done = true;
+                break;
+            }
+        }
+        ring_publish(&pipeline->tokens);
+    }
+    pipeline->lex_time = trace_phase_end(&scope, "lex", NULL);
+    return NULL;
+}
+
+static Token next_token(void* context, const char** error) {
+    Pipeline* pipeline = context;
+    if (pipeline->at_eof) return pipeline->eof;
+    if (!pipeline->block || pipeline->next == pipeline->block->count) {
+        if (pipeline->block) ring_release(&pipeline->tokens);
+        long slot = ring_peek(&pipeline->tokens);
+        if (slot < 0) {
+            // Only if the pipeline was stopped under the parser
+            pipeline->at_eof = true;
+            pipeline->eof.type = TOKEN_EOF;
+            return pipeline->eof;
+        }
+        pipeline->block = &pipeline->blocks[slot];
+        pipeline->next = 0;
+    }
+
+    Token token = pipeline->block->tokens[pipeline->next++];
+    if (token.type == TOKEN_ERROR) *error = pipeline->block->error;
+    if (token.type == TOKEN_EOF) {
+        pipeline->at_eof = true;
+        pipeline->eof = token;
+    }
+    return token;
+}
+
+static void* codegen_main(void* arg) {
+    Pipeline* pipeline = arg;
+    trace_thread_name("codegen");
+    for (;;) {
+        long slot = ring_peek(&pipeline->declarations);
+        if (slot < 0) break;
+        const ASTNode* declaration = pipeline->slots[slot];
+        ring_release(&pipeline->declarations);
+        if (!declaration) break;
+        codegen_stream_declaration(pipeline->codegen, pipeline->stream, declaration);
+    }
+    return NULL;
+}
+
+static void hand_over(void* context, const ASTNode* declaration) {
+    Pipeline* pipeline = context;
+    pipeline->declaration_count++;
+    if (!pipeline->codegen_thread) {
+        codegen_stream_declaration(pipeline->codegen, pipeline->stream, declaration);
+        return;
+    }
+    long slot = ring_reserve(&pipeline->declarations);
+    if (slot < 0) return;
+    pipeline->slots[slot] = declaration;
+    ring_publish(&pipeline->declarations);
+}
+
+// ================== DRIVER ==================
+
+ASTNode* pipeline_parse(Parser* parser, CodeGenerator* codegen, CodegenStream* stream,
+                        PipelineStats* stats) {
+    memset(stats, 0, sizeof(*stats));
+    double start = timer_now();
+    Pipeline* pipeline = calloc(1, sizeof(Pipeline));
+    TokenBlock* blocks = malloc(sizeof(TokenBlock) * PIPELINE_TOKEN_BLOCKS);
+    const ASTNode** slots = malloc(sizeof(const ASTNode*) * PIPELINE_DECLARATIONS);
+    if (!pipeline || !blocks || !slots) {
+        free(pipeline);
+        free(blocks);
+        free(slots);
+        return NULL;
+    }
+    pipeline->lexer = parser->lexer;
+    pipeline->blocks = blocks;
+    pipeline->slots = slots;
+    pipeline->codegen = codegen;
+    pipeline->stream = stream;
+
+    // A stage whose thread cannot start runs inline on the parser's thread
+    pthread_t lexer_thread, codegen_thread;
+    if (ring_init(&pipeline->tokens, PIPELINE_TOKEN_BLOCKS)) {
+        stats->lexer_thread = pthread_create(&lexer_thread, NULL, lexer_main, pipeline) == 0;
+        if (!stats->lexer_thread) ring_destroy(&pipeline->tokens);
+    }
+    if (ring_init(&pipeline->declarations, PIPELINE_DECLARATIONS)) {
+        pipeline->codegen_thread = pthread_create(&codegen_thread, NULL, codegen_main, pipeline) == 0;
+        if (!pipeline->codegen_thread) ring_destroy(&pipeline->declarations);
+    }
+    stats->codegen_thread = pipeline->codegen_thread;
+    if (stats->lexer_thread) parser_set_token_source(parser, next_token, pipeline);
+    parser_set_declaration_hook(parser, hand_over, pipeline);
+
+    ASTNode* program = parser_parse(parser);
+
+    // After an error the lexer may still be filling blocks nobody will read
+    if (stats->lexer_thread) {
+        ring_stop(&pipeline->tokens);
+        pthread_join(lexer_thread, NULL);
+        stats->token_blocks = pipeline->tokens.tail;
+        stats->lexer_waits = pipeline->tokens.producer_waits;
+        stats->parser_waits = pipeline->tokens.consumer_waits;
+        stats->lex_time = pipeline->lex_time;
+        ring_destroy(&pipeline->tokens);
+    }
+    if (pipeline->codegen_thread) {
+        long slot = ring_reserve(&pipeline->declarations);
+        pipeline->slots[slot] = NULL;
+        ring_publish(&pipeline->declarations);
+        pthread_join(codegen_thread, NULL);
+        stats->codegen_waits = pipeline->declarations.consumer_waits;
+        ring_destroy(&pipeline->declarations);
+    }
+    parser_set_token_source(parser, NULL, NULL);
+    parser_set_declaration_hook(parser, NULL, NULL);
+    stats->declarations = pipeline->declaration_count;
+    stats->parse_time = timer_now() - start;
+
+    free(pipeline);
+    free(blocks);
+    free(slots);
+    return program;
+}
+
+void pipeline_print(const PipelineStats* stats, FILE* stream) {
+    fprintf(stream, ">> PIPELINE:\n");
+    fprintf(stream, "   Threads: lexer %s, codegen %s\n",
+                    stats->lexer_thread ? "own thread" : "inline", stats->codegen_thread ? "own thread" : "inline");
+    fprintf(stream, "   Lex + parse + codegen of declarations: %.4f seconds (lexer busy %.4f)\n",
+                    stats->parse_time, stats->lex_time);
+    fprintf(stream, "   Handed over: %llu token blocks, %llu declarations\n",
+                    (unsigned long long)stats->token_blocks, (unsigned long long)stats->declarations);
+    fprintf(stream, "   Stalls: lexer %llu (ring full), parser %llu (no tokens), codegen %llu (no declarations)\n",
+                    (unsigned long long)stats->lexer_waits, (unsigned long long)stats->parser_waits,
+                    (unsigned long long)stats->codegen_waits);
+}
@@ -0,0 +1,67 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "lexer.h"
+#include "parser.h"
+#include "codegen.h"
+#include <stdio.h>
+#include <pthread.h>
+
+// ================== PIPELINED COMPILE ==================
+//
+// `--pipeline` runs the three phases at once: a lexer thread fills blocks
+// of tokens, the parser takes them on the calling thread, and each
+// top-level declaration goes to a codegen thread as soon as it is parsed.
+// Blocks and declarations travel through single-producer single-consumer
+// rings; a stage spins briefly when its ring is empty (or full) and then
+// sleeps until the other side moves. Code generation streams with
+// codegen_stream_*, so the output is what a sequential compile writes.
+
+#define PIPELINE_BLOCK_TOKENS 1024
+#define PIPELINE_TOKEN_BLOCKS 16        // Power of two
+#define PIPELINE_DECLARATIONS 1024      // Power of two
+#define PIPELINE_SPIN 128               // Polls before a stage sleeps
+
+// Indices only; the slots live with whoever owns the ring
+typedef struct {
+    size_t head;                // Next slot to consume; written by the consumer
+    char pad_head[64 - sizeof(size_t)];
+    size_t tail;                // Next slot to fill; written by the producer
+    char pad_tail[64 - sizeof(size_t)];
+    size_t capacity;
+    int sleepers;               // Threads in pthread_cond_wait
+    bool stopped;               // Both sides give up waiting
+    uint64_t producer_waits;    // Times the ring was full
+    uint64_t consumer_waits;    // Times the ring was empty
+    pthread_mutex_t lock;       // Only for sleeping
+    pthread_cond_t moved;
+} PipelineRing;
+
+typedef struct {
+    int count;
+    char error[256];            // The lexer's message when the last token is a TOKEN_ERROR
+    Token tokens[PIPELINE_BLOCK_TOKENS];
+} TokenBlock;
+
+typedef struct {
+    bool lexer_thread;          // False if the thread could not start; lexed inline
+    bool codegen_thread;
+    uint64_t token_blocks;
+    uint64_t declarations;
+    uint64_t lexer_waits;       // Token ring full
+    uint64_t parser_waits;      // Token ring empty
+    uint64_t codegen_waits;     // Declaration ring empty
+    double lex_time;            // Seconds the lexer thread was lexing
+    double parse_time;          // Wall-clock seconds of the whole pipeline
+} PipelineStats;
+
+// Parses parser's program (parser_create or parser_set_lexer already
+// done) while generating each declaration into stream, which must have
+// been begun. Returns what parser_parse returns; the caller finishes the
+// stream only if the parse succeeded.
+ASTNode* pipeline_parse(Parser* parser, CodeGenerator* codegen, CodegenStream* stream,
+                        PipelineStats* stats);
+
+void pipeline_print(const PipelineStats* stats, FILE* stream);
+
+#endif
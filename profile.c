@@ -0,0 +1,123 @@
+#include "profile.h"
+#include "hash.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// ================== LOADING ==================
+
+static bool profile_error(ProfileData* data, const char* path, int line, const char* message) {
+    snprintf(data->error_message, sizeof(data->error_message), "%s:%d: %s", path, line, message);
+    return false;
+}
+
+static ProfileFunction* add_function(ProfileData* data) {
+    if (data->count == data->capacity) {
+        int capacity = data->capacity ? data->capacity * 2 : 16;
+        ProfileFunction* functions = realloc(data->functions, sizeof(ProfileFunction) * (size_t)capacity);
+        if (!functions) return NULL;
+        data->functions = functions;
+        data->capacity = capacity;
+    }
+    ProfileFunction* function = &data->functions[data->count++];
+    memset(function, 0, sizeof(*function));
+    return function;
+}
+
+static int compare_functions(const void* a, const void* b) {
+    return strcmp(((const ProfileFunction*)a)->name, ((const ProfileFunction*)b)->name);
+}
+
+static bool read_lines(ProfileData* data, FILE* file, const char* path) {
+    char line[PROFILE_MAX_LINE];
+    char name[PROFILE_MAX_LINE];
+    ProfileFunction* function = NULL;
+    int number = 0;
+
+    while (fgets(line, sizeof(line), file)) {
+        number++;
+        data->checksum = hash_bytes(line, strlen(line), data->checksum);
+        if (!strchr(line, '\n') && !feof(file)) {
+            return profile_error(data, path, number, "Line too long");
+        }
+
+        char unit[16], scope[16];
+        int site, branches;
+        unsigned long long calls, self, total, taken, not_taken;
+        if (number == 1) {
+            if (sscanf(line, "# shaynefro profile 1 %15s %15s", unit, scope) != 2) {
+                return profile_error(data, path, number, "Not a shaynefro profile");
+            }
+            data->complete = strcmp(scope, "all") == 0;
+        } else if (line[0] == '#' || line[0] == '\n') {
+            continue;
+        } else if (sscanf(line, "function %s %llu %llu %llu %d", name, &calls, &self, &total, &branches) == 5) {
+            if (branches < 0 || branches > 1 << 20) {
+                return profile_error(data, path, number, "Bad branch count");
+            }
+            function = add_function(data);
+            if (!function) return profile_error(data, path, number, "Out of memory");
+            function->name = malloc(strlen(name) + 1);
+            function->branches = branches ? calloc((size_t)branches, sizeof(*function->branches)) : NULL;
+            if (!function->name || (branches && !function->branches)) {
+                return profile_error(data, path, number, "Out of memory");
+            }
+            strcpy(function->name, name);
+            function->calls = calls;
+            function->self = self;
+            function->total = total;
+            function->branch_count = branches;
+        } else if (sscanf(line, "branch %d %llu %llu", &site, &taken, &not_taken) == 3) {
+            if (!function || site < 0 || site >= function->branch_count) {
+                return profile_error(data, path, number, "Branch outside a function");
+            }
+            function->branches[site][0] = taken;
+            function->branches[site][1] = not_taken;
+        } else {
+            return profile_error(data, path, number, "Unrecognised line");
+        }
+    }
+    if (number == 0) return profile_error(data, path, 0, "Empty profile");
+    return true;
+}
+
+bool profile_load(ProfileData* data, const char* path) {
+    memset(data, 0, sizeof(*data));
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        snprintf(data->error_message, sizeof(data->error_message), "Cannot open profile: %s", path);
+        return false;
+    }
+    bool loaded = read_lines(data, file, path);
+    fclose(file);
+    if (!loaded) {
+        char message[sizeof(data->error_message)];
+        memcpy(message, data->error_message, sizeof(message));
+        profile_free(data);
+        memcpy(data->error_message, message, sizeof(message));
+        return false;
+    }
+
+    data->total_self = 0;
+    for (int i = 0; i < data->count; i++) {
+        data->total_self += data->functions[i].self;
+    }
+    qsort(data->functions, (size_t)data->count, sizeof(ProfileFunction), compare_functions);
+    return true;
+}
+
+void profile_free(ProfileData* data) {
+    for (int i = 0; i < data->count; i++) {
+        free(data->functions[i].name);
+        free(data->functions[i].branches);
+    }
+    free(data->functions);
+    memset(data, 0, sizeof(*data));
+}
+
+const ProfileFunction* profile_find(const ProfileData* data, const char* name) {
+    if (!data || data->count == 0) return NULL;
+    ProfileFunction key;
+    key.name = (char*)name;
+    return bsearch(&key, data->functions, (size_t)data->count, sizeof(ProfileFunction), compare_functions);
+}
@@ -0,0 +1,48 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// ================== PROFILE DATA ==================
+//
+// What a --profile build writes at exit, read back for --profile-use:
+//
+//   # shaynefro profile 1 <cycles|ns> <all|marked>
+//   function <name> <calls> <self> <total> <branches>
+//   branch <site> <taken> <not taken>
+//
+// Branch lines follow their function; sites are the function's if, while
+// and for conditions in source order. "all" means every function was
+// instrumented, so one that is missing never ran.
+
+#define PROFILE_MAX_LINE 1024
+
+typedef struct {
+    char* name;
+    unsigned long long calls;
+    unsigned long long self;        // Time in the function itself
+    unsigned long long total;       // Including callees
+    int branch_count;
+    unsigned long long (*branches)[2];  // Taken and not taken, per site
+} ProfileFunction;
+
+typedef struct {
+    ProfileFunction* functions;     // Sorted by name
+    int count;
+    int capacity;
+    bool complete;                  // Written with every function instrumented
+    unsigned long long total_self;  // Sum over all functions
+    uint64_t checksum;              // Of the file, for cache keys
+    char error_message[256];
+} ProfileData;
+
+// False with error_message set if the file is missing or malformed
+bool profile_load(ProfileData* data, const char* path);
+void profile_free(ProfileData* data);
+
+// NULL if the function never ran (or was not instrumented)
+const ProfileFunction* profile_find(const ProfileData* data, const char* name);
+
+#endif
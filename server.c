@@ -0,0 +1,453 @@
+#define _POSIX_C_SOURCE 200809L
+#include "server.h"
+#include "timer.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+// ================== TRANSPORT ==================
+
+static bool read_full(int fd, void* data, size_t length) {
+    char* cursor = data;
+    while (length > 0) {
+        ssize_t got = read(fd, cursor, length);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) return false;
+        cursor += got;
+        length -= (size_t)got;
+    }
+    return true;
+}
+
+// MSG_NOSIGNAL: a client that hangs up must not kill the server
+static bool write_full(int fd, const void* data, size_t length) {
+    const char* cursor = data;
+    while (length > 0) {
+        ssize_t sent = send(fd, cursor, length, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent <= 0) return false;
+        cursor += sent;
+        length -= (size_t)sent;
+    }
+    return true;
+}
+
+// A read or send that waits longer fails with EAGAIN, which read_full and
+// write_full treat as a lost connection
+static void socket_timeout(int fd, int seconds) {
+    struct timeval timeout = { seconds, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+}
+
+static bool socket_address(struct sockaddr_un* address, const char* path) {
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address->sun_path)) return false;
+    strcpy(address->sun_path, path);
+    return true;
+}
+
+void server_default_path(char* buffer, size_t size) {
+    const char* path = getenv("SHAYNEFRO_SOCKET");
+    const char* runtime = getenv("XDG_RUNTIME_DIR");
+    if (path && path[0]) {
+        snprintf(buffer, size, "%s", path);
+    } else if (runtime && runtime[0]) {
+        snprintf(buffer, size, "%s/shaynefro.sock", runtime);
+    } else {
+        snprintf(buffer, size, "/tmp/shaynefro-%ld.sock", (long)getuid());
+    }
+}
+
+// ================== SERVING ==================
+
+typedef struct {
+    ShayContext* ctx;
+    OutputBuffer output;
+    OutputBuffer response;      // Header and diagnostics
+    char* source;
+    size_t source_capacity;
+} ServerState;
+
+static void append_u32(OutputBuffer* out, uint32_t value) {
+    outbuf_append(out, (const char*)&value, sizeof(value));
+}
+
+static bool send_bad_request(int fd) {
+    uint32_t header[SERVER_RESPONSE_FIELDS] = { SERVER_MAGIC, SERVER_STATUS_BAD_REQUEST, 0, 0 };
+    return write_full(fd, header, sizeof(header));
+}
+
+static void record_request(ServerWorker* worker, bool compiled, size_t bytes_in, size_t bytes_out, double seconds) {
+    pthread_mutex_lock(&worker->server->lock);
+    worker->requests++;
+    worker->failures += !compiled;
+    worker->bytes_in += bytes_in;
+    worker->bytes_out += bytes_out;
+    if (worker->latencies) {
+        worker->latencies[worker->latency_count % SERVER_LATENCY_WINDOW] = seconds;
+    }
+    worker->latency_count++;
+    pthread_mutex_unlock(&worker->server->lock);
+}
+
+// One request; false once the connection is finished
+static bool serve_request(ServerWorker* worker, ServerState* state, int fd) {
+    uint32_t header[SERVER_REQUEST_FIELDS];
+    if (!read_full(fd, header, sizeof(header))) return false;
+    double start = timer_now();
+
+    uint32_t format = header[1], flatten = header[2], name_length = header[3], source_length = header[4];
+    if (header[0] != SERVER_MAGIC || format != OUTPUT_C || flatten > INT32_MAX ||
+        name_length > SERVER_MAX_NAME || source_length > SERVER_MAX_SOURCE) {
+        send_bad_request(fd);
+        return false;
+    }
+    if (source_length > state->source_capacity) {
+        char* source = realloc(state->source, source_length);
+        if (!source) {
+            send_bad_request(fd);
+            return false;
+        }
+        state->source = source;
+        state->source_capacity = source_length;
+    }
+    char name[SERVER_MAX_NAME + 1];
+    if (!read_full(fd, name, name_length) || !read_full(fd, state->source, source_length)) return false;
+    name[name_length] = '\0';
+
+    ShayOptions options = shaynefro_default_options();
+    options.format = (OutputFormat)format;
+    options.filename = name_length ? name : "<client>";
+    options.flatten_threshold = (int)flatten;
+    outbuf_clear(&state->output);
+    bool compiled = shaynefro_compile(state->ctx, state->source, source_length, &options, &state->output) &&
+                    !state->output.had_error;
+
+    int count = shaynefro_diagnostic_count(state->ctx);
+    uint32_t output_length = compiled ? (uint32_t)state->output.length : 0;
+    outbuf_clear(&state->response);
+    append_u32(&state->response, SERVER_MAGIC);
+    append_u32(&state->response, compiled ? SERVER_STATUS_OK : SERVER_STATUS_ERRORS);
+    append_u32(&state->response, (uint32_t)count);
+    append_u32(&state->response, output_length);
+    for (int i = 0; i < count; i++) {
+        const ShayDiagnostic* diagnostic = shaynefro_get_diagnostic(state->ctx, i);
+        size_t length = strlen(diagnostic->message);
+        append_u32(&state->response, (uint32_t)diagnostic->phase);
+        append_u32(&state->response, (uint32_t)diagnostic->line);
+        append_u32(&state->response, (uint32_t)diagnostic->column);
+        append_u32(&state->response, (uint32_t)length);
+        outbuf_append(&state->response, diagnostic->message, length);
+    }
+    bool sent = !state->response.had_error &&
+                write_full(fd, state->response.data, state->response.length) &&
+                write_full(fd, state->output.data, output_length);
+
+    record_request(worker, compiled, sizeof(header) + name_length + source_length,
+                   state->response.length + output_length, timer_now() - start);
+    return sent;
+}
+
+static void* server_worker_main(void* arg) {
+    ServerWorker* worker = arg;
+    CompileServer* server = worker->server;
+    ServerState state;
+    memset(&state, 0, sizeof(state));
+    state.ctx = shaynefro_context_create();
+    bool ready = state.ctx && outbuf_init(&state.output, -1) && outbuf_init(&state.response, -1);
+    if (ready && worker->cache) shaynefro_context_set_cache(state.ctx, worker->cache);
+
+    while (ready) {
+        int fd = accept(server->listen_fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            break;  // Shut down by server_stop
+        }
+        socket_timeout(fd, SERVER_IDLE_TIMEOUT);
+        pthread_mutex_lock(&server->lock);
+        bool stopping = server->stopping;
+        if (!stopping) worker->client_fd = fd;
+        pthread_mutex_unlock(&server->lock);
+        if (stopping) {
+            close(fd);
+            break;
+        }
+
+        while (serve_request(worker, &state, fd)) {}
+
+        pthread_mutex_lock(&server->lock);
+        worker->client_fd = -1;
+        pthread_mutex_unlock(&server->lock);
+        close(fd);
+    }
+
+    outbuf_free(&state.output);
+    outbuf_free(&state.response);
+    free(state.source);
+    shaynefro_context_destroy(state.ctx);
+    return NULL;
+}
+
+// ================== LIFECYCLE ==================
+
+static bool server_error(CompileServer* server, const char* message, const char* detail) {
+    snprintf(server->error_message, sizeof(server->error_message), "%s: %s", message, detail);
+    return false;
+}
+
+// Another server answering on path means it is taken; a socket file nobody
+// listens on is left over from a server that died, and is replaced
+static bool path_in_use(const struct sockaddr_un* address) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return false;
+    bool in_use = connect(fd, (const struct sockaddr*)address, sizeof(*address)) == 0;
+    close(fd);
+    return in_use;
+}
+
+bool server_start(CompileServer* server, const char* path, int threads, const char* cache_dir) {
+    memset(server, 0, sizeof(*server));
+    server->listen_fd = -1;
+    server->cache_dir = cache_dir;
+    server->thread_count = threads < 1 ? 1 : threads > SERVER_MAX_THREADS ? SERVER_MAX_THREADS : threads;
+    snprintf(server->socket_path, sizeof(server->socket_path), "%s", path);
+
+    struct sockaddr_un address;
+    if (!socket_address(&address, path)) return server_error(server, "Socket path too long", path);
+    if (path_in_use(&address)) return server_error(server, "A server is already listening on", path);
+    unlink(path);
+
+    server->listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server->listen_fd < 0) return server_error(server, "Cannot create socket", strerror(errno));
+    if (bind(server->listen_fd, (const struct sockaddr*)&address, sizeof(address)) != 0 ||
+        listen(server->listen_fd, SOMAXCONN) != 0) {
+        server_error(server, "Cannot listen on", path);
+        close(server->listen_fd);
+        server->listen_fd = -1;
+        return false;
+    }
+    chmod(path, 0600);  // Only this user may send code to compile
+    pthread_mutex_init(&server->lock, NULL);
+
+    // Workers leave SIGINT and SIGTERM to server_wait
+    sigset_t blocked, previous;
+    sigemptyset(&blocked);
+    sigaddset(&blocked, SIGINT);
+    sigaddset(&blocked, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &blocked, &previous);
+
+    int started = 0;
+    for (int t = 0; t < server->thread_count; t++) {
+        ServerWorker* worker = &server->workers[t];
+        worker->server = server;
+        worker->index = t;
+        worker->client_fd = -1;
+        worker->latencies = malloc(sizeof(double) * SERVER_LATENCY_WINDOW);
+        if (cache_dir) {
+            worker->cache = cache_open(cache_dir[0] ? cache_dir : NULL, 0);
+        }
+        worker->started = (!cache_dir || worker->cache) &&
+                          pthread_create(&worker->thread, NULL, server_worker_main, worker) == 0;
+        started += worker->started;
+    }
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+
+    server->start_time = timer_now();
+    if (started < server->thread_count) {
+        server_stop(server);
+        server_free(server);
+        snprintf(server->error_message, sizeof(server->error_message),
+                 "Started %d of %d workers", started, server->thread_count);
+        return false;
+    }
+    return true;
+}
+
+void server_wait(CompileServer* server) {
+    (void)server;
+    sigset_t signals, previous;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, &previous);
+    int received;
+    sigwait(&signals, &received);
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+}
+
+void server_stop(CompileServer* server) {
+    if (server->listen_fd < 0) return;
+
+    // shutdown() wakes every accept() and read() blocked on these sockets
+    pthread_mutex_lock(&server->lock);
+    server->stopping = true;
+    shutdown(server->listen_fd, SHUT_RDWR);
+    for (int t = 0; t < server->thread_count; t++) {
+        if (server->workers[t].client_fd >= 0) shutdown(server->workers[t].client_fd, SHUT_RDWR);
+    }
+    pthread_mutex_unlock(&server->lock);
+
+    for (int t = 0; t < server->thread_count; t++) {
+        if (server->workers[t].started) pthread_join(server->workers[t].thread, NULL);
+        server->workers[t].started = false;
+    }
+    close(server->listen_fd);
+    server->listen_fd = -1;
+    unlink(server->socket_path);
+    server->stop_time = timer_now();
+}
+
+void server_free(CompileServer* server) {
+    for (int t = 0; t < server->thread_count; t++) {
+        free(server->workers[t].latencies);
+        server->workers[t].latencies = NULL;
+        cache_close(server->workers[t].cache);
+        server->workers[t].cache = NULL;
+    }
+    pthread_mutex_destroy(&server->lock);
+}
+
+// ================== REPORTING ==================
+
+static int compare_seconds(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+void server_print(CompileServer* server, FILE* stream) {
+    uint64_t requests = 0, failures = 0, bytes_in = 0, bytes_out = 0, hits = 0, misses = 0;
+    int samples = 0;
+    for (int t = 0; t < server->thread_count; t++) {
+        const ServerWorker* worker = &server->workers[t];
+        requests += worker->requests;
+        failures += worker->failures;
+        bytes_in += worker->bytes_in;
+        bytes_out += worker->bytes_out;
+        if (worker->latencies) {
+            samples += worker->latency_count < SERVER_LATENCY_WINDOW ? worker->latency_count : SERVER_LATENCY_WINDOW;
+        }
+        if (worker->cache) {
+            hits += worker->cache->session.hits;
+            misses += worker->cache->session.misses;
+        }
+    }
+
+    double elapsed = server->stop_time - server->start_time;
+    fprintf(stream, ">> COMPILE SERVER (%s, %d thread%s):\n", server->socket_path,
+            server->thread_count, server->thread_count == 1 ? "" : "s");
+    fprintf(stream, "   Requests: %llu, failed: %llu, %.1f per second over %.1f s\n",
+            (unsigned long long)requests, (unsigned long long)failures,
+            elapsed > 0 ? requests / elapsed : 0, elapsed);
+    fprintf(stream, "   Received: %.1f MB, sent: %.1f MB\n", bytes_in / 1048576.0, bytes_out / 1048576.0);
+    if (server->cache_dir) {
+        fprintf(stream, "   Cache: %llu hits, %llu misses\n", (unsigned long long)hits, (unsigned long long)misses);
+    }
+
+    double* sorted = samples ? malloc(sizeof(double) * (size_t)samples) : NULL;
+    if (!sorted) return;
+    int n = 0;
+    for (int t = 0; t < server->thread_count; t++) {
+        const ServerWorker* worker = &server->workers[t];
+        int kept = worker->latency_count < SERVER_LATENCY_WINDOW ? worker->latency_count : SERVER_LATENCY_WINDOW;
+        if (worker->latencies) {
+            memcpy(sorted + n, worker->latencies, sizeof(double) * (size_t)kept);
+            n += kept;
+        }
+    }
+    qsort(sorted, (size_t)n, sizeof(double), compare_seconds);
+    fprintf(stream, "   Service time: p50 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+            sorted[(50 * n + 99) / 100 - 1] * 1e3, sorted[(99 * n + 99) / 100 - 1] * 1e3, sorted[n - 1] * 1e3);
+    free(sorted);
+}
+
+// ================== CLIENT ==================
+
+bool server_client_connect(ServerClient* client, const char* path) {
+    memset(client, 0, sizeof(*client));
+    struct sockaddr_un address;
+    if (!socket_address(&address, path)) {
+        snprintf(client->error_message, sizeof(client->error_message), "Socket path too long: %s", path);
+        client->fd = -1;
+        return false;
+    }
+    client->fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (client->fd < 0 || connect(client->fd, (const struct sockaddr*)&address, sizeof(address)) != 0) {
+        snprintf(client->error_message, sizeof(client->error_message), "No compile server on %s", path);
+        server_client_close(client);
+        return false;
+    }
+    socket_timeout(client->fd, SERVER_CLIENT_TIMEOUT);
+    return true;
+}
+
+void server_client_close(ServerClient* client) {
+    if (client->fd >= 0) close(client->fd);
+    client->fd = -1;
+}
+
+static bool client_error(ServerClient* client, const char* message) {
+    snprintf(client->error_message, sizeof(client->error_message), "%s", message);
+    return false;
+}
+
+bool server_client_compile(ServerClient* client, const char* src, size_t len,
+                           const ShayOptions* options, OutputBuffer* out, bool* compiled) {
+    *compiled = false;
+    client->diagnostic_count = 0;
+    const char* name = options->filename ? options->filename : "";
+    size_t name_length = strlen(name);
+    if (name_length > SERVER_MAX_NAME) name_length = SERVER_MAX_NAME;
+    if (len > SERVER_MAX_SOURCE) return client_error(client, "Source too large for the server");
+
+    uint32_t request[SERVER_REQUEST_FIELDS] = {
+        SERVER_MAGIC, (uint32_t)options->format, (uint32_t)options->flatten_threshold,
+        (uint32_t)name_length, (uint32_t)len
+    };
+    uint32_t response[SERVER_RESPONSE_FIELDS];
+    if (!write_full(client->fd, request, sizeof(request)) ||
+        !write_full(client->fd, name, name_length) ||
+        !write_full(client->fd, src, len) ||
+        !read_full(client->fd, response, sizeof(response))) {
+        return client_error(client, "Connection to the compile server lost");
+    }
+    if (response[0] != SERVER_MAGIC || response[1] == SERVER_STATUS_BAD_REQUEST) {
+        return client_error(client, "The compile server rejected the request");
+    }
+
+    for (uint32_t i = 0; i < response[2]; i++) {
+        uint32_t fields[4];
+        char message[sizeof(client->diagnostics[0].message)];
+        if (!read_full(client->fd, fields, sizeof(fields)) || fields[3] >= sizeof(message) ||
+            !read_full(client->fd, message, fields[3])) {
+            return client_error(client, "Malformed diagnostics from the compile server");
+        }
+        message[fields[3]] = '\0';
+        if (client->diagnostic_count < SHAYNEFRO_MAX_DIAGNOSTICS) {
+            ShayDiagnostic* diagnostic = &client->diagnostics[client->diagnostic_count++];
+            diagnostic->severity = SHAY_SEVERITY_ERROR;
+            diagnostic->phase = (ShayPhase)fields[0];
+            diagnostic->line = (int)fields[1];
+            diagnostic->column = (int)fields[2];
+            memcpy(diagnostic->message, message, fields[3] + 1);
+        }
+    }
+
+    uint32_t output_length = response[3];
+    if (output_length > 0) {
+        if (!outbuf_reserve(out, output_length)) return client_error(client, "Out of memory");
+        if (!read_full(client->fd, out->data + out->length, output_length)) {
+            return client_error(client, "Connection to the compile server lost");
+        }
+        out->length += output_length;
+    }
+    *compiled = response[1] == SERVER_STATUS_OK;
+    return true;
+}
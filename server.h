@@ -0,0 +1,119 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "shaynefro.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+
+// ================== COMPILE SERVER ==================
+//
+// `shaynefro --server` listens on a Unix socket and compiles what clients
+// send, so a small compile costs a round trip instead of a process start.
+// Each worker thread owns a ShayContext (arenas, interner and keyword
+// tables stay allocated between requests) and, with --cache, its own
+// handle on the shared cache directory. Workers accept connections
+// themselves; a connection may carry any number of requests, and one that
+// sends nothing for SERVER_IDLE_TIMEOUT seconds is closed so an idle
+// client cannot keep a worker from the others.
+//
+// Both ends run on one machine, so every field is a uint32_t in host
+// byte order:
+//
+//   request:  magic format flatten name_length source_length
+//             name source
+//   response: magic status diagnostic_count output_length
+//             { phase line column message_length message } per diagnostic
+//             output
+//
+// The output is only sent with SERVER_STATUS_OK.
+
+#define SERVER_MAGIC 0x31594853u            // "SHY1"
+#define SERVER_MAX_THREADS 64
+#define SERVER_MAX_NAME 255
+#define SERVER_MAX_SOURCE (256u << 20)
+#define SERVER_IDLE_TIMEOUT 5              // Seconds a worker waits on a silent connection
+#define SERVER_CLIENT_TIMEOUT 120           // Seconds the client waits on a stuck server
+#define SERVER_LATENCY_WINDOW 65536         // Requests kept per worker for percentiles
+#define SERVER_REQUEST_FIELDS 5
+#define SERVER_RESPONSE_FIELDS 4
+
+typedef enum {
+    SERVER_STATUS_OK,
+    SERVER_STATUS_ERRORS,       // The source did not compile; see the diagnostics
+    SERVER_STATUS_BAD_REQUEST   // Wrong magic or a length over the limits
+} ServerStatus;
+
+struct CompileServer;
+
+typedef struct {
+    struct CompileServer* server;
+    int index;
+    pthread_t thread;
+    bool started;
+    int client_fd;              // Connection being served, -1 between them
+    CompileCache* cache;
+
+    // Under the server lock
+    uint64_t requests;
+    uint64_t failures;
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+    double* latencies;          // Seconds from request to response, a ring
+    int latency_count;          // Entries written, may exceed the window
+} ServerWorker;
+
+typedef struct CompileServer {
+    char socket_path[108];
+    int listen_fd;
+    int thread_count;
+    ServerWorker workers[SERVER_MAX_THREADS];
+    const char* cache_dir;      // NULL without --cache
+    bool stopping;
+    pthread_mutex_t lock;
+    double start_time;
+    double stop_time;
+    char error_message[256];
+} CompileServer;
+
+// $SHAYNEFRO_SOCKET, else $XDG_RUNTIME_DIR/shaynefro.sock, else
+// /tmp/shaynefro-<uid>.sock
+void server_default_path(char* buffer, size_t size);
+
+// Binds path (replacing a stale socket) and starts the workers; false with
+// error_message set. cache_dir "" uses the default cache directory.
+bool server_start(CompileServer* server, const char* path, int threads, const char* cache_dir);
+
+// Blocks until SIGINT or SIGTERM
+void server_wait(CompileServer* server);
+
+// Closes the socket and open connections, joins the workers and removes
+// the socket file
+void server_stop(CompileServer* server);
+
+// Requests, throughput and p50/p99 latency since server_start; call
+// between server_stop and server_free
+void server_print(CompileServer* server, FILE* stream);
+
+// Closes the workers' caches and frees their latency records
+void server_free(CompileServer* server);
+
+// ================== CLIENT ==================
+
+typedef struct {
+    int fd;
+    ShayDiagnostic diagnostics[SHAYNEFRO_MAX_DIAGNOSTICS];
+    int diagnostic_count;
+    char error_message[256];
+} ServerClient;
+
+bool server_client_connect(ServerClient* client, const char* path);
+void server_client_close(ServerClient* client);
+
+// One request on the connection; the output is appended to out. Returns
+// false with error_message set if the server could not be reached or
+// answered badly; *compiled is false when the source had errors.
+bool server_client_compile(ServerClient* client, const char* src, size_t len,
+                           const ShayOptions* options, OutputBuffer* out, bool* compiled);
+
+#endif
@@ -0,0 +1,139 @@
+#include "shaynefro.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// ================== CONTEXT LIFECYCLE ==================
+
+ShayContext* shaynefro_context_create(void) {
+    ShayContext* ctx = malloc(sizeof(ShayContext));
+    if (!ctx) return NULL;
+
+    // Objects are created empty and re-pointed at each compile's source
+    ctx->lexer = lexer_create_with_length("", 0, "<memory>");
+    ctx->parser = ctx->lexer ? parser_create(ctx->lexer) : NULL;
+    ctx->codegen = codegen_create_in_memory(NULL, OUTPUT_C);
+    if (!ctx->lexer || !ctx->parser || !ctx->codegen) {
+        shaynefro_context_destroy(ctx);
+        return NULL;
+    }
+
+    ctx->diagnostic_count = 0;
+    memset(&ctx->stats, 0, sizeof(ctx->stats));
+    ctx->compiles = 0;
+    ctx->cache = NULL;
+    return ctx;
+}
+
+void shaynefro_context_destroy(ShayContext* ctx) {
+    if (ctx) {
+        codegen_destroy(ctx->codegen);
+        parser_destroy(ctx->parser);
+        lexer_destroy(ctx->lexer);
+        free(ctx);
+    }
+}
+
+void shaynefro_context_set_cache(ShayContext* ctx, CompileCache* cache) {
+    ctx->cache = cache;
+}
+
+ShayOptions shaynefro_default_options(void) {
+    ShayOptions options;
+    options.format = OUTPUT_C;
+    options.filename = "<memory>";
+    options.flatten_threshold = 0;
+    options.threads = 1;
+    return options;
+}
+
+// ================== DIAGNOSTICS ==================
+
+static void add_diagnostic(ShayContext* ctx, ShayPhase phase, Position pos, const char* message) {
+    if (ctx->diagnostic_count >= SHAYNEFRO_MAX_DIAGNOSTICS) return;
+
+    ShayDiagnostic* diag = &ctx->diagnostics[ctx->diagnostic_count++];
+    diag->severity = SHAY_SEVERITY_ERROR;
+    diag->phase = phase;
+    diag->line = pos.line;
+    diag->column = pos.column;
+    snprintf(diag->message, sizeof(diag->message), "%s", message);
+}
+
+int shaynefro_diagnostic_count(const ShayContext* ctx) {
+    return ctx->diagnostic_count;
+}
+
+const ShayDiagnostic* shaynefro_get_diagnostic(const ShayContext* ctx, int index) {
+    if (index < 0 || index >= ctx->diagnostic_count) return NULL;
+    return &ctx->diagnostics[index];
+}
+
+const char* shaynefro_phase_name(ShayPhase phase) {
+    switch (phase) {
+        case SHAY_PHASE_LEXER: return "lexer";
+        case SHAY_PHASE_PARSER: return "parser";
+        case SHAY_PHASE_CODEGEN: return "codegen";
+        default: return "unknown";
+    }
+}
+
+// ================== COMPILATION ==================
+
+bool shaynefro_compile(ShayContext* ctx, const char* src, size_t len,
+                       const ShayOptions* options, OutputBuffer* output) {
+    ShayOptions defaults = shaynefro_default_options();
+    if (!options) options = &defaults;
+
+    ctx->diagnostic_count = 0;
+    memset(&ctx->stats, 0, sizeof(ctx->stats));
+    ctx->compiles++;
+
+    lexer_reset(ctx->lexer, src, len, options->filename);
+
+    // The filename only appears in diagnostics, so it is not part of the key
+    uint64_t key = 0;
+    size_t start_size = outbuf_total_size(output);
+    if (ctx->cache) {
+        char description[64];
+        snprintf(description, sizeof(description), "format=%d flatten=%d",
+                 (int)options->format, options->flatten_threshold);
+        key = cache_key(ctx->lexer->checksum, description);
+        if (cache_lookup(ctx->cache, key, output)) {
+            ctx->stats.cache_hit = true;
+            ctx->stats.output_bytes = outbuf_total_size(output) - start_size;
+            return true;
+        }
+    }
+
+    parser_reset(ctx->parser, ctx->lexer);
+
+    ASTNode* ast = parser_parse(ctx->parser);
+    ctx->stats.tokens = ctx->lexer->tokens_processed;
+    ctx->stats.ast_nodes = parser_get_nodes_created(ctx->parser);
+
+    if (!ast || parser_has_error(ctx->parser)) {
+        ShayPhase phase = lexer_has_error(ctx->lexer) ? SHAY_PHASE_LEXER : SHAY_PHASE_PARSER;
+        add_diagnostic(ctx, phase, ctx->parser->error_pos,
+                       ast ? ctx->parser->error_detail : "Out of memory while parsing");
+        return false;
+    }
+
+    codegen_reset(ctx->codegen, output, options->format);
+    codegen_set_flatten_threshold(ctx->codegen, options->flatten_threshold);
+    codegen_set_threads(ctx->codegen, options->threads);
+    if (!codegen_generate(ctx->codegen, ast)) {
+        Position unknown = {0, 0, options->filename};
+        add_diagnostic(ctx, SHAY_PHASE_CODEGEN, unknown, codegen_get_error(ctx->codegen));
+        return false;
+    }
+
+    ctx->stats.output_lines = codegen_get_lines_generated(ctx->codegen);
+    ctx->stats.output_bytes = outbuf_total_size(output) - start_size;
+
+    // Output that was already flushed to a file is not available to store
+    if (ctx->cache && output->fd < 0) {
+        cache_store(ctx->cache, key, output->data + start_size, ctx->stats.output_bytes);
+    }
+    return true;
+}
@@ -0,0 +1,90 @@
+#ifndef SHAYNEFRO_H
+#define SHAYNEFRO_H
+
+#include "lexer.h"
+#include "parser.h"
+#include "codegen.h"
+#include "outbuf.h"
+#include "cache.h"
+#include <stddef.h>
+#include <stdbool.h>
+
+// ================== COMPILER-AS-A-LIBRARY API ==================
+//
+// Runs lexer, parser and code generator entirely in memory. A ShayContext
+// owns the lexer/parser/codegen objects and their arenas and is reused
+// across compiles; contexts share no state, so one context per thread
+// makes the API safe to call concurrently.
+
+#define SHAYNEFRO_VERSION "1.1.0"
+#define SHAYNEFRO_MAX_DIAGNOSTICS 16
+
+typedef enum {
+    SHAY_PHASE_LEXER,
+    SHAY_PHASE_PARSER,
+    SHAY_PHASE_CODEGEN
+} ShayPhase;
+
+typedef enum {
+    SHAY_SEVERITY_ERROR,
+    SHAY_SEVERITY_WARNING
+} ShaySeverity;
+
+// One structured diagnostic, no text scraping required
+typedef struct {
+    ShaySeverity severity;
+    ShayPhase phase;
+    int line;               // 1-based, 0 when unknown
+    int column;             // 1-based, 0 when unknown
+    char message[256];
+} ShayDiagnostic;
+
+typedef struct {
+    OutputFormat format;    // Target language
+    const char* filename;   // Name used in diagnostics
+    int flatten_threshold;  // Split expressions larger than this many nodes, 0 = off
+    int threads;            // Threads generating function bodies; output is the same for any count
+} ShayOptions;
+
+// Per-compile statistics
+typedef struct {
+    size_t tokens;
+    int ast_nodes;
+    int output_lines;
+    size_t output_bytes;
+    bool cache_hit;         // Output came from the cache; nothing was lexed or parsed
+} ShayStats;
+
+typedef struct {
+    Lexer* lexer;
+    Parser* parser;
+    CodeGenerator* codegen;
+
+    ShayDiagnostic diagnostics[SHAYNEFRO_MAX_DIAGNOSTICS];
+    int diagnostic_count;
+    ShayStats stats;
+    int compiles;           // Compiles run through this context
+    CompileCache* cache;    // Optional, not owned
+} ShayContext;
+
+// Context lifecycle
+ShayContext* shaynefro_context_create(void);
+void shaynefro_context_destroy(ShayContext* ctx);
+
+ShayOptions shaynefro_default_options(void);
+
+// Look up and store in-memory compiles in cache (NULL disables caching)
+void shaynefro_context_set_cache(ShayContext* ctx, CompileCache* cache);
+
+// Compile len bytes of src (NUL termination not required) and append the
+// generated code to output. Returns false if any error diagnostic was
+// produced; the output is then unspecified.
+bool shaynefro_compile(ShayContext* ctx, const char* src, size_t len,
+                       const ShayOptions* options, OutputBuffer* output);
+
+// Diagnostics from the last compile
+int shaynefro_diagnostic_count(const ShayContext* ctx);
+const ShayDiagnostic* shaynefro_get_diagnostic(const ShayContext* ctx, int index);
+const char* shaynefro_phase_name(ShayPhase phase);
+
+#endif
@@ -0,0 +1,179 @@
+#include "stats.h"
+#include <stdlib.h>
+#include <string.h>
+
+// ================== MEMORY ACCOUNTING ==================
+
+void memory_stats_collect(MemoryStats* stats, const Lexer* lexer, const Parser* parser,
+                          const CodeGenerator* codegen) {
+    memset(stats, 0, sizeof(*stats));
+    arena_get_stats(lexer->arena, &stats->lexer_arena);
+    stats->interner_used = lexer->string_pool_used;
+    stats->interner_capacity = lexer->string_pool_size;
+    stats->source_bytes = (size_t)(lexer->end - lexer->source);
+    if (parser) {
+        arena_get_stats(parser->arena, &stats->parser_arena);
+        stats->ast_nodes = parser_get_nodes_created(parser);
+    }
+    if (codegen) {
+        codegen_get_memory(codegen, &stats->codegen);
+    }
+}
+
+double memory_stats_bytes_per_node(const MemoryStats* stats) {
+    return stats->ast_nodes > 0 ? (double)stats->parser_arena.peak_used / stats->ast_nodes : 0.0;
+}
+
+static size_t codegen_total(const CodegenMemory* memory) {
+    return memory->output_buffer + memory->symbol_tables + memory->flatten + memory->scratch_peak;
+}
+
+size_t memory_stats_peak_total(const MemoryStats* stats) {
+    return stats->lexer_arena.peak_reserved + stats->parser_arena.peak_reserved + codegen_total(&stats->codegen);
+}
+
+size_t memory_peak_rss(void) {
+    FILE* status = fopen("/proc/self/status", "r");
+    if (!status) return 0;
+    char line[256];
+    size_t kilobytes = 0;
+    while (fgets(line, sizeof(line), status)) {
+        if (strncmp(line, "VmHWM:", 6) == 0) {
+            kilobytes = (size_t)strtoull(line + 6, NULL, 10);
+            break;
+        }
+    }
+    fclose(status);
+    return kilobytes * 1024;
+}
+
+static void print_arena(const char* name, const ArenaStats* arena) {
+    printf("   %s: %zu / %zu bytes in %zu block%s, %zu allocations (peak %zu / %zu, waste %zu)\n",
+           name, arena->used, arena->reserved, arena->blocks, arena->blocks == 1 ? "" : "s",
+           arena->allocations, arena->peak_used, arena->peak_reserved, arena->waste);
+}
+
+void memory_stats_print(const MemoryStats* stats) {
+    print_arena("Lexer arena", &stats->lexer_arena);
+    printf("   Interner: %zu / %zu bytes\n", stats->interner_used, stats->interner_capacity);
+    print_arena("Parser arena", &stats->parser_arena);
+    printf("   AST: %d nodes, %.1f arena bytes per node (node struct %zu)\n",
+           stats->ast_nodes, memory_stats_bytes_per_node(stats), sizeof(ASTNode));
+    printf("   Codegen: output buffer %zu, symbol tables %zu, flattening %zu, workers/units peak %zu bytes\n",
+           stats->codegen.output_buffer, stats->codegen.symbol_tables,
+           stats->codegen.flatten, stats->codegen.scratch_peak);
+    size_t total = memory_stats_peak_total(stats);
+    printf("   Peak total: %zu bytes", total);
+    if (stats->source_bytes > 0) {
+        printf(" (%.1f per source byte)", (double)total / stats->source_bytes);
+    }
+    printf("\n");
+}
+
+static void write_arena_json(FILE* file, const ArenaStats* arena) {
+    fprintf(file, "\"allocations\": %zu, \"used\": %zu, \"reserved\": %zu, \"waste\": %zu, "
+            "\"blocks\": %zu, \"peak_used\": %zu, \"peak_reserved\": %zu",
+            arena->allocations, arena->used, arena->reserved, arena->waste,
+            arena->blocks, arena->peak_used, arena->peak_reserved);
+}
+
+void memory_stats_write_json(const MemoryStats* stats, FILE* file) {
+    fprintf(file, "{\"lexer\": {");
+    write_arena_json(file, &stats->lexer_arena);
+    fprintf(file, ", \"interner_used\": %zu, \"interner_capacity\": %zu}, \"parser\": {",
+            stats->interner_used, stats->interner_capacity);
+    write_arena_json(file, &stats->parser_arena);
+    fprintf(file, ", \"bytes_per_node\": %.2f}, ", memory_stats_bytes_per_node(stats));
+    fprintf(file, "\"codegen\": {\"output_buffer\": %zu, \"symbol_tables\": %zu, \"flatten\": %zu, "
+            "\"scratch_peak\": %zu}, ",
+            stats->codegen.output_buffer, stats->codegen.symbol_tables,
+            stats->codegen.flatten, stats->codegen.scratch_peak);
+    fprintf(file, "\"peak_total\": %zu}", memory_stats_peak_total(stats));
+}
+
+// ================== COMPILE STATISTICS ==================
+
+void compile_stats_init(CompileStats* stats, const char* filename) {
+    memset(stats, 0, sizeof(*stats));
+    stats->filename = filename;
+    stats->threads = 1;
+}
+
+void compile_stats_from_codegen(CompileStats* stats, const CodeGenerator* codegen) {
+    stats->codegen_time = codegen_get_generation_time(codegen);
+    stats->output_lines = codegen_get_lines_generated(codegen);
+    stats->output_bytes = codegen_get_bytes_generated(codegen);
+    stats->functions = codegen->functions_generated;
+    stats->variables = codegen->variables_declared;
+    stats->binary_expressions = codegen->binary_expressions;
+    stats->parens_elided = codegen_get_parens_elided(codegen);
+    stats->flatten_threshold = codegen->flatten.threshold;
+    stats->expressions_flattened = codegen->flatten.expressions_flattened;
+    stats->temps_generated = codegen->flatten.temps_generated;
+    stats->threads = codegen->threads;
+}
+
+void json_write_string(FILE* file, const char* text) {
+    fputc('"', file);
+    for (const unsigned char* p = (const unsigned char*)text; *p; p++) {
+        if (*p == '"' || *p == '\\') {
+            fprintf(file, "\\%c", *p);
+        } else if (*p < 0x20) {
+            fprintf(file, "\\u%04x", *p);
+        } else {
+            fputc(*p, file);
+        }
+    }
+    fputc('"', file);
+}
+
+// Only counters the kernel provided; an empty object when none were
+static void write_counters_json(FILE* file, const CounterSample* sample) {
+    fprintf(file, "{");
+    bool first = true;
+    for (int kind = 0; kind < COUNTER_KINDS; kind++) {
+        if (!sample->valid[kind]) continue;
+        fprintf(file, "%s\"%s\": %llu", first ? "" : ", ", counter_name((CounterKind)kind),
+                (unsigned long long)sample->values[kind]);
+        first = false;
+    }
+    fprintf(file, "}");
+}
+
+void compile_stats_write_json(const CompileStats* stats, FILE* file) {
+    fprintf(file, "{\"file\": ");
+    json_write_string(file, stats->filename ? stats->filename : "");
+    fprintf(file, ", \"success\": %s", stats->success ? "true" : "false");
+    if (!stats->success) {
+        fprintf(file, ", \"error\": ");
+        json_write_string(file, stats->error_message);
+    }
+    
+    fprintf(file, ",\n \"timings\": {\"parse\": %.6f, \"codegen\": %.6f, \"cc\": %.6f, "
+            "\"cache\": %.6f, \"total\": %.6f}",
+            stats->parse_time, stats->codegen_time, stats->cc_time, stats->cache_time, stats->total_time);
+    fprintf(file, ",\n \"counts\": {\"source_bytes\": %zu, \"tokens\": %zu, \"ast_nodes\": %d, "
+            "\"output_lines\": %d, \"output_bytes\": %zu, \"functions\": %d, \"variables\": %d}",
+            stats->memory.source_bytes, stats->tokens, stats->ast_nodes, stats->output_lines,
+            stats->output_bytes, stats->functions, stats->variables);
+    fprintf(file, ",\n \"optimisations\": {\"binary_expressions\": %zu, \"parens_elided\": %zu, "
+            "\"flatten_threshold\": %d, \"expressions_flattened\": %d, \"temporaries\": %d, "
+            "\"threads\": %d, \"cache\": %s, \"incremental\": ",
+            stats->binary_expressions, stats->parens_elided, stats->flatten_threshold,
+            stats->expressions_flattened, stats->temps_generated, stats->threads,
+            !stats->cache_used ? "null" : stats->cache_hit ? "\"hit\"" : "\"miss\"");
+    if (stats->incremental) {
+        fprintf(file, "{\"units\": %d, \"reused\": %d, \"regenerated\": %d}}",
+                stats->units, stats->units_reused, stats->units_regenerated);
+    } else {
+        fprintf(file, "null}");
+    }
+    
+    fprintf(file, ",\n \"counters\": {\"parse\": ");
+    write_counters_json(file, &stats->parse_counters);
+    fprintf(file, ", \"codegen\": ");
+    write_counters_json(file, &stats->codegen_counters);
+    fprintf(file, "},\n \"memory\": ");
+    memory_stats_write_json(&stats->memory, file);
+    fprintf(file, "}\n");
+}
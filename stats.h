@@ -0,0 +1,106 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include "lexer.h"
+#include "parser.h"
+#include "codegen.h"
+#include "counters.h"
+#include <stdio.h>
+#include <stddef.h>
+
+// ================== MEMORY ACCOUNTING ==================
+//
+// Heap held by one compile, grouped by the phase that allocated it: the
+// lexer arena (which also holds the interner's pool), the parser's AST
+// arena and code generation's buffers and tables. Arena peaks cover the
+// arena's whole life, so a reused context reports its largest compile.
+
+// Bytes of parser arena per AST node above which --check-memory fails
+#define MEMORY_DEFAULT_NODE_BUDGET 96
+
+typedef struct {
+    ArenaStats lexer_arena;
+    size_t interner_used;
+    size_t interner_capacity;
+    ArenaStats parser_arena;    // AST nodes, names, literals and child lists
+    CodegenMemory codegen;
+    size_t source_bytes;
+    int ast_nodes;
+} MemoryStats;
+
+// Call after generation, while the output buffer is still allocated;
+// codegen may be NULL when only lexing and parsing ran
+void memory_stats_collect(MemoryStats* stats, const Lexer* lexer, const Parser* parser,
+                          const CodeGenerator* codegen);
+
+// Parser arena bytes handed out per AST node, 0 without nodes
+double memory_stats_bytes_per_node(const MemoryStats* stats);
+
+// Sum of each phase's largest footprint
+size_t memory_stats_peak_total(const MemoryStats* stats);
+
+void memory_stats_print(const MemoryStats* stats);
+
+// Most memory this process has had resident (VmHWM), in bytes; 0 where
+// /proc does not say
+size_t memory_peak_rss(void);
+
+// text as a quoted JSON string; every JSON report escapes through this
+void json_write_string(FILE* file, const char* text);
+
+// One JSON object, no trailing newline, for embedding in larger reports
+void memory_stats_write_json(const MemoryStats* stats, FILE* file);
+
+// ================== COMPILE STATISTICS ==================
+//
+// Everything one compile reports, for --stats=json. Timings are wall
+// clock seconds; a phase that did not run stays 0.
+
+typedef struct {
+    const char* filename;
+    bool success;
+    char error_message[256];
+    
+    // Timings
+    double parse_time;      // Including the lexing it drives
+    double codegen_time;
+    double cc_time;         // C compiler after the end of its input, with -o
+    double cache_time;      // Cache lookup and store
+    double total_time;
+    
+    // Counts
+    size_t tokens;
+    int ast_nodes;
+    int output_lines;
+    size_t output_bytes;
+    int functions;
+    int variables;
+    
+    // Optimisation counters
+    size_t binary_expressions;
+    size_t parens_elided;
+    int flatten_threshold;
+    int expressions_flattened;
+    int temps_generated;
+    int threads;
+    bool cache_used;
+    bool cache_hit;
+    bool incremental;
+    int units;              // Incremental build units, reused and regenerated
+    int units_reused;
+    int units_regenerated;
+    
+    CounterSample parse_counters;
+    CounterSample codegen_counters;
+    MemoryStats memory;
+} CompileStats;
+
+void compile_stats_init(CompileStats* stats, const char* filename);
+
+// Counts and optimisation counters from a finished generation
+void compile_stats_from_codegen(CompileStats* stats, const CodeGenerator* codegen);
+
+// The whole report as one JSON object followed by a newline
+void compile_stats_write_json(const CompileStats* stats, FILE* file);
+
+#endif
@@ -0,0 +1,143 @@
+#define _DEFAULT_SOURCE     // madvise()
+#include "streaming.h"
+#include "stats.h"
+#include "timer.h"
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+typedef struct {
+    Parser* parser;
+    CodeGenerator* codegen;
+    CodegenStream* stream;
+    const char* source;
+    size_t released;            // Source bytes dropped from memory, a page multiple
+    size_t page_size;
+    size_t arena_base;          // AST arena bytes held outside any declaration
+    StreamingResult* result;
+} StreamingState;
+
+// Runs between parsing a declaration and releasing its nodes
+static void generate_declaration(void* context, const ASTNode* declaration) {
+    StreamingState* state = context;
+    size_t held = arena_get_usage(state->parser->arena) - state->arena_base;
+    if (held > state->result->largest_declaration) state->result->largest_declaration = held;
+    state->result->declarations++;
+    codegen_stream_declaration(state->codegen, state->stream, declaration);
+
+    // Everything before the parser's lookahead is done with; the pages stay
+    // mapped and would be read back from the file if touched again
+    size_t done = (size_t)(state->parser->current.start - state->source);
+    done -= done % state->page_size;
+    if (done > state->released) {
+        madvise((char*)state->source + state->released, done - state->released, MADV_DONTNEED);
+        state->released = done;
+    }
+}
+
+static bool map_source(const char* path, StreamingResult* result, char** source) {
+    int fd = open(path, O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0) {
+        snprintf(result->error_message, sizeof(result->error_message),
+                 "Cannot open %.200s: %s", path, strerror(errno));
+        if (fd >= 0) close(fd);
+        return false;
+    }
+    result->source_bytes = (size_t)info.st_size;
+    *source = NULL;
+    if (result->source_bytes > 0) {
+        void* mapped = mmap(NULL, result->source_bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped == MAP_FAILED) {
+            snprintf(result->error_message, sizeof(result->error_message),
+                     "Cannot map %.200s: %s", path, strerror(errno));
+            close(fd);
+            return false;
+        }
+        *source = mapped;
+        madvise(mapped, result->source_bytes, MADV_SEQUENTIAL);
+    }
+    close(fd);
+    return true;
+}
+
+bool streaming_compile(const char* path, const char* output_path, CodeGenerator* codegen,
+                       StreamingResult* result) {
+    memset(result, 0, sizeof(*result));
+    double start = timer_now();
+    char* source;
+    if (!map_source(path, result, &source)) return false;
+
+    // The checksum would read the whole file in before the first token
+    const char* text = source ? source : "";
+    Lexer* lexer = lexer_create_with_length(text, 0, path);
+    if (lexer) lexer_set_source(lexer, text, result->source_bytes, path);
+    Parser* parser = lexer ? parser_create(lexer) : NULL;
+    CodegenStream stream;
+    memset(&stream, 0, sizeof(stream));
+    bool compiled = parser && codegen_stream_begin(codegen, &stream) && codegen_stream_spill(codegen, &stream);
+    if (!compiled) {
+        snprintf(result->error_message, sizeof(result->error_message), "%s",
+                 codegen_has_error(codegen) ? codegen_get_error(codegen) : "Out of memory");
+    }
+
+    if (compiled) {
+        StreamingState state = { parser, codegen, &stream, text, 0, (size_t)sysconf(_SC_PAGESIZE),
+                                 arena_get_usage(parser->arena), result };
+        compiled = parser_parse_each(parser, generate_declaration, &state);
+        if (!compiled) {
+            snprintf(result->error_message, sizeof(result->error_message), "Parsing failed: %s",
+                     parser_get_error(parser));
+        }
+    }
+    if (compiled && !codegen_open_output(codegen, output_path)) {
+        snprintf(result->error_message, sizeof(result->error_message), "Cannot open %.200s for writing",
+                 output_path);
+        compiled = false;
+    }
+    if (compiled && !codegen_stream_finish(codegen, &stream, NULL)) {
+        snprintf(result->error_message, sizeof(result->error_message), "Code generation failed: %s",
+                 codegen_get_error(codegen));
+        compiled = false;
+    }
+
+    if (parser) {
+        ArenaStats arena;
+        arena_get_stats(parser->arena, &arena);
+        result->arena_peak = arena.peak_reserved;
+        result->parse_time = parser_get_parse_time(parser);
+        result->ast_nodes = parser_get_nodes_created(parser);
+        result->tokens = lexer->tokens_processed;
+    }
+    result->output_lines = codegen_get_lines_generated(codegen);
+    result->output_bytes = codegen_get_bytes_generated(codegen);
+    codegen_stream_free(&stream);
+    parser_destroy(parser);
+    lexer_destroy(lexer);
+    if (source) munmap(source, result->source_bytes);
+    result->total_time = timer_now() - start;
+    result->peak_rss = memory_peak_rss();
+    return compiled;
+}
+
+void streaming_print(const StreamingResult* result, FILE* stream) {
+    fprintf(stream, ">> STREAMING:\n");
+    fprintf(stream, "   Source: %zu bytes, %zu tokens, %d AST nodes\n",
+                    result->source_bytes, result->tokens, result->ast_nodes);
+    fprintf(stream, "   Declarations: %llu, largest held %zu bytes of AST (arena peak %zu)\n",
+                    (unsigned long long)result->declarations, result->largest_declaration, result->arena_peak);
+    fprintf(stream, "   Parse + codegen: %.4f seconds", result->parse_time);
+    if (result->parse_time > 0) {
+        fprintf(stream, " (%.1f MB/s)", result->source_bytes / result->parse_time / 1e6);
+    }
+    fprintf(stream, "\n   Total: %.4f seconds\n", result->total_time);
+    fprintf(stream, "   Output: %zu bytes, %d lines\n", result->output_bytes, result->output_lines);
+    fprintf(stream, "   Peak RSS: %.1f MB", result->peak_rss / 1e6);
+    if (result->source_bytes > 0) {
+        fprintf(stream, " (%.2f per source byte)", (double)result->peak_rss / result->source_bytes);
+    }
+    fprintf(stream, "\n");
+}
@@ -0,0 +1,43 @@
+#ifndef STREAMING_H
+#define STREAMING_H
+
+#include "codegen.h"
+#include <stdio.h>
+#include <stdint.h>
+
+// ================== STREAMING COMPILE ==================
+//
+// `--stream` compiles a file too big to hold as a syntax tree. The source
+// is mapped rather than read, each top-level declaration is generated as
+// soon as it is parsed and its nodes are then released (parser_parse_each
+// rewinds the AST arena), and the generated parts wait in temporary files
+// until they are joined into the output. Source pages the parser has
+// finished with are dropped too, so resident memory follows the largest
+// declaration, not the file. The output is what a normal compile writes.
+// Flattening needs every function's signature up front and is not
+// available.
+
+typedef struct {
+    size_t source_bytes;
+    uint64_t declarations;
+    size_t largest_declaration; // Most AST arena bytes one declaration held
+    size_t arena_peak;          // Most bytes the AST arena held in blocks
+    size_t tokens;
+    int ast_nodes;
+    int output_lines;
+    size_t output_bytes;
+    double parse_time;          // Including generating each declaration
+    double total_time;
+    size_t peak_rss;            // Of the whole process, from memory_peak_rss
+    char error_message[256];
+} StreamingResult;
+
+// Compiles path into output_path with codegen, which must have been
+// created in memory (NULL target) and configured. output_path is only
+// opened once the whole file has parsed. False with error_message set.
+bool streaming_compile(const char* path, const char* output_path, CodeGenerator* codegen,
+                       StreamingResult* result);
+
+void streaming_print(const StreamingResult* result, FILE* stream);
+
+#endif
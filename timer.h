@@ -0,0 +1,11 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+// ================== MONOTONIC TIMER ==================
+
+// Seconds on a monotonic clock; only differences are meaningful.
+// Unlike clock() this is wall time, so it includes time spent waiting
+// on child processes and I/O.
+double timer_now(void);
+
+#endif
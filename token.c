@@ -1,7 +1,11 @@
 #include "token.h"
+#include "lexer.h"
 #include <stdio.h>
 
 const char* token_type_to_string(TokenType type) {
+    // Emoji tokens live in their own enum
+    if ((int)type == TOKEN_ANALYTICS) return "ANALYTICS";
+    
     switch (type) {
         // Literals
         case TOKEN_INTEGER: return "INTEGER";
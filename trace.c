@@ -0,0 +1,162 @@
+#define _POSIX_C_SOURCE 200809L
+#include "trace.h"
+#include "stats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#define TRACE_DETAIL_SIZE 40
+#define TRACE_INITIAL_EVENTS 1024
+
+typedef struct {
+    double start;
+    double end;
+    const char* name;
+    char detail[TRACE_DETAIL_SIZE];
+} TraceEvent;
+
+typedef struct TraceThread {
+    int tid;                // 1 for the thread that called trace_start
+    char name[32];
+    TraceEvent* events;
+    size_t count;
+    size_t capacity;
+    bool out_of_memory;     // Later events were dropped
+    struct TraceThread* next;
+} TraceThread;
+
+bool trace_active = false;
+
+static struct {
+    double origin;          // Timestamps are microseconds since trace_start
+    pthread_key_t key;
+    bool key_created;
+    pthread_mutex_t lock;   // Guards adding to threads
+    TraceThread* threads;
+    int next_tid;
+} tracer = { 0, 0, false, PTHREAD_MUTEX_INITIALIZER, NULL, 1 };
+
+// ================== PER-THREAD BUFFERS ==================
+
+static TraceThread* current_thread(void) {
+    TraceThread* thread = pthread_getspecific(tracer.key);
+    if (thread) return thread;
+
+    thread = calloc(1, sizeof(TraceThread));
+    if (!thread) return NULL;
+    pthread_mutex_lock(&tracer.lock);
+    thread->tid = tracer.next_tid++;
+    snprintf(thread->name, sizeof(thread->name), "thread %d", thread->tid);
+    thread->next = tracer.threads;
+    tracer.threads = thread;
+    pthread_mutex_unlock(&tracer.lock);
+    pthread_setspecific(tracer.key, thread);
+    return thread;
+}
+
+void trace_thread_name(const char* name) {
+    if (!trace_active) return;
+    TraceThread* thread = current_thread();
+    if (thread) snprintf(thread->name, sizeof(thread->name), "%s", name);
+}
+
+void trace_record(double start, double end, const char* name, const char* detail) {
+    TraceThread* thread = current_thread();
+    if (!thread || thread->out_of_memory) return;
+    if (thread->count == thread->capacity) {
+        size_t capacity = thread->capacity ? thread->capacity * 2 : TRACE_INITIAL_EVENTS;
+        TraceEvent* grown = realloc(thread->events, capacity * sizeof(TraceEvent));
+        if (!grown) {
+            thread->out_of_memory = true;
+            return;
+        }
+        thread->events = grown;
+        thread->capacity = capacity;
+    }
+    TraceEvent* event = &thread->events[thread->count++];
+    event->start = start;
+    event->end = end;
+    event->name = name;
+    if (detail) {
+        snprintf(event->detail, sizeof(event->detail), "%s", detail);
+    } else {
+        event->detail[0] = '\0';
+    }
+}
+
+// ================== START AND OUTPUT ==================
+
+bool trace_start(void) {
+    if (!tracer.key_created) {
+        if (pthread_key_create(&tracer.key, NULL) != 0) return false;
+        tracer.key_created = true;
+    }
+    tracer.origin = timer_now();
+    trace_active = true;
+    trace_thread_name("main");
+    return true;
+}
+
+// Thread records stay allocated because a thread that is still alive
+// keeps pointing at its own; only the events go
+static void clear_events(void) {
+    for (TraceThread* thread = tracer.threads; thread; thread = thread->next) {
+        free(thread->events);
+        thread->events = NULL;
+        thread->count = thread->capacity = 0;
+        thread->out_of_memory = false;
+    }
+}
+
+bool trace_finish(const char* path, char* error, size_t error_size) {
+    trace_active = false;
+    FILE* file = fopen(path, "w");
+    if (!file) {
+        snprintf(error, error_size, "Cannot open %s", path);
+        clear_events();
+        return false;
+    }
+
+    int pid = (int)getpid();
+    bool dropped = false;
+    fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    bool first = true;
+    for (TraceThread* thread = tracer.threads; thread; thread = thread->next) {
+        fprintf(file, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %d, \"tid\": %d, \"args\": {\"name\": ",
+                first ? "" : ",\n", pid, thread->tid);
+        json_write_string(file, thread->name);
+        fprintf(file, "}}");
+        first = false;
+        dropped |= thread->out_of_memory;
+
+        for (size_t i = 0; i < thread->count; i++) {
+            const TraceEvent* event = &thread->events[i];
+            fprintf(file, ",\n{\"name\": ");
+            if (event->detail[0]) {
+                // "function f12" reads better in the timeline than a bare "function"
+                char label[64 + TRACE_DETAIL_SIZE];
+                snprintf(label, sizeof(label), "%s %s", event->name, event->detail);
+                json_write_string(file, label);
+            } else {
+                json_write_string(file, event->name);
+            }
+            fprintf(file, ", \"cat\": \"shaynefro\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, \"pid\": %d, \"tid\": %d}",
+                    (event->start - tracer.origin) * 1e6, (event->end - event->start) * 1e6, pid, thread->tid);
+        }
+    }
+    fprintf(file, "\n]}\n");
+
+    bool ok = !ferror(file);
+    ok = fclose(file) == 0 && ok;
+    if (!ok) {
+        snprintf(error, error_size, "Cannot write %s", path);
+    } else if (dropped) {
+        snprintf(error, error_size, "Out of memory, some events were dropped");
+    } else {
+        error[0] = '\0';
+    }
+    clear_events();
+    return ok;
+}
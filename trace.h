@@ -0,0 +1,58 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "timer.h"
+#include <stddef.h>
+#include <stdbool.h>
+
+// ================== TRACE-EVENT TIMELINE ==================
+//
+// Records timed scopes per thread and writes them as Chrome trace-event
+// JSON ("X" complete events), which chrome://tracing and ui.perfetto.dev
+// open directly. Scopes nest by time, so a function's codegen shows up
+// inside the codegen pass inside the compile.
+//
+// While tracing is off a scope costs one predictable branch at each end;
+// no clock is read. Phases whose duration the compiler reports anyway
+// use trace_phase_begin/trace_phase_end, which always time and also
+// record when tracing is on. Each thread appends to its own buffer, so
+// codegen workers never contend on a lock after their first event.
+
+typedef struct {
+    double start;
+} TraceScope;
+
+// Only written by trace_start/trace_finish, with no other threads running
+extern bool trace_active;
+
+bool trace_start(void);
+
+// Writes every recorded event to path and stops tracing
+bool trace_finish(const char* path, char* error, size_t error_size);
+
+// Names the calling thread in the timeline ("main", "codegen worker 2")
+void trace_thread_name(const char* name);
+
+// name must be a string literal; detail (a function name, a file) is copied
+void trace_record(double start, double end, const char* name, const char* detail);
+
+static inline void trace_begin(TraceScope* scope) {
+    scope->start = trace_active ? timer_now() : 0.0;
+}
+
+static inline void trace_end(const TraceScope* scope, const char* name, const char* detail) {
+    if (trace_active) trace_record(scope->start, timer_now(), name, detail);
+}
+
+static inline void trace_phase_begin(TraceScope* scope) {
+    scope->start = timer_now();
+}
+
+// Seconds since trace_phase_begin
+static inline double trace_phase_end(const TraceScope* scope, const char* name, const char* detail) {
+    double end = timer_now();
+    if (trace_active) trace_record(scope->start, end, name, detail);
+    return end - scope->start;
+}
+
+#endif
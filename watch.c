@@ -0,0 +1,263 @@
+#define _POSIX_C_SOURCE 200809L
+#include "watch.h"
+#include "batch.h"
+#include "timer.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+
+// Saved in place, or written elsewhere and renamed over the file
+#define WATCH_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO)
+
+// ================== SETUP ==================
+
+bool watch_init(Watcher* watcher, int flatten_threshold, int debounce_ms) {
+    memset(watcher, 0, sizeof(*watcher));
+    watcher->flatten_threshold = flatten_threshold;
+    watcher->debounce_ms = debounce_ms;
+    watcher->inotify_fd = inotify_init1(IN_CLOEXEC);
+    if (watcher->inotify_fd < 0) {
+        snprintf(watcher->error_message, sizeof(watcher->error_message),
+                 "Cannot start inotify: %s", strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+void watch_free(Watcher* watcher) {
+    for (int i = 0; i < watcher->file_count; i++) {
+        free(watcher->files[i].path);
+    }
+    free(watcher->files);
+    free(watcher->source);
+    if (watcher->inotify_fd >= 0) close(watcher->inotify_fd);
+    memset(watcher, 0, sizeof(*watcher));
+    watcher->inotify_fd = -1;
+}
+
+bool watch_add(Watcher* watcher, const char* path) {
+    if (watcher->file_count == watcher->file_capacity) {
+        int capacity = watcher->file_capacity ? watcher->file_capacity * 2 : 8;
+        WatchFile* files = realloc(watcher->files, sizeof(WatchFile) * (size_t)capacity);
+        if (!files) {
+            snprintf(watcher->error_message, sizeof(watcher->error_message), "Out of memory");
+            return false;
+        }
+        watcher->files = files;
+        watcher->file_capacity = capacity;
+    }
+
+    WatchFile* file = &watcher->files[watcher->file_count];
+    memset(file, 0, sizeof(*file));
+    file->path = strdup(path);
+    if (!file->path) {
+        snprintf(watcher->error_message, sizeof(watcher->error_message), "Out of memory");
+        return false;
+    }
+    char* slash = strrchr(file->path, '/');
+    file->name = slash ? slash + 1 : file->path;
+    batch_output_path(path, file->output, sizeof(file->output));
+
+    char dir[512];
+    if (slash) {
+        snprintf(dir, sizeof(dir), "%.*s", slash == file->path ? 1 : (int)(slash - file->path), file->path);
+    } else {
+        snprintf(dir, sizeof(dir), ".");
+    }
+    file->watch = inotify_add_watch(watcher->inotify_fd, dir, WATCH_EVENTS);
+    if (file->watch < 0) {
+        snprintf(watcher->error_message, sizeof(watcher->error_message),
+                 "Cannot watch %.200s: %s", dir, strerror(errno));
+        free(file->path);
+        return false;
+    }
+    watcher->file_count++;
+    return true;
+}
+
+// ================== REBUILDING ==================
+
+static bool read_source(Watcher* watcher, const char* path, size_t* length) {
+    FILE* file = fopen(path, "rb");
+    if (!file) return false;
+    *length = 0;
+    bool ok = true;
+    while (ok) {
+        if (watcher->source_capacity - *length < 4096) {
+            size_t capacity = watcher->source_capacity ? watcher->source_capacity * 2 : 65536;
+            char* source = realloc(watcher->source, capacity);
+            if (!source) {
+                ok = false;
+                break;
+            }
+            watcher->source = source;
+            watcher->source_capacity = capacity;
+        }
+        size_t got = fread(watcher->source + *length, 1, watcher->source_capacity - *length, file);
+        *length += got;
+        if (got == 0) {
+            ok = !ferror(file);
+            break;
+        }
+    }
+    fclose(file);
+    return ok;
+}
+
+static bool rebuild(Watcher* watcher, WatchFile* file, FILE* report) {
+    double start = timer_now();
+    size_t length = 0;
+    IncrementalResult result;
+    bool built = read_source(watcher, file->path, &length);
+    if (!built) {
+        snprintf(result.error_message, sizeof(result.error_message), "Cannot read file");
+    } else {
+        built = incremental_compile(watcher->source, length, file->path, file->output,
+                                    watcher->flatten_threshold, &result);
+    }
+    double seconds = timer_now() - start;
+    watcher->last = result;
+
+    watcher->latencies[watcher->rebuilds % WATCH_LATENCY_WINDOW] = seconds;
+    watcher->rebuilds++;
+    watcher->failures += !built;
+    if (built) {
+        fprintf(report, "[REBUILT] %s -> %s in %.2f ms (%d of %d units regenerated)\n",
+                file->path, file->output, seconds * 1e3, result.regenerated, result.units);
+    } else {
+        fprintf(report, "[ERROR] %s: %s\n", file->path, result.error_message);
+    }
+    fflush(report);
+    return built;
+}
+
+bool watch_build_all(Watcher* watcher, FILE* report) {
+    bool built = true;
+    for (int i = 0; i < watcher->file_count; i++) {
+        built &= rebuild(watcher, &watcher->files[i], report);
+    }
+    return built;
+}
+
+// ================== EVENTS ==================
+
+// Marks the files the queued events name; -1 if reading failed, else
+// the number of events that named a watched file. The watcher's own .c
+// and .manifest writes and changes to unrelated files count for nothing.
+static int read_events(Watcher* watcher) {
+    union {
+        struct inotify_event event;     // Aligns the buffer
+        char bytes[4096];
+    } events;
+    char* buffer = events.bytes;
+    ssize_t length = read(watcher->inotify_fd, buffer, sizeof(events.bytes));
+    if (length < 0) return errno == EINTR ? 0 : -1;
+
+    int marked = 0;
+    for (char* cursor = buffer; cursor < buffer + length; ) {
+        const struct inotify_event* event = (const struct inotify_event*)cursor;
+        for (int i = 0; event->len > 0 && i < watcher->file_count; i++) {
+            WatchFile* file = &watcher->files[i];
+            if (file->watch == event->wd && strcmp(file->name, event->name) == 0) {
+                file->dirty = true;
+                marked++;
+            }
+        }
+        cursor += sizeof(struct inotify_event) + event->len;
+    }
+    return marked;
+}
+
+// 0 on timeout, signal or only unrelated events, the number of watched
+// files named once events were read, -1 on error
+static int wait_events(Watcher* watcher, int timeout_ms) {
+    struct pollfd pending = { watcher->inotify_fd, POLLIN, 0 };
+    int ready = poll(&pending, 1, timeout_ms);
+    if (ready < 0) return errno == EINTR ? 0 : -1;
+    if (ready == 0) return 0;
+    return read_events(watcher);
+}
+
+int watch_poll(Watcher* watcher, int timeout_ms, FILE* report) {
+    int waited = wait_events(watcher, timeout_ms);
+    if (waited <= 0) return waited;
+
+    // An editor's save is often several events; wait for a quiet interval.
+    // Only saves of watched files restart it, and a steady stream of them
+    // still rebuilds after WATCH_MAX_SETTLE_MS (or one interval, if longer).
+    double now = timer_now();
+    double quiet_at = now + watcher->debounce_ms / 1e3;
+    double settle_ms = watcher->debounce_ms > WATCH_MAX_SETTLE_MS ? watcher->debounce_ms : WATCH_MAX_SETTLE_MS;
+    double give_up_at = now + settle_ms / 1e3;
+    while (now < quiet_at && now < give_up_at) {
+        double until = quiet_at < give_up_at ? quiet_at : give_up_at;
+        waited = wait_events(watcher, (int)((until - now) * 1e3) + 1);
+        if (waited < 0) return -1;
+        now = timer_now();
+        if (waited > 0) quiet_at = now + watcher->debounce_ms / 1e3;
+    }
+
+    int rebuilt = 0;
+    for (int i = 0; i < watcher->file_count; i++) {
+        WatchFile* file = &watcher->files[i];
+        if (!file->dirty) continue;
+        file->dirty = false;
+        rebuild(watcher, file, report);
+        rebuilt++;
+    }
+    return rebuilt;
+}
+
+static volatile sig_atomic_t stop_requested;
+
+static void request_stop(int signal_number) {
+    (void)signal_number;
+    stop_requested = 1;
+}
+
+bool watch_run(Watcher* watcher, FILE* report) {
+    // No SA_RESTART, so the signal also ends the wait in poll()
+    struct sigaction action, previous_int, previous_term;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = request_stop;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, &previous_int);
+    sigaction(SIGTERM, &action, &previous_term);
+    stop_requested = 0;
+
+    bool ok = true;
+    while (ok && !stop_requested) {
+        if (watch_poll(watcher, -1, report) < 0) {
+            snprintf(watcher->error_message, sizeof(watcher->error_message),
+                     "Reading inotify events failed: %s", strerror(errno));
+            ok = false;
+        }
+    }
+    sigaction(SIGINT, &previous_int, NULL);
+    sigaction(SIGTERM, &previous_term, NULL);
+    return ok;
+}
+
+// ================== REPORTING ==================
+
+static int compare_seconds(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+void watch_print(const Watcher* watcher, FILE* stream) {
+    int n = watcher->rebuilds < WATCH_LATENCY_WINDOW ? watcher->rebuilds : WATCH_LATENCY_WINDOW;
+    fprintf(stream, ">> WATCH: %d rebuild%s, %d failed\n", watcher->rebuilds,
+            watcher->rebuilds == 1 ? "" : "s", watcher->failures);
+    if (n == 0) return;
+
+    double sorted[WATCH_LATENCY_WINDOW];
+    memcpy(sorted, watcher->latencies, sizeof(double) * (size_t)n);
+    qsort(sorted, (size_t)n, sizeof(double), compare_seconds);
+    fprintf(stream, "   Rebuild time: p50 %.2f ms, max %.2f ms\n",
+            sorted[(50 * n + 99) / 100 - 1] * 1e3, sorted[n - 1] * 1e3);
+}
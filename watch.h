@@ -0,0 +1,70 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+#include "incremental.h"
+#include <stdio.h>
+
+// ================== WATCH MODE ==================
+//
+// `shaynefro --watch a.shay b.shay` builds each file to a .c beside it and
+// then waits on inotify. The watches are on the files' directories, so an
+// editor that saves by writing a new file and renaming it over the old
+// one is seen like one that writes in place. Events are collected until
+// no watched file has been saved for the debounce interval, or for at
+// most WATCH_MAX_SETTLE_MS; each changed file is then rebuilt once with
+// incremental_compile, which regenerates only the declarations whose
+// tokens changed.
+
+#define WATCH_DEFAULT_DEBOUNCE_MS 5
+#define WATCH_MAX_DEBOUNCE_MS 10000
+#define WATCH_MAX_SETTLE_MS 1000    // Longest a burst of saves postpones a rebuild
+#define WATCH_LATENCY_WINDOW 4096   // Rebuilds kept for percentiles
+
+typedef struct {
+    char* path;
+    char* name;                 // Last component of path, as inotify reports it
+    char output[512];           // a.shay -> a.c
+    int watch;                  // inotify descriptor of the directory
+    bool dirty;
+} WatchFile;
+
+typedef struct {
+    WatchFile* files;
+    int file_count;
+    int file_capacity;
+    int inotify_fd;
+    int flatten_threshold;
+    int debounce_ms;
+
+    char* source;               // Reused between rebuilds
+    size_t source_capacity;
+
+    int rebuilds;
+    int failures;
+    IncrementalResult last;     // Of the latest rebuild
+    double latencies[WATCH_LATENCY_WINDOW];  // Seconds per rebuild, a ring
+    char error_message[256];
+} Watcher;
+
+bool watch_init(Watcher* watcher, int flatten_threshold, int debounce_ms);
+void watch_free(Watcher* watcher);
+
+// Watches path's directory; false with error_message set
+bool watch_add(Watcher* watcher, const char* path);
+
+// Builds every file once, reporting each; false if any failed
+bool watch_build_all(Watcher* watcher, FILE* report);
+
+// Waits up to timeout_ms (-1 forever) for a change, debounces, and
+// rebuilds what changed. Returns the number of files rebuilt, 0 on
+// timeout, interruption by a signal or events for unwatched files, -1 if
+// inotify failed.
+int watch_poll(Watcher* watcher, int timeout_ms, FILE* report);
+
+// watch_poll until SIGINT or SIGTERM; false if inotify failed
+bool watch_run(Watcher* watcher, FILE* report);
+
+// Rebuild count and p50/max latency
+void watch_print(const Watcher* watcher, FILE* stream);
+
+#endif